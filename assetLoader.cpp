@@ -0,0 +1,316 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: assetLoader.cpp
+//
+// Desc: Background texture loading and mesh simplification with budgeted uploads.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "assetLoader.h"
+#include <algorithm>
+
+d3d::AssetLoader::AssetLoader(int threads)
+	: _threads(std::max(threads, 1)), _busy(0), _quit(false)
+{
+}
+
+d3d::AssetLoader::~AssetLoader()
+{
+	Clear();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+	for (size_t i = 0; i < _workers.size(); ++i)
+		_workers[i].join();
+}
+
+void d3d::AssetLoader::SetTextureCache(const char* directory)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_cacheDirectory = directory ? directory : "";
+}
+
+int d3d::AssetLoader::LoadTexture(RenderDevice* device, const char* fileName, D3DCOLOR placeholder)
+{
+	Texture* tex = 0;
+	DWORD texel = placeholder;
+	if (!device->CreateTexture(1, 1, &tex))
+		return -1;
+	tex->WriteRows(0, 1, &texel);
+	tex->GenerateMips();
+
+	Asset* asset = new Asset;
+	asset->fileName = fileName;
+	asset->placeholderTexture = tex;
+	return Queue(asset);
+}
+
+int d3d::AssetLoader::LoadMeshLod(Mesh* full, const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+	UINT numTriangles)
+{
+	Asset* asset = new Asset;
+	asset->isLod = true;
+	asset->vertices.assign(vertices, vertices + numVertices);
+	asset->indices.assign(indices, indices + numTriangles * 3);
+	MeshLod& lod = asset->lod;
+	lod.NumLevels = 1;
+	lod.Levels[0] = full;
+	lod.PrimCounts[0] = numTriangles;
+	lod.Errors[0] = 0.0f;
+	return Queue(asset);
+}
+
+int d3d::AssetLoader::Queue(Asset* asset)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_workers.empty())
+	{
+		for (int i = 0; i < _threads; ++i)
+			_workers.push_back(std::thread(&AssetLoader::WorkerMain, this));
+	}
+	_assets.push_back(asset);
+	_queue.push_back((int)_assets.size() - 1);
+	_wake.notify_one();
+	return (int)_assets.size() - 1;
+}
+
+d3d::Texture* d3d::AssetLoader::GetTexture(int asset) const
+{
+	if (asset < 0 || asset >= (int)_assets.size())
+		return 0;
+	const Asset& a = *_assets[asset];
+	return GetState(asset) == ASSET_READY ? a.texture : a.placeholderTexture;
+}
+
+const d3d::MeshLod* d3d::AssetLoader::GetMeshLod(int asset) const
+{
+	if (asset < 0 || asset >= (int)_assets.size())
+		return 0;
+	return GetState(asset) == ASSET_READY ? &_assets[asset]->lod : 0;
+}
+
+d3d::AssetState d3d::AssetLoader::GetState(int asset) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _assets[asset]->state;
+}
+
+int d3d::AssetLoader::GetPendingCount() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	int pending = 0;
+	for (size_t i = 0; i < _assets.size(); ++i)
+		if (_assets[i]->state == ASSET_LOADING || _assets[i]->state == ASSET_UPLOADING)
+			++pending;
+	return pending;
+}
+
+void d3d::AssetLoader::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		while (!_quit && _queue.empty())
+			_wake.wait(lock);
+		if (_quit)
+			return;
+
+		Asset* asset = _assets[_queue.front()];
+		_queue.pop_front();
+		++_busy;
+		std::string cacheDirectory = _cacheDirectory;
+
+		lock.unlock();
+		bool ok = Decode(*asset, cacheDirectory);
+		lock.lock();
+
+		asset->state = ok ? ASSET_UPLOADING : ASSET_FAILED;
+		if (--_busy == 0 && _queue.empty())
+			_idle.notify_all();
+	}
+}
+
+bool d3d::AssetLoader::Decode(Asset& asset, const std::string& cacheDirectory)
+{
+	if (asset.isLod)
+	{
+		if (!asset.indices.empty())
+			BuildLodChain(&asset.vertices[0], (UINT)asset.vertices.size(), &asset.indices[0],
+				(UINT)asset.indices.size() / 3, &asset.levels);
+		std::vector<MeshVertex>().swap(asset.vertices);
+		std::vector<WORD>().swap(asset.indices);
+		return true;
+	}
+
+	// without a usable cache fall back to decoding the source
+	if (!cacheDirectory.empty() &&
+		LoadCachedTexture(asset.fileName.c_str(), cacheDirectory.c_str(), &asset.file, &asset.dds))
+		return true;
+	asset.file.Close();
+	return LoadImageFile(asset.fileName.c_str(), &asset.image);
+}
+
+int d3d::AssetLoader::Update(RenderDevice* device, UINT budget)
+{
+	int ready = 0;
+	UINT written = 0;
+	for (size_t i = 0; i < _assets.size(); ++i)
+	{
+		Asset& asset = *_assets[i];
+		if (GetState((int)i) != ASSET_UPLOADING)
+			continue;
+		if (written > 0 && written >= budget)
+			break;
+
+		written += Upload(device, asset, written < budget ? budget - written : 0);
+		if (GetState((int)i) == ASSET_READY)
+			++ready;
+	}
+	return ready;
+}
+
+UINT d3d::AssetLoader::Upload(RenderDevice* device, Asset& asset, UINT budget)
+{
+	AssetState state = ASSET_UPLOADING;
+	UINT written = 0;
+
+	if (asset.isLod)
+		written = UploadLod(device, asset, budget, &state);
+	else if (asset.file.IsOpen())
+		written = UploadLevels(device, asset, budget, &state);
+	else
+	{
+		const Image& image = asset.image;
+		UINT width = (UINT)image.Width, height = (UINT)image.Height;
+		if (!asset.texture && !device->CreateTexture(width, height, &asset.texture))
+			state = ASSET_FAILED;
+
+		if (state == ASSET_UPLOADING)
+		{
+			UINT rowBytes = width * sizeof(DWORD);
+			UINT rows = std::min(std::max(budget / rowBytes, 1u), height - asset.rowsWritten);
+			if (asset.texture->WriteRows(asset.rowsWritten, rows, &image.Pixels[(size_t)asset.rowsWritten * width]))
+			{
+				asset.rowsWritten += rows;
+				written = rows * rowBytes;
+				if (asset.rowsWritten == height)
+				{
+					asset.texture->GenerateMips();
+					state = ASSET_READY;
+				}
+			}
+			else
+				state = ASSET_FAILED;
+		}
+
+		if (state != ASSET_UPLOADING)
+			std::vector<DWORD>().swap(asset.image.Pixels);
+		if (state == ASSET_FAILED && asset.texture)
+		{
+			asset.texture->Release();
+			asset.texture = 0;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	asset.state = state;
+	return written;
+}
+
+// Mapped DDS files go up a whole level at a time.
+UINT d3d::AssetLoader::UploadLevels(RenderDevice* device, Asset& asset, UINT budget, AssetState* state)
+{
+	const DdsTexture& dds = asset.dds;
+	if (!asset.texture && !device->CreateTextureLevels(dds.Format, dds.Width, dds.Height, dds.Levels, &asset.texture))
+		*state = ASSET_FAILED;
+
+	UINT written = 0;
+	while (*state == ASSET_UPLOADING && (written == 0 || written < budget))
+	{
+		UINT width, height;
+		const unsigned char* data = GetDdsLevel(dds, asset.levelsWritten, &width, &height);
+		if (!asset.texture->WriteLevel(asset.levelsWritten, data))
+			*state = ASSET_FAILED;
+		else if (++asset.levelsWritten == dds.Levels)
+			*state = ASSET_READY;
+		written += GetLevelSize(dds.Format, width, height);
+	}
+
+	if (*state != ASSET_UPLOADING)
+		asset.file.Close();
+	if (*state == ASSET_FAILED && asset.texture)
+	{
+		asset.texture->Release();
+		asset.texture = 0;
+	}
+	return written;
+}
+
+// Simplified meshes go up a whole level at a time too.
+UINT d3d::AssetLoader::UploadLod(RenderDevice* device, Asset& asset, UINT budget, AssetState* state)
+{
+	MeshLod& lod = asset.lod;
+	UINT written = 0;
+	while (*state == ASSET_UPLOADING && (written == 0 || written < budget))
+	{
+		if (lod.NumLevels - 1 == (int)asset.levels.size())
+		{
+			*state = ASSET_READY;
+			break;
+		}
+		const LodGeometry& level = asset.levels[lod.NumLevels - 1];
+		UINT primCount = (UINT)level.Indices.size() / 3;
+		Mesh* mesh = 0;
+		if (!device->CreateMesh(&level.Vertices[0], (UINT)level.Vertices.size(), &level.Indices[0], primCount, &mesh))
+		{
+			*state = ASSET_FAILED;
+			break;
+		}
+		lod.Levels[lod.NumLevels] = mesh;
+		lod.PrimCounts[lod.NumLevels] = primCount;
+		lod.Errors[lod.NumLevels] = level.Error;
+		++lod.NumLevels;
+		written += (UINT)(level.Vertices.size() * sizeof(MeshVertex) + level.Indices.size() * sizeof(WORD));
+	}
+
+	if (*state != ASSET_UPLOADING)
+		std::vector<LodGeometry>().swap(asset.levels);
+	if (*state == ASSET_FAILED)
+		ReleaseMeshLod(&lod);
+	return written;
+}
+
+int d3d::AssetLoader::Finish(RenderDevice* device)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (!_queue.empty() || _busy > 0)
+			_idle.wait(lock);
+	}
+	return Update(device, 0xFFFFFFFF);
+}
+
+void d3d::AssetLoader::Clear()
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_queue.clear();
+		while (_busy > 0)
+			_idle.wait(lock);
+	}
+
+	for (size_t i = 0; i < _assets.size(); ++i)
+	{
+		Asset* asset = _assets[i];
+		if (asset->texture)
+			asset->texture->Release();
+		if (asset->placeholderTexture)
+			asset->placeholderTexture->Release();
+		if (asset->isLod)
+			ReleaseMeshLod(&asset->lod);
+		delete asset;
+	}
+	_assets.clear();
+}
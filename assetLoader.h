@@ -0,0 +1,137 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: assetLoader.h
+//
+// Desc: Streams textures and builds levels of detail in the background.  LoadTexture
+//       hands out a handle right away together with a cheap placeholder, a 1x1 texture of
+//       one colour; worker threads read and decode the files, and Update, called once a
+//       frame on the render thread, moves finished work to the device a few rows of texels
+//       at a time, so no frame stalls on a large upload.  Once an asset is ready GetTexture
+//       returns it instead of its placeholder and the scene swaps it in.
+//
+//       LoadMeshLod simplifies a mesh the same way (meshLod.h): a worker builds the levels
+//       and Update creates their meshes a level at a time.  The full mesh stands in for
+//       them until GetMeshLod returns the chain.
+//
+//       With a texture cache directory set, textures come from the compressed cache
+//       (dds.h): the worker maps the cached DDS, converting the source on a miss, and
+//       Update copies its levels as they are, so a warm start decodes no JPEGs.
+//
+//       The loader owns everything it hands out; Clear() releases it all.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __assetLoaderH__
+#define __assetLoaderH__
+
+#include "dds.h"
+#include "meshLod.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace d3d
+{
+	enum AssetState
+	{
+		ASSET_LOADING,      // queued or being decoded on a worker
+		ASSET_UPLOADING,    // decoded, waiting for Update to copy it to the device
+		ASSET_READY,
+		ASSET_FAILED        // the placeholder stays
+	};
+
+	class AssetLoader
+	{
+	public:
+		AssetLoader(int threads = 2);
+		~AssetLoader();
+
+		// Where converted textures are cached; "" (the default) decodes every source each
+		// time.  Applies to textures loaded afterwards.
+		void SetTextureCache(const char* directory);
+
+		// 'fileName' is a BMP, a baseline JPEG or a DDS.  Returns the asset's handle, or -1
+		// when not even the placeholder could be created.
+		int LoadTexture(RenderDevice* device, const char* fileName, D3DCOLOR placeholder);
+
+		// Levels of detail of 'full', which stays its caller's, from a copy of its geometry.
+		// Returns the asset's handle.
+		int LoadMeshLod(Mesh* full, const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+			UINT numTriangles);
+
+		// The asset once it is ready, its placeholder until then.
+		Texture*   GetTexture(int asset) const;
+		// The levels once they are ready, 0 until then or when they failed.
+		const MeshLod* GetMeshLod(int asset) const;
+		AssetState GetState(int asset) const;
+
+		// Assets not yet ready or failed.
+		int GetPendingCount() const;
+
+		// Render thread, once a frame.  Copies decoded assets to 'device', stopping once
+		// about 'budget' bytes of texels and vertices were written; at least one slice is
+		// always written so every call makes progress.  Returns the number of assets that
+		// became ready and should be swapped in.
+		int Update(RenderDevice* device, UINT budget);
+
+		// Blocks until every asset is ready or failed.  Returns like Update.
+		int Finish(RenderDevice* device);
+
+		// Drops the queued work, waits for the assets being decoded and releases every
+		// asset and placeholder.  Handles are invalid afterwards.
+		void Clear();
+
+	private:
+		struct Asset
+		{
+			Asset() : state(ASSET_LOADING), isLod(false), rowsWritten(0), levelsWritten(0), texture(0),
+				placeholderTexture(0) { lod.NumLevels = 0; }
+
+			AssetState  state;          // guarded by _mutex while LOADING
+			bool        isLod;
+			std::string fileName;
+
+			// decoded or mapped by the worker, freed once uploaded
+			Image                   image;
+			UINT                    rowsWritten;
+			MappedFile              file;
+			DdsTexture              dds;        // in 'file' while it is open
+			UINT                    levelsWritten;
+			std::vector<MeshVertex> vertices;   // of the full mesh
+			std::vector<WORD>       indices;
+			std::vector<LodGeometry> levels;
+
+			Texture* texture;
+			Texture* placeholderTexture;
+			MeshLod  lod;               // level 0 and the levels created so far
+		};
+
+		AssetLoader(const AssetLoader&);
+		AssetLoader& operator=(const AssetLoader&);
+
+		int  Queue(Asset* asset);
+		void WorkerMain();
+		static bool Decode(Asset& asset, const std::string& cacheDirectory);
+
+		// Writes at most 'budget' bytes of 'asset'.  Returns the bytes written.
+		UINT Upload(RenderDevice* device, Asset& asset, UINT budget);
+		UINT UploadLevels(RenderDevice* device, Asset& asset, UINT budget, AssetState* state);
+		UINT UploadLod(RenderDevice* device, Asset& asset, UINT budget, AssetState* state);
+
+		std::vector<Asset*>      _assets;
+		std::deque<int>          _queue;
+		std::string              _cacheDirectory;
+		int                      _threads;
+		std::vector<std::thread> _workers;
+		mutable std::mutex       _mutex;
+		std::condition_variable  _wake;
+		std::condition_variable  _idle;
+		int                      _busy;
+		bool                     _quit;
+	};
+}
+
+#endif // __assetLoaderH__
@@ -0,0 +1,308 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: bvh.cpp
+//
+// Desc: Dynamic bounding volume hierarchy and SSE box culling.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "bvh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define BVH_SSE
+#endif
+
+namespace
+{
+	// Leaf boxes are this much of the radius larger on each side than the sphere.
+	const float LeafMargin = 0.25f;
+
+	template <class Box>
+	Box Union(const Box& a, const Box& b)
+	{
+		Box u;
+		u.Min = D3DXVECTOR3(std::min(a.Min.x, b.Min.x), std::min(a.Min.y, b.Min.y), std::min(a.Min.z, b.Min.z));
+		u.Max = D3DXVECTOR3(std::max(a.Max.x, b.Max.x), std::max(a.Max.y, b.Max.y), std::max(a.Max.z, b.Max.z));
+		return u;
+	}
+
+	// half the surface area, the cost of a box in the insertion heuristic
+	template <class Box>
+	float Area(const Box& b)
+	{
+		D3DXVECTOR3 e = b.Max - b.Min;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	template <class Box>
+	bool Contains(const Box& outer, const D3DXVECTOR3& center, float radius)
+	{
+		return outer.Min.x <= center.x - radius && outer.Min.y <= center.y - radius &&
+			outer.Min.z <= center.z - radius && outer.Max.x >= center.x + radius &&
+			outer.Max.y >= center.y + radius && outer.Max.z >= center.z + radius;
+	}
+}
+
+d3d::Bvh::Bvh() : _root(-1), _free(-1)
+{
+}
+
+void d3d::Bvh::Clear()
+{
+	_nodes.clear();
+	_objects.clear();
+	_root = -1;
+	_free = -1;
+}
+
+int d3d::Bvh::Insert(const D3DXVECTOR3& center, float radius)
+{
+	int leaf = AllocateNode();
+	Node& n = _nodes[leaf];
+	n.Bounds = MakeLeafBox(center, radius);
+	n.Child[0] = n.Child[1] = -1;
+	n.Object = (int)_objects.size();
+
+	Object o = { center, radius, leaf };
+	_objects.push_back(o);
+	InsertLeaf(leaf);   // may move _nodes
+	return (int)_objects.size() - 1;
+}
+
+void d3d::Bvh::Move(int object, const D3DXVECTOR3& center, float radius)
+{
+	Object& o = _objects[object];
+	o.Center = center;
+	o.Radius = radius;
+	if (Contains(_nodes[o.Leaf].Bounds, center, radius))
+		return;
+
+	RemoveLeaf(o.Leaf);
+	_nodes[o.Leaf].Bounds = MakeLeafBox(center, radius);
+	InsertLeaf(o.Leaf);
+}
+
+d3d::Bvh::Box d3d::Bvh::MakeLeafBox(const D3DXVECTOR3& center, float radius) const
+{
+	float r = radius * (1.0f + LeafMargin);
+	Box b;
+	b.Min = D3DXVECTOR3(center.x - r, center.y - r, center.z - r);
+	b.Max = D3DXVECTOR3(center.x + r, center.y + r, center.z + r);
+	return b;
+}
+
+int d3d::Bvh::AllocateNode()
+{
+	if (_free < 0)
+	{
+		_nodes.push_back(Node());
+		_nodes.back().Parent = -1;
+		return (int)_nodes.size() - 1;
+	}
+	int node = _free;
+	_free = _nodes[node].Parent;
+	_nodes[node].Parent = -1;
+	return node;
+}
+
+void d3d::Bvh::FreeNode(int node)
+{
+	_nodes[node].Parent = _free;
+	_nodes[node].Child[0] = _nodes[node].Child[1] = -1;
+	_nodes[node].Object = -1;
+	_free = node;
+}
+
+void d3d::Bvh::InsertLeaf(int leaf)
+{
+	if (_root < 0)
+	{
+		_root = leaf;
+		_nodes[leaf].Parent = -1;
+		return;
+	}
+
+	// walk down to the node whose box grows least by taking the leaf in, counting what the
+	// boxes above grow by on the way
+	Box box = _nodes[leaf].Bounds;
+	int index = _root;
+	while (_nodes[index].Child[0] >= 0)
+	{
+		const Node& n = _nodes[index];
+		float area = Area(n.Bounds);
+		float combined = Area(Union(n.Bounds, box));
+		float cost = 2.0f * combined;                   // a new parent of this node and the leaf
+		float inheritance = 2.0f * (combined - area);   // going further down grows this box anyway
+
+		float childCost[2];
+		for (int k = 0; k < 2; ++k)
+		{
+			const Node& c = _nodes[n.Child[k]];
+			float grown = Area(Union(c.Bounds, box));
+			childCost[k] = (c.Child[0] < 0 ? grown : grown - Area(c.Bounds)) + inheritance;
+		}
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+		index = n.Child[childCost[0] <= childCost[1] ? 0 : 1];
+	}
+
+	// the leaf and the node it ends up next to get a new parent in the node's place
+	int sibling = index;
+	int oldParent = _nodes[sibling].Parent;
+	int parent = AllocateNode();
+	Node& p = _nodes[parent];
+	p.Parent = oldParent;
+	p.Bounds = Union(_nodes[sibling].Bounds, box);
+	p.Child[0] = sibling;
+	p.Child[1] = leaf;
+	p.Object = -1;
+	_nodes[sibling].Parent = parent;
+	_nodes[leaf].Parent = parent;
+
+	if (oldParent < 0)
+		_root = parent;
+	else
+		_nodes[oldParent].Child[_nodes[oldParent].Child[0] == sibling ? 0 : 1] = parent;
+	Refit(oldParent);
+}
+
+void d3d::Bvh::RemoveLeaf(int leaf)
+{
+	if (leaf == _root)
+	{
+		_root = -1;
+		return;
+	}
+
+	// the sibling takes the place of the parent
+	int parent = _nodes[leaf].Parent;
+	int grandParent = _nodes[parent].Parent;
+	int sibling = _nodes[parent].Child[_nodes[parent].Child[0] == leaf ? 1 : 0];
+	_nodes[sibling].Parent = grandParent;
+	if (grandParent < 0)
+		_root = sibling;
+	else
+		_nodes[grandParent].Child[_nodes[grandParent].Child[0] == parent ? 0 : 1] = sibling;
+	FreeNode(parent);
+	_nodes[leaf].Parent = -1;
+	Refit(grandParent);
+}
+
+void d3d::Bvh::Refit(int node)
+{
+	for (; node >= 0; node = _nodes[node].Parent)
+	{
+		Node& n = _nodes[node];
+		n.Bounds = Union(_nodes[n.Child[0]].Bounds, _nodes[n.Child[1]].Bounds);
+	}
+}
+
+UINT d3d::Bvh::Cull(const CullVolume& volume, char* visible) const
+{
+	if (_objects.empty())
+		return 0;
+	memset(visible, 0, _objects.size());
+	if (_root < 0)
+		return 0;
+
+	// padding planes (0, 0, 0, 1) have everything inside
+	PlaneSet planes;
+	planes.NumGroups = (volume.NumPlanes + 3) / 4;
+	for (int i = 0; i < planes.NumGroups * 4; ++i)
+	{
+		float (*g)[4] = planes.Groups[i / 4];
+		D3DXPLANE p = i < volume.NumPlanes ? volume.Planes[i] : D3DXPLANE(0.0f, 0.0f, 0.0f, 1.0f);
+		g[0][i & 3] = p.a;
+		g[1][i & 3] = p.b;
+		g[2][i & 3] = p.c;
+		g[3][i & 3] = p.d;
+		g[4][i & 3] = fabsf(p.a);
+		g[5][i & 3] = fabsf(p.b);
+		g[6][i & 3] = fabsf(p.c);
+	}
+	return CullNode(_root, planes, volume, false, visible);
+}
+
+int d3d::Bvh::TestBox(const PlaneSet& planes, const Box& box)
+{
+	// a plane's distance to the box center, and how far the box reaches along its normal
+	D3DXVECTOR3 c = (box.Min + box.Max) * 0.5f;
+	D3DXVECTOR3 e = (box.Max - box.Min) * 0.5f;
+	int result = Inside;
+#ifdef BVH_SSE
+	__m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+	__m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+	__m128 zero = _mm_setzero_ps();
+	for (int i = 0; i < planes.NumGroups; ++i)
+	{
+		const float (*g)[4] = planes.Groups[i];
+		__m128 dist = _mm_mul_ps(_mm_loadu_ps(g[0]), cx);
+		dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(g[1]), cy));
+		dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(g[2]), cz));
+		dist = _mm_add_ps(dist, _mm_loadu_ps(g[3]));
+		__m128 reach = _mm_mul_ps(_mm_loadu_ps(g[4]), ex);
+		reach = _mm_add_ps(reach, _mm_mul_ps(_mm_loadu_ps(g[5]), ey));
+		reach = _mm_add_ps(reach, _mm_mul_ps(_mm_loadu_ps(g[6]), ez));
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, reach), zero)))
+			return Outside;
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, reach), zero)))
+			result = Intersecting;
+	}
+#else
+	for (int i = 0; i < planes.NumGroups; ++i)
+	{
+		const float (*g)[4] = planes.Groups[i];
+		for (int k = 0; k < 4; ++k)
+		{
+			float dist = g[0][k] * c.x + g[1][k] * c.y + g[2][k] * c.z + g[3][k];
+			float reach = g[4][k] * e.x + g[5][k] * e.y + g[6][k] * e.z;
+			if (dist + reach < 0.0f)
+				return Outside;
+			if (dist - reach < 0.0f)
+				result = Intersecting;
+		}
+	}
+#endif
+	return result;
+}
+
+UINT d3d::Bvh::CullNode(int node, const PlaneSet& planes, const CullVolume& volume, bool inside,
+	char* visible) const
+{
+	const Node& n = _nodes[node];
+	if (!inside)
+	{
+		int test = TestBox(planes, n.Bounds);
+		if (test == Outside)
+			return 0;
+		inside = test == Inside;
+	}
+
+	if (n.Child[0] < 0)
+	{
+		const Object& o = _objects[n.Object];
+		if (!inside && !IntersectSphere(volume, o.Center, o.Radius))
+			return 0;
+		visible[n.Object] = 1;
+		return 1;
+	}
+	return CullNode(n.Child[0], planes, volume, inside, visible) +
+		CullNode(n.Child[1], planes, volume, inside, visible);
+}
+
+int d3d::Bvh::GetHeight() const
+{
+	return _root < 0 ? 0 : GetHeight(_root);
+}
+
+int d3d::Bvh::GetHeight(int node) const
+{
+	const Node& n = _nodes[node];
+	if (n.Child[0] < 0)
+		return 1;
+	return 1 + std::max(GetHeight(n.Child[0]), GetHeight(n.Child[1]));
+}
@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: bvh.h
+//
+// Desc: A bounding volume hierarchy of axis aligned boxes over objects bounded by spheres,
+//       kept up to date incrementally as in Box2D's dynamic tree.  Each leaf box is a
+//       little larger than its sphere, so an object that moves a bit only moves its
+//       sphere; one that leaves its box is taken out and inserted again where it now
+//       fits best, and only the boxes above the two places are refitted.
+//
+//       Cull tests a node's box against four planes at a time with SSE.  Below a node that
+//       lies entirely inside the volume nothing is tested again; a leaf that straddles a
+//       plane is tested with its sphere, so the result is the same as testing every
+//       object's sphere on its own.
+//
+//       Cull only reads the tree, so several threads may cull it at once.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __bvhH__
+#define __bvhH__
+
+#include "frustum.h"
+#include <vector>
+
+namespace d3d
+{
+	class Bvh
+	{
+	public:
+		Bvh();
+
+		void Clear();
+
+		// Adds an object and returns its index; objects are numbered 0, 1, 2, ...
+		int Insert(const D3DXVECTOR3& center, float radius);
+
+		// Moves object 'object' to the new sphere.
+		void Move(int object, const D3DXVECTOR3& center, float radius);
+
+		// Sets visible[i] to 1 for the objects whose sphere touches 'volume' and to 0 for the
+		// others; 'visible' has room for GetNumObjects() entries.  Returns how many are visible.
+		UINT Cull(const CullVolume& volume, char* visible) const;
+
+		UINT GetNumObjects() const { return (UINT)_objects.size(); }
+
+		// Levels from the root to the deepest leaf, 0 when empty.
+		int GetHeight() const;
+
+	private:
+		struct Box
+		{
+			D3DXVECTOR3 Min, Max;
+		};
+
+		struct Node
+		{
+			Box Bounds;
+			int Parent;         // -1 at the root; next free node while on the free list
+			int Child[2];       // -1 in leaves
+			int Object;         // leaves only
+		};
+
+		struct Object
+		{
+			D3DXVECTOR3 Center;
+			float       Radius;
+			int         Leaf;
+		};
+
+		// The planes of a volume, four at a time: a, b, c, d, |a|, |b|, |c| of each group.
+		struct PlaneSet
+		{
+			int   NumGroups;
+			float Groups[(MaxCullPlanes + 3) / 4][7][4];
+		};
+
+		enum { Outside, Intersecting, Inside };
+
+		int  AllocateNode();
+		void FreeNode(int node);
+		void InsertLeaf(int leaf);
+		void RemoveLeaf(int leaf);
+		void Refit(int node);
+		Box  MakeLeafBox(const D3DXVECTOR3& center, float radius) const;
+
+		static int TestBox(const PlaneSet& planes, const Box& box);
+		UINT CullNode(int node, const PlaneSet& planes, const CullVolume& volume, bool inside,
+			char* visible) const;
+		int  GetHeight(int node) const;
+
+		std::vector<Node>   _nodes;
+		std::vector<Object> _objects;
+		int                 _root;
+		int                 _free;
+	};
+}
+
+#endif // __bvhH__
@@ -0,0 +1,326 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: commandBuffer.cpp
+//
+// Desc: Recorded device calls.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "commandBuffer.h"
+#include <cstring>
+
+void d3d::CommandBuffer::Reset()
+{
+	_commands.clear();
+	_data.clear();
+}
+
+d3d::CommandBuffer::Command& d3d::CommandBuffer::Add(CommandType type, void* object)
+{
+	Command c;
+	c.Type = type;
+	memset(c.Args, 0, sizeof(c.Args));
+	c.Object = object;
+	_commands.push_back(c);
+	return _commands.back();
+}
+
+DWORD d3d::CommandBuffer::Store(const void* data, size_t size)
+{
+	if (!data || size == 0)
+		return NoData;
+	DWORD offset = (DWORD)_data.size();
+	_data.resize(_data.size() + (size + sizeof(DWORD) - 1) / sizeof(DWORD));
+	memcpy(&_data[offset], data, size);
+	return offset;
+}
+
+//
+// Resources are made by the device the buffer is replayed on, never through the buffer.
+//
+
+bool d3d::CommandBuffer::CreateVertexBuffer(UINT, DWORD, VertexBuffer** vb)
+{
+	*vb = 0;
+	return false;
+}
+
+bool d3d::CommandBuffer::CreateIndexBuffer(UINT, IndexBuffer** ib)
+{
+	*ib = 0;
+	return false;
+}
+
+bool d3d::CommandBuffer::CreateTexture(UINT, UINT, Texture** tex)
+{
+	*tex = 0;
+	return false;
+}
+
+bool d3d::CommandBuffer::CreateTextureLevels(D3DFORMAT, UINT, UINT, UINT, Texture** tex)
+{
+	*tex = 0;
+	return false;
+}
+
+bool d3d::CommandBuffer::CreateMesh(const MeshVertex*, UINT, const WORD*, UINT, Mesh** mesh)
+{
+	*mesh = 0;
+	return false;
+}
+
+bool d3d::CommandBuffer::CreateRenderTarget(UINT, UINT, Texture** tex)
+{
+	*tex = 0;
+	return false;
+}
+
+bool d3d::CommandBuffer::CreateStateBlock(const PassDesc&, StateBlock** block)
+{
+	*block = 0;
+	return false;
+}
+
+//
+// Recording
+//
+
+void d3d::CommandBuffer::SetRenderState(D3DRENDERSTATETYPE state, DWORD value)
+{
+	Command& c = Add(CMD_RENDERSTATE, 0);
+	c.Args[0] = (DWORD)state;
+	c.Args[1] = value;
+}
+
+void d3d::CommandBuffer::SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value)
+{
+	Command& c = Add(CMD_SAMPLERSTATE, 0);
+	c.Args[0] = sampler;
+	c.Args[1] = (DWORD)type;
+	c.Args[2] = value;
+}
+
+void d3d::CommandBuffer::SetTexture(DWORD stage, Texture* tex)
+{
+	Command& c = Add(CMD_TEXTURE, tex);
+	c.Args[0] = stage;
+}
+
+void d3d::CommandBuffer::SetMaterial(const D3DMATERIAL9* mtrl)
+{
+	DWORD data = Store(mtrl, sizeof(D3DMATERIAL9));
+	Add(CMD_MATERIAL, 0).Args[0] = data;
+}
+
+void d3d::CommandBuffer::SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix)
+{
+	DWORD data = Store(matrix, sizeof(D3DMATRIX));
+	Command& c = Add(CMD_TRANSFORM, 0);
+	c.Args[0] = (DWORD)state;
+	c.Args[1] = data;
+}
+
+void d3d::CommandBuffer::SetLight(DWORD index, const D3DLIGHT9* light)
+{
+	DWORD data = Store(light, sizeof(D3DLIGHT9));
+	Command& c = Add(CMD_LIGHT, 0);
+	c.Args[0] = index;
+	c.Args[1] = data;
+}
+
+void d3d::CommandBuffer::LightEnable(DWORD index, bool enable)
+{
+	Command& c = Add(CMD_LIGHTENABLE, 0);
+	c.Args[0] = index;
+	c.Args[1] = enable;
+}
+
+void d3d::CommandBuffer::SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride)
+{
+	Command& c = Add(CMD_STREAMSOURCE, vb);
+	c.Args[0] = stream;
+	c.Args[1] = offset;
+	c.Args[2] = stride;
+}
+
+void d3d::CommandBuffer::SetFVF(DWORD fvf)
+{
+	Add(CMD_FVF, 0).Args[0] = fvf;
+}
+
+void d3d::CommandBuffer::SetIndices(IndexBuffer* ib)
+{
+	Add(CMD_INDICES, ib);
+}
+
+void d3d::CommandBuffer::SetClipPlane(DWORD index, const float* plane)
+{
+	DWORD data = Store(plane, 4 * sizeof(float));
+	Command& c = Add(CMD_CLIPPLANE, 0);
+	c.Args[0] = index;
+	c.Args[1] = data;
+}
+
+void d3d::CommandBuffer::ApplyStateBlock(StateBlock* block)
+{
+	Add(CMD_STATEBLOCK, block);
+}
+
+void d3d::CommandBuffer::SetRenderTarget(Texture* target)
+{
+	Add(CMD_RENDERTARGET, target);
+}
+
+void d3d::CommandBuffer::Clear(DWORD count, const D3DRECT* rects, DWORD flags, D3DCOLOR color, float z,
+	DWORD stencil)
+{
+	DWORD data = Store(rects, count * sizeof(D3DRECT));
+	Command& c = Add(CMD_CLEAR, 0);
+	c.Args[0] = count;
+	c.Args[1] = data;
+	c.Args[2] = flags;
+	c.Args[3] = color;
+	memcpy(&c.Args[4], &z, sizeof(float));
+	c.Args[5] = stencil;
+}
+
+void d3d::CommandBuffer::BeginScene()
+{
+	Add(CMD_BEGINSCENE, 0);
+}
+
+void d3d::CommandBuffer::EndScene()
+{
+	Add(CMD_ENDSCENE, 0);
+}
+
+void d3d::CommandBuffer::Present()
+{
+	Add(CMD_PRESENT, 0);
+}
+
+void d3d::CommandBuffer::DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount)
+{
+	Command& c = Add(CMD_DRAWPRIMITIVE, 0);
+	c.Args[0] = (DWORD)type;
+	c.Args[1] = startVertex;
+	c.Args[2] = primCount;
+}
+
+void d3d::CommandBuffer::DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+	UINT numVertices, UINT startIndex, UINT primCount)
+{
+	Command& c = Add(CMD_DRAWINDEXED, 0);
+	c.Args[0] = (DWORD)type;
+	c.Args[1] = (DWORD)baseVertex;
+	c.Args[2] = minIndex;
+	c.Args[3] = numVertices;
+	c.Args[4] = startIndex;
+	c.Args[5] = primCount;
+}
+
+void d3d::CommandBuffer::DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+	const D3DMATERIAL9* palette, UINT paletteSize)
+{
+	DWORD instanceData = Store(instances, count * sizeof(MeshInstance));
+	DWORD paletteData = Store(palette, paletteSize * sizeof(D3DMATERIAL9));
+	Command& c = Add(CMD_DRAWINSTANCES, mesh);
+	c.Args[0] = instanceData;
+	c.Args[1] = count;
+	c.Args[2] = paletteData;
+	c.Args[3] = paletteSize;
+}
+
+void d3d::CommandBuffer::DrawSubset(Mesh* mesh, DWORD attribId)
+{
+	Add(CMD_DRAWSUBSET, mesh).Args[0] = attribId;
+}
+
+void d3d::CommandBuffer::Release()
+{
+	delete this;
+}
+
+//
+// Replay
+//
+
+void d3d::CommandBuffer::Replay(RenderDevice* device) const
+{
+	for (size_t i = 0; i < _commands.size(); ++i)
+	{
+		const Command& c = _commands[i];
+		const DWORD* a = c.Args;
+		switch (c.Type)
+		{
+		case CMD_RENDERSTATE:
+			device->SetRenderState((D3DRENDERSTATETYPE)a[0], a[1]);
+			break;
+		case CMD_SAMPLERSTATE:
+			device->SetSamplerState(a[0], (D3DSAMPLERSTATETYPE)a[1], a[2]);
+			break;
+		case CMD_TEXTURE:
+			device->SetTexture(a[0], (Texture*)c.Object);
+			break;
+		case CMD_MATERIAL:
+			device->SetMaterial((const D3DMATERIAL9*)GetData(a[0]));
+			break;
+		case CMD_TRANSFORM:
+			device->SetTransform((D3DTRANSFORMSTATETYPE)a[0], (const D3DMATRIX*)GetData(a[1]));
+			break;
+		case CMD_LIGHT:
+			device->SetLight(a[0], (const D3DLIGHT9*)GetData(a[1]));
+			break;
+		case CMD_LIGHTENABLE:
+			device->LightEnable(a[0], a[1] != 0);
+			break;
+		case CMD_STREAMSOURCE:
+			device->SetStreamSource(a[0], (VertexBuffer*)c.Object, a[1], a[2]);
+			break;
+		case CMD_FVF:
+			device->SetFVF(a[0]);
+			break;
+		case CMD_INDICES:
+			device->SetIndices((IndexBuffer*)c.Object);
+			break;
+		case CMD_CLIPPLANE:
+			device->SetClipPlane(a[0], (const float*)GetData(a[1]));
+			break;
+		case CMD_STATEBLOCK:
+			device->ApplyStateBlock((StateBlock*)c.Object);
+			break;
+		case CMD_RENDERTARGET:
+			device->SetRenderTarget((Texture*)c.Object);
+			break;
+		case CMD_CLEAR:
+		{
+			float z;
+			memcpy(&z, &a[4], sizeof(float));
+			device->Clear(a[0], (const D3DRECT*)GetData(a[1]), a[2], (D3DCOLOR)a[3], z, a[5]);
+			break;
+		}
+		case CMD_BEGINSCENE:
+			device->BeginScene();
+			break;
+		case CMD_ENDSCENE:
+			device->EndScene();
+			break;
+		case CMD_PRESENT:
+			device->Present();
+			break;
+		case CMD_DRAWPRIMITIVE:
+			device->DrawPrimitive((D3DPRIMITIVETYPE)a[0], a[1], a[2]);
+			break;
+		case CMD_DRAWINDEXED:
+			device->DrawIndexedPrimitive((D3DPRIMITIVETYPE)a[0], (INT)a[1], a[2], a[3], a[4], a[5]);
+			break;
+		case CMD_DRAWINSTANCES:
+			device->DrawInstances((Mesh*)c.Object, (const MeshInstance*)GetData(a[0]), a[1],
+				(const D3DMATERIAL9*)GetData(a[2]), a[3]);
+			break;
+		case CMD_DRAWSUBSET:
+			device->DrawSubset((Mesh*)c.Object, a[0]);
+			break;
+		}
+	}
+}
@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: commandBuffer.h
+//
+// Desc: A RenderDevice that records the calls made to it instead of executing them.
+//       Replay() makes the same calls, in the same order, on a real device.  Direct3D 9 is
+//       not thread safe, so the passes of a frame are recorded into one buffer each on the
+//       worker threads (scene traversal, culling and matrix work run in parallel) and the
+//       render thread replays the buffers one after the other.
+//
+//       Everything a call points to (matrices, materials, lights, instances, palettes,
+//       rectangles) is copied into the buffer, so the caller's memory may change as soon
+//       as the call returns.  Resources are only referenced: they have to live until the
+//       buffer has been replayed.  Resources cannot be created through a buffer.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __commandBufferH__
+#define __commandBufferH__
+
+#include "renderDevice.h"
+#include <vector>
+
+namespace d3d
+{
+	class CommandBuffer : public RenderDevice
+	{
+	public:
+		CommandBuffer() {}
+
+		// Forgets the recorded calls; the memory is kept for the next recording.
+		void Reset();
+
+		// Makes every recorded call on 'device'.  The buffer stays as it is and may be
+		// replayed again.
+		void Replay(RenderDevice* device) const;
+
+		UINT GetCommandCount() const { return (UINT)_commands.size(); }
+
+		// RenderDevice.  The Create* calls fail.
+		bool CreateVertexBuffer(UINT length, DWORD fvf, VertexBuffer** vb);
+		bool CreateIndexBuffer(UINT length, IndexBuffer** ib);
+		bool CreateTexture(UINT width, UINT height, Texture** tex);
+		bool CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels, Texture** tex);
+		bool CreateMesh(const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+			UINT numTriangles, Mesh** mesh);
+		bool CreateRenderTarget(UINT width, UINT height, Texture** tex);
+
+		void SetRenderState(D3DRENDERSTATETYPE state, DWORD value);
+		void SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value);
+		void SetTexture(DWORD stage, Texture* tex);
+		void SetMaterial(const D3DMATERIAL9* mtrl);
+		void SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix);
+		void SetLight(DWORD index, const D3DLIGHT9* light);
+		void LightEnable(DWORD index, bool enable);
+		void SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride);
+		void SetFVF(DWORD fvf);
+		void SetIndices(IndexBuffer* ib);
+		void SetClipPlane(DWORD index, const float* plane);
+
+		bool CreateStateBlock(const PassDesc& desc, StateBlock** block);
+		void ApplyStateBlock(StateBlock* block);
+
+		void SetRenderTarget(Texture* target);
+		void Clear(DWORD count, const D3DRECT* rects, DWORD flags, D3DCOLOR color, float z, DWORD stencil);
+		void BeginScene();
+		void EndScene();
+		void Present();
+		void DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount);
+		void DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+			UINT numVertices, UINT startIndex, UINT primCount);
+		void DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+			const D3DMATERIAL9* palette, UINT paletteSize);
+		void DrawSubset(Mesh* mesh, DWORD attribId);
+
+		// Deletes the buffer.
+		void Release();
+
+	private:
+		enum CommandType
+		{
+			CMD_RENDERSTATE,
+			CMD_SAMPLERSTATE,
+			CMD_TEXTURE,
+			CMD_MATERIAL,
+			CMD_TRANSFORM,
+			CMD_LIGHT,
+			CMD_LIGHTENABLE,
+			CMD_STREAMSOURCE,
+			CMD_FVF,
+			CMD_INDICES,
+			CMD_CLIPPLANE,
+			CMD_STATEBLOCK,
+			CMD_RENDERTARGET,
+			CMD_CLEAR,
+			CMD_BEGINSCENE,
+			CMD_ENDSCENE,
+			CMD_PRESENT,
+			CMD_DRAWPRIMITIVE,
+			CMD_DRAWINDEXED,
+			CMD_DRAWINSTANCES,
+			CMD_DRAWSUBSET
+		};
+
+		// Args hold the call's integer arguments and the offsets of its copied data.
+		struct Command
+		{
+			CommandType Type;
+			DWORD       Args[6];
+			void*       Object;     // texture, render target, buffer, mesh or state block
+		};
+
+		enum { NoData = 0xffffffff };
+
+		Command& Add(CommandType type, void* object);
+		// Copies 'size' bytes into _data and returns their offset, or NoData for none.
+		DWORD Store(const void* data, size_t size);
+		const void* GetData(DWORD offset) const { return offset == NoData ? 0 : &_data[offset]; }
+
+		std::vector<Command> _commands;
+		std::vector<DWORD>   _data;     // DWORDs keep the copied floats and matrices aligned
+	};
+}
+
+#endif // __commandBufferH__
@@ -0,0 +1,741 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3d9Device.cpp
+//
+// Desc: RenderDevice implementation that forwards to IDirect3DDevice9.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "renderDevice.h"
+#include "dds.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+
+namespace
+{
+	class D3D9Texture : public d3d::Texture
+	{
+	public:
+		D3D9Texture(IDirect3DTexture9* tex, IDirect3DSurface9* depth = 0) : _tex(tex), _depth(depth) {}
+		~D3D9Texture()
+		{
+			if (_depth) { _depth->Release(); _depth = 0; }
+			if (_tex) { _tex->Release(); _tex = 0; }
+		}
+
+		bool WriteRows(UINT first, UINT rows, const DWORD* texels)
+		{
+			D3DSURFACE_DESC desc;
+			if (FAILED(_tex->GetLevelDesc(0, &desc)) || first + rows > desc.Height ||
+				(desc.Format != D3DFMT_A8R8G8B8 && desc.Format != D3DFMT_X8R8G8B8))
+				return false;
+			RECT rect = { 0, (LONG)first, (LONG)desc.Width, (LONG)(first + rows) };
+			D3DLOCKED_RECT locked;
+			if (FAILED(_tex->LockRect(0, &locked, &rect, 0)))
+				return false;
+			for (UINT y = 0; y < rows; ++y)
+				memcpy((BYTE*)locked.pBits + y * locked.Pitch, texels + y * desc.Width, desc.Width * sizeof(DWORD));
+			_tex->UnlockRect(0);
+			return true;
+		}
+		void GenerateMips() { D3DXFilterTexture(_tex, 0, 0, D3DX_DEFAULT); }
+		bool WriteLevel(UINT level, const void* data)
+		{
+			D3DSURFACE_DESC desc;
+			if (FAILED(_tex->GetLevelDesc(level, &desc)))
+				return false;
+			UINT rowBytes, rows;
+			d3d::GetLevelPitch(desc.Format, desc.Width, desc.Height, &rowBytes, &rows);
+			D3DLOCKED_RECT locked;
+			if (FAILED(_tex->LockRect(level, &locked, 0, 0)))
+				return false;
+			for (UINT y = 0; y < rows; ++y)
+				memcpy((BYTE*)locked.pBits + y * locked.Pitch, (const BYTE*)data + y * rowBytes, rowBytes);
+			_tex->UnlockRect(level);
+			return true;
+		}
+		void Release() { delete this; }
+
+		IDirect3DTexture9* _tex;
+		IDirect3DSurface9* _depth;  // render targets only
+	};
+
+	class D3D9VertexBuffer : public d3d::VertexBuffer
+	{
+	public:
+		D3D9VertexBuffer(IDirect3DVertexBuffer9* vb) : _vb(vb) {}
+		~D3D9VertexBuffer() { if (_vb) { _vb->Release(); _vb = 0; } }
+
+		bool Lock(UINT offset, UINT size, void** data, DWORD flags)
+		{
+			return SUCCEEDED(_vb->Lock(offset, size, data, flags));
+		}
+		void Unlock() { _vb->Unlock(); }
+		void Release() { delete this; }
+
+		IDirect3DVertexBuffer9* _vb;
+	};
+
+	class D3D9IndexBuffer : public d3d::IndexBuffer
+	{
+	public:
+		D3D9IndexBuffer(IDirect3DIndexBuffer9* ib) : _ib(ib) {}
+		~D3D9IndexBuffer() { if (_ib) { _ib->Release(); _ib = 0; } }
+
+		bool Lock(UINT offset, UINT size, void** data, DWORD flags)
+		{
+			return SUCCEEDED(_ib->Lock(offset, size, data, flags));
+		}
+		void Unlock() { _ib->Unlock(); }
+		void Release() { delete this; }
+
+		IDirect3DIndexBuffer9* _ib;
+	};
+
+	class D3D9Mesh : public d3d::Mesh
+	{
+	public:
+		D3D9Mesh(ID3DXMesh* mesh) : _mesh(mesh), _instanceDecl(0) {}
+		~D3D9Mesh()
+		{
+			if (_instanceDecl) { _instanceDecl->Release(); _instanceDecl = 0; }
+			if (_mesh) { _mesh->Release(); _mesh = 0; }
+		}
+
+		void  DrawSubset(DWORD attribId) { _mesh->DrawSubset(attribId); }
+		DWORD GetNumFaces() const { return _mesh->GetNumFaces(); }
+		DWORD GetNumVertices() const { return _mesh->GetNumVertices(); }
+		bool  GetGeometry(D3DXVECTOR3* positions, DWORD* indices) const
+		{
+			BYTE* v = 0;
+			if (FAILED(_mesh->LockVertexBuffer(D3DLOCK_READONLY, (void**)&v)))
+				return false;
+			DWORD stride = _mesh->GetNumBytesPerVertex();
+			for (DWORD i = 0; i < _mesh->GetNumVertices(); ++i)
+				positions[i] = *(D3DXVECTOR3*)(v + i * stride);
+			_mesh->UnlockVertexBuffer();
+
+			void* ib = 0;
+			if (FAILED(_mesh->LockIndexBuffer(D3DLOCK_READONLY, &ib)))
+				return false;
+			DWORD count = _mesh->GetNumFaces() * 3;
+			bool wide = (_mesh->GetOptions() & D3DXMESH_32BIT) != 0;
+			for (DWORD i = 0; i < count; ++i)
+				indices[i] = wide ? ((DWORD*)ib)[i] : ((WORD*)ib)[i];
+			_mesh->UnlockIndexBuffer();
+			return true;
+		}
+		void  Release() { delete this; }
+
+		ID3DXMesh*                   _mesh;
+		IDirect3DVertexDeclaration9* _instanceDecl; // the mesh's layout plus the instance stream
+	};
+
+	//
+	// Instancing.  Stream 0 walks the mesh once per instance, stream 1 steps once per
+	// instance through the MeshInstance array.  The fixed function pipeline cannot read a
+	// per instance stream, so a vs_3_0/ps_3_0 pair stands in for it; it covers what the
+	// demo's meshes use: directional lights, material, specular, no texture.  User clip
+	// planes, which a vertex shader takes in clip space, are moved there for the draw, so
+	// reflections clipped at the mirror plane stay instanced.
+	//
+
+	const char* InstanceVS =
+		"float4x4 ViewProj;\n"
+		"float4   Eye;\n"
+		"float4   GlobalAmbient;\n"
+		"float    SpecularEnable;\n"
+		"float4   LightDir[4];\n"          // towards the light
+		"float4   LightDiffuse[4];\n"
+		"float4   LightSpecular[4];\n"
+		"float4   LightAmbient[4];\n"
+		"float4   MtrlDiffuse[32];\n"
+		"float4   MtrlAmbient[32];\n"
+		"float4   MtrlSpecular[32];\n"     // w = power
+		"float4   MtrlEmissive[32];\n"
+		"struct VS_IN\n"
+		"{\n"
+		"    float3 pos    : POSITION;\n"
+		"    float3 normal : NORMAL;\n"
+		"    float4 w0     : TEXCOORD1;\n"
+		"    float4 w1     : TEXCOORD2;\n"
+		"    float4 w2     : TEXCOORD3;\n"
+		"    float4 w3     : TEXCOORD4;\n"
+		"    float4 mtrl   : TEXCOORD5;\n"
+		"};\n"
+		"struct VS_OUT\n"
+		"{\n"
+		"    float4 pos      : POSITION;\n"
+		"    float4 diffuse  : COLOR0;\n"
+		"    float4 specular : COLOR1;\n"
+		"};\n"
+		"VS_OUT main(VS_IN i)\n"
+		"{\n"
+		"    float4x4 world = float4x4(i.w0, i.w1, i.w2, i.w3);\n"
+		"    float4 wp = mul(float4(i.pos, 1.0f), world);\n"
+		"    float3 n = normalize(mul(i.normal, (float3x3)world));\n"
+		"    float3 toEye = normalize(Eye.xyz - wp.xyz);\n"
+		"    int m = (int)i.mtrl.x;\n"
+		"    float power = MtrlSpecular[m].w;\n"
+		"    float3 amb = GlobalAmbient.rgb;\n"
+		"    float3 dif = 0.0f;\n"
+		"    float3 spe = 0.0f;\n"
+		"    for (int l = 0; l < 4; ++l)\n"
+		"    {\n"
+		"        amb += LightAmbient[l].rgb;\n"
+		"        float ndotl = dot(n, LightDir[l].xyz);\n"
+		"        if (ndotl > 0.0f)\n"
+		"        {\n"
+		"            dif += LightDiffuse[l].rgb * ndotl;\n"
+		"            float ndoth = dot(n, normalize(toEye + LightDir[l].xyz));\n"
+		"            if (power > 0.0f && ndoth > 0.0f)\n"
+		"                spe += LightSpecular[l].rgb * pow(ndoth, power);\n"
+		"        }\n"
+		"    }\n"
+		"    VS_OUT o;\n"
+		"    o.pos = mul(wp, ViewProj);\n"
+		"    o.diffuse = saturate(float4(MtrlEmissive[m].rgb + MtrlAmbient[m].rgb * amb +\n"
+		"        MtrlDiffuse[m].rgb * dif, MtrlDiffuse[m].a));\n"
+		"    o.specular = saturate(float4(MtrlSpecular[m].rgb * spe * SpecularEnable, 0.0f));\n"
+		"    return o;\n"
+		"}\n";
+
+	const char* InstancePS =
+		"float4 main(float4 diffuse : COLOR0, float4 specular : COLOR1) : COLOR\n"
+		"{\n"
+		"    return float4(saturate(diffuse.rgb + specular.rgb), diffuse.a);\n"
+		"}\n";
+
+	enum
+	{
+		MaxInstanceLights  = 4,
+		MaxInstancePalette = 32
+	};
+
+	class D3D9StateBlock : public d3d::StateBlock
+	{
+	public:
+		D3D9StateBlock(const d3d::PassDesc& desc, IDirect3DStateBlock9* block) : _desc(desc), _block(block) {}
+		~D3D9StateBlock() { if (_block) { _block->Release(); _block = 0; } }
+
+		const d3d::PassDesc& GetDesc() const { return _desc; }
+		void Release() { delete this; }
+
+		d3d::PassDesc         _desc;
+		IDirect3DStateBlock9* _block;
+	};
+
+	class D3D9Device : public d3d::RenderDevice
+	{
+	public:
+		D3D9Device(IDirect3DDevice9* device)
+			: _device(device), _instancing(-1), _instanceVS(0), _instancePS(0), _instanceConstants(0),
+			_instanceVB(0), _instanceCapacity(0), _backBuffer(0), _backDepth(0)
+		{
+			_device->AddRef();
+		}
+		~D3D9Device()
+		{
+			if (_backDepth) { _backDepth->Release(); _backDepth = 0; }
+			if (_backBuffer) { _backBuffer->Release(); _backBuffer = 0; }
+			if (_instanceVB) { _instanceVB->Release(); _instanceVB = 0; }
+			if (_instanceConstants) { _instanceConstants->Release(); _instanceConstants = 0; }
+			if (_instancePS) { _instancePS->Release(); _instancePS = 0; }
+			if (_instanceVS) { _instanceVS->Release(); _instanceVS = 0; }
+			if (_device) { _device->Release(); _device = 0; }
+		}
+
+		bool CreateVertexBuffer(UINT length, DWORD fvf, d3d::VertexBuffer** vb)
+		{
+			IDirect3DVertexBuffer9* buffer = 0;
+			HRESULT hr = _device->CreateVertexBuffer(length, 0, fvf, D3DPOOL_MANAGED, &buffer, 0);
+			*vb = SUCCEEDED(hr) ? new D3D9VertexBuffer(buffer) : 0;
+			return SUCCEEDED(hr);
+		}
+
+		bool CreateIndexBuffer(UINT length, d3d::IndexBuffer** ib)
+		{
+			IDirect3DIndexBuffer9* buffer = 0;
+			HRESULT hr = _device->CreateIndexBuffer(length, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
+				D3DPOOL_MANAGED, &buffer, 0);
+			*ib = SUCCEEDED(hr) ? new D3D9IndexBuffer(buffer) : 0;
+			return SUCCEEDED(hr);
+		}
+
+		bool CreateTexture(UINT width, UINT height, d3d::Texture** tex)
+		{
+			IDirect3DTexture9* texture = 0;
+			HRESULT hr = _device->CreateTexture(width, height, 0, 0, D3DFMT_A8R8G8B8,
+				D3DPOOL_MANAGED, &texture, 0);
+			*tex = SUCCEEDED(hr) ? new D3D9Texture(texture) : 0;
+			return SUCCEEDED(hr);
+		}
+
+		bool CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels, d3d::Texture** tex)
+		{
+			IDirect3DTexture9* texture = 0;
+			HRESULT hr = _device->CreateTexture(width, height, levels, 0, format, D3DPOOL_MANAGED, &texture, 0);
+			*tex = SUCCEEDED(hr) ? new D3D9Texture(texture) : 0;
+			return SUCCEEDED(hr);
+		}
+
+		// Render targets live in the default pool: they have to be made again after a reset.
+		bool CreateRenderTarget(UINT width, UINT height, d3d::Texture** tex)
+		{
+			*tex = 0;
+			IDirect3DTexture9* texture = 0;
+			IDirect3DSurface9* depth = 0;
+			if (FAILED(_device->CreateTexture(width, height, 1, D3DUSAGE_RENDERTARGET, D3DFMT_A8R8G8B8,
+				D3DPOOL_DEFAULT, &texture, 0)))
+				return false;
+			if (FAILED(_device->CreateDepthStencilSurface(width, height, D3DFMT_D24S8, D3DMULTISAMPLE_NONE,
+				0, TRUE, &depth, 0)))
+			{
+				texture->Release();
+				return false;
+			}
+			*tex = new D3D9Texture(texture, depth);
+			return true;
+		}
+
+		bool CreateMesh(const d3d::MeshVertex* vertices, UINT numVertices, const WORD* indices,
+			UINT numTriangles, d3d::Mesh** mesh)
+		{
+			*mesh = 0;
+			ID3DXMesh* m = 0;
+			if (FAILED(D3DXCreateMeshFVF(numTriangles, numVertices, D3DXMESH_MANAGED,
+				D3DFVF_XYZ | D3DFVF_NORMAL, _device, &m)))
+				return false;
+
+			void*  v = 0;
+			void*  i = 0;
+			DWORD* attributes = 0;
+			bool ok = SUCCEEDED(m->LockVertexBuffer(0, &v));
+			if (ok)
+			{
+				memcpy(v, vertices, numVertices * sizeof(d3d::MeshVertex));
+				m->UnlockVertexBuffer();
+				ok = SUCCEEDED(m->LockIndexBuffer(0, &i));
+			}
+			if (ok)
+			{
+				memcpy(i, indices, numTriangles * 3 * sizeof(WORD));
+				m->UnlockIndexBuffer();
+				ok = SUCCEEDED(m->LockAttributeBuffer(0, &attributes));
+			}
+			if (ok)
+			{
+				memset(attributes, 0, numTriangles * sizeof(DWORD));
+				m->UnlockAttributeBuffer();
+			}
+			if (!ok)
+			{
+				m->Release();
+				return false;
+			}
+			*mesh = new D3D9Mesh(m);
+			return true;
+		}
+
+		void SetRenderState(D3DRENDERSTATETYPE state, DWORD value)
+		{
+			_device->SetRenderState(state, value);
+		}
+		void SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value)
+		{
+			_device->SetSamplerState(sampler, type, value);
+		}
+		void SetTexture(DWORD stage, d3d::Texture* tex)
+		{
+			_device->SetTexture(stage, tex ? ((D3D9Texture*)tex)->_tex : 0);
+		}
+		void SetMaterial(const D3DMATERIAL9* mtrl)
+		{
+			_device->SetMaterial(mtrl);
+		}
+		void SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix)
+		{
+			_device->SetTransform(state, matrix);
+		}
+		void SetLight(DWORD index, const D3DLIGHT9* light)
+		{
+			_device->SetLight(index, light);
+		}
+		void LightEnable(DWORD index, bool enable)
+		{
+			_device->LightEnable(index, enable);
+		}
+		void SetStreamSource(UINT stream, d3d::VertexBuffer* vb, UINT offset, UINT stride)
+		{
+			_device->SetStreamSource(stream, vb ? ((D3D9VertexBuffer*)vb)->_vb : 0, offset, stride);
+		}
+		void SetFVF(DWORD fvf)
+		{
+			_device->SetFVF(fvf);
+		}
+		void SetIndices(d3d::IndexBuffer* ib)
+		{
+			_device->SetIndices(ib ? ((D3D9IndexBuffer*)ib)->_ib : 0);
+		}
+		void SetClipPlane(DWORD index, const float* plane)
+		{
+			_device->SetClipPlane(index, plane);
+		}
+
+		bool CreateStateBlock(const d3d::PassDesc& desc, d3d::StateBlock** block)
+		{
+			DWORD values[d3d::PASS_STATE_COUNT];
+			desc.GetRenderStates(values);
+
+			IDirect3DStateBlock9* recorded = 0;
+			_device->BeginStateBlock();
+			for (int i = 0; i < d3d::PASS_STATE_COUNT; ++i)
+				_device->SetRenderState(d3d::PassRenderStates[i], values[i]);
+			HRESULT hr = _device->EndStateBlock(&recorded);
+
+			*block = SUCCEEDED(hr) ? new D3D9StateBlock(desc, recorded) : 0;
+			return SUCCEEDED(hr);
+		}
+		void ApplyStateBlock(d3d::StateBlock* block)
+		{
+			((D3D9StateBlock*)block)->_block->Apply();
+		}
+
+		// The back buffer and its depth buffer are fetched the first time a target is set,
+		// so that setting 0 can put them back.
+		void SetRenderTarget(d3d::Texture* target)
+		{
+			if (!_backBuffer)
+			{
+				if (!target || FAILED(_device->GetRenderTarget(0, &_backBuffer)))
+					return;
+				_device->GetDepthStencilSurface(&_backDepth);
+			}
+
+			if (!target)
+			{
+				_device->SetRenderTarget(0, _backBuffer);
+				_device->SetDepthStencilSurface(_backDepth);
+				return;
+			}
+			D3D9Texture* tex = (D3D9Texture*)target;
+			IDirect3DSurface9* surface = 0;
+			if (FAILED(tex->_tex->GetSurfaceLevel(0, &surface)))
+				return;
+			_device->SetRenderTarget(0, surface);
+			_device->SetDepthStencilSurface(tex->_depth);
+			surface->Release();
+		}
+		void Clear(DWORD count, const D3DRECT* rects, DWORD flags, D3DCOLOR color, float z, DWORD stencil)
+		{
+			_device->Clear(count, rects, flags, color, z, stencil);
+		}
+		void BeginScene() { _device->BeginScene(); }
+		void EndScene() { _device->EndScene(); }
+		void Present() { _device->Present(0, 0, 0, 0); }
+		void DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount)
+		{
+			_device->DrawPrimitive(type, startVertex, primCount);
+		}
+		void DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+			UINT numVertices, UINT startIndex, UINT primCount)
+		{
+			_device->DrawIndexedPrimitive(type, baseVertex, minIndex, numVertices, startIndex, primCount);
+		}
+		void DrawInstances(d3d::Mesh* mesh, const d3d::MeshInstance* instances, UINT count,
+			const D3DMATERIAL9* palette, UINT paletteSize)
+		{
+			if (count == 0 || paletteSize == 0)
+				return;
+			if (DrawInstancesWithShader((D3D9Mesh*)mesh, instances, count, palette, paletteSize))
+				return;
+
+			// fixed function fallback: still one call from the caller's point of view
+			for (UINT i = 0; i < count; ++i)
+			{
+				if (instances[i].Material >= paletteSize)
+					continue;
+				_device->SetTransform(D3DTS_WORLD, &instances[i].World);
+				_device->SetMaterial(&palette[instances[i].Material]);
+				((D3D9Mesh*)mesh)->_mesh->DrawSubset(0);
+			}
+		}
+
+		void Release() { delete this; }
+
+	private:
+		bool InitInstancing()
+		{
+			if (_instancing >= 0)
+				return _instancing != 0;
+			_instancing = 0;
+
+			D3DCAPS9 caps;
+			if (FAILED(_device->GetDeviceCaps(&caps)) ||
+				caps.VertexShaderVersion < D3DVS_VERSION(3, 0) ||
+				caps.PixelShaderVersion < D3DPS_VERSION(3, 0))
+				return false;
+
+			ID3DXBuffer* code = 0;
+			HRESULT hr = D3DXCompileShader(InstanceVS, (UINT)strlen(InstanceVS), 0, 0, "main", "vs_3_0", 0,
+				&code, 0, &_instanceConstants);
+			if (SUCCEEDED(hr))
+			{
+				hr = _device->CreateVertexShader((const DWORD*)code->GetBufferPointer(), &_instanceVS);
+				code->Release();
+			}
+			if (FAILED(hr))
+				return false;
+
+			hr = D3DXCompileShader(InstancePS, (UINT)strlen(InstancePS), 0, 0, "main", "ps_3_0", 0,
+				&code, 0, 0);
+			if (SUCCEEDED(hr))
+			{
+				hr = _device->CreatePixelShader((const DWORD*)code->GetBufferPointer(), &_instancePS);
+				code->Release();
+			}
+			if (FAILED(hr))
+				return false;
+
+			_instancing = 1;
+			return true;
+		}
+
+		bool FillInstances(const d3d::MeshInstance* instances, UINT count)
+		{
+			if (count > _instanceCapacity)
+			{
+				if (_instanceVB) { _instanceVB->Release(); _instanceVB = 0; }
+				UINT capacity = std::max(count, _instanceCapacity * 2);
+				if (FAILED(_device->CreateVertexBuffer(capacity * sizeof(d3d::MeshInstance),
+					D3DUSAGE_DYNAMIC | D3DUSAGE_WRITEONLY, 0, D3DPOOL_DEFAULT, &_instanceVB, 0)))
+				{
+					_instanceCapacity = 0;
+					return false;
+				}
+				_instanceCapacity = capacity;
+			}
+
+			void* data = 0;
+			UINT bytes = count * sizeof(d3d::MeshInstance);
+			if (FAILED(_instanceVB->Lock(0, bytes, &data, D3DLOCK_DISCARD)))
+				return false;
+			memcpy(data, instances, bytes);
+			_instanceVB->Unlock();
+			return true;
+		}
+
+		bool CreateInstanceDecl(D3D9Mesh* mesh)
+		{
+			if (mesh->_instanceDecl)
+				return true;
+
+			D3DVERTEXELEMENT9 elements[MAX_FVF_DECL_SIZE];
+			if (FAILED(mesh->_mesh->GetDeclaration(elements)))
+				return false;
+			UINT n = 0;
+			while (elements[n].Stream != 0xff)
+				++n;
+			if (n + 6 > MAX_FVF_DECL_SIZE)
+				return false;
+
+			for (BYTE row = 0; row < 4; ++row)
+			{
+				D3DVERTEXELEMENT9 e = { 1, (WORD)(row * 16), D3DDECLTYPE_FLOAT4, D3DDECLMETHOD_DEFAULT,
+					D3DDECLUSAGE_TEXCOORD, (BYTE)(row + 1) };
+				elements[n++] = e;
+			}
+			D3DVERTEXELEMENT9 material = { 1, 64, D3DDECLTYPE_UBYTE4, D3DDECLMETHOD_DEFAULT,
+				D3DDECLUSAGE_TEXCOORD, 5 };
+			elements[n++] = material;
+			D3DVERTEXELEMENT9 end = D3DDECL_END();
+			elements[n] = end;
+
+			return SUCCEEDED(_device->CreateVertexDeclaration(elements, &mesh->_instanceDecl));
+		}
+
+		// False when the current state needs something the shader does not do: lighting
+		// off, a texture, a light that is not directional, more than MaxInstanceLights
+		// lights or more than MaxInstancePalette materials.  The caller then falls back to
+		// one fixed function draw per instance.
+		bool DrawInstancesWithShader(D3D9Mesh* mesh, const d3d::MeshInstance* instances, UINT count,
+			const D3DMATERIAL9* palette, UINT paletteSize)
+		{
+			if (paletteSize > MaxInstancePalette || !InitInstancing())
+				return false;
+			for (UINT i = 0; i < count; ++i)
+				if (instances[i].Material >= paletteSize)
+					return false;
+
+			DWORD lighting = 0, specular = 0, ambient = 0;
+			_device->GetRenderState(D3DRS_LIGHTING, &lighting);
+			_device->GetRenderState(D3DRS_SPECULARENABLE, &specular);
+			_device->GetRenderState(D3DRS_AMBIENT, &ambient);
+			if (!lighting)
+				return false;
+
+			IDirect3DBaseTexture9* texture = 0;
+			_device->GetTexture(0, &texture);
+			if (texture)
+			{
+				texture->Release();
+				return false;
+			}
+
+			D3DXVECTOR4 lightDir[MaxInstanceLights], lightDiffuse[MaxInstanceLights];
+			D3DXVECTOR4 lightSpecular[MaxInstanceLights], lightAmbient[MaxInstanceLights];
+			memset(lightDir, 0, sizeof(lightDir));
+			memset(lightDiffuse, 0, sizeof(lightDiffuse));
+			memset(lightSpecular, 0, sizeof(lightSpecular));
+			memset(lightAmbient, 0, sizeof(lightAmbient));
+			int numLights = 0;
+			for (DWORD i = 0; i < 8; ++i)
+			{
+				BOOL enabled = FALSE;
+				if (FAILED(_device->GetLightEnable(i, &enabled)) || !enabled)
+					continue;
+				D3DLIGHT9 light;
+				_device->GetLight(i, &light);
+				if (light.Type != D3DLIGHT_DIRECTIONAL || numLights == MaxInstanceLights)
+					return false;
+
+				D3DXVECTOR3 dir(-light.Direction.x, -light.Direction.y, -light.Direction.z);
+				D3DXVec3Normalize(&dir, &dir);
+				lightDir[numLights] = D3DXVECTOR4(dir.x, dir.y, dir.z, 0.0f);
+				lightDiffuse[numLights] = D3DXVECTOR4(light.Diffuse.r, light.Diffuse.g, light.Diffuse.b, light.Diffuse.a);
+				lightSpecular[numLights] = D3DXVECTOR4(light.Specular.r, light.Specular.g, light.Specular.b, light.Specular.a);
+				lightAmbient[numLights] = D3DXVECTOR4(light.Ambient.r, light.Ambient.g, light.Ambient.b, light.Ambient.a);
+				++numLights;
+			}
+
+			if (!CreateInstanceDecl(mesh) || !FillInstances(instances, count))
+				return false;
+
+			D3DXVECTOR4 mtrlDiffuse[MaxInstancePalette], mtrlAmbient[MaxInstancePalette];
+			D3DXVECTOR4 mtrlSpecular[MaxInstancePalette], mtrlEmissive[MaxInstancePalette];
+			for (UINT i = 0; i < paletteSize; ++i)
+			{
+				const D3DMATERIAL9& m = palette[i];
+				mtrlDiffuse[i] = D3DXVECTOR4(m.Diffuse.r, m.Diffuse.g, m.Diffuse.b, m.Diffuse.a);
+				mtrlAmbient[i] = D3DXVECTOR4(m.Ambient.r, m.Ambient.g, m.Ambient.b, m.Ambient.a);
+				mtrlSpecular[i] = D3DXVECTOR4(m.Specular.r, m.Specular.g, m.Specular.b, m.Power);
+				mtrlEmissive[i] = D3DXVECTOR4(m.Emissive.r, m.Emissive.g, m.Emissive.b, m.Emissive.a);
+			}
+
+			D3DXMATRIX view, proj, invView;
+			_device->GetTransform(D3DTS_VIEW, &view);
+			_device->GetTransform(D3DTS_PROJECTION, &proj);
+			D3DXMatrixInverse(&invView, 0, &view);
+			D3DXMATRIX viewProj = view * proj;
+
+			// with a vertex shader bound clip planes are taken in clip space, not world
+			// space: planes transform by the inverse transpose of ViewProj
+			DWORD clipPlanes = 0;
+			_device->GetRenderState(D3DRS_CLIPPLANEENABLE, &clipPlanes);
+			D3DXPLANE worldPlanes[D3DMAXUSERCLIPPLANES];
+			if (clipPlanes)
+			{
+				D3DXMATRIX toClip;
+				if (!D3DXMatrixInverse(&toClip, 0, &viewProj))
+					return false;
+				D3DXMatrixTranspose(&toClip, &toClip);
+				for (DWORD i = 0; i < D3DMAXUSERCLIPPLANES; ++i)
+				{
+					if (!(clipPlanes & (1u << i)))
+						continue;
+					D3DXPLANE clip;
+					_device->GetClipPlane(i, (float*)&worldPlanes[i]);
+					D3DXPlaneTransform(&clip, &worldPlanes[i], &toClip);
+					_device->SetClipPlane(i, (const float*)&clip);
+				}
+			}
+			D3DXVECTOR4 eye(invView._41, invView._42, invView._43, 1.0f);
+			D3DXCOLOR globalAmbient(ambient);
+
+			ID3DXConstantTable* c = _instanceConstants;
+			c->SetMatrix(_device, "ViewProj", &viewProj);
+			c->SetVector(_device, "Eye", &eye);
+			c->SetVector(_device, "GlobalAmbient", (const D3DXVECTOR4*)&globalAmbient);
+			c->SetFloat(_device, "SpecularEnable", specular ? 1.0f : 0.0f);
+			c->SetVectorArray(_device, "LightDir", lightDir, MaxInstanceLights);
+			c->SetVectorArray(_device, "LightDiffuse", lightDiffuse, MaxInstanceLights);
+			c->SetVectorArray(_device, "LightSpecular", lightSpecular, MaxInstanceLights);
+			c->SetVectorArray(_device, "LightAmbient", lightAmbient, MaxInstanceLights);
+			c->SetVectorArray(_device, "MtrlDiffuse", mtrlDiffuse, paletteSize);
+			c->SetVectorArray(_device, "MtrlAmbient", mtrlAmbient, paletteSize);
+			c->SetVectorArray(_device, "MtrlSpecular", mtrlSpecular, paletteSize);
+			c->SetVectorArray(_device, "MtrlEmissive", mtrlEmissive, paletteSize);
+
+			// subset 0 only, like DrawSubset(0)
+			ID3DXMesh* m = mesh->_mesh;
+			DWORD faceStart = 0, faceCount = m->GetNumFaces();
+			DWORD vertexStart = 0, vertexCount = m->GetNumVertices();
+			DWORD numAttributes = 0;
+			m->GetAttributeTable(0, &numAttributes);
+			if (numAttributes > 0)
+			{
+				std::vector<D3DXATTRIBUTERANGE> table(numAttributes);
+				m->GetAttributeTable(&table[0], &numAttributes);
+				for (DWORD i = 0; i < numAttributes; ++i)
+				{
+					if (table[i].AttribId == 0)
+					{
+						faceStart = table[i].FaceStart;
+						faceCount = table[i].FaceCount;
+						vertexStart = table[i].VertexStart;
+						vertexCount = table[i].VertexCount;
+					}
+				}
+			}
+
+			IDirect3DVertexBuffer9* vb = 0;
+			IDirect3DIndexBuffer9* ib = 0;
+			m->GetVertexBuffer(&vb);
+			m->GetIndexBuffer(&ib);
+
+			_device->SetVertexDeclaration(mesh->_instanceDecl);
+			_device->SetVertexShader(_instanceVS);
+			_device->SetPixelShader(_instancePS);
+			_device->SetStreamSource(0, vb, 0, m->GetNumBytesPerVertex());
+			_device->SetStreamSourceFreq(0, D3DSTREAMSOURCE_INDEXEDDATA | count);
+			_device->SetStreamSource(1, _instanceVB, 0, sizeof(d3d::MeshInstance));
+			_device->SetStreamSourceFreq(1, D3DSTREAMSOURCE_INSTANCEDATA | 1u);
+			_device->SetIndices(ib);
+			_device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, 0, vertexStart, vertexCount, faceStart * 3, faceCount);
+
+			_device->SetStreamSourceFreq(0, 1);
+			_device->SetStreamSourceFreq(1, 1);
+			_device->SetStreamSource(1, 0, 0, 0);
+			_device->SetVertexShader(0);
+			_device->SetPixelShader(0);
+			for (DWORD i = 0; i < D3DMAXUSERCLIPPLANES; ++i)
+				if (clipPlanes & (1u << i))
+					_device->SetClipPlane(i, (const float*)&worldPlanes[i]);
+			vb->Release();
+			ib->Release();
+			return true;
+		}
+
+		IDirect3DDevice9*       _device;
+
+		int                     _instancing;        // -1 not tried yet, 0 unsupported, 1 ready
+		IDirect3DVertexShader9* _instanceVS;
+		IDirect3DPixelShader9*  _instancePS;
+		ID3DXConstantTable*     _instanceConstants;
+		IDirect3DVertexBuffer9* _instanceVB;        // dynamic, grows to the largest batch
+		UINT                    _instanceCapacity;
+
+		IDirect3DSurface9*      _backBuffer;    // saved by the first SetRenderTarget
+		IDirect3DSurface9*      _backDepth;
+	};
+}
+
+d3d::RenderDevice* d3d::CreateD3D9Device(IDirect3DDevice9* device)
+{
+	return device ? new D3D9Device(device) : 0;
+}
+
+#endif // _WIN32
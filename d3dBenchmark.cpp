@@ -0,0 +1,345 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dBenchmark.cpp
+//
+// Desc: Headless benchmark of the mirror/shadow scene on the software device.  The camera
+//       and the teapot follow a fixed script instead of the keyboard and every frame
+//       advances the simulation by exactly 1/60 s, so each run renders the same frames.
+//       The suite sweeps the number of mirrors, teapots (shadow casters), lights and the
+//       resolution away from a 640x480 baseline, and renders the mirrors into textures
+//       instead of the stencil buffer; it reports frames per second, the median
+//       and 99th percentile frame time, the heap allocations per frame and the depth pixels
+//       the mirror pass writes to get the scene's depth out of the way of the reflections.
+//
+//       Usage: d3dBenchmark [results.csv|results.json] [frames] [threads]
+//
+//       g++ -O2 -std=c++11 -pthread d3dBenchmark.cpp d3dInit.cpp d3dUtility.cpp
+//           d3dCompat.cpp drawList.cpp frustum.cpp mirror.cpp renderDevice.cpp softDevice.cpp
+//           shadow.cpp shadowVolume.cpp stateCache.cpp taskPool.cpp
+//           simdMath.cpp staticMesh.cpp transformCache.cpp frameClock.cpp profiler.cpp
+//           image.cpp meshGeometry.cpp assetLoader.cpp dds.cpp mappedFile.cpp sceneFile.cpp
+//           commandBuffer.cpp bvh.cpp meshLod.cpp -o d3dBenchmark
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "d3dInit.h"
+#include "frameClock.h"
+#include "profiler.h"
+#include "softDevice.h"
+#include "stateCache.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+//
+// Allocation counting: every operator new in the process goes through here.
+//
+
+static std::atomic<unsigned long long> Allocations(0);
+
+// GCC sees malloc paired with operator delete once these are inlined
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+	++Allocations;
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+namespace
+{
+	struct BenchConfig
+	{
+		const char* Sweep;        // which parameter this run varies
+		int         Width, Height;
+		int         Mirrors;
+		int         Teapots;
+		int         Lights;
+		ShadowMode  Shadow;
+		MirrorDepthMode Depth;
+		ReflectionMode Reflection;
+	};
+
+	struct BenchResult
+	{
+		BenchConfig Config;
+		int         Frames;
+		double      Fps;
+		double      MedianMs;
+		double      P99Ms;
+		double      AllocationsPerFrame;
+		double      DepthPixelsPerFrame;  // written by the mirror pass to reset depth
+	};
+
+	const int WarmupFrames = 10;
+
+	// The camera swings in front of the back wall so the side mirrors come into view; the
+	// teapot slides along the wall through the mirror's reflection.
+	void Script(SimState& state, double time)
+	{
+		state.Angle = 1.5f * D3DX_PI + 0.6f * (float)sin(time * 0.5);
+		state.Radius = 18.0f + 3.0f * (float)sin(time * 0.3);
+		state.TeapotPosition = D3DXVECTOR3(3.0f * (float)sin(time * 0.8), 3.0f, -7.5f);
+	}
+
+#if D3D_PROFILE
+	void Quiet(const char*)
+	{
+	}
+#endif
+
+	BenchConfig MakeConfig(const char* sweep)
+	{
+		BenchConfig c = { sweep, 640, 480, 1, 1, 1, SHADOW_PLANAR, MIRROR_DEPTH_AUTO, REFLECTION_STENCIL };
+		return c;
+	}
+
+	std::vector<BenchConfig> MakeSuite()
+	{
+		std::vector<BenchConfig> suite;
+		suite.push_back(MakeConfig("baseline"));
+
+		for (int m = 2; m <= MaxSceneMirrors; ++m)
+		{
+			BenchConfig c = MakeConfig("mirrors");
+			c.Mirrors = m;
+			suite.push_back(c);
+		}
+
+		// the other depth reset than the one AUTO picks for 1, 3 and 5 mirrors
+		for (int m = 1; m <= MaxSceneMirrors; m += 2)
+		{
+			BenchConfig c = MakeConfig("depth");
+			c.Mirrors = m;
+			c.Depth = m == 1 ? MIRROR_DEPTH_REGION : MIRROR_DEPTH_CLEAR;
+			suite.push_back(c);
+		}
+
+		// reflections rendered into textures at each mirror's scale and update interval
+		for (int m = 1; m <= MaxSceneMirrors; m += 2)
+		{
+			BenchConfig c = MakeConfig("texture");
+			c.Mirrors = m;
+			c.Reflection = REFLECTION_TEXTURE;
+			suite.push_back(c);
+		}
+
+		const int teapots[] = { 20, 100, 400 };
+		for (int i = 0; i < 3; ++i)
+		{
+			BenchConfig c = MakeConfig("casters");
+			c.Teapots = teapots[i];
+			suite.push_back(c);
+		}
+
+		const ShadowMode shadows[] = { SHADOW_PLANAR, SHADOW_VOLUME, SHADOW_TEXTURE };
+		for (int s = 0; s < 3; ++s)
+		{
+			for (int l = 1; l <= MaxSceneLights; ++l)
+			{
+				if (s == 0 && l == 1)
+					continue;   // the baseline
+				BenchConfig c = MakeConfig("lights");
+				c.Lights = l;
+				c.Shadow = shadows[s];
+				suite.push_back(c);
+			}
+		}
+
+		const int sizes[][2] = { { 320, 240 }, { 1280, 720 }, { 1920, 1080 } };
+		for (int i = 0; i < 3; ++i)
+		{
+			BenchConfig c = MakeConfig("resolution");
+			c.Width = sizes[i][0];
+			c.Height = sizes[i][1];
+			suite.push_back(c);
+		}
+
+		return suite;
+	}
+
+	bool Run(const BenchConfig& config, int frames, int threads, BenchResult* result)
+	{
+		width = config.Width;
+		height = config.Height;
+		MirrorCount = config.Mirrors;
+		TeapotCount = config.Teapots;
+		LightCount = config.Lights;
+		ShadowTechnique = config.Shadow;
+		MirroDepthMode = config.Depth;
+		ReflectionTechnique = config.Reflection;
+		RecordThreads = threads;
+
+		Device = new d3d::StateCache(new d3d::SoftwareDevice(width, height, threads));
+		if (!Setup())
+		{
+			CleanUp();
+			Device->Release();
+			Device = 0;
+			return false;
+		}
+		WaitForAssets();
+
+		for (int i = 0; i < WarmupFrames; ++i)
+			Display(1.0 / 60.0);
+
+		std::vector<double> times(frames);
+		double depthPixels = 0.0;
+		unsigned long long allocations = Allocations;
+		double start = d3d::GetTime();
+		for (int i = 0; i < frames; ++i)
+		{
+			double frameStart = d3d::GetTime();
+			Display(1.0 / 60.0);
+			times[i] = (d3d::GetTime() - frameStart) * 1000.0;
+			depthPixels += MirroDepthPixels;
+		}
+		double seconds = d3d::GetTime() - start;
+		allocations = Allocations - allocations;
+
+		CleanUp();
+		Device->Release();
+		Device = 0;
+
+		std::sort(times.begin(), times.end());
+		result->Config = config;
+		result->Frames = frames;
+		result->Fps = seconds > 0.0 ? frames / seconds : 0.0;
+		result->MedianMs = times[(frames - 1) / 2];
+		result->P99Ms = times[std::max(0, (int)ceil(frames * 0.99) - 1)];
+		result->AllocationsPerFrame = (double)allocations / frames;
+		result->DepthPixelsPerFrame = depthPixels / frames;
+		return true;
+	}
+
+	const char* ShadowName(ShadowMode mode)
+	{
+		return mode == SHADOW_VOLUME ? "volume" : mode == SHADOW_TEXTURE ? "texture" : "planar";
+	}
+
+	const char* DepthName(MirrorDepthMode mode)
+	{
+		return mode == MIRROR_DEPTH_CLEAR ? "clear" : mode == MIRROR_DEPTH_REGION ? "region" : "auto";
+	}
+
+	const char* ReflectionName(ReflectionMode mode)
+	{
+		return mode == REFLECTION_TEXTURE ? "texture" : "stencil";
+	}
+
+	bool WriteCsv(const char* fileName, const std::vector<BenchResult>& results)
+	{
+		FILE* file = fopen(fileName, "w");
+		if (!file)
+			return false;
+
+		fprintf(file, "sweep,width,height,mirrors,teapots,lights,shadow,depth,reflection,frames,fps,p50_ms,"
+			"p99_ms,allocs_per_frame,depth_px_per_frame\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchResult& r = results[i];
+			const BenchConfig& c = r.Config;
+			fprintf(file, "%s,%d,%d,%d,%d,%d,%s,%s,%s,%d,%.2f,%.3f,%.3f,%.2f,%.0f\n", c.Sweep, c.Width,
+				c.Height, c.Mirrors, c.Teapots, c.Lights, ShadowName(c.Shadow), DepthName(c.Depth),
+				ReflectionName(c.Reflection), r.Frames, r.Fps, r.MedianMs, r.P99Ms, r.AllocationsPerFrame,
+				r.DepthPixelsPerFrame);
+		}
+		return fclose(file) == 0;
+	}
+
+	bool WriteJson(const char* fileName, const std::vector<BenchResult>& results)
+	{
+		FILE* file = fopen(fileName, "w");
+		if (!file)
+			return false;
+
+		fprintf(file, "[\n");
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchResult& r = results[i];
+			const BenchConfig& c = r.Config;
+			fprintf(file, "  {\"sweep\":\"%s\",\"width\":%d,\"height\":%d,\"mirrors\":%d,\"teapots\":%d,"
+				"\"lights\":%d,\"shadow\":\"%s\",\"depth\":\"%s\",\"reflection\":\"%s\",\"frames\":%d,"
+				"\"fps\":%.2f,\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"allocs_per_frame\":%.2f,"
+				"\"depth_px_per_frame\":%.0f}%s\n", c.Sweep, c.Width, c.Height, c.Mirrors, c.Teapots, c.Lights,
+				ShadowName(c.Shadow), DepthName(c.Depth), ReflectionName(c.Reflection), r.Frames, r.Fps,
+				r.MedianMs, r.P99Ms, r.AllocationsPerFrame, r.DepthPixelsPerFrame, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(file, "]\n");
+		return fclose(file) == 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "benchmark.csv";
+	int frames = argc > 2 ? std::max(1, atoi(argv[2])) : 120;
+	int threads = argc > 3 ? atoi(argv[3]) : 0;
+
+	SimulationScript = Script;
+	MirroBudget.MaxMilliseconds = 1.0e9f;   // the triangle limit alone keeps the work the same
+	ReflectionClip = REFLECTION_CLIP_PLANE;    // the software device clips in world space
+#if D3D_PROFILE
+	d3d::SetProfileOutput(Quiet);
+#endif
+
+	std::vector<BenchConfig> suite = MakeSuite();
+	std::vector<BenchResult> results;
+
+	printf("%-10s %9s %7s %7s %6s %6s %6s %7s %8s %8s %8s %9s\n", "sweep", "size", "mirrors", "teapots",
+		"lights", "shadow", "depth", "fps", "p50 ms", "p99 ms", "allocs", "depth px");
+	for (size_t i = 0; i < suite.size(); ++i)
+	{
+		const BenchConfig& c = suite[i];
+		BenchResult r;
+		if (!Run(c, frames, threads, &r))
+		{
+			printf("%-10s Setup() - FAILED\n", c.Sweep);
+			continue;
+		}
+		results.push_back(r);
+
+		char size[32];
+		sprintf(size, "%dx%d", c.Width, c.Height);
+		printf("%-10s %9s %7d %7d %6d %6s %6s %7.1f %8.3f %8.3f %8.1f %9.0f\n", c.Sweep, size, c.Mirrors,
+			c.Teapots, c.Lights, ShadowName(c.Shadow), DepthName(c.Depth), r.Fps, r.MedianMs, r.P99Ms,
+			r.AllocationsPerFrame, r.DepthPixelsPerFrame);
+		fflush(stdout);
+	}
+
+	size_t length = strlen(output);
+	bool json = length >= 5 && strcmp(output + length - 5, ".json") == 0;
+	if (!(json ? WriteJson(output, results) : WriteCsv(output, results)))
+	{
+		printf("could not write %s\n", output);
+		return 1;
+	}
+	return results.size() == suite.size() ? 0 : 1;
+}
@@ -0,0 +1,321 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dCompat.cpp
+//
+// Desc: Portable implementations of the D3DX math functions declared in d3dCompat.h.  On
+//       Windows the real D3DX library is linked instead and this file compiles to nothing.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "d3dCompat.h"
+#include <algorithm>
+
+#ifndef _WIN32
+
+D3DXMATRIX::D3DXMATRIX(
+	float f11, float f12, float f13, float f14,
+	float f21, float f22, float f23, float f24,
+	float f31, float f32, float f33, float f34,
+	float f41, float f42, float f43, float f44)
+{
+	_11 = f11; _12 = f12; _13 = f13; _14 = f14;
+	_21 = f21; _22 = f22; _23 = f23; _24 = f24;
+	_31 = f31; _32 = f32; _33 = f33; _34 = f34;
+	_41 = f41; _42 = f42; _43 = f43; _44 = f44;
+}
+
+D3DXMATRIX D3DXMATRIX::operator*(const D3DXMATRIX& mat) const
+{
+	D3DXMATRIX out;
+	D3DXMatrixMultiply(&out, this, &mat);
+	return out;
+}
+
+D3DXMATRIX& D3DXMATRIX::operator*=(const D3DXMATRIX& mat)
+{
+	D3DXMatrixMultiply(this, this, &mat);
+	return *this;
+}
+
+D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX* pOut)
+{
+	*pOut = D3DXMATRIX(
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f);
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixMultiply(D3DXMATRIX* pOut, const D3DXMATRIX* pM1, const D3DXMATRIX* pM2)
+{
+	D3DXMATRIX r;
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			r.m[i][j] =
+				pM1->m[i][0] * pM2->m[0][j] +
+				pM1->m[i][1] * pM2->m[1][j] +
+				pM1->m[i][2] * pM2->m[2][j] +
+				pM1->m[i][3] * pM2->m[3][j];
+		}
+	}
+	*pOut = r;
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX* pOut, float x, float y, float z)
+{
+	D3DXMatrixIdentity(pOut);
+	pOut->_41 = x;
+	pOut->_42 = y;
+	pOut->_43 = z;
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixScaling(D3DXMATRIX* pOut, float sx, float sy, float sz)
+{
+	D3DXMatrixIdentity(pOut);
+	pOut->_11 = sx;
+	pOut->_22 = sy;
+	pOut->_33 = sz;
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixRotationY(D3DXMATRIX* pOut, float angle)
+{
+	float s = sinf(angle);
+	float c = cosf(angle);
+	D3DXMatrixIdentity(pOut);
+	pOut->_11 = c;
+	pOut->_13 = -s;
+	pOut->_31 = s;
+	pOut->_33 = c;
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixTranspose(D3DXMATRIX* pOut, const D3DXMATRIX* pM)
+{
+	D3DXMATRIX r;
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			r.m[i][j] = pM->m[j][i];
+	*pOut = r;
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixInverse(D3DXMATRIX* pOut, float* pDeterminant, const D3DXMATRIX* pM)
+{
+	const float* a = &pM->_11;
+	float inv[16];
+
+	inv[0]  =  a[5]*a[10]*a[15] - a[5]*a[11]*a[14] - a[9]*a[6]*a[15] + a[9]*a[7]*a[14] + a[13]*a[6]*a[11] - a[13]*a[7]*a[10];
+	inv[4]  = -a[4]*a[10]*a[15] + a[4]*a[11]*a[14] + a[8]*a[6]*a[15] - a[8]*a[7]*a[14] - a[12]*a[6]*a[11] + a[12]*a[7]*a[10];
+	inv[8]  =  a[4]*a[9]*a[15]  - a[4]*a[11]*a[13] - a[8]*a[5]*a[15] + a[8]*a[7]*a[13] + a[12]*a[5]*a[11] - a[12]*a[7]*a[9];
+	inv[12] = -a[4]*a[9]*a[14]  + a[4]*a[10]*a[13] + a[8]*a[5]*a[14] - a[8]*a[6]*a[13] - a[12]*a[5]*a[10] + a[12]*a[6]*a[9];
+	inv[1]  = -a[1]*a[10]*a[15] + a[1]*a[11]*a[14] + a[9]*a[2]*a[15] - a[9]*a[3]*a[14] - a[13]*a[2]*a[11] + a[13]*a[3]*a[10];
+	inv[5]  =  a[0]*a[10]*a[15] - a[0]*a[11]*a[14] - a[8]*a[2]*a[15] + a[8]*a[3]*a[14] + a[12]*a[2]*a[11] - a[12]*a[3]*a[10];
+	inv[9]  = -a[0]*a[9]*a[15]  + a[0]*a[11]*a[13] + a[8]*a[1]*a[15] - a[8]*a[3]*a[13] - a[12]*a[1]*a[11] + a[12]*a[3]*a[9];
+	inv[13] =  a[0]*a[9]*a[14]  - a[0]*a[10]*a[13] - a[8]*a[1]*a[14] + a[8]*a[2]*a[13] + a[12]*a[1]*a[10] - a[12]*a[2]*a[9];
+	inv[2]  =  a[1]*a[6]*a[15]  - a[1]*a[7]*a[14]  - a[5]*a[2]*a[15] + a[5]*a[3]*a[14] + a[13]*a[2]*a[7]  - a[13]*a[3]*a[6];
+	inv[6]  = -a[0]*a[6]*a[15]  + a[0]*a[7]*a[14]  + a[4]*a[2]*a[15] - a[4]*a[3]*a[14] - a[12]*a[2]*a[7]  + a[12]*a[3]*a[6];
+	inv[10] =  a[0]*a[5]*a[15]  - a[0]*a[7]*a[13]  - a[4]*a[1]*a[15] + a[4]*a[3]*a[13] + a[12]*a[1]*a[7]  - a[12]*a[3]*a[5];
+	inv[14] = -a[0]*a[5]*a[14]  + a[0]*a[6]*a[13]  + a[4]*a[1]*a[14] - a[4]*a[2]*a[13] - a[12]*a[1]*a[6]  + a[12]*a[2]*a[5];
+	inv[3]  = -a[1]*a[6]*a[11]  + a[1]*a[7]*a[10]  + a[5]*a[2]*a[11] - a[5]*a[3]*a[10] - a[9]*a[2]*a[7]   + a[9]*a[3]*a[6];
+	inv[7]  =  a[0]*a[6]*a[11]  - a[0]*a[7]*a[10]  - a[4]*a[2]*a[11] + a[4]*a[3]*a[10] + a[8]*a[2]*a[7]   - a[8]*a[3]*a[6];
+	inv[11] = -a[0]*a[5]*a[11]  + a[0]*a[7]*a[9]   + a[4]*a[1]*a[11] - a[4]*a[3]*a[9]  - a[8]*a[1]*a[7]   + a[8]*a[3]*a[5];
+	inv[15] =  a[0]*a[5]*a[10]  - a[0]*a[6]*a[9]   - a[4]*a[1]*a[10] + a[4]*a[2]*a[9]  + a[8]*a[1]*a[6]   - a[8]*a[2]*a[5];
+
+	float det = a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12];
+	if (pDeterminant)
+		*pDeterminant = det;
+	if (det == 0.0f)
+		return 0;
+
+	float invDet = 1.0f / det;
+	float* o = &pOut->_11;
+	for (int i = 0; i < 16; ++i)
+		o[i] = inv[i] * invDet;
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixReflect(D3DXMATRIX* pOut, const D3DXPLANE* pPlane)
+{
+	D3DXPLANE p;
+	D3DXPlaneNormalize(&p, pPlane);
+
+	*pOut = D3DXMATRIX(
+		-2.0f * p.a * p.a + 1.0f, -2.0f * p.b * p.a,        -2.0f * p.c * p.a,        0.0f,
+		-2.0f * p.a * p.b,        -2.0f * p.b * p.b + 1.0f, -2.0f * p.c * p.b,        0.0f,
+		-2.0f * p.a * p.c,        -2.0f * p.b * p.c,        -2.0f * p.c * p.c + 1.0f, 0.0f,
+		-2.0f * p.a * p.d,        -2.0f * p.b * p.d,        -2.0f * p.c * p.d,        1.0f);
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixShadow(D3DXMATRIX* pOut, const D3DXVECTOR4* pLight, const D3DXPLANE* pPlane)
+{
+	D3DXPLANE p;
+	D3DXPlaneNormalize(&p, pPlane);
+	const D3DXVECTOR4& l = *pLight;
+	float d = p.a * l.x + p.b * l.y + p.c * l.z + p.d * l.w;
+
+	*pOut = D3DXMATRIX(
+		-p.a * l.x + d, -p.a * l.y,     -p.a * l.z,     -p.a * l.w,
+		-p.b * l.x,     -p.b * l.y + d, -p.b * l.z,     -p.b * l.w,
+		-p.c * l.x,     -p.c * l.y,     -p.c * l.z + d, -p.c * l.w,
+		-p.d * l.x,     -p.d * l.y,     -p.d * l.z,     -p.d * l.w + d);
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX* pOut,
+	const D3DXVECTOR3* pEye, const D3DXVECTOR3* pAt, const D3DXVECTOR3* pUp)
+{
+	D3DXVECTOR3 zaxis = *pAt - *pEye;
+	D3DXVec3Normalize(&zaxis, &zaxis);
+	D3DXVECTOR3 xaxis;
+	D3DXVec3Cross(&xaxis, pUp, &zaxis);
+	D3DXVec3Normalize(&xaxis, &xaxis);
+	D3DXVECTOR3 yaxis;
+	D3DXVec3Cross(&yaxis, &zaxis, &xaxis);
+
+	*pOut = D3DXMATRIX(
+		xaxis.x, yaxis.x, zaxis.x, 0.0f,
+		xaxis.y, yaxis.y, zaxis.y, 0.0f,
+		xaxis.z, yaxis.z, zaxis.z, 0.0f,
+		-D3DXVec3Dot(&xaxis, pEye), -D3DXVec3Dot(&yaxis, pEye), -D3DXVec3Dot(&zaxis, pEye), 1.0f);
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixPerspectiveFovLH(D3DXMATRIX* pOut,
+	float fovy, float aspect, float zn, float zf)
+{
+	float yScale = 1.0f / tanf(fovy * 0.5f);
+	float xScale = yScale / aspect;
+
+	*pOut = D3DXMATRIX(
+		xScale, 0.0f,   0.0f,                   0.0f,
+		0.0f,   yScale, 0.0f,                   0.0f,
+		0.0f,   0.0f,   zf / (zf - zn),         1.0f,
+		0.0f,   0.0f,   -zn * zf / (zf - zn),   0.0f);
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixPerspectiveOffCenterLH(D3DXMATRIX* pOut,
+	float l, float r, float b, float t, float zn, float zf)
+{
+	*pOut = D3DXMATRIX(
+		2.0f * zn / (r - l),  0.0f,                 0.0f,                   0.0f,
+		0.0f,                 2.0f * zn / (t - b),  0.0f,                   0.0f,
+		(l + r) / (l - r),    (t + b) / (b - t),    zf / (zf - zn),         1.0f,
+		0.0f,                 0.0f,                 -zn * zf / (zf - zn),   0.0f);
+	return pOut;
+}
+
+D3DXMATRIX* D3DXMatrixOrthoOffCenterLH(D3DXMATRIX* pOut,
+	float l, float r, float b, float t, float zn, float zf)
+{
+	*pOut = D3DXMATRIX(
+		2.0f / (r - l),       0.0f,                 0.0f,                   0.0f,
+		0.0f,                 2.0f / (t - b),       0.0f,                   0.0f,
+		0.0f,                 0.0f,                 1.0f / (zf - zn),       0.0f,
+		(l + r) / (l - r),    (t + b) / (b - t),    zn / (zn - zf),         1.0f);
+	return pOut;
+}
+
+D3DXPLANE* D3DXPlaneNormalize(D3DXPLANE* pOut, const D3DXPLANE* pP)
+{
+	float len = sqrtf(pP->a * pP->a + pP->b * pP->b + pP->c * pP->c);
+	float inv = len > 0.0f ? 1.0f / len : 0.0f;
+	*pOut = D3DXPLANE(pP->a * inv, pP->b * inv, pP->c * inv, pP->d * inv);
+	return pOut;
+}
+
+D3DXPLANE* D3DXPlaneFromPointNormal(D3DXPLANE* pOut, const D3DXVECTOR3* pPoint, const D3DXVECTOR3* pNormal)
+{
+	*pOut = D3DXPLANE(pNormal->x, pNormal->y, pNormal->z, -D3DXVec3Dot(pPoint, pNormal));
+	return pOut;
+}
+
+D3DXPLANE* D3DXPlaneFromPoints(D3DXPLANE* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2, const D3DXVECTOR3* pV3)
+{
+	D3DXVECTOR3 e1 = *pV2 - *pV1, e2 = *pV3 - *pV1, n;
+	D3DXVec3Cross(&n, &e1, &e2);
+	D3DXVec3Normalize(&n, &n);
+	return D3DXPlaneFromPointNormal(pOut, pV1, &n);
+}
+
+D3DXPLANE* D3DXPlaneTransform(D3DXPLANE* pOut, const D3DXPLANE* pP, const D3DXMATRIX* pM)
+{
+	D3DXPLANE p = *pP;
+	*pOut = D3DXPLANE(
+		p.a * pM->_11 + p.b * pM->_21 + p.c * pM->_31 + p.d * pM->_41,
+		p.a * pM->_12 + p.b * pM->_22 + p.c * pM->_32 + p.d * pM->_42,
+		p.a * pM->_13 + p.b * pM->_23 + p.c * pM->_33 + p.d * pM->_43,
+		p.a * pM->_14 + p.b * pM->_24 + p.c * pM->_34 + p.d * pM->_44);
+	return pOut;
+}
+
+D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV)
+{
+	float len = D3DXVec3Length(pV);
+	float inv = len > 0.0f ? 1.0f / len : 0.0f;
+	*pOut = D3DXVECTOR3(pV->x * inv, pV->y * inv, pV->z * inv);
+	return pOut;
+}
+
+D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2)
+{
+	*pOut = D3DXVECTOR3(
+		pV1->y * pV2->z - pV1->z * pV2->y,
+		pV1->z * pV2->x - pV1->x * pV2->z,
+		pV1->x * pV2->y - pV1->y * pV2->x);
+	return pOut;
+}
+
+D3DXVECTOR3* D3DXVec3TransformCoord(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV, const D3DXMATRIX* pM)
+{
+	float x = pV->x * pM->_11 + pV->y * pM->_21 + pV->z * pM->_31 + pM->_41;
+	float y = pV->x * pM->_12 + pV->y * pM->_22 + pV->z * pM->_32 + pM->_42;
+	float z = pV->x * pM->_13 + pV->y * pM->_23 + pV->z * pM->_33 + pM->_43;
+	float w = pV->x * pM->_14 + pV->y * pM->_24 + pV->z * pM->_34 + pM->_44;
+	float inv = w != 0.0f ? 1.0f / w : 0.0f;
+	*pOut = D3DXVECTOR3(x * inv, y * inv, z * inv);
+	return pOut;
+}
+
+D3DXVECTOR3* D3DXVec3TransformNormal(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV, const D3DXMATRIX* pM)
+{
+	*pOut = D3DXVECTOR3(
+		pV->x * pM->_11 + pV->y * pM->_21 + pV->z * pM->_31,
+		pV->x * pM->_12 + pV->y * pM->_22 + pV->z * pM->_32,
+		pV->x * pM->_13 + pV->y * pM->_23 + pV->z * pM->_33);
+	return pOut;
+}
+
+HRESULT D3DXComputeBoundingSphere(const D3DXVECTOR3* pFirstPosition, DWORD NumVertices,
+	DWORD dwStride, D3DXVECTOR3* pCenter, float* pRadius)
+{
+	if (!pFirstPosition || !pCenter || !pRadius)
+		return E_FAIL;
+
+	const unsigned char* p = (const unsigned char*)pFirstPosition;
+	D3DXVECTOR3 center(0.0f, 0.0f, 0.0f);
+	for (DWORD i = 0; i < NumVertices; ++i)
+		center += *(const D3DXVECTOR3*)(p + i * dwStride);
+	if (NumVertices > 0)
+		center *= 1.0f / NumVertices;
+
+	float radius = 0.0f;
+	for (DWORD i = 0; i < NumVertices; ++i)
+	{
+		D3DXVECTOR3 d = *(const D3DXVECTOR3*)(p + i * dwStride) - center;
+		radius = std::max(radius, D3DXVec3Length(&d));
+	}
+
+	*pCenter = center;
+	*pRadius = radius;
+	return S_OK;
+}
+
+#endif // _WIN32
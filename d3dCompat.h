@@ -0,0 +1,446 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dCompat.h
+//
+// Desc: Pulls in <d3dx9.h> on Windows.  Everywhere else it declares the small subset of the
+//       Direct3D 9 / D3DX types, enums and math functions the demo uses, with the same names,
+//       layouts and values, so the scene code and the software device build on machines
+//       without the DirectX SDK (e.g. headless Linux boxes).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __d3dCompatH__
+#define __d3dCompatH__
+
+#ifdef _WIN32
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <d3dx9.h>
+
+#else
+
+#include <cstring>
+#include <cmath>
+
+typedef unsigned int   DWORD;  // 32 bits, as on Windows
+typedef unsigned short WORD;
+typedef unsigned char  BYTE;
+typedef unsigned int   UINT;
+typedef int            INT;
+typedef int            BOOL;
+typedef long           HRESULT;
+typedef DWORD          D3DCOLOR;
+
+#define ZeroMemory(p, n) memset((p), 0, (n))
+
+#define D3D_OK 0L
+#define SUCCEEDED(hr) ((HRESULT)(hr) >= 0)
+#define FAILED(hr)    ((HRESULT)(hr) < 0)
+#define S_OK          ((HRESULT)0L)
+#define E_FAIL        ((HRESULT)(int)0x80004005)
+
+#define D3DCOLOR_ARGB(a,r,g,b) \
+	((D3DCOLOR)((((a)&0xff)<<24)|(((r)&0xff)<<16)|(((g)&0xff)<<8)|((b)&0xff)))
+#define D3DCOLOR_XRGB(r,g,b) D3DCOLOR_ARGB(0xff,r,g,b)
+
+#define D3DX_PI ((float)3.141592654f)
+
+//
+// Enums (values match d3d9types.h)
+//
+
+enum D3DRENDERSTATETYPE
+{
+	D3DRS_ZENABLE               = 7,
+	D3DRS_FILLMODE              = 8,
+	D3DRS_SHADEMODE             = 9,
+	D3DRS_ZWRITEENABLE          = 14,
+	D3DRS_ALPHATESTENABLE       = 15,
+	D3DRS_SRCBLEND              = 19,
+	D3DRS_DESTBLEND             = 20,
+	D3DRS_CULLMODE              = 22,
+	D3DRS_ZFUNC                 = 23,
+	D3DRS_ALPHAREF              = 24,
+	D3DRS_ALPHAFUNC             = 25,
+	D3DRS_DITHERENABLE          = 26,
+	D3DRS_ALPHABLENDENABLE      = 27,
+	D3DRS_FOGENABLE             = 28,
+	D3DRS_SPECULARENABLE        = 29,
+	D3DRS_STENCILENABLE         = 52,
+	D3DRS_STENCILFAIL           = 53,
+	D3DRS_STENCILZFAIL          = 54,
+	D3DRS_STENCILPASS           = 55,
+	D3DRS_STENCILFUNC           = 56,
+	D3DRS_STENCILREF            = 57,
+	D3DRS_STENCILMASK           = 58,
+	D3DRS_STENCILWRITEMASK      = 59,
+	D3DRS_TEXTUREFACTOR         = 60,
+	D3DRS_CLIPPING              = 136,
+	D3DRS_LIGHTING              = 137,
+	D3DRS_AMBIENT               = 139,
+	D3DRS_COLORVERTEX           = 141,
+	D3DRS_LOCALVIEWER           = 142,
+	D3DRS_NORMALIZENORMALS      = 143,
+	D3DRS_CLIPPLANEENABLE       = 152,
+	D3DRS_COLORWRITEENABLE      = 168,
+	D3DRS_BLENDOP               = 171,
+	D3DRS_TWOSIDEDSTENCILMODE   = 185,
+	D3DRS_CCW_STENCILFAIL       = 186,
+	D3DRS_CCW_STENCILZFAIL      = 187,
+	D3DRS_CCW_STENCILPASS       = 188,
+	D3DRS_CCW_STENCILFUNC       = 189,
+
+	D3DRS_FORCE_DWORD           = 0x7fffffff
+};
+
+enum D3DCMPFUNC
+{
+	D3DCMP_NEVER        = 1,
+	D3DCMP_LESS         = 2,
+	D3DCMP_EQUAL        = 3,
+	D3DCMP_LESSEQUAL    = 4,
+	D3DCMP_GREATER      = 5,
+	D3DCMP_NOTEQUAL     = 6,
+	D3DCMP_GREATEREQUAL = 7,
+	D3DCMP_ALWAYS       = 8,
+	D3DCMP_FORCE_DWORD  = 0x7fffffff
+};
+
+enum D3DSTENCILOP
+{
+	D3DSTENCILOP_KEEP        = 1,
+	D3DSTENCILOP_ZERO        = 2,
+	D3DSTENCILOP_REPLACE     = 3,
+	D3DSTENCILOP_INCRSAT     = 4,
+	D3DSTENCILOP_DECRSAT     = 5,
+	D3DSTENCILOP_INVERT      = 6,
+	D3DSTENCILOP_INCR        = 7,
+	D3DSTENCILOP_DECR        = 8,
+	D3DSTENCILOP_FORCE_DWORD = 0x7fffffff
+};
+
+enum D3DBLEND
+{
+	D3DBLEND_ZERO         = 1,
+	D3DBLEND_ONE          = 2,
+	D3DBLEND_SRCCOLOR     = 3,
+	D3DBLEND_INVSRCCOLOR  = 4,
+	D3DBLEND_SRCALPHA     = 5,
+	D3DBLEND_INVSRCALPHA  = 6,
+	D3DBLEND_DESTALPHA    = 7,
+	D3DBLEND_INVDESTALPHA = 8,
+	D3DBLEND_DESTCOLOR    = 9,
+	D3DBLEND_INVDESTCOLOR = 10,
+	D3DBLEND_FORCE_DWORD  = 0x7fffffff
+};
+
+enum D3DCULL
+{
+	D3DCULL_NONE        = 1,
+	D3DCULL_CW          = 2,
+	D3DCULL_CCW         = 3,
+	D3DCULL_FORCE_DWORD = 0x7fffffff
+};
+
+enum D3DZBUFFERTYPE
+{
+	D3DZB_FALSE = 0,
+	D3DZB_TRUE  = 1
+};
+
+enum D3DTRANSFORMSTATETYPE
+{
+	D3DTS_VIEW        = 2,
+	D3DTS_PROJECTION  = 3,
+	D3DTS_WORLD       = 256,
+	D3DTS_FORCE_DWORD = 0x7fffffff
+};
+
+enum D3DSAMPLERSTATETYPE
+{
+	D3DSAMP_ADDRESSU    = 1,
+	D3DSAMP_ADDRESSV    = 2,
+	D3DSAMP_MAGFILTER   = 5,
+	D3DSAMP_MINFILTER   = 6,
+	D3DSAMP_MIPFILTER   = 7,
+	D3DSAMP_FORCE_DWORD = 0x7fffffff
+};
+
+enum D3DTEXTUREFILTERTYPE
+{
+	D3DTEXF_NONE        = 0,
+	D3DTEXF_POINT       = 1,
+	D3DTEXF_LINEAR      = 2,
+	D3DTEXF_FORCE_DWORD = 0x7fffffff
+};
+
+enum D3DPRIMITIVETYPE
+{
+	D3DPT_POINTLIST     = 1,
+	D3DPT_LINELIST      = 2,
+	D3DPT_LINESTRIP     = 3,
+	D3DPT_TRIANGLELIST  = 4,
+	D3DPT_TRIANGLESTRIP = 5,
+	D3DPT_TRIANGLEFAN   = 6,
+	D3DPT_FORCE_DWORD   = 0x7fffffff
+};
+
+enum D3DLIGHTTYPE
+{
+	D3DLIGHT_POINT       = 1,
+	D3DLIGHT_SPOT        = 2,
+	D3DLIGHT_DIRECTIONAL = 3,
+	D3DLIGHT_FORCE_DWORD = 0x7fffffff
+};
+
+enum D3DFORMAT
+{
+	D3DFMT_UNKNOWN  = 0,
+	D3DFMT_A8R8G8B8 = 21,
+	D3DFMT_X8R8G8B8 = 22,
+	D3DFMT_A8B8G8R8 = 32,
+	D3DFMT_X8B8G8R8 = 33,
+	D3DFMT_D24S8    = 75,
+	D3DFMT_D16      = 80,
+	D3DFMT_INDEX16  = 101,
+	D3DFMT_DXT1     = 0x31545844,
+	D3DFMT_DXT5     = 0x35545844
+};
+
+#define D3DCLEAR_TARGET  0x00000001l
+#define D3DCLEAR_ZBUFFER 0x00000002l
+#define D3DCLEAR_STENCIL 0x00000004l
+
+#define D3DFVF_XYZ      0x002
+#define D3DFVF_NORMAL   0x010
+#define D3DFVF_DIFFUSE  0x040
+#define D3DFVF_TEX1     0x100
+
+#define D3DCLIPPLANE0 (1 << 0)
+
+#define D3DCOLORWRITEENABLE_RED   (1L<<0)
+#define D3DCOLORWRITEENABLE_GREEN (1L<<1)
+#define D3DCOLORWRITEENABLE_BLUE  (1L<<2)
+#define D3DCOLORWRITEENABLE_ALPHA (1L<<3)
+
+//
+// Plain structures (layouts match d3d9types.h)
+//
+
+struct D3DVECTOR
+{
+	float x, y, z;
+};
+
+struct D3DCOLORVALUE
+{
+	float r, g, b, a;
+};
+
+struct D3DRECT
+{
+	int x1, y1, x2, y2;
+};
+
+struct D3DMATRIX
+{
+	union
+	{
+		struct
+		{
+			float _11, _12, _13, _14;
+			float _21, _22, _23, _24;
+			float _31, _32, _33, _34;
+			float _41, _42, _43, _44;
+		};
+		float m[4][4];
+	};
+};
+
+struct D3DMATERIAL9
+{
+	D3DCOLORVALUE Diffuse;
+	D3DCOLORVALUE Ambient;
+	D3DCOLORVALUE Specular;
+	D3DCOLORVALUE Emissive;
+	float         Power;
+};
+
+struct D3DLIGHT9
+{
+	D3DLIGHTTYPE  Type;
+	D3DCOLORVALUE Diffuse;
+	D3DCOLORVALUE Specular;
+	D3DCOLORVALUE Ambient;
+	D3DVECTOR     Position;
+	D3DVECTOR     Direction;
+	float         Range;
+	float         Falloff;
+	float         Attenuation0;
+	float         Attenuation1;
+	float         Attenuation2;
+	float         Theta;
+	float         Phi;
+};
+
+//
+// D3DX subset
+//
+
+struct D3DXVECTOR3 : public D3DVECTOR
+{
+	D3DXVECTOR3() {}
+	D3DXVECTOR3(float fx, float fy, float fz) { x = fx; y = fy; z = fz; }
+
+	D3DXVECTOR3 operator+(const D3DXVECTOR3& v) const { return D3DXVECTOR3(x + v.x, y + v.y, z + v.z); }
+	D3DXVECTOR3 operator-(const D3DXVECTOR3& v) const { return D3DXVECTOR3(x - v.x, y - v.y, z - v.z); }
+	D3DXVECTOR3 operator*(float f) const { return D3DXVECTOR3(x * f, y * f, z * f); }
+	D3DXVECTOR3 operator-() const { return D3DXVECTOR3(-x, -y, -z); }
+	D3DXVECTOR3& operator+=(const D3DXVECTOR3& v) { x += v.x; y += v.y; z += v.z; return *this; }
+	D3DXVECTOR3& operator-=(const D3DXVECTOR3& v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+	D3DXVECTOR3& operator*=(float f) { x *= f; y *= f; z *= f; return *this; }
+	bool operator==(const D3DXVECTOR3& v) const { return x == v.x && y == v.y && z == v.z; }
+	bool operator!=(const D3DXVECTOR3& v) const { return !(*this == v); }
+};
+
+struct D3DXVECTOR4
+{
+	D3DXVECTOR4() {}
+	D3DXVECTOR4(float fx, float fy, float fz, float fw) { x = fx; y = fy; z = fz; w = fw; }
+
+	float x, y, z, w;
+};
+
+struct D3DXPLANE
+{
+	D3DXPLANE() {}
+	D3DXPLANE(float fa, float fb, float fc, float fd) { a = fa; b = fb; c = fc; d = fd; }
+
+	D3DXPLANE operator-() const { return D3DXPLANE(-a, -b, -c, -d); }
+
+	bool operator==(const D3DXPLANE& p) const { return a == p.a && b == p.b && c == p.c && d == p.d; }
+	bool operator!=(const D3DXPLANE& p) const { return !(*this == p); }
+
+	float a, b, c, d;
+};
+
+struct D3DXCOLOR
+{
+	D3DXCOLOR() {}
+	D3DXCOLOR(DWORD argb)
+	{
+		const float f = 1.0f / 255.0f;
+		r = f * (float)(unsigned char)(argb >> 16);
+		g = f * (float)(unsigned char)(argb >> 8);
+		b = f * (float)(unsigned char)(argb >> 0);
+		a = f * (float)(unsigned char)(argb >> 24);
+	}
+	D3DXCOLOR(float fr, float fg, float fb, float fa) { r = fr; g = fg; b = fb; a = fa; }
+	D3DXCOLOR(const D3DCOLORVALUE& c) { r = c.r; g = c.g; b = c.b; a = c.a; }
+
+	operator D3DCOLORVALUE&() { return *(D3DCOLORVALUE*)&r; }
+	operator const D3DCOLORVALUE&() const { return *(const D3DCOLORVALUE*)&r; }
+
+	D3DXCOLOR operator*(float f) const { return D3DXCOLOR(r * f, g * f, b * f, a * f); }
+	D3DXCOLOR operator+(const D3DXCOLOR& c) const { return D3DXCOLOR(r + c.r, g + c.g, b + c.b, a + c.a); }
+
+	float r, g, b, a;
+};
+
+struct D3DXMATRIX : public D3DMATRIX
+{
+	D3DXMATRIX() {}
+	D3DXMATRIX(const D3DMATRIX& mat) { memcpy(&_11, &mat, sizeof(D3DMATRIX)); }
+	D3DXMATRIX(
+		float f11, float f12, float f13, float f14,
+		float f21, float f22, float f23, float f24,
+		float f31, float f32, float f33, float f34,
+		float f41, float f42, float f43, float f44);
+
+	float& operator()(UINT row, UINT col) { return m[row][col]; }
+	float  operator()(UINT row, UINT col) const { return m[row][col]; }
+
+	D3DXMATRIX operator*(const D3DXMATRIX& mat) const;
+	D3DXMATRIX& operator*=(const D3DXMATRIX& mat);
+};
+
+D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX* pOut);
+D3DXMATRIX* D3DXMatrixMultiply(D3DXMATRIX* pOut, const D3DXMATRIX* pM1, const D3DXMATRIX* pM2);
+D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX* pOut, float x, float y, float z);
+D3DXMATRIX* D3DXMatrixScaling(D3DXMATRIX* pOut, float sx, float sy, float sz);
+D3DXMATRIX* D3DXMatrixRotationY(D3DXMATRIX* pOut, float angle);
+D3DXMATRIX* D3DXMatrixInverse(D3DXMATRIX* pOut, float* pDeterminant, const D3DXMATRIX* pM);
+D3DXMATRIX* D3DXMatrixTranspose(D3DXMATRIX* pOut, const D3DXMATRIX* pM);
+D3DXMATRIX* D3DXMatrixReflect(D3DXMATRIX* pOut, const D3DXPLANE* pPlane);
+D3DXMATRIX* D3DXMatrixShadow(D3DXMATRIX* pOut, const D3DXVECTOR4* pLight, const D3DXPLANE* pPlane);
+D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX* pOut,
+	const D3DXVECTOR3* pEye, const D3DXVECTOR3* pAt, const D3DXVECTOR3* pUp);
+D3DXMATRIX* D3DXMatrixPerspectiveFovLH(D3DXMATRIX* pOut,
+	float fovy, float aspect, float zn, float zf);
+D3DXMATRIX* D3DXMatrixPerspectiveOffCenterLH(D3DXMATRIX* pOut,
+	float l, float r, float b, float t, float zn, float zf);
+D3DXMATRIX* D3DXMatrixOrthoOffCenterLH(D3DXMATRIX* pOut,
+	float l, float r, float b, float t, float zn, float zf);
+
+D3DXPLANE*   D3DXPlaneNormalize(D3DXPLANE* pOut, const D3DXPLANE* pP);
+D3DXPLANE*   D3DXPlaneFromPointNormal(D3DXPLANE* pOut, const D3DXVECTOR3* pPoint, const D3DXVECTOR3* pNormal);
+D3DXPLANE*   D3DXPlaneFromPoints(D3DXPLANE* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2, const D3DXVECTOR3* pV3);
+D3DXPLANE*   D3DXPlaneTransform(D3DXPLANE* pOut, const D3DXPLANE* pP, const D3DXMATRIX* pM);
+
+D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV);
+D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2);
+D3DXVECTOR3* D3DXVec3TransformCoord(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV, const D3DXMATRIX* pM);
+D3DXVECTOR3* D3DXVec3TransformNormal(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV, const D3DXMATRIX* pM);
+
+HRESULT D3DXComputeBoundingSphere(const D3DXVECTOR3* pFirstPosition, DWORD NumVertices,
+	DWORD dwStride, D3DXVECTOR3* pCenter, float* pRadius);
+
+inline float D3DXVec3Dot(const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2)
+{
+	return pV1->x * pV2->x + pV1->y * pV2->y + pV1->z * pV2->z;
+}
+
+inline float D3DXVec3Length(const D3DXVECTOR3* pV)
+{
+	return sqrtf(D3DXVec3Dot(pV, pV));
+}
+
+inline D3DXVECTOR3* D3DXVec3Lerp(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2, float s)
+{
+	pOut->x = pV1->x + s * (pV2->x - pV1->x);
+	pOut->y = pV1->y + s * (pV2->y - pV1->y);
+	pOut->z = pV1->z + s * (pV2->z - pV1->z);
+	return pOut;
+}
+
+inline D3DXVECTOR3* D3DXVec3Minimize(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2)
+{
+	pOut->x = pV1->x < pV2->x ? pV1->x : pV2->x;
+	pOut->y = pV1->y < pV2->y ? pV1->y : pV2->y;
+	pOut->z = pV1->z < pV2->z ? pV1->z : pV2->z;
+	return pOut;
+}
+
+inline D3DXVECTOR3* D3DXVec3Maximize(D3DXVECTOR3* pOut, const D3DXVECTOR3* pV1, const D3DXVECTOR3* pV2)
+{
+	pOut->x = pV1->x > pV2->x ? pV1->x : pV2->x;
+	pOut->y = pV1->y > pV2->y ? pV1->y : pV2->y;
+	pOut->z = pV1->z > pV2->z ? pV1->z : pV2->z;
+	return pOut;
+}
+
+inline float D3DXPlaneDotCoord(const D3DXPLANE* pP, const D3DXVECTOR3* pV)
+{
+	return pP->a * pV->x + pP->b * pV->y + pP->c * pV->z + pP->d;
+}
+
+inline float D3DXPlaneDotNormal(const D3DXPLANE* pP, const D3DXVECTOR3* pV)
+{
+	return pP->a * pV->x + pP->b * pV->y + pP->c * pV->z;
+}
+
+#endif // _WIN32
+
+#endif // __d3dCompatH__
@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dHeadless.cpp
+//
+// Desc: Runs the demo scene on the software device without a window or a GPU and reports
+//       the frame rate.  The profiler's per second summary goes to stdout.
+//       Usage: d3dHeadless [frames] [threads] [output.bmp] [planar|volume|texture] [teapots] [trace.json]
+//                          [stencil|texture] [cull|nocull] [lod|nolod]
+//
+//       g++ -O2 -std=c++11 -pthread d3dHeadless.cpp d3dInit.cpp d3dUtility.cpp
+//           d3dCompat.cpp drawList.cpp frustum.cpp mirror.cpp renderDevice.cpp softDevice.cpp
+//           shadow.cpp shadowVolume.cpp stateCache.cpp taskPool.cpp
+//           simdMath.cpp staticMesh.cpp transformCache.cpp frameClock.cpp profiler.cpp
+//           image.cpp meshGeometry.cpp assetLoader.cpp dds.cpp mappedFile.cpp sceneFile.cpp
+//           commandBuffer.cpp bvh.cpp meshLod.cpp -o d3dHeadless
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "d3dInit.h"
+#include "frameClock.h"
+#include "profiler.h"
+#include "softDevice.h"
+#include "stateCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 1000;
+	int threads = argc > 2 ? atoi(argv[2]) : 0;
+	const char* output = argc > 3 ? argv[3] : "headless.bmp";
+	if (argc > 4 && strcmp(argv[4], "volume") == 0)
+		ShadowTechnique = SHADOW_VOLUME;
+	if (argc > 4 && strcmp(argv[4], "texture") == 0)
+		ShadowTechnique = SHADOW_TEXTURE;
+	if (argc > 5)
+		TeapotCount = std::max(1, atoi(argv[5]));
+	const char* trace = argc > 6 ? argv[6] : "";
+	if (argc > 7 && strcmp(argv[7], "texture") == 0)
+		ReflectionTechnique = REFLECTION_TEXTURE;
+	if (argc > 8 && strcmp(argv[8], "nocull") == 0)
+		ObjectCulling = false;
+	if (argc > 9 && strcmp(argv[9], "nolod") == 0)
+		LodPixelError = 0.0f;
+	ReflectionClip = REFLECTION_CLIP_PLANE;   // the software device clips in world space
+
+	RecordThreads = threads;
+	d3d::SoftwareDevice* soft = new d3d::SoftwareDevice(width, height, threads);
+	d3d::StateCache* cache = new d3d::StateCache(soft);
+	Device = cache;
+
+	double setupStart = d3d::GetTime();
+	if (!Setup())
+	{
+		printf("Setup() - FAILED\n");
+		return 1;
+	}
+	double setupEnd = d3d::GetTime();
+	WaitForAssets();   // render the loaded scene, not the placeholders
+	printf("setup %.1f ms, assets ready %.1f ms later\n", (setupEnd - setupStart) * 1000.0,
+		(d3d::GetTime() - setupEnd) * 1000.0);
+
+	double start = d3d::GetTime();
+	for (int i = 0; i < frames; ++i)
+		Display(1.0 / 60.0);
+	double seconds = d3d::GetTime() - start;
+
+	printf("%d frames in %.3f s (%.1f fps)\n", frames, seconds, seconds > 0.0 ? frames / seconds : 0.0);
+	const d3d::StateCacheStats& stats = cache->GetFrameStats();
+	printf("state calls per frame: %u forwarded, %u dropped\n",
+		(unsigned)stats.TotalForwarded(), (unsigned)stats.TotalDropped());
+	for (int i = 0; i < d3d::STATE_CATEGORY_COUNT; ++i)
+	{
+		printf("  %-12s %4u forwarded %4u dropped\n", d3d::GetStateCategoryName((d3d::StateCategory)i),
+			(unsigned)stats.forwarded[i], (unsigned)stats.dropped[i]);
+	}
+
+	printf("mirror depth reset: %.0f px written, %.0f px under the mirrors, %d px for a full clear\n",
+		MirroDepthPixels, MirroRegionPixels, width * height);
+	if (ReflectionTechnique == REFLECTION_TEXTURE)
+		printf("mirror textures redrawn in the last frame: %d\n", MirroTextureUpdates);
+	if (ShadowTechnique == SHADOW_TEXTURE)
+		printf("shadow textures redrawn in the last frame: %d\n", ShadowTextureUpdates);
+
+	if (output[0] && !soft->SaveBackBuffer(output))
+		printf("could not write %s\n", output);
+	if (trace[0] && !D3D_PROFILE_WRITE_TRACE(trace))
+		printf("could not write %s (profiler compiled out?)\n", trace);
+
+	CleanUp();
+	Device->Release();
+	return 0;
+}
@@ -12,34 +12,276 @@
 //          
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include "d3dInit.h"
 #include "d3dUtility.h"
-#include "cube.h"
+#include "stateCache.h"
+#include "mirror.h"
+#include "drawList.h"
+#include "transformCache.h"
+#include "shadow.h"
+#include "staticMesh.h"
+#include "meshLod.h"
+#include "shadowVolume.h"
+#include "frameClock.h"
+#include "profiler.h"
+#include "assetLoader.h"
+#include "sceneFile.h"
+#include "commandBuffer.h"
+#include "taskPool.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+#ifdef _WIN32
 #include<windows.h>
+#endif
 
 //
 // Globals
 //
 
-IDirect3DDevice9* Device = 0;
-const int width = 640;
-const int height = 480;
-IDirect3DVertexBuffer9* VB = 0;
-
-IDirect3DTexture9* wallTex = 0;
-IDirect3DTexture9* floorTex = 0;
-IDirect3DTexture9* mirroTex = 0;
-
-D3DMATERIAL9 FloorMt = d3d::WHITE_MTRL;
-D3DMATERIAL9 WallMt = d3d::WHITE_MTRL;
-D3DMATERIAL9 MirroMt = d3d::WHITE_MTRL;
-
-ID3DXMesh* Teapot = 0;
-D3DXVECTOR3 TeapotPosition(0.0f, 3.0f, -7.5f);
-D3DMATERIAL9 TeapotMt = d3d::YELLOW_MTRL;
+d3d::RenderDevice* Device = 0;
+int width = 640;
+int height = 480;
+//塢ʡӡӰ桢ԴӶƳļӳ
+//ļڻ汾ʱȴıļת
+const char* SceneFile = "room.scb";
+const char* SceneSource = "room.scn";
+
+d3d::StaticMesh* Room = 0;         //ذǽӺ壬ÿֲһλ
+std::vector<int> RoomItems;        //̬ÿΧڻбһ
+d3d::VertexBuffer* MirroVB = 0;
+std::vector<d3d::Mesh*> SceneMeshes;
+
+//ϸڲΣÿغں̨򻯳ԽԽֵÿ׶ѡͶӰĻϲ
+//LodPixelErrorصһʱı仯ôأƫÿ1һ
+std::vector<int> SceneLodAssets;   //ÿһں̨򻯣֮ǰSceneMeshes
+float LodPixelError = 1.0f;
+float SceneLodBias = 0.0f;
+float ReflectionLodBias = 1.0f;
+float ShadowLodBias = 1.0f;
+//ÿӽǼסһ֡ÿһѡļݲһŻͣٽ紦岻ÿ֡
+//ÿʷͬʱֻһ߳
+d3d::LodHistory SceneLodHistory;
+d3d::LodHistory ShadowLodHistory;                      //нƽӰãȾ߳ѡ
+std::vector<d3d::LodHistory> ShadowTextureLodHistories; //ÿӰͼһ
+std::vector<d3d::LodHistory> MirrorLodHistories;        //ÿ澵һģ巴ͷͼ
+std::map<unsigned long long, d3d::LodHistory> NestedLodHistories; //еľӣ⵽ﾭľ
+
+//ļĲʣÿʵͼԴûͼΪ-1
+std::vector<D3DMATERIAL9> Materials;
+std::vector<int> MaterialAssets;
+D3DMATERIAL9 MirroMt = d3d::WHITE_MTRL; //оӶõһ澵ӵĲ
+int MirroAsset = -1;
+d3d::Texture* mirroTex = 0;
+
+//ͼɺ̶̨߳ȡ룬֮ǰõɫռλͼ
+d3d::AssetLoader Assets;
+UINT AssetUploadBudget = 256 * 1024;
+//ͼһμʱѹɴmipmapDXT1/DXT5 DDSĿ¼ֱ֮ӳ仺ļٽJPEG
+const char* TextureCacheDirectory = "texcache";
+
+d3d::Mesh* Teapot = 0;             //ļĵһʵ
+D3DXVECTOR3 TeapotPosition;
+d3d::SceneCamera Camera;
+
+//ĲСľ̬һŷڵذ
+int TeapotCount = 1;
+const int TeapotColumns = 19;
+const float TeapotCopyScale = 0.2f;
+const float TeapotCopySpacing = 0.75f;
+std::vector<std::vector<d3d::MeshInstance> > ShadowInstances; //ÿһһԴͶӰӰ
+
+//ƽӰԴ x  x ͶӰ壬ֻƶ¼
+d3d::PlanarShadows Shadows;
+int TeapotCaster = 0;
+
+//ӰͼÿӰһڽϵͼԴͶӰ嶼ûʱһֱ
+//ÿֻ֡ͼ˵ϣһһλ
+UINT ShadowTextureSize = 1024;
+struct ShadowTexture
+{
+	d3d::Texture* Target;    //һõʱŴ
+	D3DXMATRIX View, Proj;   //Խ
+	UINT FirstVertex;        //ReceiverVBλ
+	UINT NumTriangles;
+	bool Valid;              //һ֮Ϊtrue
+	DWORD Version;           //ʱPlanarShadows::GetVersionֵ
+};
+std::vector<ShadowTexture> ShadowTextures;
+d3d::VertexBuffer* ReceiverVB = 0;  //ΣuvӰͼϵ
+std::vector<int> ShadowUpdates;     //һ֡ҪػͼĽ
+int ShadowTextureUpdates = 0;
+D3DMATERIAL9 TextureColorMt = d3d::InitMtrl(d3d::BLACK, d3d::BLACK, d3d::BLACK, d3d::WHITE, 0.0f); //ɫͼ
+
+//Ӱ壺ÿԴһֻڹԴԲƶ
+ShadowMode ShadowTechnique = SHADOW_PLANAR;
+std::vector<d3d::ShadowVolume*> TeapotVolumes;
+const float VolumeExtrude = 25.0f; //ȷĶԽ߳ԶķԶü֮ڣԽԽ
+d3d::VertexBuffer* ScreenVB = 0;   //ĻľΣüռ
+
+//ֻ¼һΣ÷طţƶʱֻ
+d3d::DrawList SceneList;
+int TeapotItem = 0;
+
+//޳׶壬͸濴ķ׶壬ӰóԴɨ׶
+//ÿ֡Ⱦ߳ã¼ֻ߳
+bool ObjectCulling = true;
+d3d::CullVolume ViewVolume;
+std::vector<d3d::CullVolume> MirrorVolumes;      //ÿ澵һֻпɼľһ֡
+std::vector<std::vector<char> > ShadowVisible;   //ÿԴһбЩӰ׶
+std::vector<int> CasterItems;                    //ÿͶӰڻбλ
+
+//λáûб仯ʱTT*R͹۲һεĽ
+d3d::TransformCache Transforms;
+int TeapotObject = 0;
+int RoomObject = 0; //ذǽΪλ
+
+D3DXMATRIX View;
+D3DXMATRIX Proj;
+D3DXMATRIX ViewProj;
+D3DXMATRIX FarProj; //жͶӰԶƽ棬
+D3DXVECTOR3 Eye;
+d3d::Frustum ViewFrustum;
+
+//ģⰴ̶ÿ60ƽ֡޹أȾʱֵ֮
+SimState PrevState, CurrState;
+double SimulationTime = 0.0;
+void (*SimulationScript)(SimState& state, double time) = 0;
+d3d::FixedTimestep Timestep(1.0 / 60.0, 8);
+double FrameRateLimit = 0.0;
+
+void UpdateSimulation(SimState& state, float dt);
+
+int MirrorCount = 1;
+
+int LightCount = 1;
+std::vector<d3d::Mirror> Mirrors;
+
+//ǰ֡ɼľ
+int VisibleMirrors[d3d::MaxVisibleMirrors];
+int NumVisibleMirrors = 0;
+
+//еľӣ3㣬ÿ֡2Ρ2
+d3d::MirrorBudget MirroBudget = d3d::InitMirrorBudget(3, 20000, 2.0f);
+DWORD MirroTriangles = 0;
+
+//ӽ϶ʱֻþڵȣȻ
+MirrorDepthMode MirroDepthMode = MIRROR_DEPTH_AUTO;
+float MirroDepthPixels = 0.0f;
+float MirroRegionPixels = 0.0f;
+std::chrono::steady_clock::time_point MirroStart;
+
+//ھ洦üǰ岻ᱻ䵽
+ReflectionClipMode ReflectionClip = REFLECTION_CLIP_OBLIQUE;
+
+//ͼģʽÿ澵ӰѷĳȾԼͼٰͼ˵
+//ͼĴС͸¼Գļ۾ͳûʱϴεͼ
+ReflectionMode ReflectionTechnique = REFLECTION_STENCIL;
+struct MirrorTexture
+{
+	d3d::Texture* Target;
+	DWORD Interval;          //θ֮ٸ֡
+	bool Valid;              //һ֮Ϊtrue
+	DWORD LastFrame;         //ϴθµ֡
+	D3DXVECTOR3 Eye;         //ϴθʱ۾λ
+	DWORD SceneChanges;      //ϴθʱSceneChanges
+	D3DXMATRIX View, Proj;   //͸濴
+	d3d::CullVolume Volume;  //õ壬֮ǰռ
+	UINT Height;             //ͼĸ߶ȣѡϸڲ
+};
+std::vector<MirrorTexture> MirroTextures;
+DWORD MirroFrame = 0;
+DWORD SceneChanges = 0;  //ƶ߻ϼɵͼʱһĶܱ
+int UpdatedMirrors[d3d::MaxVisibleMirrors]; //һ֡Ҫػͼľ
+int MirroTextureUpdates = 0;
+
+//ÿȾ׶ε״̬
+d3d::StateBlock* DefaultPass = 0;
+d3d::StateBlock* MirroMarkPass = 0;
+d3d::StateBlock* ReflectPass = 0;
+d3d::StateBlock* ShadowPass = 0;
+d3d::StateBlock* ReceiverMarkPass = 0;
+d3d::StateBlock* ReceiverClearPass = 0;
+d3d::StateBlock* VolumeBackPass = 0;
+d3d::StateBlock* VolumeFrontPass = 0;
+d3d::StateBlock* VolumeShadePass = 0;
+d3d::StateBlock* NestedMarkPass = 0;
+d3d::StateBlock* DepthResetPass = 0;
+d3d::StateBlock* NestedPopPass = 0;
+d3d::StateBlock* MirroTexturePass = 0;
+d3d::StateBlock* ModulatePass = 0;
+
+//ÿ֡Ⱦ׶ɹ̲߳м¼ԵȾٰ߳˳طŵDevice
+//D3D9̰߳ȫģֻлطŻ豸޳;ɢ
+int RecordThreads = 0;
+d3d::TaskPool* RecordPool = 0;
+d3d::CommandBuffer* SceneCommands = 0;           //;
+std::vector<d3d::CommandBuffer*> ShadowCommands; //ƽӰÿһӰÿԴһ
+int NumShadowCommands = 0;
+d3d::CommandBuffer* MirroCommands = 0;           //Ǿӡ
+std::vector<d3d::CommandBuffer*> ReflectCommands; //ÿɼľһ
+d3d::CommandBuffer* NestedCommands = 0;          //еľ
+d3d::CommandBuffer* ReceiverCommands = 0;        //Ӱͼ˵
+
+//ܷÿ׶һ֣¼ͻطŶ
+enum FramePass
+{
+	PASS_SCENE,
+	PASS_SHADOW,
+	PASS_SHADOW_TEXTURES,
+	PASS_MIRRO,
+	PASS_MIRROR_TEXTURES,
+	PASS_NESTED,
+	PASS_COUNT
+};
+const char* const PassNames[PASS_COUNT] =
+{
+	"RenderScene", "RenderShadow", "ShadowTextures", "RenderMirro", "MirrorTextures", "NestedMirrors"
+};
 
-void RenderScene();
-void RenderMirro();
-void RenderShadow();
+//һͼ¼ĺ
+struct RecordTask
+{
+	d3d::CommandBuffer* Commands;
+	void (*Record)(d3d::RenderDevice* device, int index);
+	int Index;
+	FramePass Pass;
+};
+std::vector<RecordTask> RecordTasks;
+
+void RecordFrame();
+void ReplayFrame();
+void RenderScene(d3d::RenderDevice* device);
+void RenderMirro(d3d::RenderDevice* device);
+int SelectMirrorUpdates();
+void RenderMirrorTexture(d3d::RenderDevice* device, int i);
+void DrawMirrorTextures(d3d::RenderDevice* device);
+void RenderReflection(d3d::RenderDevice* device, int i);
+void RenderNestedMirrors(d3d::RenderDevice* device);
+void RenderNestedMirrors(d3d::RenderDevice* device, const d3d::MirrorView& parent, unsigned long long path);
+void BeginReflection(d3d::RenderDevice* device, const D3DXPLANE& mirrorPlane);
+void EndReflection(d3d::RenderDevice* device);
+void RenderShadow(d3d::RenderDevice* device, int r);
+void RenderShadowVolume(d3d::RenderDevice* device, int l);
+void UpdateCullVolumes();
+d3d::LodView ReflectedLodView(const D3DXMATRIX& reflect, const D3DXMATRIX& proj, UINT viewportHeight,
+	d3d::LodHistory* history);
+d3d::LodView ShadowLodView();
+bool CastsShadow(int l, int r, int c, const char* visible);
+bool DrawShadowCasters(d3d::RenderDevice* device, int l, int r, const D3DMATERIAL9& mtrl, const char* visible,
+	const d3d::LodView* lod);
+bool CreateShadowTextures();
+int SelectShadowUpdates();
+void RenderShadowTexture(d3d::RenderDevice* device, int i);
+void RenderReceivers(d3d::RenderDevice* device, int);
+void DrawReceiver(d3d::RenderDevice* device, const d3d::ShadowReceiver& receiver);
+bool BuildTeapotVolumes();
+void UpdateAssets();
+void ApplyAssets();
 
 struct Vertex
 {
@@ -67,62 +309,218 @@ const DWORD Vertex::FVF = D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_TEX1;
 
 bool Setup()
 {
-	WallMt.Specular = d3d::WHITE*0.2f;
+	//ӳ䳡ļõݶSetup︴Ƶ豸ͳУʱӳ
+	d3d::MappedFile sceneData;
+	d3d::Scene scene;
+	std::string error;
+	if (!d3d::LoadScene(SceneFile, SceneSource, &sceneData, &scene, &error))
+	{
+#ifdef _WIN32
+		::MessageBox(0, error.c_str(), "LoadScene() - FAILED", 0);
+#else
+		fprintf(stderr, "%s\n", error.c_str());
+#endif
+		return false;
+	}
+	const UINT* counts = scene.Counts;
+	if (counts[d3d::SCENE_INSTANCES] == 0)
+		return false;
+
+	//ʺͼռλͼɺUpdateAssets
+	Assets.SetTextureCache(TextureCacheDirectory);
+	for (UINT m = 0; m < counts[d3d::SCENE_MATERIALS]; ++m)
+	{
+		const d3d::SceneMaterial& material = scene.Materials[m];
+		const char* texture = d3d::GetSceneTexture(scene, m);
+		Materials.push_back(material.Material);
+		MaterialAssets.push_back(texture ? Assets.LoadTexture(Device, texture, material.Placeholder) : -1);
+	}
+
+	//ֱӴӳļƵ㻺
+	for (UINT m = 0; m < counts[d3d::SCENE_MESHES]; ++m)
+	{
+		const d3d::SceneMesh& mesh = scene.Meshes[m];
+		d3d::Mesh* created = 0;
+		if (!Device->CreateMesh(scene.MeshVertices + mesh.FirstVertex, mesh.NumVertices,
+			scene.MeshIndices + mesh.FirstIndex, mesh.NumTriangles, &created))
+			return false;
+		SceneMeshes.push_back(created);
+	}
 
-	D3DXCreateTeapot(Device, &Teapot, 0);
+	//ÿڼ߳ϼ򻯳ֵļUpdateAssetsбһݶ
+	for (UINT m = 0; m < counts[d3d::SCENE_MESHES]; ++m)
+	{
+		const d3d::SceneMesh& mesh = scene.Meshes[m];
+		SceneLodAssets.push_back(Assets.LoadMeshLod(SceneMeshes[m], scene.MeshVertices + mesh.FirstVertex,
+			mesh.NumVertices, scene.MeshIndices + mesh.FirstIndex, mesh.NumTriangles));
+	}
 
-	Device->CreateVertexBuffer(
-		24 * sizeof(Vertex),
-		0,
-		Vertex::FVF,
-		D3DPOOL_MANAGED,
-		&VB,
-		0);
+	if (!d3d::CreateStaticMesh(Device, d3d::SceneVertexFVF, sizeof(d3d::SceneVertex),
+		scene.StaticVertices, counts[d3d::SCENE_STATIC_VERTICES],
+		scene.StaticIndices, counts[d3d::SCENE_STATIC_INDICES],
+		scene.StaticRanges, counts[d3d::SCENE_STATIC_RANGES], &Room))
+		return false;
+
+	//Ӱƽ棺ذǽָһ
+	//ӰͼģʽҪõδӾ̬帴ƳuvԽµ
+	std::vector<Vertex> receiverVertices;
+	for (UINT r = 0; r < counts[d3d::SCENE_RECEIVERS]; ++r)
+	{
+		//㳬65536Ĳʷֳ˼ΧÿΧһ
+		DWORD material = scene.Receivers[r].Material;
+		for (int range = Room->FindRange(material); range >= 0; range = Room->FindRange(material, range + 1))
+		{
+			int receiver = Shadows.AddReceiver(d3d::InitShadowReceiver(scene.Receivers[r].Plane, Room, range));
+
+			const d3d::MeshRange& rg = scene.StaticRanges[range];
+			const d3d::SceneVertex* vertices = scene.StaticVertices + rg.BaseVertex;
+			ShadowTexture t;
+			t.Target = 0;
+			t.FirstVertex = (UINT)receiverVertices.size();
+			t.NumTriangles = rg.PrimCount;
+			t.Valid = false;
+			t.Version = 0;
+			d3d::GetReceiverTextureCamera(Shadows.GetReceiver(receiver), vertices, rg.NumVertices,
+				sizeof(d3d::SceneVertex), &t.View, &t.Proj);
+			D3DXMATRIX toTexture = t.View * t.Proj;
+			for (UINT k = 0; k < rg.PrimCount * 3; ++k)
+			{
+				const d3d::SceneVertex& v = vertices[scene.StaticIndices[rg.StartIndex + k]];
+				D3DXVECTOR3 p(v.x, v.y, v.z), uv;
+				D3DXVec3TransformCoord(&uv, &p, &toTexture);
+				receiverVertices.push_back(Vertex(v.x, v.y, v.z, v.nx, v.ny, v.nz, 0.5f + 0.5f * uv.x, 0.5f - 0.5f * uv.y));
+			}
+			ShadowTextures.push_back(t);
+		}
+	}
+	if (!receiverVertices.empty())
+	{
+		Vertex* rv = 0;
+		Device->CreateVertexBuffer((UINT)receiverVertices.size() * sizeof(Vertex), Vertex::FVF, &ReceiverVB);
+		ReceiverVB->Lock(0, 0, (void**)&rv, 0);
+		memcpy(rv, &receiverVertices[0], receiverVertices.size() * sizeof(Vertex));
+		ReceiverVB->Unlock();
+	}
+	ShadowUpdates.resize(ShadowTextures.size());
+
+	//һʵǿƶĲ
+	const d3d::SceneInstance& teapot = scene.Instances[0];
+	const d3d::SceneMesh& teapotMesh = scene.Meshes[teapot.Mesh];
+	Teapot = SceneMeshes[teapot.Mesh];
+	TeapotPosition = teapot.Position;
+	TeapotObject = Transforms.AddObject(TeapotPosition);
+	RoomObject = Transforms.AddObject(D3DXVECTOR3(0.0f, 0.0f, 0.0f));
+	TeapotCaster = Shadows.AddCaster(Teapot, Transforms.GetWorld(TeapotObject));
+
+	Camera = *scene.Camera;
+	CurrState.TeapotPosition = TeapotPosition;
+	CurrState.Radius = Camera.Distance;
+	CurrState.Angle = Camera.Angle;
+	PrevState = CurrState;
 
 	Vertex* v = 0;
-	VB->Lock(0,0,(void**)&v, 0);
-	// floor
-	v[0] = Vertex(-7.5f, 0.0f, -10.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-7.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
-	v[2] = Vertex(7.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f);
-
-	v[3] = Vertex(-7.5f, 0.0f, -10.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f);
-	v[4] = Vertex(7.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f);
-	v[5] = Vertex(7.5f, 0.0f, -10.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f);
-
-	// wall
-	v[6] = Vertex(-7.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[7] = Vertex(-7.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[8] = Vertex(-2.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-
-	v[9] = Vertex(-7.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[10] = Vertex(-2.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[11] = Vertex(-2.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// Note: We leave gap in middle of walls for mirror
-
-	v[12] = Vertex(2.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[13] = Vertex(2.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[14] = Vertex(7.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-
-	v[15] = Vertex(2.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[16] = Vertex(7.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[17] = Vertex(7.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// mirror
-	v[18] = Vertex(-2.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[19] = Vertex(-2.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[20] = Vertex(2.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-
-	v[21] = Vertex(-2.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[22] = Vertex(2.5f, 5.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[23] = Vertex(2.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-	VB->Unlock();
-
-	//ͼ
-	D3DXCreateTextureFromFile(Device, "checker.jpg", &floorTex);
-	D3DXCreateTextureFromFile(Device, "brick0.jpg", &wallTex);
-	D3DXCreateTextureFromFile(Device, "ice.bmp", &mirroTex);
+	Device->CreateVertexBuffer(6 * sizeof(Vertex), Vertex::FVF, &ScreenVB);
+	ScreenVB->Lock(0, 0, (void**)&v, 0);
+	v[0] = Vertex(-1.0f, -1.0f, 0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
+	v[1] = Vertex(-1.0f, 1.0f, 0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
+	v[2] = Vertex(1.0f, 1.0f, 0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
+	v[3] = Vertex(-1.0f, -1.0f, 0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
+	v[4] = Vertex(1.0f, 1.0f, 0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
+	v[5] = Vertex(1.0f, -1.0f, 0.5f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
+	ScreenVB->Unlock();
+
+	// mirrors, two triangles each
+	int numMirrors = std::min(std::min(std::max(MirrorCount, 1), (int)MaxSceneMirrors),
+		(int)counts[d3d::SCENE_MIRRORS]);
+	for (int i = 0; i < numMirrors; ++i)
+	{
+		Mirrors.push_back(d3d::InitMirror(scene.Mirrors[i].Corners));
+		Transforms.AddMirror(Mirrors.back().Plane);
+	}
+
+	//ͼģʽÿ澵һȾĿ꣬ļıС
+	if (ReflectionTechnique == REFLECTION_TEXTURE)
+	{
+		for (int i = 0; i < numMirrors; ++i)
+		{
+			MirrorTexture t;
+			t.Target = 0;
+			t.Valid = false;
+			t.LastFrame = 0;
+			t.SceneChanges = 0;
+			float scale = scene.Mirrors[i].TextureScale;
+			UINT w = (UINT)std::max(1.0f, width * scale + 0.5f);
+			UINT h = (UINT)std::max(1.0f, height * scale + 0.5f);
+			if (!Device->CreateRenderTarget(w, h, &t.Target))
+				return false;
+			t.Interval = scene.Mirrors[i].UpdateInterval;
+			t.Height = h;
+			MirroTextures.push_back(t);
+		}
+	}
+
+	if (!Mirrors.empty())
+	{
+		MirroMt = Materials[scene.Mirrors[0].Material];
+		MirroAsset = MaterialAssets[scene.Mirrors[0].Material];
+		mirroTex = Assets.GetTexture(MirroAsset);
+
+		Device->CreateVertexBuffer(
+			(UINT)Mirrors.size() * 6 * sizeof(Vertex),
+			Vertex::FVF,
+			&MirroVB);
+
+		MirroVB->Lock(0, 0, (void**)&v, 0);
+		for (size_t i = 0; i < Mirrors.size(); ++i, v += 6)
+		{
+			const D3DXVECTOR3* c = Mirrors[i].Corners;
+			const D3DXPLANE& n = Mirrors[i].Plane;
+			v[0] = Vertex(c[0].x, c[0].y, c[0].z, n.a, n.b, n.c, 0.0f, 1.0f);
+			v[1] = Vertex(c[1].x, c[1].y, c[1].z, n.a, n.b, n.c, 0.0f, 0.0f);
+			v[2] = Vertex(c[2].x, c[2].y, c[2].z, n.a, n.b, n.c, 1.0f, 0.0f);
+
+			v[3] = Vertex(c[0].x, c[0].y, c[0].z, n.a, n.b, n.c, 0.0f, 1.0f);
+			v[4] = Vertex(c[2].x, c[2].y, c[2].z, n.a, n.b, n.c, 1.0f, 0.0f);
+			v[5] = Vertex(c[3].x, c[3].y, c[3].z, n.a, n.b, n.c, 1.0f, 1.0f);
+		}
+		MirroVB->Unlock();
+	}
+
+	//¼б̬ÿΧذ塢ǽʵ
+	TeapotItem = SceneList.AddMesh(Teapot, Transforms.GetWorld(TeapotObject), Materials[teapot.Material], 0,
+		teapotMesh.Center, teapotMesh.Radius, TeapotObject);
+	CasterItems.push_back(TeapotItem);
+	for (int r = 0; r < Room->GetNumRanges(); ++r)
+	{
+		DWORD material = Room->GetRange(r).Material;
+		RoomItems.push_back(SceneList.AddRange(Room, r, Transforms.GetWorld(RoomObject), Materials[material],
+			Assets.GetTexture(MaterialAssets[material]), RoomObject));
+	}
+	for (UINT i = 1; i < counts[d3d::SCENE_INSTANCES]; ++i)
+	{
+		const d3d::SceneInstance& instance = scene.Instances[i];
+		const d3d::SceneMesh& mesh = scene.Meshes[instance.Mesh];
+		D3DXMATRIX W;
+		D3DXMatrixTranslation(&W, instance.Position.x, instance.Position.y, instance.Position.z);
+		CasterItems.push_back(SceneList.AddMesh(SceneMeshes[instance.Mesh], W, Materials[instance.Material], 0,
+			mesh.Center, mesh.Radius));
+		Shadows.AddCaster(SceneMeshes[instance.Mesh], W);
+	}
+
+	//Ͳһ񣬻бǺϲһʵƣӰֻΪƶĲ
+	const D3DMATERIAL9 copyMt[4] = { d3d::RED_MTRL, d3d::GREEN_MTRL, d3d::BLUE_MTRL, d3d::YELLOW_MTRL };
+	for (int k = 1; k < TeapotCount; ++k)
+	{
+		int col = (k - 1) % TeapotColumns;
+		int row = (k - 1) / TeapotColumns;
+		D3DXMATRIX S, T;
+		D3DXMatrixScaling(&S, TeapotCopyScale, TeapotCopyScale, TeapotCopyScale);
+		D3DXMatrixTranslation(&T, (col - (TeapotColumns - 1) * 0.5f) * TeapotCopySpacing,
+			0.15f, -(row + 1) * TeapotCopySpacing);
+		D3DXMATRIX W = S * T;
+		CasterItems.push_back(SceneList.AddMesh(Teapot, W, copyMt[k % 4], 0, teapotMesh.Center, teapotMesh.Radius));
+		Shadows.AddCaster(Teapot, W);
+	}
 
 	//ù
 	Device->SetSamplerState(0, D3DSAMP_MINFILTER, D3DTEXF_LINEAR);
@@ -130,263 +528,1099 @@ bool Setup()
 	Device->SetSamplerState(0, D3DSAMP_MIPFILTER, D3DTEXF_LINEAR);
 
 	//ùԴ
-	D3DXVECTOR3 lightDir(0.707f, -0.707f, 0.707f);
-	D3DXCOLOR color(1.0f, 1.0f, 1.0f, 1.0f);
-	D3DLIGHT9 light = d3d::InitDirectionalLight(&lightDir, &color);
-	Device->SetLight(0, &light);
-	Device->LightEnable(0, true);
+	int numLights = std::min(std::min(std::max(LightCount, 1), (int)MaxSceneLights), (int)counts[d3d::SCENE_LIGHTS]);
+	for (int l = 0; l < numLights; ++l)
+	{
+		D3DXVECTOR3 lightDir = scene.Lights[l].Direction;
+		D3DXCOLOR color = scene.Lights[l].Color;
+		D3DLIGHT9 light = d3d::InitDirectionalLight(&lightDir, &color);
+		Device->SetLight(l, &light);
+		Device->LightEnable(l, true);
+		Shadows.AddLight(D3DXVECTOR4(lightDir.x, lightDir.y, lightDir.z, 0.0f));
+	}
+	if (!BuildTeapotVolumes())
+		return false;
+	MirrorVolumes.resize(Mirrors.size());
+	MirrorLodHistories.resize(Mirrors.size());
+	ShadowVisible.assign(Shadows.GetNumLights(), std::vector<char>(SceneList.GetItems().size(), 1));
 	Device->SetRenderState(D3DRS_SPECULARENABLE, true);
 	Device->SetRenderState(D3DRS_NORMALIZENORMALS, true);
 
 	//
-	D3DXVECTOR3 pos(-10.0f, 3.0f, -15.0f);
-	D3DXVECTOR3 target(0, 0, 0);
-	D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
-	D3DXMATRIX M;
-	D3DXMatrixLookAtLH(&M, &pos, &target, &up);
-	Device->SetTransform(D3DTS_VIEW, &M);
-
-	D3DXMATRIX K;
 	D3DXMatrixPerspectiveFovLH(
-		&K,
-		D3DX_PI / 4.0f, // 45 - degree
+		&Proj,
+		Camera.FieldOfView,
 		(float)width / (float)height,
-		1.0f,
-		1000.0f);
-	Device->SetTransform(D3DTS_PROJECTION, &K);
+		Camera.NearPlane,
+		Camera.FarPlane);
+	Device->SetTransform(D3DTS_PROJECTION, &Proj);
+
+	//z = w1.0
+	FarProj = Proj;
+	FarProj._13 = Proj._14;
+	FarProj._23 = Proj._24;
+	FarProj._33 = Proj._34;
+	FarProj._43 = Proj._44;
+
+	//Ⱦ׶ε״̬
+	d3d::PassDesc pass = d3d::InitPassDesc();
+	Device->CreateStateBlock(pass, &DefaultPass);
+
+	//дģ建
+	pass = d3d::InitPassDesc();
+	pass.StencilEnable = true;
+	pass.StencilFunc = D3DCMP_ALWAYS; //ΪǼɹ
+	pass.StencilRef = 0x1; //refֵ
+	pass.StencilMask = 0xffffffff; //ֵ
+	pass.StencilWriteMask = 0xffffffff; //ֻд
+	pass.StencilZFail = D3DSTENCILOP_KEEP; //ȼʧˣôģ建浱еֵи
+	pass.StencilFail = D3DSTENCILOP_KEEP; //ģʧˣ ôģ建浱еֵи
+	pass.StencilPass = D3DSTENCILOP_REPLACE;//ģ建涼ɹˣôʹrefֵ滻еĶӦλ
+	//дȻ̨
+	pass.ZWriteEnable = false;    //رȼ
+	pass.AlphaBlendEnable = true; //ں
+	pass.SrcBlend = D3DBLEND_ZERO; //ԴںΪ0
+	pass.DestBlend = D3DBLEND_ONE; //ĿںΪ1 
+	Device->CreateStateBlock(pass, &MirroMarkPass);
+
+	//ֻƷĲƵĵط
+	pass.StencilFunc = D3DCMP_EQUAL;
+	pass.StencilPass = D3DSTENCILOP_KEEP; //ģɹôԭ
+	pass.ZWriteEnable = true; //´Z
+	pass.SrcBlend = D3DBLEND_DESTCOLOR; //ʹԲ뾵ں
+	pass.DestBlend = D3DBLEND_ZERO;
+	pass.CullMode = D3DCULL_CW; //ȾǰȷȾ棬зת
+	Device->CreateStateBlock(pass, &ReflectPass);
+
+	//ǽϿɼأ˵ؾǽ汾дɫ
+	pass = d3d::InitPassDesc();
+	pass.StencilEnable = true;
+	pass.StencilFunc = D3DCMP_ALWAYS;
+	pass.StencilRef = 0x1;
+	pass.StencilPass = D3DSTENCILOP_REPLACE;
+	pass.ZWriteEnable = false;
+	pass.ZFunc = D3DCMP_EQUAL;
+	pass.AlphaBlendEnable = true;
+	pass.SrcBlend = D3DBLEND_ZERO;
+	pass.DestBlend = D3DBLEND_ONE;
+	Device->CreateStateBlock(pass, &ReceiverMarkPass);
+
+	//Ӱģֵ0Ӱ䵽һƽ֮
+	pass.StencilRef = 0x0;
+	Device->CreateStateBlock(pass, &ReceiverClearPass);
+
+	//ӰֻģֵΪ1ǵĽ棩ĵط
+	pass = d3d::InitPassDesc();
+	pass.StencilEnable = true;
+	pass.StencilFunc = D3DCMP_EQUAL;
+	pass.StencilRef = 0x1;
+	//״νƵ̨ܳɹ
+	//ͼһѾдؽдģʧ
+	pass.StencilPass = D3DSTENCILOP_INCR;
+	pass.AlphaBlendEnable = true;
+	pass.SrcBlend = D3DBLEND_DESTALPHA;
+	pass.DestBlend = D3DBLEND_INVSRCALPHA;
+	pass.ZEnable = false; //Ȼ
+	Device->CreateStateBlock(pass, &ShadowPass);
+
+	//Ӱ壨z-failȲʧʱģֵһһдɫ
+	pass = d3d::InitPassDesc();
+	pass.StencilEnable = true;
+	pass.StencilFunc = D3DCMP_ALWAYS;
+	pass.StencilZFail = D3DSTENCILOP_INCR;
+	pass.ZWriteEnable = false; //ͨϵķڲԼ䰵
+	pass.AlphaBlendEnable = true;
+	pass.SrcBlend = D3DBLEND_ZERO;
+	pass.DestBlend = D3DBLEND_ONE;
+	pass.CullMode = D3DCULL_CW; //ֻ
+	Device->CreateStateBlock(pass, &VolumeBackPass);
+
+	pass.StencilZFail = D3DSTENCILOP_DECR;
+	pass.CullMode = D3DCULL_CCW; //ֻ
+	Device->CreateStateBlock(pass, &VolumeFrontPass);
+
+	//ģֵΪ0Ӱ棺䰵ͬʱģֵ
+	pass = d3d::InitPassDesc();
+	pass.StencilEnable = true;
+	pass.StencilFunc = D3DCMP_NOTEQUAL;
+	pass.StencilRef = 0x0;
+	pass.StencilPass = D3DSTENCILOP_ZERO;
+	pass.AlphaBlendEnable = true;
+	pass.SrcBlend = D3DBLEND_DESTALPHA;
+	pass.DestBlend = D3DBLEND_INVSRCALPHA;
+	pass.ZEnable = false;
+	pass.CullMode = D3DCULL_NONE;
+	Device->CreateStateBlock(pass, &VolumeShadePass);
+
+	//еľӣڸӵﻭ棬ģֵһ
+	pass = d3d::InitPassDesc();
+	pass.StencilEnable = true;
+	pass.StencilFunc = D3DCMP_EQUAL;
+	pass.StencilPass = D3DSTENCILOP_INCR;
+	pass.ZWriteEnable = false;
+	pass.CullMode = D3DCULL_NONE; //֮ĳᷭת
+	Device->CreateStateBlock(pass, &NestedMarkPass);
+
+	//ֻ澵ӵΪԶдɫ
+	pass.StencilPass = D3DSTENCILOP_KEEP;
+	pass.ZWriteEnable = true;
+	pass.ZFunc = D3DCMP_ALWAYS;
+	pass.AlphaBlendEnable = true;
+	pass.SrcBlend = D3DBLEND_ZERO;
+	pass.DestBlend = D3DBLEND_ONE;
+	Device->CreateStateBlock(pass, &DepthResetPass);
+
+	//֮ģֵȥȻָΪ
+	pass.StencilPass = D3DSTENCILOP_DECR;
+	Device->CreateStateBlock(pass, &NestedPopPass);
+
+	//ѷĳӵͼ֮淭ת
+	pass = d3d::InitPassDesc();
+	pass.CullMode = D3DCULL_CW;
+	Device->CreateStateBlock(pass, &MirroTexturePass);
+
+	//ͼ˵ѾõľϣȺ;
+	pass = d3d::InitPassDesc();
+	pass.ZWriteEnable = false;
+	pass.AlphaBlendEnable = true;
+	pass.SrcBlend = D3DBLEND_DESTCOLOR;
+	pass.DestBlend = D3DBLEND_ZERO;
+	Device->CreateStateBlock(pass, &ModulatePass);
+
+	//ͼ¼߳
+	RecordPool = new d3d::TaskPool(RecordThreads);
+	SceneCommands = new d3d::CommandBuffer;
+	MirroCommands = new d3d::CommandBuffer;
+	NestedCommands = new d3d::CommandBuffer;
+	ReceiverCommands = new d3d::CommandBuffer;
+	ShadowInstances.resize(Shadows.GetNumReceivers());
+	ShadowTextureLodHistories.resize(Shadows.GetNumReceivers());
+	for (int i = std::max(Shadows.GetNumReceivers(), Shadows.GetNumLights()); i > 0; --i)
+		ShadowCommands.push_back(new d3d::CommandBuffer);
+	for (size_t i = 0; i < Mirrors.size(); ++i)
+		ReflectCommands.push_back(new d3d::CommandBuffer);
+
+	if (ShadowTechnique == SHADOW_TEXTURE && !CreateShadowTextures())
+		return false;
+
+	return true;
+}
 
+//ÿһӰͼֻʹӰͼʱ
+bool CreateShadowTextures()
+{
+	for (size_t r = 0; r < ShadowTextures.size(); ++r)
+	{
+		ShadowTexture& t = ShadowTextures[r];
+		if (t.Target)
+			continue;
+		if (!Device->CreateRenderTarget(ShadowTextureSize, ShadowTextureSize, &t.Target))
+			return false;
+		t.Valid = false;
+	}
 	return true;
 }
 
+//ӰӲɣÿԴһ
+bool BuildTeapotVolumes()
+{
+	for (size_t i = 0; i < TeapotVolumes.size(); ++i)
+		d3d::Release<d3d::ShadowVolume*>(TeapotVolumes[i]);
+	TeapotVolumes.clear();
+	for (int l = 0; l < Shadows.GetNumLights(); ++l)
+	{
+		d3d::ShadowVolume* volume = 0;
+		if (!d3d::CreateShadowVolume(Device, Teapot, &volume))
+			return false;
+		TeapotVolumes.push_back(volume);
+	}
+	return true;
+}
+
+//ÿ֡ѽõԴԤϴһ֣Դʱ
+void UpdateAssets()
+{
+	D3D_PROFILE_SCOPE("Assets");
+	if (Assets.Update(Device, AssetUploadBudget) > 0)
+		ApplyAssets();
+}
+
+//б;滻ɼɵͼûȻռλͼ
+//򻯺õ񽻸бûõĻʧֻܵ
+void ApplyAssets()
+{
+	for (size_t i = 0; i < RoomItems.size(); ++i)
+		SceneList.SetTexture(RoomItems[i], Assets.GetTexture(MaterialAssets[Room->GetRange((int)i).Material]));
+	mirroTex = Assets.GetTexture(MirroAsset);
+	for (size_t m = 0; m < SceneLodAssets.size(); ++m)
+	{
+		const d3d::MeshLod* lod = Assets.GetMeshLod(SceneLodAssets[m]);
+		if (lod)
+			SceneList.SetLod(SceneMeshes[m], lod);
+	}
+	++SceneChanges;
+}
+
+void WaitForAssets()
+{
+	if (Assets.Finish(Device) > 0)
+		ApplyAssets();
+}
+
 void CleanUp()
 {
-	d3d::Release<IDirect3DVertexBuffer9*>(VB);
-	d3d::Release<IDirect3DTexture9*>(wallTex);
-	d3d::Release<IDirect3DTexture9*>(floorTex);
-	d3d::Release<IDirect3DTexture9*>(mirroTex);
-	d3d::Release<ID3DXMesh*>(Teapot);
+	d3d::Release<d3d::StaticMesh*>(Room);
+	d3d::Release<d3d::VertexBuffer*>(MirroVB);
+	d3d::Release<d3d::VertexBuffer*>(ScreenVB);
+	d3d::Release<d3d::VertexBuffer*>(ReceiverVB);
+	for (size_t i = 0; i < ShadowTextures.size(); ++i)
+		d3d::Release<d3d::Texture*>(ShadowTextures[i].Target);
+	ShadowTextures.clear();
+	ShadowUpdates.clear();
+	for (size_t i = 0; i < TeapotVolumes.size(); ++i)
+		d3d::Release<d3d::ShadowVolume*>(TeapotVolumes[i]);
+	TeapotVolumes.clear();
+	for (size_t i = 0; i < SceneMeshes.size(); ++i)
+		d3d::Release<d3d::Mesh*>(SceneMeshes[i]);
+	SceneMeshes.clear();
+	Teapot = 0;
+	//ͼͼ򻯳
+	Assets.Clear();
+	SceneLodAssets.clear();
+	Materials.clear();
+	MaterialAssets.clear();
+	MirroAsset = -1;
+	mirroTex = 0;
+	d3d::Release<d3d::StateBlock*>(DefaultPass);
+	d3d::Release<d3d::StateBlock*>(MirroMarkPass);
+	d3d::Release<d3d::StateBlock*>(ReflectPass);
+	d3d::Release<d3d::StateBlock*>(ShadowPass);
+	d3d::Release<d3d::StateBlock*>(ReceiverMarkPass);
+	d3d::Release<d3d::StateBlock*>(ReceiverClearPass);
+	d3d::Release<d3d::StateBlock*>(VolumeBackPass);
+	d3d::Release<d3d::StateBlock*>(VolumeFrontPass);
+	d3d::Release<d3d::StateBlock*>(VolumeShadePass);
+	d3d::Release<d3d::StateBlock*>(NestedMarkPass);
+	d3d::Release<d3d::StateBlock*>(DepthResetPass);
+	d3d::Release<d3d::StateBlock*>(NestedPopPass);
+	d3d::Release<d3d::StateBlock*>(MirroTexturePass);
+	d3d::Release<d3d::StateBlock*>(ModulatePass);
+	for (size_t i = 0; i < MirroTextures.size(); ++i)
+		d3d::Release<d3d::Texture*>(MirroTextures[i].Target);
+	MirroTextures.clear();
+	d3d::Release<d3d::CommandBuffer*>(SceneCommands);
+	d3d::Release<d3d::CommandBuffer*>(MirroCommands);
+	d3d::Release<d3d::CommandBuffer*>(NestedCommands);
+	d3d::Release<d3d::CommandBuffer*>(ReceiverCommands);
+	for (size_t i = 0; i < ShadowCommands.size(); ++i)
+		d3d::Release<d3d::CommandBuffer*>(ShadowCommands[i]);
+	ShadowCommands.clear();
+	NumShadowCommands = 0;
+	for (size_t i = 0; i < ReflectCommands.size(); ++i)
+		d3d::Release<d3d::CommandBuffer*>(ReflectCommands[i]);
+	ReflectCommands.clear();
+	delete RecordPool;
+	RecordPool = 0;
+
+	//صSetup֮ǰӣٴεSetup
+	SceneList.Clear();
+	RoomItems.clear();
+	CasterItems.clear();
+	MirrorVolumes.clear();
+	ShadowVisible.clear();
+	Shadows = d3d::PlanarShadows();
+	Transforms = d3d::TransformCache();
+	Mirrors.clear();
+	NumVisibleMirrors = 0;
+	ShadowInstances.clear();
+	SceneLodHistory.clear();
+	ShadowLodHistory.clear();
+	ShadowTextureLodHistories.clear();
+	MirrorLodHistories.clear();
+	NestedLodHistories.clear();
+	Timestep = d3d::FixedTimestep(1.0 / 60.0, 8);
+	SimulationTime = 0.0;
+}
+
+void UpdateSimulation(SimState& state, float dt)
+{
+	SimulationTime += dt;
+	if (SimulationScript)
+	{
+		SimulationScript(state, SimulationTime);
+		return;
+	}
+
+#ifdef _WIN32
+	if (::GetAsyncKeyState(VK_LEFT) & 0x8000f)
+	{
+		state.TeapotPosition.x -= 0.3f*dt;
+	}
+	if (::GetAsyncKeyState(VK_RIGHT) & 0x8000f)
+	{
+		state.TeapotPosition.x += 0.3f*dt;
+	}
+	if (::GetAsyncKeyState(VK_UP) & 0x8000f)
+	{
+		state.Radius -= 2.0f*dt;
+	}
+	if (::GetAsyncKeyState(VK_DOWN) & 0x8000f)
+	{
+		state.Radius += 2.0f*dt;
+	}
+	if (::GetAsyncKeyState('A')&0x8000f)
+	{
+		state.Angle -= 0.5f*dt;
+	}
+	if (::GetAsyncKeyState('D')&0x8000f)
+	{
+		state.Angle += 0.5f*dt;
+	}
+	if (::GetAsyncKeyState('P')&0x8000f)
+	{
+		ShadowTechnique = SHADOW_PLANAR;
+	}
+	if (::GetAsyncKeyState('V')&0x8000f)
+	{
+		ShadowTechnique = SHADOW_VOLUME;
+	}
+	if (::GetAsyncKeyState('T')&0x8000f)
+	{
+		ShadowTechnique = SHADOW_TEXTURE;
+	}
+#endif
 }
 
-bool Display(float timedelta)
+bool Display(double timedelta)
 {
 	if (Device)
 	{
-		//İ뾶
-		static float radius = 20.0f;
-		if (::GetAsyncKeyState(VK_LEFT) & 0x8000F)
-		{
-			TeapotPosition.x -= 0.3f*timedelta;
-		}
-		if (::GetAsyncKeyState(VK_RIGHT) & 0x8000f)
-		{
-			TeapotPosition.x += 0.3f*timedelta;
-		}
-		if (::GetAsyncKeyState(VK_UP) & 0x8000f)
+		D3D_PROFILE_SCOPE("Display");
+
+		//̶ƽģ⣬һһֵ֮Ҫ״̬
 		{
-			radius -= 2.0f *timedelta;
+			D3D_PROFILE_SCOPE("Simulate");
+			for (int steps = Timestep.Advance(timedelta); steps > 0; --steps)
+			{
+				PrevState = CurrState;
+				UpdateSimulation(CurrState, (float)Timestep.GetStep());
+			}
 		}
-		if (::GetAsyncKeyState(VK_DOWN) & 0x8000f)
+		UpdateAssets();
+		float alpha = Timestep.GetAlpha();
+		D3DXVec3Lerp(&TeapotPosition, &PrevState.TeapotPosition, &CurrState.TeapotPosition, alpha);
+		float radius = PrevState.Radius + (CurrState.Radius - PrevState.Radius) * alpha;
+		float angle = PrevState.Angle + (CurrState.Angle - PrevState.Angle) * alpha;
+
+		//ųļĿת
+		const D3DXVECTOR3& target = Camera.Target;
+		Eye = D3DXVECTOR3(target.x + cosf(angle)*radius, Camera.Height, target.z + sinf(angle)*radius);
+		D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
+		if (Transforms.SetCamera(Eye, target, up))
 		{
-			radius += 2.0f * timedelta;
+			View = Transforms.GetView();
+			ViewProj = View * Proj;
+			d3d::ExtractFrustum(&ViewFrustum, &ViewProj);
 		}
-		static float angle = (3.0f * D3DX_PI) / 2.0f;
+		Device->SetTransform(D3DTS_VIEW, &View);
 
-		if (::GetAsyncKeyState('A')&0x8000f)
+		//ƶ˲Ÿ»бӰ
+		if (Transforms.SetPosition(TeapotObject, TeapotPosition))
 		{
-			angle -= 0.5f*timedelta;
+			const D3DXMATRIX& T = Transforms.GetWorld(TeapotObject);
+			SceneList.SetWorld(TeapotItem, T);
+			Shadows.SetCasterWorld(TeapotCaster, T);
+			++SceneChanges;
 		}
-		if (::GetAsyncKeyState('D')&0x8000f)
+
+		//޳׶֮ľӣͼģʽûоеľӣÿ澵ֻռһģֵ
+		int depth = ReflectionTechnique == REFLECTION_TEXTURE ? 1 : MirroBudget.MaxDepth;
+		NumVisibleMirrors = Mirrors.empty() ? 0 :
+			d3d::CullMirrors(&Mirrors[0], (int)Mirrors.size(), Eye, ViewFrustum, depth, VisibleMirrors);
+
+		//һлӰͼʱͼ
+		if (ShadowTechnique == SHADOW_TEXTURE && !CreateShadowTextures())
+			ShadowTechnique = SHADOW_PLANAR;
+
+		if (ObjectCulling)
+			UpdateCullVolumes();
+
+		RecordFrame();
+
+		//ӰĶɼ¼߳ɣд붥㻺ҪȾ߳
+		if (ShadowTechnique == SHADOW_VOLUME)
 		{
-			angle += 0.5f*timedelta;
+			for (size_t l = 0; l < TeapotVolumes.size(); ++l)
+				TeapotVolumes[l]->Upload();
 		}
-		
-		//
-		D3DXVECTOR3 position(cosf(angle)*radius, 3.0f, sinf(angle)*radius);
-		D3DXVECTOR3 target(0.0f, 0.0f, 0.0f);
-		D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
-		D3DXMATRIX V;
-		D3DXMatrixLookAtLH(&V, &position, &target, &up);
-		Device->SetTransform(D3DTS_VIEW, &V);
 
 		Device->Clear(0, 0,
 			D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL,
 			0xff000000, 1.0f, 0L);
 		Device->BeginScene();
-		RenderScene();
-		RenderMirro();
-		RenderShadow();
-		Device->EndScene();
-		Device->Present(0, 0, 0, 0);
+		ReplayFrame();
+		{
+			D3D_PROFILE_SCOPE("EndScene"); //豸դ
+			Device->EndScene();
+		}
+		{
+			D3D_PROFILE_SCOPE("Present");
+			Device->Present();
+		}
 	}
+	D3D_PROFILE_END_FRAME();
 	return true;
 }
 
-void RenderScene()
+void RecordSceneTask(d3d::RenderDevice* device, int)
 {
-	//Ʋ
-	Device->SetMaterial(&TeapotMt);
-	Device->SetTexture(0, 0);
-	D3DXMATRIX W;
-	D3DXMatrixTranslation(&W,
-		TeapotPosition.x,
-		TeapotPosition.y,
-		TeapotPosition.z);
-	Device->SetTransform(D3DTS_WORLD, &W);
-	Teapot->DrawSubset(0);
+	RenderScene(device);
+}
 
-	//ǰع
-	D3DXMATRIX I;
-	D3DXMatrixIdentity(&I); //õλ
-	Device->SetTransform(D3DTS_WORLD, &I);
-
-	//Ƶǰbuffer
-	Device->SetStreamSource(0, VB, 0, sizeof(Vertex));
-	Device->SetFVF(Vertex::FVF);
-
-	//ݵǰVBԶƽл
-	Device->SetMaterial(&FloorMt);
-	Device->SetTexture(0, floorTex);
-	Device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 2);
-
-	Device->SetMaterial(&WallMt);
-	Device->SetTexture(0, wallTex);
-	Device->DrawPrimitive(D3DPT_TRIANGLELIST, 6, 4);
-
-	Device->SetMaterial(&MirroMt);
-	Device->SetTexture(0, mirroTex);
-	Device->DrawPrimitive(D3DPT_TRIANGLELIST, 18, 2);
-}
-
-void RenderMirro()
-{
-	Device->SetRenderState(D3DRS_STENCILENABLE, true);
-	Device->SetRenderState(D3DRS_STENCILFUNC, D3DCMP_ALWAYS); //ΪǼɹ
-	Device->SetRenderState(D3DRS_STENCILREF, 0x1); //refֵ
-	Device->SetRenderState(D3DRS_STENCILMASK, 0xffffffff); //ֵ
-	Device->SetRenderState(D3DRS_STENCILWRITEMASK, 0xffffffff); //ֻд
-	Device->SetRenderState(D3DRS_STENCILZFAIL, D3DSTENCILOP_KEEP); //ȼʧˣôģ建浱еֵи
-	Device->SetRenderState(D3DRS_STENCILFAIL, D3DSTENCILOP_KEEP); //ģʧˣ ôģ建浱еֵи
-	Device->SetRenderState(D3DRS_STENCILPASS, D3DSTENCILOP_REPLACE);//ģ建涼ɹˣôʹrefֵ滻еĶӦλ
-	
-	//дȻ̨
-	Device->SetRenderState(D3DRS_ZWRITEENABLE, false);    //رȼ
-	Device->SetRenderState(D3DRS_ALPHABLENDENABLE, true); //ں
-	Device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_ZERO); //ԴںΪ0
-	Device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_ONE); //ĿںΪ1 
+void RecordMirroTask(d3d::RenderDevice* device, int)
+{
+	RenderMirro(device);
+}
+
+void RecordNestedTask(d3d::RenderDevice* device, int)
+{
+	RenderNestedMirrors(device);
+}
+
+void RecordMirroTexturesTask(d3d::RenderDevice* device, int)
+{
+	DrawMirrorTextures(device);
+}
+
+void RecordFrame()
+{
+	D3D_PROFILE_SCOPE("Record");
+
+	//¼֮ǰйڵľã¼ֻ߳TransformCache
+	Transforms.Update();
+	++MirroFrame;
+
+	//طŵ˳УӰ
+	RecordTasks.clear();
+	RecordTask scene = { SceneCommands, RecordSceneTask, 0, PASS_SCENE };
+	RecordTasks.push_back(scene);
+	if (ShadowTechnique == SHADOW_TEXTURE)
+	{
+		//ֻػԴͶӰ嶯Ľͼٰÿͼ˵
+		NumShadowCommands = ShadowTextureUpdates = SelectShadowUpdates();
+		for (int i = 0; i < NumShadowCommands; ++i)
+		{
+			RecordTask update = { ShadowCommands[i], RenderShadowTexture, i, PASS_SHADOW_TEXTURES };
+			RecordTasks.push_back(update);
+		}
+		RecordTask receivers = { ReceiverCommands, RenderReceivers, 0, PASS_SHADOW };
+		RecordTasks.push_back(receivers);
+	}
+	else
+	{
+		NumShadowCommands = ShadowTechnique == SHADOW_VOLUME ? (int)TeapotVolumes.size() : Shadows.GetNumReceivers();
+		//ļ¼̹߳һϸڲεӽǣѡã¼ʱֻ
+		if (ShadowTechnique == SHADOW_PLANAR)
+			SceneList.UpdateLods(ShadowLodView());
+		for (int i = 0; i < NumShadowCommands; ++i)
+		{
+			RecordTask shadow = { ShadowCommands[i], ShadowTechnique == SHADOW_VOLUME ? RenderShadowVolume : RenderShadow, i,
+				PASS_SHADOW };
+			RecordTasks.push_back(shadow);
+		}
+	}
+	MirroTextureUpdates = 0;
+	if (NumVisibleMirrors > 0 && ReflectionTechnique == REFLECTION_TEXTURE)
+	{
+		//ҪµľӸһͼٰпɼľ
+		MirroTextureUpdates = SelectMirrorUpdates();
+		for (int i = 0; i < MirroTextureUpdates; ++i)
+		{
+			RecordTask update = { ReflectCommands[i], RenderMirrorTexture, i, PASS_MIRROR_TEXTURES };
+			RecordTasks.push_back(update);
+		}
+		RecordTask composite = { MirroCommands, RecordMirroTexturesTask, 0, PASS_MIRRO };
+		RecordTasks.push_back(composite);
+		MirroDepthPixels = MirroRegionPixels = 0.0f;
+	}
+	else if (NumVisibleMirrors > 0)
+	{
+		RecordTask mirro = { MirroCommands, RecordMirroTask, 0, PASS_MIRRO };
+		RecordTasks.push_back(mirro);
+		for (int i = 0; i < NumVisibleMirrors; ++i)
+		{
+			RecordTask reflect = { ReflectCommands[i], RenderReflection, i, PASS_MIRRO };
+			RecordTasks.push_back(reflect);
+		}
+		RecordTask nested = { NestedCommands, RecordNestedTask, 0, PASS_NESTED };
+		RecordTasks.push_back(nested);
+	}
+	else
+	{
+		MirroDepthPixels = MirroRegionPixels = 0.0f;
+	}
+
+	//ÿԼ߳ϼʱܷǹ鵽Record
+	auto record = [](int i)
+	{
+		const RecordTask& task = RecordTasks[i];
+		D3D_PROFILE_SCOPE(PassNames[task.Pass]);
+		task.Commands->Reset();
+		task.Record(task.Commands, task.Index);
+	};
+	RecordPool->ParallelFor((int)RecordTasks.size(), record);
+}
+
+void ReplayFrame()
+{
+	//ȻȾĿ֮Ľ׶ζں̨
+	if (MirroTextureUpdates > 0)
+	{
+		D3D_PROFILE_SCOPE(PassNames[PASS_MIRROR_TEXTURES]);
+		for (int i = 0; i < MirroTextureUpdates; ++i)
+			ReflectCommands[i]->Replay(Device);
+	}
+	if (ShadowTechnique == SHADOW_TEXTURE && NumShadowCommands > 0)
+	{
+		D3D_PROFILE_SCOPE(PassNames[PASS_SHADOW_TEXTURES]);
+		for (int i = 0; i < NumShadowCommands; ++i)
+			ShadowCommands[i]->Replay(Device);
+	}
+	{
+		D3D_PROFILE_SCOPE(PassNames[PASS_SCENE]);
+		SceneCommands->Replay(Device);
+	}
+	{
+		D3D_PROFILE_SCOPE(PassNames[PASS_SHADOW]);
+		if (ShadowTechnique == SHADOW_TEXTURE)
+			ReceiverCommands->Replay(Device);
+		else
+		{
+			for (int i = 0; i < NumShadowCommands; ++i)
+				ShadowCommands[i]->Replay(Device);
+		}
+	}
+	if (NumVisibleMirrors > 0)
+	{
+		D3D_PROFILE_SCOPE(PassNames[PASS_MIRRO]);
+		MirroCommands->Replay(Device);
+		if (ReflectionTechnique != REFLECTION_TEXTURE)
+		{
+			for (int i = 0; i < NumVisibleMirrors; ++i)
+				ReflectCommands[i]->Replay(Device);
+			D3D_PROFILE_SCOPE(PassNames[PASS_NESTED]);
+			NestedCommands->Replay(Device);
+		}
+	}
+}
+
+//һ֡׶ε޳壬Ⱦ߳ϵ
+void UpdateCullVolumes()
+{
+	d3d::InitCullVolume(&ViewVolume, ViewFrustum);
+
+	for (int i = 0; i < NumVisibleMirrors; ++i)
+	{
+		int index = VisibleMirrors[i];
+		d3d::GetMirrorCullVolume(Mirrors[index], Eye, ViewFrustum, &MirrorVolumes[index]);
+	}
+
+	//ӰͼӽػҪеӰ׶޳
+	if (ShadowTechnique != SHADOW_TEXTURE)
+	{
+		for (int l = 0; l < Shadows.GetNumLights(); ++l)
+		{
+			d3d::CullVolume volume;
+			d3d::ExtrudeCullVolume(&volume, ViewFrustum, Shadows.GetLight(l));
+			SceneList.Cull(volume, &ShadowVisible[l][0]);
+		}
+	}
+}
+
+void RenderScene(d3d::RenderDevice* device)
+{
+	device->ApplyStateBlock(DefaultPass);
+	d3d::LodView lod = d3d::InitLodView(Eye, Proj, height, LodPixelError, SceneLodBias, &SceneLodHistory);
+	SceneList.Draw(device, ObjectCulling ? &ViewVolume : 0, &lod);
+
+	//治бӲᷴԼ
+	device->SetTransform(D3DTS_WORLD, &Transforms.GetWorld(RoomObject));
+	device->SetStreamSource(0, MirroVB, 0, sizeof(Vertex));
+	device->SetFVF(Vertex::FVF);
+	device->SetMaterial(&MirroMt);
+	device->SetTexture(0, mirroTex);
+	for (int i = 0; i < NumVisibleMirrors; ++i)
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, VisibleMirrors[i] * 6, 2);
+}
+
+//Ǿӣþ
+void RenderMirro(d3d::RenderDevice* device)
+{
+	MirroDepthPixels = MirroRegionPixels = 0.0f;
+
+	device->ApplyStateBlock(MirroMarkPass);
 	//ֹ̨ĸ
 
-	//ƾӵģ建
-	Device->SetStreamSource(0, VB, 0, sizeof(Vertex));
-	Device->SetFVF(Vertex::FVF);
-	Device->SetMaterial(&MirroMt);
-	Device->SetTexture(0, mirroTex);
+	//ƾӵģ建ÿ澵дԼrefֵ
+	device->SetStreamSource(0, MirroVB, 0, sizeof(Vertex));
+	device->SetFVF(Vertex::FVF);
+	device->SetMaterial(&MirroMt);
+	device->SetTexture(0, mirroTex);
 	D3DXMATRIX I;
 	D3DXMatrixIdentity(&I);
-	Device->SetTransform(D3DTS_WORLD, &I);
-	Device->DrawPrimitive(D3DPT_TRIANGLELIST, 18, 2);
+	device->SetTransform(D3DTS_WORLD, &I);
+	for (int i = 0; i < NumVisibleMirrors; ++i)
+	{
+		const d3d::Mirror& m = Mirrors[VisibleMirrors[i]];
+		device->SetRenderState(D3DRS_STENCILREF, m.StencilRef);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, VisibleMirrors[i] * 6, 2);
+	}
+	//浱пɼӦģضó˸þӵrefֵ
+	//˴ֻģ Ǿ
 
-	//´Z
-	Device->SetRenderState(D3DRS_ZWRITEENABLE, true);
-	//浱пɼӦģضó0x1
+	//ԾȾס˷Ⱦ˾ҪΪԶ
+	for (int i = 0; i < NumVisibleMirrors; ++i)
+		MirroRegionPixels += d3d::GetMirrorScreenArea(Mirrors[VisibleMirrors[i]], ViewProj, width, height);
 
+	bool region = MirroDepthMode == MIRROR_DEPTH_REGION ||
+		(MirroDepthMode == MIRROR_DEPTH_AUTO && NumVisibleMirrors > 1);
+	if (region)
+	{
+		//ѾͶӰԶƽ棬ֻдģֵ澵refصȣȲ
+		device->ApplyStateBlock(DepthResetPass);
+		device->SetTransform(D3DTS_PROJECTION, &FarProj);
+		for (int i = 0; i < NumVisibleMirrors; ++i)
+		{
+			const d3d::Mirror& m = Mirrors[VisibleMirrors[i]];
+			device->SetRenderState(D3DRS_STENCILREF, m.StencilRef);
+			device->DrawPrimitive(D3DPT_TRIANGLELIST, VisibleMirrors[i] * 6, 2);
+		}
+		device->SetTransform(D3DTS_PROJECTION, &Proj);
+		MirroDepthPixels = MirroRegionPixels;
+	}
+	else
+	{
+		//z
+		device->Clear(0, 0, D3DCLEAR_ZBUFFER, 0, 1.0f, 0);
+		MirroDepthPixels = (float)width * height;
+	}
 
-	//ֻƷĲƵĵط
-	Device->SetRenderState(D3DRS_STENCILFUNC, D3DCMP_EQUAL);
-	Device->SetRenderState(D3DRS_STENCILPASS, D3DSTENCILOP_KEEP); //ģɹôԭ
-	//˴ֻģ Ǿ
+	//ʼĳ뾵blend
+	device->ApplyStateBlock(ReflectPass);
+}
 
-	//λ÷,ȴ
-	D3DXMATRIX W, T, R;
+//iɼľﷴĳ
+void RenderReflection(d3d::RenderDevice* device, int i)
+{
+	const d3d::Mirror& m = Mirrors[VisibleMirrors[i]];
+
+	//ֻƵ澵ڵĵطӱ
+	device->SetRenderState(D3DRS_STENCILREF, m.StencilRef);
+	BeginReflection(device, m.Plane);
+	d3d::LodView lod = ReflectedLodView(m.Reflect, Proj, height, &MirrorLodHistories[VisibleMirrors[i]]);
+	SceneList.DrawReflected(device, Transforms, VisibleMirrors[i], m.Plane,
+		ObjectCulling ? &MirrorVolumes[VisibleMirrors[i]] : 0, &lod);
+}
 
-	D3DXPLANE plane(0.0f, 0.0f, 1.0f, 0.0f);
-	D3DXMatrixReflect(&R, &plane);
+//͸reflectѡϸڲΣ۾һ࣬ľǵľ
+d3d::LodView ReflectedLodView(const D3DXMATRIX& reflect, const D3DXMATRIX& proj, UINT viewportHeight,
+	d3d::LodHistory* history)
+{
+	D3DXMATRIX back;
+	D3DXMatrixInverse(&back, 0, &reflect);
+	D3DXVECTOR3 eye;
+	D3DXVec3TransformCoord(&eye, &Eye, &back);
+	return d3d::InitLodView(eye, proj, viewportHeight, LodPixelError, ReflectionLodBias, history);
+}
 
-	//õλþ
-	D3DXMatrixTranslation(&T,
-		TeapotPosition.x,
-		TeapotPosition.y,
-		TeapotPosition.z);
+//ѡһ֡ҪػͼĿɼӣûģ۾˶ϴθѾ㹻֡
+//Ⱦ߳ϵã¼ֻ߳ӵ
+int SelectMirrorUpdates()
+{
+	int count = 0;
+	for (int i = 0; i < NumVisibleMirrors; ++i)
+	{
+		int index = VisibleMirrors[i];
+		MirrorTexture& t = MirroTextures[index];
+		if (t.Valid && ((t.Eye == Eye && t.SceneChanges == SceneChanges) || MirroFrame - t.LastFrame < t.Interval))
+			continue;
+
+		d3d::GetMirrorCamera(Mirrors[index], Eye, Camera.FarPlane, &t.View, &t.Proj);
+		//ͼúüֻ֡Լ޳һ֡׶
+		d3d::Frustum frustum;
+		D3DXMATRIX viewProj = t.View * t.Proj;
+		d3d::ExtractFrustum(&frustum, &viewProj);
+		d3d::InitCullVolume(&t.Volume, frustum);
+		d3d::TransformCullVolume(&t.Volume, Mirrors[index].Reflect);
+		t.Valid = true;
+		t.LastFrame = MirroFrame;
+		t.Eye = Eye;
+		t.SceneChanges = SceneChanges;
+		UpdatedMirrors[count++] = index;
+	}
+	return count;
+}
 
-	//λþԷ󣬵õĲ
-	W = T*R;
+//iҪµľӣ͸濴ķ䳡ͼ
+void RenderMirrorTexture(d3d::RenderDevice* device, int i)
+{
+	int index = UpdatedMirrors[i];
+	const MirrorTexture& t = MirroTextures[index];
+
+	device->SetRenderTarget(t.Target);
+	//ûз䵽ĵطǰɫ˵ϻǾ汾ɫ
+	device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER | D3DCLEAR_STENCIL, 0xffffffff, 1.0f, 0);
+	device->ApplyStateBlock(MirroTexturePass);
+	//ƽǾ棬ǰĶửͼ
+	device->SetTransform(D3DTS_VIEW, &t.View);
+	device->SetTransform(D3DTS_PROJECTION, &t.Proj);
+	d3d::LodView lod = ReflectedLodView(Mirrors[index].Reflect, t.Proj, t.Height, &MirrorLodHistories[index]);
+	SceneList.DrawReflected(device, Transforms, index, Mirrors[index].Plane, ObjectCulling ? &t.Volume : 0, &lod);
+
+	device->SetTransform(D3DTS_VIEW, &View);
+	device->SetTransform(D3DTS_PROJECTION, &Proj);
+	device->SetRenderTarget(0);
+}
 
-	//zҿʼ뾵blend
-	Device->Clear(0, 0, D3DCLEAR_ZBUFFER, 0, 1.0f, 0); //ԾȾס˲ȾZ
-	Device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_DESTCOLOR); //ʹԲ뾵ں
-	Device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_ZERO);
+//ÿɼӵͼ˵ϣģ巽ʽһɫԾɫ
+void DrawMirrorTextures(d3d::RenderDevice* device)
+{
+	device->ApplyStateBlock(ModulatePass);
+	device->SetTransform(D3DTS_WORLD, &Transforms.GetWorld(RoomObject));
+	device->SetStreamSource(0, MirroVB, 0, sizeof(Vertex));
+	device->SetFVF(Vertex::FVF);
+	device->SetMaterial(&TextureColorMt);
+	for (int i = 0; i < NumVisibleMirrors; ++i)
+	{
+		device->SetTexture(0, MirroTextures[VisibleMirrors[i]].Target);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, VisibleMirrors[i] * 6, 2);
+	}
+	//һ֡ͼʱܻͼ׶
+	device->SetTexture(0, 0);
+}
 
-	//õǰλãþĲĵط
-	Device->SetTransform(D3DTS_WORLD, &W);
-	Device->SetMaterial(&TeapotMt);
-	Device->SetTexture(0, 0);
+//еľӣݹ飬ֱﵽȻԤ
+void RenderNestedMirrors(d3d::RenderDevice* device)
+{
+	if (MirroBudget.MaxDepth > 1)
+	{
+		MirroTriangles = 0;
+		MirroStart = std::chrono::steady_clock::now();
+		for (int i = 0; i < NumVisibleMirrors; ++i)
+		{
+			const d3d::Mirror& m = Mirrors[VisibleMirrors[i]];
+			RenderNestedMirrors(device, d3d::InitMirrorView(m, VisibleMirrors[i]), VisibleMirrors[i] + 1);
+		}
+	}
+	EndReflection(device);
+}
 
-	//ȾǰȷȾ棬зת
-	Device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CW);
-	Teapot->DrawSubset(0);
+void BeginReflection(d3d::RenderDevice* device, const D3DXPLANE& mirrorPlane)
+{
+	//ֻ汳Ĳ֣ü泯ӱ
+	D3DXPLANE behind = -mirrorPlane;
+	if (ReflectionClip == REFLECTION_CLIP_OBLIQUE)
+	{
+		//ƽƵϣöĲü
+		D3DXMATRIX oblique;
+		d3d::MatrixObliqueProjection(&oblique, View, Proj, behind);
+		device->SetTransform(D3DTS_PROJECTION, &oblique);
+	}
+	else
+	{
+		device->SetTransform(D3DTS_PROJECTION, &Proj);
+		device->SetClipPlane(0, (const float*)&behind);
+		device->SetRenderState(D3DRS_CLIPPLANEENABLE, D3DCLIPPLANE0);
+	}
+}
 
-	//ر֮ǰ򿪵Ⱦflag
-	Device->SetRenderState(D3DRS_ALPHABLENDENABLE, false);
-	Device->SetRenderState(D3DRS_STENCILENABLE, false);
-	Device->SetRenderState(D3DRS_CULLMODE, D3DCULL_CCW);
+void EndReflection(d3d::RenderDevice* device)
+{
+	device->SetTransform(D3DTS_PROJECTION, &Proj);
+	device->SetRenderState(D3DRS_CLIPPLANEENABLE, 0);
 }
 
-void RenderShadow()
+bool MirroOverBudget(DWORD triangles)
 {
-	//ڻ㣬ôд룬ģԶΪ
-	Device->SetRenderState(D3DRS_STENCILENABLE, true);
-	Device->SetRenderState(D3DRS_STENCILFUNC, D3DCMP_EQUAL);
-	Device->SetRenderState(D3DRS_STENCILREF, 0x0); //ģ建жӦֵΪ0ôͻƵ̨
-	Device->SetRenderState(D3DRS_STENCILMASK, 0xffffffff);
-	Device->SetRenderState(D3DRS_STENCILWRITEMASK, 0xffffffff);
-	Device->SetRenderState(D3DRS_STENCILZFAIL, D3DSTENCILOP_KEEP);
-	Device->SetRenderState(D3DRS_STENCILFAIL, D3DSTENCILOP_KEEP);
-	//״νƵ̨ܳɹ
-	//ͼһѾдؽдģʧ
-	Device->SetRenderState(D3DRS_STENCILPASS, D3DSTENCILOP_INCR);
-
-	//Ӱ
-	D3DXVECTOR4 lightDirection(0.707f, -0.707f, 0.707f, 0.0f);
-	D3DXPLANE groundPlane(0.0f, -1.0f, 0.0f, 0.0f);
-	D3DXMATRIX S;
-	D3DXMatrixShadow(&S,
-		&lightDirection,
-		&groundPlane);
-
-	D3DXMATRIX T;
-	D3DXMatrixTranslation(&T,
-		TeapotPosition.x,
-		TeapotPosition.y,
-		TeapotPosition.z);
-
-	D3DXMATRIX W = T*S;
-	Device->SetTransform(D3DTS_WORLD, &W);
-
-	//͸50%ĺɫʣȻ棬Ӱ
-	//ȻȻ沢ҽAlphaںϺģ
-	//
-	Device->SetRenderState(D3DRS_ALPHABLENDENABLE, true);
-	Device->SetRenderState(D3DRS_SRCBLEND, D3DBLEND_DESTALPHA);
-	Device->SetRenderState(D3DRS_DESTBLEND, D3DBLEND_INVSRCALPHA);
+	if (MirroTriangles + triangles > MirroBudget.MaxTriangles)
+		return true;
+	std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - MirroStart;
+	return elapsed.count() > MirroBudget.MaxMilliseconds;
+}
+
+//pathǴ⵽ﾭĸ澵ӵıżһһλÿǶ׵ӽһ
+void RenderNestedMirrors(d3d::RenderDevice* device, const d3d::MirrorView& parent, unsigned long long path)
+{
+	if (parent.Level >= MirroBudget.MaxDepth)
+		return;
 
+	//ÿһ㣺6Σǡȡָб
+	const DWORD cost = 6 + SceneList.GetTriangleCount();
+
+	for (size_t i = 0; i < Mirrors.size(); ++i)
+	{
+		d3d::MirrorView view;
+		if (!d3d::CullMirror(Mirrors[i], (int)i, parent, Eye, ViewFrustum, &view))
+			continue;
+		if (MirroOverBudget(cost))
+			return;
+
+		//ڸӵﻭ澵ӣģֵһ
+		//øӵĲüģʱҪͬͶӰ
+		BeginReflection(device, parent.Plane);
+		device->ApplyStateBlock(NestedMarkPass);
+		device->SetRenderState(D3DRS_STENCILREF, parent.StencilRef);
+		device->SetStreamSource(0, MirroVB, 0, sizeof(Vertex));
+		device->SetFVF(Vertex::FVF);
+		device->SetMaterial(&MirroMt);
+		device->SetTexture(0, mirroTex);
+		device->SetTransform(D3DTS_WORLD, &parent.Reflect);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, (UINT)i * 6, 2);
+
+		//ֻ澵ӵ
+		device->ApplyStateBlock(DepthResetPass);
+		device->SetRenderState(D3DRS_STENCILREF, view.StencilRef);
+		device->SetTransform(D3DTS_PROJECTION, &FarProj);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, (UINT)i * 6, 2);
+
+		//ĳÿһ淭תһ
+		BeginReflection(device, view.Plane);
+		device->ApplyStateBlock(ReflectPass);
+		device->SetRenderState(D3DRS_STENCILREF, view.StencilRef);
+		device->SetRenderState(D3DRS_CULLMODE, view.Level % 2 ? D3DCULL_CW : D3DCULL_CCW);
+		unsigned long long viewPath = path * (Mirrors.size() + 1) + i + 1;
+		d3d::LodView lod = ReflectedLodView(view.Reflect, Proj, height, &NestedLodHistories[viewPath]);
+		MirroTriangles += 6 + SceneList.DrawReflected(device, view.Reflect, Mirrors[i].Plane, &lod);
+
+		RenderNestedMirrors(device, view, viewPath);
+
+		//ָӵģֵȣúľӿȷر
+		BeginReflection(device, parent.Plane);
+		device->ApplyStateBlock(NestedPopPass);
+		device->SetRenderState(D3DRS_STENCILREF, view.StencilRef);
+		device->SetStreamSource(0, MirroVB, 0, sizeof(Vertex));
+		device->SetFVF(Vertex::FVF);
+		device->SetTransform(D3DTS_WORLD, &parent.Reflect);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, (UINT)i * 6, 2);
+	}
+}
+
+void DrawReceiver(d3d::RenderDevice* device, const d3d::ShadowReceiver& receiver)
+{
+	D3DXMATRIX I;
+	D3DXMatrixIdentity(&I);
+	device->SetTransform(D3DTS_WORLD, &I);
+	receiver.Geometry->DrawRange(device, receiver.Range);
+}
+
+//һйԴƽӰ
+void RenderShadow(d3d::RenderDevice* device, int r)
+{
+	//͸50%ĺɫʣӰ
 	D3DMATERIAL9 mtrl = d3d::InitMtrl(d3d::BLACK, d3d:: BLACK, d3d:: BLACK, d3d::BLACK, 0.0F);
 	mtrl.Diffuse.a = 0.5f;
 
-	Device->SetRenderState(D3DRS_ZENABLE, false);
+	const d3d::ShadowReceiver& receiver = Shadows.GetReceiver(r);
+	bool touched = false;
+	d3d::LodView lod = ShadowLodView();
 
-	Device->SetMaterial(&mtrl);
-	Device->SetTexture(0, 0);
+	for (int l = 0; l < Shadows.GetNumLights(); ++l)
+	{
+		const char* visible = ObjectCulling ? &ShadowVisible[l][0] : 0;
+		bool casts = false;
+		for (int c = 0; c < Shadows.GetNumCasters() && !casts; ++c)
+			casts = CastsShadow(l, r, c, visible);
+		if (!casts)
+			continue;
+
+		//ÿԴ±һΣģֵص1INCR֤ͬһӰֻںһ
+		device->ApplyStateBlock(ReceiverMarkPass);
+		DrawReceiver(device, receiver);
+		device->ApplyStateBlock(ShadowPass);
+		device->SetMaterial(&mtrl);
+		device->SetTexture(0, 0);
+		touched = true;
+		DrawShadowCasters(device, l, r, mtrl, visible, &lod);
+	}
 
-	Teapot->DrawSubset(0);
+	//ı
+	if (touched)
+	{
+		device->ApplyStateBlock(ReceiverClearPass);
+		DrawReceiver(device, receiver);
+	}
+}
 
-	Device->SetRenderState(D3DRS_ZENABLE, true);
-	Device->SetRenderState(D3DRS_ALPHABLENDENABLE, false);
-	Device->SetRenderState(D3DRS_STENCILENABLE, false);
+//ƽӰѡϸڲεӽǣн湲һʷͬһڸϵӰһ𻻼
+d3d::LodView ShadowLodView()
+{
+	return d3d::InitLodView(Eye, Proj, height, LodPixelError, ShadowLodBias, &ShadowLodHistory);
+}
 
+//ͶӰcڹԴlûӰڽrϣvisibleΪ0ʱȿӰ᲻׶
+bool CastsShadow(int l, int r, int c, const char* visible)
+{
+	return (!visible || visible[CasterItems[c]]) && Shadows.GetMatrix(l, r, c) != 0;
 }
 
+//ԴlڽrͶµӰͬһӰһһʵ
+//ӰϸڲΰͶӰ屾۾Զѡ
+bool DrawShadowCasters(d3d::RenderDevice* device, int l, int r, const D3DMATERIAL9& mtrl, const char* visible,
+	const d3d::LodView* lod)
+{
+	std::vector<d3d::MeshInstance>& instances = ShadowInstances[r];
+	d3d::Mesh* batch = 0;
+	bool drawn = false;
+	instances.clear();
+	for (int c = 0; c < Shadows.GetNumCasters(); ++c)
+	{
+		if (visible && !visible[CasterItems[c]])
+			continue;
+		const D3DXMATRIX* S = Shadows.GetMatrix(l, r, c);
+		if (!S)
+			continue;
+
+		d3d::Mesh* mesh = SceneList.GetModel(CasterItems[c], lod);
+		if (mesh != batch && !instances.empty())
+		{
+			device->DrawInstances(batch, &instances[0], (UINT)instances.size(), &mtrl, 1);
+			instances.clear();
+		}
+		batch = mesh;
+		d3d::MeshInstance instance;
+		instance.World = *S;
+		instance.Material = 0;
+		instances.push_back(instance);
+		drawn = true;
+	}
+	if (!instances.empty())
+		device->DrawInstances(batch, &instances[0], (UINT)instances.size(), &mtrl, 1);
+	return drawn;
+}
 
+//ѡһ֡ҪػӰͼĽ棺ûģ߹ԴͶӰ嶯
+//Ⱦ߳ϵã¼ֻ߳ͼ
+int SelectShadowUpdates()
+{
+	int count = 0;
+	for (size_t r = 0; r < ShadowTextures.size(); ++r)
+	{
+		ShadowTexture& t = ShadowTextures[r];
+		DWORD version = Shadows.GetVersion((int)r);
+		if (t.Valid && t.Version == version)
+			continue;
+		t.Valid = true;
+		t.Version = version;
+		ShadowUpdates[count++] = (int)r;
+	}
+	return count;
+}
 
+//iҪػĽ棺йԴӰѹƽϣͼ
+void RenderShadowTexture(d3d::RenderDevice* device, int i)
+{
+	int r = ShadowUpdates[i];
+	const ShadowTexture& t = ShadowTextures[r];
+	D3DMATERIAL9 mtrl = d3d::InitMtrl(d3d::BLACK, d3d:: BLACK, d3d:: BLACK, d3d::BLACK, 0.0F);
+	mtrl.Diffuse.a = 0.5f;
+
+	//ɫûӰĵطģֵΪ1ػܱԴӰ䰵һ
+	device->SetRenderTarget(t.Target);
+	device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_STENCIL, 0xffffffff, 1.0f, 1);
+	device->SetTransform(D3DTS_VIEW, &t.View);
+	device->SetTransform(D3DTS_PROJECTION, &t.Proj);
+	device->ApplyStateBlock(ShadowPass);
+	device->SetMaterial(&mtrl);
+	device->SetTexture(0, 0);
+	//ƽͶӰѡϸڲκ۾λ޹أͼΪƶػ
+	d3d::LodView lod = d3d::InitLodView(Eye, t.Proj, ShadowTextureSize, LodPixelError, ShadowLodBias,
+		&ShadowTextureLodHistories[r]);
+	bool drawn = false;
+	for (int l = 0; l < Shadows.GetNumLights(); ++l)
+	{
+		if (drawn)
+			device->Clear(0, 0, D3DCLEAR_STENCIL, 0, 1.0f, 1);
+		drawn = DrawShadowCasters(device, l, r, mtrl, 0, &lod);
+	}
+
+	device->SetTransform(D3DTS_VIEW, &View);
+	device->SetTransform(D3DTS_PROJECTION, &Proj);
+	device->SetRenderTarget(0);
+}
+
+//ÿӰͼ˵ѾõĽϣȺͽ
+void RenderReceivers(d3d::RenderDevice* device, int)
+{
+	D3DXMATRIX I;
+	D3DXMatrixIdentity(&I);
+	device->ApplyStateBlock(ModulatePass);
+	device->SetTransform(D3DTS_WORLD, &I);
+	device->SetStreamSource(0, ReceiverVB, 0, sizeof(Vertex));
+	device->SetFVF(Vertex::FVF);
+	device->SetMaterial(&TextureColorMt);
+	for (size_t r = 0; r < ShadowTextures.size(); ++r)
+	{
+		const ShadowTexture& t = ShadowTextures[r];
+		device->SetTexture(0, t.Target);
+		device->DrawPrimitive(D3DPT_TRIANGLELIST, t.FirstVertex, t.NumTriangles);
+	}
+	device->SetTexture(0, 0);
+}
+
+
+
+
+//lԴӰ
+void RenderShadowVolume(d3d::RenderDevice* device, int l)
+{
+	//Ӱ䲻׶Դʲôû
+	if (ObjectCulling && !ShadowVisible[l][TeapotItem])
+		return;
 
+	const D3DXMATRIX& T = Transforms.GetWorld(TeapotObject);
+	D3DXMATRIX invT;
+	D3DXMatrixInverse(&invT, 0, &T);
+
+	D3DMATERIAL9 mtrl = d3d::InitMtrl(d3d::BLACK, d3d:: BLACK, d3d:: BLACK, d3d::BLACK, 0.0F);
+	mtrl.Diffuse.a = 0.5f;
+
+	D3DXMATRIX I;
+	D3DXMatrixIdentity(&I);
+
+	//ѹԴ任ռ䣬ֻƽʱⲻ䣬Ӱ岻
+	//ֻɶ㣬Ⱦ߳ڻط֮ǰд붥㻺
+	const D3DXVECTOR4& light = Shadows.GetLight(l);
+	D3DXVECTOR3 p(light.x, light.y, light.z);
+	if (light.w == 0.0f)
+		D3DXVec3TransformNormal(&p, &p, &invT);
+	else
+		D3DXVec3TransformCoord(&p, &p, &invT);
+	TeapotVolumes[l]->Build(D3DXVECTOR4(p.x, p.y, p.z, light.w), VolumeExtrude);
+
+	device->SetTransform(D3DTS_WORLD, &T);
+	device->ApplyStateBlock(VolumeBackPass);
+	TeapotVolumes[l]->Draw(device);
+	device->ApplyStateBlock(VolumeFrontPass);
+	TeapotVolumes[l]->Draw(device);
+
+	//ȫİ͸ɫΣֻӰ
+	device->ApplyStateBlock(VolumeShadePass);
+	device->SetTransform(D3DTS_WORLD, &I);
+	device->SetTransform(D3DTS_VIEW, &I);
+	device->SetTransform(D3DTS_PROJECTION, &I);
+	device->SetMaterial(&mtrl);
+	device->SetTexture(0, 0);
+	device->SetStreamSource(0, ScreenVB, 0, sizeof(Vertex));
+	device->SetFVF(Vertex::FVF);
+	device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, 2);
+	device->SetTransform(D3DTS_VIEW, &View);
+	device->SetTransform(D3DTS_PROJECTION, &Proj);
+}
+
+
+
+
+#ifdef _WIN32
 LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
 	switch (msg)
@@ -411,12 +1645,15 @@ int WINAPI WinMain(HINSTANCE hinstance,
 	PSTR cmdLine,
 	int showCmd)
 {
+	IDirect3DDevice9* d3d9 = 0;
 	if (!d3d::InitD3D(hinstance,
-		width, height, true, D3DDEVTYPE_HAL, &Device))
+		width, height, true, D3DDEVTYPE_HAL, &d3d9))
 	{
 		::MessageBox(0, "InitD3D() - FAILED", 0, 0);
 		return 0;
 	}
+	Device = new d3d::StateCache(d3d::CreateD3D9Device(d3d9));
+	d3d9->Release();
 
 	if (!Setup())
 	{
@@ -424,11 +1661,31 @@ int WINAPI WinMain(HINSTANCE hinstance,
 		return 0;
 	}
 
-	d3d::EnterMsgLoop(Display);
+	//-fps N֡ʣʱóCPU
+	const char* fps = strstr(cmdLine, "-fps");
+	if (fps)
+		FrameRateLimit = atof(fps + 4);
+
+	//-trace ļ˳ʱ֡дChrome trace
+	std::string trace;
+	const char* traceArg = strstr(cmdLine, "-trace");
+	if (traceArg)
+	{
+		for (traceArg += 6; *traceArg == ' '; ++traceArg)
+			;
+		while (*traceArg && *traceArg != ' ')
+			trace += *traceArg++;
+	}
+
+	d3d::EnterMsgLoop(Display, FrameRateLimit);
+
+	if (!trace.empty())
+		(void)D3D_PROFILE_WRITE_TRACE(trace.c_str());
 
 	CleanUp();
 
 	Device->Release();
 
 	return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,160 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dInit.h
+//
+// Desc: Entry points of the mirror/shadow demo scene, shared by WinMain and the headless
+//       driver.  Assign Device before calling Setup().
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __d3dInitH__
+#define __d3dInitH__
+
+#include "mirror.h"
+#include "renderDevice.h"
+
+extern d3d::RenderDevice* Device;
+
+// Back buffer size; set before Setup().
+extern int width;
+extern int height;
+
+// Planar projection onto the receiver planes, z-fail stencil shadow volumes, or planar
+// shadows rendered once into a texture per receiver and multiplied onto it every frame.  A
+// receiver's texture is redrawn only when a light or a caster changed.
+enum ShadowMode
+{
+	SHADOW_PLANAR,
+	SHADOW_VOLUME,
+	SHADOW_TEXTURE
+};
+extern ShadowMode ShadowTechnique;
+
+// Shadow textures the last frame redrew.
+extern int ShadowTextureUpdates;
+
+// Draw only the objects whose bounding sphere can show up in a pass: inside the view
+// frustum for the scene, inside the frustum seen through the mirror quad for a reflection,
+// and inside the frustum swept towards the light for planar shadows and shadow volumes.
+// Shadow textures are kept across views and are not culled.
+extern bool ObjectCulling;
+
+// Levels of detail: every scene mesh is simplified into coarser levels in the background
+// once it is loaded, the full mesh standing in until they are ready, and each pass draws
+// the coarsest level whose error covers at most LodPixelError pixels where it is drawn.
+// Each step of a pass's bias doubles that; reflections and shadows are small or dark
+// enough to take more.  0 pixels always draws the full meshes.  Shadow volumes are built
+// from the full teapot and do not change level.
+extern float LodPixelError;
+extern float SceneLodBias;
+extern float ReflectionLodBias;
+extern float ShadowLodBias;
+
+// The room, its lights, mirrors, the teapot and the camera come from a binary scene file
+// (see sceneFile.h), compiled from the text source first when the binary is missing or of
+// an older version.  Set before Setup().
+extern const char* SceneFile;
+extern const char* SceneSource;
+
+// Teapots in the room: the scene's first instance, which the arrow keys move, plus
+// TeapotCount - 1 small static copies of it on the floor, drawn as instances.  Set
+// before Setup().
+extern int TeapotCount;
+
+// Mirrors in the room, 1 to MaxSceneMirrors: the first MirrorCount mirrors of the scene,
+// at most as many as it has.  room.scn has the one in the back wall, then mirrors on the
+// left and right walls that face each other.  Set before Setup().
+enum { MaxSceneMirrors = 5 };
+extern int MirrorCount;
+
+// Limits on mirrors seen in mirrors.  With a time limit what gets drawn depends on the
+// speed of the machine.
+extern d3d::MirrorBudget MirroBudget;
+
+// How the mirror pass gets the scene's depth out of the way of the reflections: clear the
+// whole depth buffer, or reset it to the far plane only under each mirror's stencil value,
+// which leaves the rest of the scene's depth intact.  AUTO resets regions whenever more
+// than one mirror is visible.
+enum MirrorDepthMode
+{
+	MIRROR_DEPTH_AUTO,
+	MIRROR_DEPTH_CLEAR,
+	MIRROR_DEPTH_REGION
+};
+extern MirrorDepthMode MirroDepthMode;
+
+// Depth pixels the last frame's mirror pass wrote to reset depth, and the pixels region
+// resets cover (the visible mirrors' clipped screen area, so an upper bound).
+extern float MirroDepthPixels;
+extern float MirroRegionPixels;
+
+// How reflections drop what lies in front of the mirror they are seen in: an oblique
+// projection whose near plane is the mirror plane, or a user clip plane, for devices
+// that clip in world space like the software one.  Either way nothing reflected ends up
+// between the eye and the mirror.
+enum ReflectionClipMode
+{
+	REFLECTION_CLIP_OBLIQUE,
+	REFLECTION_CLIP_PLANE
+};
+extern ReflectionClipMode ReflectionClip;
+
+// How mirrors show their reflections: drawn into the mirror's stencil pixels every frame,
+// or rendered into a texture per mirror that is then multiplied onto the mirror.  Each
+// mirror's texture is the back buffer size times the mirror's 'scale' in the scene file,
+// and is redrawn only when the eye or the scene moved, and then at most every 'every'
+// frames.  Texture reflections do not show mirrors inside mirrors.  Set before Setup().
+enum ReflectionMode
+{
+	REFLECTION_STENCIL,
+	REFLECTION_TEXTURE
+};
+extern ReflectionMode ReflectionTechnique;
+
+// Mirror textures the last frame redrew.
+extern int MirroTextureUpdates;
+
+// Directional lights, 1 to MaxSceneLights, each lighting the scene and casting shadows:
+// the first LightCount lights of the scene, at most as many as it has.  Set before Setup().
+enum { MaxSceneLights = 3 };
+extern int LightCount;
+
+// What the simulation moves.  Display() draws a state interpolated between the last two
+// steps.
+struct SimState
+{
+	D3DXVECTOR3 TeapotPosition;
+	float Radius;   // camera distance from the origin
+	float Angle;    // camera angle around the y axis
+};
+
+// Replaces the keyboard when set: called every simulation step with the simulated time
+// since Setup(), in seconds.  Deterministic as long as Display() gets fixed deltas.
+extern void (*SimulationScript)(SimState& state, double time);
+
+// Frames per second the window's message loop is held to; 0 runs unthrottled.
+extern double FrameRateLimit;
+
+// Textures load in the background; until they are ready the scene shows placeholder
+// colours.  Display() uploads at most about this many bytes of them a frame.
+extern UINT AssetUploadBudget;
+// Where textures are kept converted to DXT1/DXT5 with their mip chains (see dds.h); ""
+// decodes the sources on every run.
+extern const char* TextureCacheDirectory;
+
+// Threads, the render thread included, that record the passes of a frame (the scene, each
+// shadow receiver or light, each mirror) into command buffers in parallel; the render
+// thread alone replays them on Device.  0 uses every hardware thread.  Set before Setup().
+extern int RecordThreads;
+
+bool Setup();
+// Blocks until every asset Setup() started loading is ready (or failed) and swaps them
+// in, e.g. for output that must not depend on how fast the loader threads run.
+void WaitForAssets();
+// Releases everything Setup() created and resets the scene, so Setup() can run again.
+void CleanUp();
+// Advances the simulation in fixed steps by 'timedelta' seconds and renders a frame
+// interpolated between the last two steps.
+bool Display(double timedelta);
+
+#endif // __d3dInitH__
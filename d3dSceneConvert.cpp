@@ -0,0 +1,45 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dSceneConvert.cpp
+//
+// Desc: Compiles a text scene into the binary scene file the demo maps at startup.
+//       Usage: d3dSceneConvert [source.scn [scene.scb]]     (room.scn, room.scb)
+//
+//       g++ -O2 -std=c++11 d3dSceneConvert.cpp sceneFile.cpp mappedFile.cpp staticMesh.cpp
+//           meshGeometry.cpp image.cpp dds.cpp d3dCompat.cpp -o d3dSceneConvert
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "sceneFile.h"
+#include <cstdio>
+
+int main(int argc, char** argv)
+{
+	const char* source = argc > 1 ? argv[1] : "room.scn";
+	const char* output = argc > 2 ? argv[2] : "room.scb";
+
+	std::string error;
+	d3d::MappedFile file;
+	d3d::Scene scene;
+	if (!d3d::ConvertScene(source, output, &error))
+	{
+		printf("%s\n", error.c_str());
+		return 1;
+	}
+	if (!file.Open(output) || !d3d::ParseScene(file.GetData(), file.GetSize(), &scene))
+	{
+		printf("%s: written but does not load\n", output);
+		return 1;
+	}
+
+	const UINT* counts = scene.Counts;
+	printf("%s: %u bytes, version %d\n", output, (unsigned)file.GetSize(), (int)d3d::SceneVersion);
+	printf("  %u materials, %u static vertices, %u static triangles in %u ranges\n",
+		counts[d3d::SCENE_MATERIALS], counts[d3d::SCENE_STATIC_VERTICES],
+		counts[d3d::SCENE_STATIC_INDICES] / 3, counts[d3d::SCENE_STATIC_RANGES]);
+	printf("  %u meshes (%u vertices, %u triangles), %u instances\n", counts[d3d::SCENE_MESHES],
+		counts[d3d::SCENE_MESH_VERTICES], counts[d3d::SCENE_MESH_INDICES] / 3, counts[d3d::SCENE_INSTANCES]);
+	printf("  %u mirrors, %u shadow receivers, %u lights\n", counts[d3d::SCENE_MIRRORS],
+		counts[d3d::SCENE_RECEIVERS], counts[d3d::SCENE_LIGHTS]);
+	return 0;
+}
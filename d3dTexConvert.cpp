@@ -0,0 +1,70 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: d3dTexConvert.cpp
+//
+// Desc: Fills the texture cache ahead of time so that the demo's first run maps DXT
+//       textures instead of decoding its JPEGs.  Sources already in the cache are left
+//       alone.
+//       Usage: d3dTexConvert [-cache directory] textures...
+//
+//       g++ -O2 -std=c++11 d3dTexConvert.cpp d3dCompat.cpp image.cpp dds.cpp mappedFile.cpp
+//           -o d3dTexConvert
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "dds.h"
+#include <cstdio>
+#include <cstring>
+
+static const char* GetFormatName(D3DFORMAT format)
+{
+	switch (format)
+	{
+	case D3DFMT_DXT1:     return "DXT1";
+	case D3DFMT_DXT5:     return "DXT5";
+	case D3DFMT_X8R8G8B8: return "X8R8G8B8";
+	default:              return "A8R8G8B8";
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* directory = "texcache";
+	int first = 1;
+	if (argc > 2 && strcmp(argv[1], "-cache") == 0)
+	{
+		directory = argv[2];
+		first = 3;
+	}
+	if (first >= argc)
+	{
+		printf("usage: d3dTexConvert [-cache directory] textures...\n");
+		return 1;
+	}
+
+	int failed = 0;
+	for (int i = first; i < argc; ++i)
+	{
+		d3d::MappedFile file;
+		d3d::DdsTexture tex;
+		if (!d3d::LoadCachedTexture(argv[i], directory, &file, &tex))
+		{
+			printf("%s: could not convert\n", argv[i]);
+			++failed;
+			continue;
+		}
+
+		// what the texture would take as A8R8G8B8 with the same levels
+		size_t size = 0, texels = 0;
+		for (UINT level = 0; level < tex.Levels; ++level)
+		{
+			UINT width, height;
+			d3d::GetDdsLevel(tex, level, &width, &height);
+			size += d3d::GetLevelSize(tex.Format, width, height);
+			texels += (size_t)width * height;
+		}
+		printf("%s: %ux%u %s, %u levels, %u bytes (%.1f:1)\n", argv[i], tex.Width, tex.Height,
+			GetFormatName(tex.Format), tex.Levels, (unsigned)size, texels * 4.0 / size);
+	}
+	return failed > 0 ? 1 : 0;
+}
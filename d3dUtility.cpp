@@ -11,6 +11,7 @@
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "frameClock.h"
 
 D3DMATERIAL9 d3d::InitMtrl(D3DXCOLOR a, D3DXCOLOR d, D3DXCOLOR s, D3DXCOLOR e, float p)
 {
@@ -23,6 +24,7 @@ D3DMATERIAL9 d3d::InitMtrl(D3DXCOLOR a, D3DXCOLOR d, D3DXCOLOR s, D3DXCOLOR e, f
 	return mat;
 }
 
+#ifdef _WIN32
 bool d3d::InitD3D(
 	HINSTANCE hInstance,
 	int width, int height,
@@ -150,12 +152,16 @@ bool d3d::InitD3D(
 	return true;
 }
 
-int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
+int d3d::EnterMsgLoop( bool (*ptr_display)(double timeDelta), double maxFps )
 {
 	MSG msg;
 	::ZeroMemory(&msg, sizeof(MSG));
 
-	static float lastTime = (float)timeGetTime(); 
+	FrameLimiter limiter(maxFps);
+	if (maxFps > 0.0)
+		timeBeginPeriod(1);
+
+	double lastTime = GetTime();
 
 	while(msg.message != WM_QUIT)
 	{
@@ -166,16 +172,21 @@ int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
 		}
 		else
         {	
-			float currTime  = (float)timeGetTime();
-			float timeDelta = (currTime - lastTime)*0.001f;
+			double currTime  = GetTime();
+			double timeDelta = currTime - lastTime;
 
 			ptr_display(timeDelta);
 
 			lastTime = currTime;
+			limiter.Wait();
         }
     }
+
+	if (maxFps > 0.0)
+		timeEndPeriod(1);
     return msg.wParam;
 }
+#endif
 
 D3DLIGHT9 d3d::InitDirectionalLight(D3DXVECTOR3 * direction, D3DXCOLOR * color)
 {
@@ -13,7 +13,7 @@
 #ifndef __d3dUtilityH__
 #define __d3dUtilityH__
 
-#include <d3dx9.h>
+#include "d3dCompat.h"
 #include <string>
 
 
@@ -25,6 +25,7 @@ namespace d3d
 
 
 
+#ifdef _WIN32
 	bool InitD3D(
 		HINSTANCE hInstance,       // [in] Application instance.
 		int width, int height,     // [in] Backbuffer dimensions.
@@ -32,14 +33,18 @@ namespace d3d
 		D3DDEVTYPE deviceType,     // [in] HAL or REF
 		IDirect3DDevice9** device);// [out]The created device.
 
+	// Calls ptr_display with the seconds since its last call, measured with GetTime().
+	// A maxFps above 0 sleeps between frames instead of running flat out.
 	int EnterMsgLoop( 
-		bool (*ptr_display)(float timeDelta));
+		bool (*ptr_display)(double timeDelta),
+		double maxFps = 0.0);
 
 	LRESULT CALLBACK WndProc(
 		HWND hwnd,
 		UINT msg, 
 		WPARAM wParam,
 		LPARAM lParam);
+#endif
 
 	template<class T> void Release(T t)
 	{
@@ -0,0 +1,560 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: dds.cpp
+//
+// Desc: DDS reading and writing, BC1/BC3 block coding and the texture cache.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "dds.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// bump when the encoder changes so old cache files are not used
+	const char CacheVersion[] = "bc-1";
+
+	const DWORD DDSD_CAPS        = 0x1;
+	const DWORD DDSD_HEIGHT      = 0x2;
+	const DWORD DDSD_WIDTH       = 0x4;
+	const DWORD DDSD_PIXELFORMAT = 0x1000;
+	const DWORD DDSD_MIPMAPCOUNT = 0x20000;
+	const DWORD DDSD_LINEARSIZE  = 0x80000;
+	const DWORD DDPF_ALPHAPIXELS = 0x1;
+	const DWORD DDPF_FOURCC      = 0x4;
+	const DWORD DDPF_RGB         = 0x40;
+	const DWORD DDSCAPS_COMPLEX  = 0x8;
+	const DWORD DDSCAPS_TEXTURE  = 0x1000;
+	const DWORD DDSCAPS_MIPMAP   = 0x400000;
+	const DWORD DDSCAPS2_CUBEMAP = 0x200;
+	const DWORD DDSCAPS2_VOLUME  = 0x200000;
+	const size_t HeaderSize      = 128;    // "DDS " and DDS_HEADER
+
+	DWORD ReadU32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((DWORD)p[3] << 24); }
+
+	void WriteU32(unsigned char* p, DWORD v)
+	{
+		p[0] = (unsigned char)v;
+		p[1] = (unsigned char)(v >> 8);
+		p[2] = (unsigned char)(v >> 16);
+		p[3] = (unsigned char)(v >> 24);
+	}
+
+	bool IsCompressed(D3DFORMAT format)
+	{
+		return format == D3DFMT_DXT1 || format == D3DFMT_DXT5;
+	}
+
+	UINT CountLevels(UINT width, UINT height)
+	{
+		UINT levels = 1;
+		while (width > 1 || height > 1)
+		{
+			width = std::max(1u, width / 2);
+			height = std::max(1u, height / 2);
+			++levels;
+		}
+		return levels;
+	}
+
+	//
+	// Block coding
+	//
+
+	void Expand565(WORD c, int rgb[3])
+	{
+		int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	WORD Pack565(const float rgb[3])
+	{
+		int r = std::min(31, std::max(0, (int)(rgb[0] * 31.0f / 255.0f + 0.5f)));
+		int g = std::min(63, std::max(0, (int)(rgb[1] * 63.0f / 255.0f + 0.5f)));
+		int b = std::min(31, std::max(0, (int)(rgb[2] * 31.0f / 255.0f + 0.5f)));
+		return (WORD)((r << 11) | (g << 5) | b);
+	}
+
+	// Endpoints are the two texels furthest apart along the block's principal axis.
+	void EncodeColorBlock(const DWORD texels[16], unsigned char* out)
+	{
+		float c[16][3], mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; ++i)
+		{
+			c[i][0] = (float)((texels[i] >> 16) & 0xff);
+			c[i][1] = (float)((texels[i] >> 8) & 0xff);
+			c[i][2] = (float)(texels[i] & 0xff);
+			for (int k = 0; k < 3; ++k)
+				mean[k] += c[i][k] / 16.0f;
+		}
+
+		float cov[3][3] = { { 0.0f } };
+		for (int i = 0; i < 16; ++i)
+			for (int j = 0; j < 3; ++j)
+				for (int k = 0; k < 3; ++k)
+					cov[j][k] += (c[i][j] - mean[j]) * (c[i][k] - mean[k]);
+
+		float axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float v[3];
+			for (int j = 0; j < 3; ++j)
+				v[j] = cov[j][0] * axis[0] + cov[j][1] * axis[1] + cov[j][2] * axis[2];
+			float length = std::max(fabsf(v[0]), std::max(fabsf(v[1]), fabsf(v[2])));
+			if (length < 1.0e-6f)
+				break;  // a flat block; any axis will do
+			for (int j = 0; j < 3; ++j)
+				axis[j] = v[j] / length;
+		}
+
+		int lo = 0, hi = 0;
+		float tMin = 1.0e30f, tMax = -1.0e30f;
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = c[i][0] * axis[0] + c[i][1] * axis[1] + c[i][2] * axis[2];
+			if (t < tMin) { tMin = t; lo = i; }
+			if (t > tMax) { tMax = t; hi = i; }
+		}
+
+		WORD e0 = Pack565(c[hi]), e1 = Pack565(c[lo]);
+		if (e0 < e1)
+			std::swap(e0, e1);
+
+		DWORD indices = 0;
+		if (e0 != e1)
+		{
+			// four colour mode: e0 > e1
+			int p[4][3];
+			Expand565(e0, p[0]);
+			Expand565(e1, p[1]);
+			for (int k = 0; k < 3; ++k)
+			{
+				p[2][k] = (2 * p[0][k] + p[1][k]) / 3;
+				p[3][k] = (p[0][k] + 2 * p[1][k]) / 3;
+			}
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				float bestDist = 1.0e30f;
+				for (int j = 0; j < 4; ++j)
+				{
+					float d = 0.0f;
+					for (int k = 0; k < 3; ++k)
+						d += (c[i][k] - p[j][k]) * (c[i][k] - p[j][k]);
+					if (d < bestDist)
+					{
+						bestDist = d;
+						best = j;
+					}
+				}
+				indices |= (DWORD)best << (2 * i);
+			}
+		}
+
+		out[0] = (unsigned char)e0;
+		out[1] = (unsigned char)(e0 >> 8);
+		out[2] = (unsigned char)e1;
+		out[3] = (unsigned char)(e1 >> 8);
+		WriteU32(out + 4, indices);
+	}
+
+	void EncodeAlphaBlock(const DWORD texels[16], unsigned char* out)
+	{
+		int a[16], a0 = 0, a1 = 255;
+		for (int i = 0; i < 16; ++i)
+		{
+			a[i] = (int)(texels[i] >> 24);
+			a0 = std::max(a0, a[i]);
+			a1 = std::min(a1, a[i]);
+		}
+
+		unsigned long long indices = 0;
+		if (a0 != a1)
+		{
+			// eight alpha mode: a0 > a1
+			int p[8] = { a0, a1 };
+			for (int j = 2; j < 8; ++j)
+				p[j] = ((8 - j) * a0 + (j - 1) * a1) / 7;
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				for (int j = 1; j < 8; ++j)
+					if (abs(a[i] - p[j]) < abs(a[i] - p[best]))
+						best = j;
+				indices |= (unsigned long long)best << (3 * i);
+			}
+		}
+
+		out[0] = (unsigned char)a0;
+		out[1] = (unsigned char)a1;
+		for (int k = 0; k < 6; ++k)
+			out[2 + k] = (unsigned char)(indices >> (8 * k));
+	}
+
+	// BC3 colour blocks are always in four colour mode.
+	void DecodeColorBlock(const unsigned char* in, bool fourColor, DWORD out[16])
+	{
+		WORD c0 = (WORD)(in[0] | (in[1] << 8)), c1 = (WORD)(in[2] | (in[3] << 8));
+		int p[4][3];
+		Expand565(c0, p[0]);
+		Expand565(c1, p[1]);
+		DWORD palette[4];
+		if (fourColor || c0 > c1)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				p[2][k] = (2 * p[0][k] + p[1][k]) / 3;
+				p[3][k] = (p[0][k] + 2 * p[1][k]) / 3;
+			}
+			for (int j = 0; j < 4; ++j)
+				palette[j] = D3DCOLOR_XRGB(p[j][0], p[j][1], p[j][2]);
+		}
+		else
+		{
+			for (int k = 0; k < 3; ++k)
+				p[2][k] = (p[0][k] + p[1][k]) / 2;
+			for (int j = 0; j < 3; ++j)
+				palette[j] = D3DCOLOR_XRGB(p[j][0], p[j][1], p[j][2]);
+			palette[3] = 0;     // transparent black
+		}
+
+		DWORD indices = ReadU32(in + 4);
+		for (int i = 0; i < 16; ++i)
+			out[i] = palette[(indices >> (2 * i)) & 3];
+	}
+
+	void DecodeAlphaBlock(const unsigned char* in, DWORD out[16])
+	{
+		int p[8] = { in[0], in[1] };
+		if (p[0] > p[1])
+		{
+			for (int j = 2; j < 8; ++j)
+				p[j] = ((8 - j) * p[0] + (j - 1) * p[1]) / 7;
+		}
+		else
+		{
+			for (int j = 2; j < 6; ++j)
+				p[j] = ((6 - j) * p[0] + (j - 1) * p[1]) / 5;
+			p[6] = 0;
+			p[7] = 255;
+		}
+
+		unsigned long long indices = 0;
+		for (int k = 0; k < 6; ++k)
+			indices |= (unsigned long long)in[2 + k] << (8 * k);
+		for (int i = 0; i < 16; ++i)
+			out[i] = (out[i] & 0x00ffffff) | ((DWORD)p[(indices >> (3 * i)) & 7] << 24);
+	}
+
+	void EncodeLevel(D3DFORMAT format, const DWORD* texels, UINT width, UINT height, unsigned char* out)
+	{
+		for (UINT by = 0; by < height; by += 4)
+		{
+			for (UINT bx = 0; bx < width; bx += 4)
+			{
+				// blocks past the edge repeat the last row and column
+				DWORD block[16];
+				for (UINT y = 0; y < 4; ++y)
+					for (UINT x = 0; x < 4; ++x)
+						block[y * 4 + x] = texels[std::min(by + y, height - 1) * width + std::min(bx + x, width - 1)];
+
+				if (format == D3DFMT_DXT5)
+				{
+					EncodeAlphaBlock(block, out);
+					out += 8;
+				}
+				EncodeColorBlock(block, out);
+				out += 8;
+			}
+		}
+	}
+
+	std::string CacheName(const unsigned char* data, size_t size, const char* sourceFile, const char* directory)
+	{
+		// FNV-1a over the encoder version and the contents
+		unsigned long long hash = 14695981039346656037ull;
+		for (size_t i = 0; i < sizeof(CacheVersion); ++i)
+			hash = (hash ^ (unsigned char)CacheVersion[i]) * 1099511628211ull;
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ data[i]) * 1099511628211ull;
+
+		std::string name = sourceFile;
+		size_t slash = name.find_last_of("/\\");
+		if (slash != std::string::npos)
+			name.erase(0, slash + 1);
+		size_t dot = name.find_last_of('.');
+		if (dot != std::string::npos && dot > 0)
+			name.erase(dot);
+
+		char suffix[32];
+		sprintf(suffix, "-%016llx.dds", hash);
+		std::string path = directory;
+		if (!path.empty() && path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+			path += '/';
+		return path + name + suffix;
+	}
+
+	bool WriteCacheFile(const unsigned char* source, size_t size, const char* directory, const std::string& cacheFile)
+	{
+		d3d::Image image;
+		if (!d3d::DecodeImage(source, size, &image))
+			return false;
+		std::vector<unsigned char> dds;
+		d3d::EncodeDDS(image, &dds);
+
+#ifdef _WIN32
+		_mkdir(directory);
+#else
+		mkdir(directory, 0777);
+#endif
+
+		// written under a name of its own and renamed, so a reader never maps half a file
+		char suffix[32];
+		sprintf(suffix, ".%x.tmp", (unsigned)std::hash<std::thread::id>()(std::this_thread::get_id()));
+		std::string temp = cacheFile + suffix;
+		FILE* f = fopen(temp.c_str(), "wb");
+		if (!f)
+			return false;
+		bool ok = fwrite(&dds[0], 1, dds.size(), f) == dds.size();
+		ok = fclose(f) == 0 && ok;
+		if (!ok || rename(temp.c_str(), cacheFile.c_str()) != 0)
+		{
+			remove(temp.c_str());   // e.g. another thread got there first on Windows
+			return ok;
+		}
+		return true;
+	}
+}
+
+void d3d::GetLevelPitch(D3DFORMAT format, UINT width, UINT height, UINT* rowBytes, UINT* rows)
+{
+	if (IsCompressed(format))
+	{
+		*rowBytes = std::max(1u, (width + 3) / 4) * (format == D3DFMT_DXT1 ? 8 : 16);
+		*rows = std::max(1u, (height + 3) / 4);
+	}
+	else
+	{
+		*rowBytes = width * sizeof(DWORD);
+		*rows = height;
+	}
+}
+
+UINT d3d::GetLevelSize(D3DFORMAT format, UINT width, UINT height)
+{
+	UINT rowBytes, rows;
+	GetLevelPitch(format, width, height, &rowBytes, &rows);
+	return rowBytes * rows;
+}
+
+const unsigned char* d3d::GetDdsLevel(const DdsTexture& tex, UINT level, UINT* width, UINT* height)
+{
+	const unsigned char* data = tex.Data;
+	UINT w = tex.Width, h = tex.Height;
+	for (UINT i = 0; i < level; ++i)
+	{
+		data += GetLevelSize(tex.Format, w, h);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+	*width = w;
+	*height = h;
+	return data;
+}
+
+bool d3d::ParseDDS(const unsigned char* data, size_t size, DdsTexture* tex)
+{
+	if (size < HeaderSize || memcmp(data, "DDS ", 4) != 0 || ReadU32(data + 4) != 124)
+		return false;
+
+	DWORD flags   = ReadU32(data + 8);
+	UINT  height  = ReadU32(data + 12);
+	UINT  width   = ReadU32(data + 16);
+	UINT  levels  = (flags & DDSD_MIPMAPCOUNT) ? ReadU32(data + 28) : 1;
+	DWORD pfFlags = ReadU32(data + 80);
+	DWORD fourCC  = ReadU32(data + 84);
+	DWORD caps2   = ReadU32(data + 112);
+	if (width == 0 || height == 0 || width > 16384 || height > 16384 ||
+		(caps2 & (DDSCAPS2_CUBEMAP | DDSCAPS2_VOLUME)))
+		return false;
+	levels = std::max(levels, 1u);
+	if (levels > CountLevels(width, height))
+		return false;
+
+	D3DFORMAT format;
+	if (pfFlags & DDPF_FOURCC)
+	{
+		if (fourCC != D3DFMT_DXT1 && fourCC != D3DFMT_DXT5)
+			return false;   // DXT2-4, DX10 headers and friends
+		format = (D3DFORMAT)fourCC;
+	}
+	else if ((pfFlags & DDPF_RGB) && ReadU32(data + 88) == 32 && ReadU32(data + 96) == 0xff00 &&
+		(ReadU32(data + 92) | ReadU32(data + 100)) == 0xff00ff)
+	{
+		bool alpha = (pfFlags & DDPF_ALPHAPIXELS) && ReadU32(data + 104) == 0xff000000;
+		if (ReadU32(data + 92) == 0xff0000)
+			format = alpha ? D3DFMT_A8R8G8B8 : D3DFMT_X8R8G8B8;
+		else
+			format = alpha ? D3DFMT_A8B8G8R8 : D3DFMT_X8B8G8R8;
+	}
+	else
+		return false;
+
+	size_t total = 0;
+	for (UINT i = 0, w = width, h = height; i < levels; ++i)
+	{
+		total += GetLevelSize(format, w, h);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+	if (HeaderSize + total > size)
+		return false;
+
+	tex->Format = format;
+	tex->Width = width;
+	tex->Height = height;
+	tex->Levels = levels;
+	tex->Data = data + HeaderSize;
+	return true;
+}
+
+void d3d::DecodeLevel(D3DFORMAT format, const unsigned char* data, UINT width, UINT height, DWORD* texels)
+{
+	if (!IsCompressed(format))
+	{
+		size_t count = (size_t)width * height;
+		memcpy(texels, data, count * sizeof(DWORD));
+		if (format == D3DFMT_A8B8G8R8 || format == D3DFMT_X8B8G8R8)
+			for (size_t i = 0; i < count; ++i)
+				texels[i] = (texels[i] & 0xff00ff00) | ((texels[i] >> 16) & 0xff) | ((texels[i] & 0xff) << 16);
+		if (format == D3DFMT_X8R8G8B8 || format == D3DFMT_X8B8G8R8)
+			for (size_t i = 0; i < count; ++i)
+				texels[i] |= 0xff000000;
+		return;
+	}
+
+	for (UINT by = 0; by < height; by += 4)
+	{
+		for (UINT bx = 0; bx < width; bx += 4)
+		{
+			DWORD block[16];
+			if (format == D3DFMT_DXT5)
+			{
+				DecodeColorBlock(data + 8, true, block);
+				DecodeAlphaBlock(data, block);
+				data += 16;
+			}
+			else
+			{
+				DecodeColorBlock(data, false, block);
+				data += 8;
+			}
+
+			for (UINT y = 0; y < 4 && by + y < height; ++y)
+				for (UINT x = 0; x < 4 && bx + x < width; ++x)
+					texels[(by + y) * width + bx + x] = block[y * 4 + x];
+		}
+	}
+}
+
+void d3d::EncodeDDS(const Image& image, std::vector<unsigned char>* file)
+{
+	bool alpha = false;
+	for (size_t i = 0; i < image.Pixels.size() && !alpha; ++i)
+		alpha = (image.Pixels[i] >> 24) != 0xff;
+	D3DFORMAT format = alpha ? D3DFMT_DXT5 : D3DFMT_DXT1;
+
+	UINT width = (UINT)image.Width, height = (UINT)image.Height;
+	UINT levels = CountLevels(width, height);
+	size_t total = 0;
+	for (UINT i = 0, w = width, h = height; i < levels; ++i)
+	{
+		total += GetLevelSize(format, w, h);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+
+	file->assign(HeaderSize + total, 0);
+	unsigned char* p = &(*file)[0];
+	memcpy(p, "DDS ", 4);
+	WriteU32(p + 4, 124);
+	WriteU32(p + 8, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	WriteU32(p + 12, height);
+	WriteU32(p + 16, width);
+	WriteU32(p + 20, GetLevelSize(format, width, height));
+	WriteU32(p + 28, levels);
+	WriteU32(p + 76, 32);
+	WriteU32(p + 80, DDPF_FOURCC);
+	WriteU32(p + 84, format);
+	WriteU32(p + 108, DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP);
+
+	unsigned char* out = p + HeaderSize;
+	std::vector<DWORD> level(image.Pixels), next;
+	for (UINT i = 0, w = width, h = height; i < levels; ++i)
+	{
+		EncodeLevel(format, &level[0], w, h, out);
+		out += GetLevelSize(format, w, h);
+		if (i + 1 == levels)
+			break;
+		next.resize((size_t)std::max(1u, w / 2) * std::max(1u, h / 2));
+		HalveTexels(&level[0], (int)w, (int)h, &next[0]);
+		level.swap(next);
+		w = std::max(1u, w / 2);
+		h = std::max(1u, h / 2);
+	}
+}
+
+bool d3d::GetCachedTextureName(const char* sourceFile, const char* directory, std::string* cacheFile)
+{
+	MappedFile source;
+	if (!source.Open(sourceFile))
+		return false;
+	*cacheFile = CacheName(source.GetData(), source.GetSize(), sourceFile, directory);
+	return true;
+}
+
+bool d3d::CacheTexture(const char* sourceFile, const char* directory, std::string* cacheFile)
+{
+	MappedFile source;
+	if (!source.Open(sourceFile))
+		return false;
+	*cacheFile = CacheName(source.GetData(), source.GetSize(), sourceFile, directory);
+
+	MappedFile cached;
+	DdsTexture tex;
+	if (cached.Open(cacheFile->c_str()) && ParseDDS(cached.GetData(), cached.GetSize(), &tex))
+		return true;
+	cached.Close();
+	return WriteCacheFile(source.GetData(), source.GetSize(), directory, *cacheFile);
+}
+
+bool d3d::LoadCachedTexture(const char* sourceFile, const char* directory, MappedFile* file, DdsTexture* tex)
+{
+	if (!file->Open(sourceFile))
+		return false;
+	// DDS files the devices take as they are need no cache; B8G8R8 ones are converted
+	if (file->GetSize() >= 4 && memcmp(file->GetData(), "DDS ", 4) == 0 &&
+		ParseDDS(file->GetData(), file->GetSize(), tex) &&
+		tex->Format != D3DFMT_A8B8G8R8 && tex->Format != D3DFMT_X8B8G8R8)
+		return true;
+	file->Close();
+
+	std::string cacheFile;
+	return CacheTexture(sourceFile, directory, &cacheFile) &&
+		file->Open(cacheFile.c_str()) && ParseDDS(file->GetData(), file->GetSize(), tex);
+}
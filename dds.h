@@ -0,0 +1,64 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: dds.h
+//
+// Desc: DDS textures and the compressed texture cache.  Source images are converted once
+//       into BC1 (DXT1) or, when they have alpha, BC3 (DXT5) DDS files with their whole
+//       box filtered mip chain, a quarter or an eighth of the size of the A8R8G8B8
+//       texels, and kept in a cache directory under a name made from a hash of the
+//       source's contents.  Later runs map the cached file instead of decoding the
+//       source; the device copies the levels as they are.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __ddsH__
+#define __ddsH__
+
+#include "image.h"
+#include "mappedFile.h"
+#include <string>
+#include <vector>
+
+namespace d3d
+{
+	// The pixel data of a DDS file: level 0 and the smaller levels after it, back to
+	// back.  Data points into the file.
+	struct DdsTexture
+	{
+		D3DFORMAT            Format;    // D3DFMT_DXT1, D3DFMT_DXT5 or 32 bit RGB in either order
+		UINT                 Width;
+		UINT                 Height;
+		UINT                 Levels;
+		const unsigned char* Data;
+	};
+
+	// Rows of one level and the bytes in each: rows of 4x4 blocks for the BC formats.
+	void GetLevelPitch(D3DFORMAT format, UINT width, UINT height, UINT* rowBytes, UINT* rows);
+	UINT GetLevelSize(D3DFORMAT format, UINT width, UINT height);
+
+	// Level 'level' of 'tex' and its size.
+	const unsigned char* GetDdsLevel(const DdsTexture& tex, UINT level, UINT* width, UINT* height);
+
+	// Checks the header and that every level is there.
+	bool ParseDDS(const unsigned char* data, size_t size, DdsTexture* tex);
+
+	// Expands one level to A8R8G8B8.
+	void DecodeLevel(D3DFORMAT format, const unsigned char* data, UINT width, UINT height, DWORD* texels);
+
+	// A complete DDS file of 'image' and its mip chain: BC3 when a texel is not opaque,
+	// otherwise BC1.
+	void EncodeDDS(const Image& image, std::vector<unsigned char>* file);
+
+	// <directory>/<source name>-<hash of its contents>.dds.  Reads the source to hash it.
+	bool GetCachedTextureName(const char* sourceFile, const char* directory, std::string* cacheFile);
+
+	// Converts 'sourceFile' into its cache file unless the cache already has it, creating
+	// 'directory' when needed.
+	bool CacheTexture(const char* sourceFile, const char* directory, std::string* cacheFile);
+
+	// Maps the cached DDS of 'sourceFile' into 'file', converting it first on a cache
+	// miss.  A DXT1, DXT5 or A8R8G8B8 DDS source is mapped as it is.
+	bool LoadCachedTexture(const char* sourceFile, const char* directory, MappedFile* file, DdsTexture* tex);
+}
+
+#endif // __ddsH__
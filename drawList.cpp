@@ -0,0 +1,330 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: drawList.cpp
+//
+// Desc: Recorded draw list.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "drawList.h"
+#include "simdMath.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+d3d::DrawList::~DrawList()
+{
+	for (size_t i = 0; i < _scratch.size(); ++i)
+		delete _scratch[i];
+}
+
+d3d::DrawList::Scratch* d3d::DrawList::AcquireScratch() const
+{
+	std::lock_guard<std::mutex> lock(_scratchLock);
+	if (_scratch.empty())
+		return new Scratch;
+	Scratch* scratch = _scratch.back();
+	_scratch.pop_back();
+	return scratch;
+}
+
+void d3d::DrawList::ReleaseScratch(Scratch* scratch) const
+{
+	std::lock_guard<std::mutex> lock(_scratchLock);
+	_scratch.push_back(scratch);
+}
+
+void d3d::DrawList::Clear()
+{
+	_items.clear();
+	_worlds.clear();
+	_palette.clear();
+	_localCenters.clear();
+	_localRadii.clear();
+	_tree.Clear();
+	_triangles = 0;
+}
+
+int d3d::DrawList::AddMesh(Mesh* mesh, const D3DXMATRIX& world, const D3DMATERIAL9& mtrl, Texture* tex,
+	const D3DXVECTOR3& center, float radius, int object)
+{
+	DrawItem item;
+	item.Model = mesh;
+	item.Indexed = 0;
+	item.Range = -1;
+	item.PrimCount = mesh->GetNumFaces();
+	item.Lod = 0;
+	item.World = world;
+	item.Material = mtrl;
+	item.Tex = tex;
+	item.Object = object;
+	return Add(item, center, radius);
+}
+
+int d3d::DrawList::AddRange(const StaticMesh* mesh, int range, const D3DXMATRIX& world,
+	const D3DMATERIAL9& mtrl, Texture* tex, int object)
+{
+	const MeshRange& r = mesh->GetRange(range);
+	DrawItem item;
+	item.Model = 0;
+	item.Indexed = mesh;
+	item.Range = range;
+	item.PrimCount = r.PrimCount;
+	item.Lod = 0;
+	item.World = world;
+	item.Material = mtrl;
+	item.Tex = tex;
+	item.Object = object;
+	return Add(item, r.Center, r.Radius);
+}
+
+int d3d::DrawList::Add(DrawItem& item, const D3DXVECTOR3& center, float radius)
+{
+	item.Palette = 0;
+	while (item.Palette < _palette.size() &&
+		memcmp(&_palette[item.Palette], &item.Material, sizeof(D3DMATERIAL9)) != 0)
+		++item.Palette;
+	if (item.Palette == _palette.size())
+		_palette.push_back(item.Material);
+
+	_localCenters.push_back(center);
+	_localRadii.push_back(radius);
+	_items.push_back(item);
+	_worlds.push_back(item.World);
+	UpdateBounds(_items.back());
+	_tree.Insert(_items.back().Center, _items.back().Radius);
+	_triangles += item.PrimCount;
+	return (int)_items.size() - 1;
+}
+
+void d3d::DrawList::SetWorld(int item, const D3DXMATRIX& world)
+{
+	_items[item].World = world;
+	_worlds[item] = world;
+	UpdateBounds(_items[item]);
+	_tree.Move(item, _items[item].Center, _items[item].Radius);
+}
+
+void d3d::DrawList::SetLod(Mesh* mesh, const MeshLod* lod)
+{
+	for (size_t i = 0; i < _items.size(); ++i)
+	{
+		if (_items[i].Model == mesh)
+			_items[i].Lod = lod;
+	}
+}
+
+d3d::Mesh* d3d::DrawList::GetModel(int item, const LodView* view) const
+{
+	const DrawItem& it = _items[item];
+	if (!it.Lod || !view)
+		return it.Model;
+	// the world matrix scales mesh space as much as it scaled the bounding sphere
+	float scale = it.Radius / _localRadii[item];
+	LodHistory* history = view->History;
+	if (!history)
+		return it.Lod->Levels[SelectLod(*it.Lod, *view, it.Center, it.Radius, scale)];
+
+	if (history->size() < _items.size())
+		history->resize(_items.size(), NoLod);
+	int previous = (*history)[item];
+	int level = SelectLod(*it.Lod, *view, it.Center, it.Radius, scale, previous);
+	if (level != previous)
+		(*history)[item] = (unsigned char)level;
+	return it.Lod->Levels[level];
+}
+
+void d3d::DrawList::UpdateLods(const LodView& view) const
+{
+	// a level picked from the one before is picked again, so GetModel writes nothing more
+	if (view.History && view.History->size() < _items.size())
+		view.History->resize(_items.size(), NoLod);
+	for (size_t i = 0; i < _items.size(); ++i)
+	{
+		if (_items[i].Lod)
+			GetModel((int)i, &view);
+	}
+}
+
+void d3d::DrawList::UpdateBounds(DrawItem& item)
+{
+	size_t i = &item - &_items[0];
+
+	// the sphere grows with the largest axis scale of the world matrix
+	const D3DXMATRIX& w = item.World;
+	float sx = w._11 * w._11 + w._12 * w._12 + w._13 * w._13;
+	float sy = w._21 * w._21 + w._22 * w._22 + w._23 * w._23;
+	float sz = w._31 * w._31 + w._32 * w._32 + w._33 * w._33;
+	TransformCoordArray(&item.Center, sizeof(D3DXVECTOR3), &_localCenters[i], sizeof(D3DXVECTOR3), &w, 1);
+	item.Radius = _localRadii[i] * sqrtf(std::max(sx, std::max(sy, sz)));
+}
+
+DWORD d3d::DrawList::Draw(RenderDevice* device, const CullVolume* volume, const LodView* lod) const
+{
+	if (_items.empty())
+		return 0;
+
+	Scratch* scratch = AcquireScratch();
+	if (volume)
+	{
+		scratch->Visible.resize(_items.size());
+		_tree.Cull(*volume, &scratch->Visible[0]);
+	}
+	else
+		scratch->Visible.assign(_items.size(), 1);
+	DWORD triangles = Submit(device, &_worlds[0], lod, *scratch);
+	ReleaseScratch(scratch);
+	return triangles;
+}
+
+DWORD d3d::DrawList::DrawReflected(RenderDevice* device, const D3DXMATRIX& reflect, const D3DXPLANE& plane,
+	const LodView* lod) const
+{
+	if (_items.empty())
+		return 0;
+
+	// one batch for the whole list; culled items are cheaper to multiply than to branch on
+	Scratch* scratch = AcquireScratch();
+	std::vector<D3DXMATRIX>& worlds = scratch->Worlds;
+	worlds.resize(_worlds.size());
+	MatrixMultiplyArray(&worlds[0], &_worlds[0], &reflect, (UINT)_worlds.size());
+
+	std::vector<char>& visible = scratch->Visible;
+	visible.resize(_items.size());
+	for (size_t i = 0; i < _items.size(); ++i)
+		visible[i] = D3DXPlaneDotCoord(&plane, &_items[i].Center) >= -_items[i].Radius;
+	DWORD triangles = Submit(device, &worlds[0], lod, *scratch);
+	ReleaseScratch(scratch);
+	return triangles;
+}
+
+DWORD d3d::DrawList::DrawReflected(RenderDevice* device, TransformCache& transforms, int mirror,
+	const D3DXPLANE& plane, const CullVolume* volume, const LodView* lod) const
+{
+	if (_items.empty())
+		return 0;
+
+	Scratch* scratch = AcquireScratch();
+	std::vector<D3DXMATRIX>& worlds = scratch->Worlds;
+	std::vector<char>& visible = scratch->Visible;
+	worlds.resize(_items.size());
+	visible.resize(_items.size());
+	if (volume)
+		_tree.Cull(*volume, &visible[0]);
+	for (size_t i = 0; i < _items.size(); ++i)
+	{
+		const DrawItem& item = _items[i];
+		visible[i] = (!volume || visible[i]) && D3DXPlaneDotCoord(&plane, &item.Center) >= -item.Radius;
+		if (!visible[i])
+			continue;
+
+		if (item.Object >= 0)
+			worlds[i] = transforms.GetReflectedWorld(item.Object, mirror);
+		else
+			MatrixMultiply(&worlds[i], &item.World, &transforms.GetReflect(mirror));
+	}
+	DWORD triangles = Submit(device, &worlds[0], lod, *scratch);
+	ReleaseScratch(scratch);
+	return triangles;
+}
+
+namespace
+{
+	// Copies of one mesh with one texture sort next to each other, in item order.
+	struct BatchLess
+	{
+		const d3d::DrawItem* items;
+		d3d::Mesh* const*    models;
+
+		bool operator()(UINT a, UINT b) const
+		{
+			if (models[a] != models[b])
+				return std::less<d3d::Mesh*>()(models[a], models[b]);
+			if (items[a].Tex != items[b].Tex)
+				return std::less<d3d::Texture*>()(items[a].Tex, items[b].Tex);
+			return a < b;
+		}
+	};
+}
+
+DWORD d3d::DrawList::Submit(RenderDevice* device, const D3DXMATRIX* worlds, const LodView* lod, Scratch& scratch) const
+{
+	const std::vector<char>& visible = scratch.Visible;
+	std::vector<MeshInstance>& instances = scratch.Instances;
+	std::vector<Mesh*>& models = scratch.Models;
+	std::vector<UINT>& batched = scratch.Batched;
+	std::vector<int>& batchStart = scratch.BatchStart;
+	models.resize(_items.size());
+	batched.clear();
+	for (size_t i = 0; i < _items.size(); ++i)
+	{
+		models[i] = visible[i] ? GetModel((int)i, lod) : 0;
+		if (models[i])
+			batched.push_back((UINT)i);
+	}
+
+	// bucket the visible mesh items by mesh and texture; a batch is drawn where its first
+	// item is in the list, so the order of the draws does not change
+	BatchLess less = { &_items[0], &models[0] };
+	std::sort(batched.begin(), batched.end(), less);
+	batchStart.assign(_items.size(), -1);
+	for (size_t k = 0; k < batched.size(); ++k)
+	{
+		if (k == 0 || models[batched[k]] != models[batched[k - 1]] ||
+			_items[batched[k]].Tex != _items[batched[k - 1]].Tex)
+			batchStart[batched[k]] = (int)k;
+	}
+
+	DWORD triangles = 0;
+	for (size_t i = 0; i < _items.size(); ++i)
+	{
+		if (!visible[i])
+			continue;
+		const DrawItem& item = _items[i];
+		Mesh* model = models[i];
+		if (!model)
+		{
+			triangles += item.PrimCount;
+			DrawItemWith(device, item, 0, worlds[i]);
+			continue;
+		}
+		if (batchStart[i] < 0)
+			continue;   // drawn with the first item of its batch
+
+		size_t first = (size_t)batchStart[i], last = first + 1;
+		while (last < batched.size() && models[batched[last]] == model && _items[batched[last]].Tex == item.Tex)
+			++last;
+		triangles += model->GetNumFaces() * (DWORD)(last - first);
+		if (last - first == 1)
+		{
+			DrawItemWith(device, item, model, worlds[i]);
+			continue;
+		}
+
+		instances.clear();
+		for (size_t k = first; k < last; ++k)
+		{
+			MeshInstance instance;
+			instance.World = worlds[batched[k]];
+			instance.Material = _items[batched[k]].Palette;
+			instances.push_back(instance);
+		}
+		device->SetTexture(0, item.Tex);
+		device->DrawInstances(model, &instances[0], (UINT)instances.size(),
+			&_palette[0], (UINT)_palette.size());
+	}
+	return triangles;
+}
+
+void d3d::DrawList::DrawItemWith(RenderDevice* device, const DrawItem& item, Mesh* model,
+	const D3DXMATRIX& world) const
+{
+	device->SetTransform(D3DTS_WORLD, &world);
+	device->SetMaterial(&item.Material);
+	device->SetTexture(0, item.Tex);
+
+	if (model)
+		device->DrawSubset(model, 0);
+	else
+		item.Indexed->DrawRange(device, item.Range);
+}
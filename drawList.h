@@ -0,0 +1,154 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: drawList.h
+//
+// Desc: A recorded list of draws (geometry, world matrix, material, texture and bounds).
+//       The scene is recorded once; items that move get a new world matrix through
+//       SetWorld.  The mirror passes replay the list under a reflection matrix without
+//       walking the scene again.  Items bound to a TransformCache object take their
+//       reflected world matrices from the cache instead of multiplying them every frame.
+//
+//       Items that draw the same mesh with the same texture are submitted together as one
+//       instanced draw, their materials indexed into a palette the list keeps.  A mesh item
+//       given levels of detail (SetLod) draws the level the pass's LodView picks for it, and
+//       batches with the items that picked the same level.
+//
+//       The items' bounding spheres are kept in a Bvh that follows SetWorld, so draws can be
+//       limited to the items touching a CullVolume without testing every item.
+//
+//       Draw and DrawReflected only read the list, so several threads may record it into
+//       different devices (CommandBuffers) at once, each with views of its own; a view's
+//       LodHistory is written as its levels are picked.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __drawListH__
+#define __drawListH__
+
+#include "bvh.h"
+#include "meshLod.h"
+#include "staticMesh.h"
+#include "transformCache.h"
+#include <mutex>
+#include <vector>
+
+namespace d3d
+{
+	struct DrawItem
+	{
+		Mesh*             Model;        // subset 0 of a mesh, or
+		const StaticMesh* Indexed;      // one range of a static mesh
+		int               Range;
+		UINT              PrimCount;
+		const MeshLod*    Lod;          // levels of detail of Model, or 0
+
+		D3DXMATRIX        World;
+		D3DMATERIAL9      Material;
+		DWORD             Palette;      // index of Material in the list's palette
+		Texture*          Tex;
+
+		D3DXVECTOR3       Center;       // world space bounding sphere
+		float             Radius;
+
+		int               Object;       // TransformCache object World comes from, or -1
+	};
+
+	class DrawList
+	{
+	public:
+		DrawList() : _triangles(0) {}
+		~DrawList();
+
+		void Clear();
+
+		// 'center' and 'radius' bound the mesh in its own space.  Returns the index of the
+		// new item.
+		int AddMesh(Mesh* mesh, const D3DXMATRIX& world, const D3DMATERIAL9& mtrl, Texture* tex,
+			const D3DXVECTOR3& center, float radius, int object = -1);
+
+		// The same for one range of a static mesh; the bounds come from the range.
+		int AddRange(const StaticMesh* mesh, int range, const D3DXMATRIX& world, const D3DMATERIAL9& mtrl,
+			Texture* tex, int object = -1);
+
+		// Moves an item; its bounds follow.
+		void SetWorld(int item, const D3DXMATRIX& world);
+
+		void SetTexture(int item, Texture* tex) { _items[item].Tex = tex; }
+
+		// Gives every item drawing 'mesh' the levels of 'lod', whose level 0 is 'mesh'; 0
+		// takes them away.  'lod' is not copied.
+		void SetLod(Mesh* mesh, const MeshLod* lod);
+
+		// The mesh item 'item' draws seen from 'view' (before any reflection), or its full
+		// mesh without a view.  Records the level in the view's history.
+		Mesh* GetModel(int item, const LodView* view) const;
+
+		// Picks the level of every item with levels for 'view' into its history.  Threads
+		// that share a view afterwards find their levels there and leave the history as it
+		// is, as long as nothing moved in between.
+		void UpdateLods(const LodView& view) const;
+
+		// Draws every item, or only those touching 'volume'.  With a 'lod' view items with
+		// levels of detail draw the level it picks.  Returns the number of triangles drawn.
+		DWORD Draw(RenderDevice* device, const CullVolume* volume = 0, const LodView* lod = 0) const;
+
+		// Draws every item that is not entirely behind 'plane' with its world matrix
+		// followed by 'reflect'.  Returns the number of triangles drawn.
+		DWORD DrawReflected(RenderDevice* device, const D3DXMATRIX& reflect, const D3DXPLANE& plane,
+			const LodView* lod = 0) const;
+
+		// The same for a mirror of 'transforms': bound items use its cached T * R.  Only
+		// reads 'transforms' once TransformCache::Update brought it up to date.  With a
+		// 'volume' (before the reflection, see GetMirrorCullVolume) only the items touching
+		// it are drawn.  'lod' views the items before the reflection too, so its eye is the
+		// eye reflected back through the mirror.
+		DWORD DrawReflected(RenderDevice* device, TransformCache& transforms, int mirror,
+			const D3DXPLANE& plane, const CullVolume* volume = 0, const LodView* lod = 0) const;
+
+		// Sets visible[i] to 1 for the items touching 'volume' and to 0 for the others;
+		// 'visible' has room for one entry per item.  Returns how many are visible.
+		UINT Cull(const CullVolume& volume, char* visible) const { return _tree.Cull(volume, visible); }
+
+		DWORD GetTriangleCount() const { return _triangles; }
+		const std::vector<DrawItem>& GetItems() const { return _items; }
+
+	private:
+		// Working memory of one Draw or DrawReflected call, kept between frames.
+		struct Scratch
+		{
+			std::vector<D3DXMATRIX>   Worlds;
+			std::vector<char>         Visible;
+			std::vector<MeshInstance> Instances;
+			std::vector<Mesh*>        Models;       // what each visible mesh item draws
+			std::vector<UINT>         Batched;      // the visible mesh items, sorted into batches
+			std::vector<int>          BatchStart;   // where in Batched a batch's first item starts, or -1
+		};
+
+		DrawList(const DrawList&);
+		DrawList& operator=(const DrawList&);
+
+		Scratch* AcquireScratch() const;
+		void     ReleaseScratch(Scratch* scratch) const;
+
+		int  Add(DrawItem& item, const D3DXVECTOR3& center, float radius);
+		void UpdateBounds(DrawItem& item);
+		void DrawItemWith(RenderDevice* device, const DrawItem& item, Mesh* model, const D3DXMATRIX& world) const;
+
+		// Draws the items flagged in scratch.Visible with worlds[i], mesh items batched into
+		// instanced draws of the level 'lod' picks; batches are found by sorting, not by
+		// searching the list for every item.  Returns the number of triangles.
+		DWORD Submit(RenderDevice* device, const D3DXMATRIX* worlds, const LodView* lod, Scratch& scratch) const;
+
+		std::vector<DrawItem>    _items;
+		std::vector<D3DXMATRIX>  _worlds;       // item world matrices, packed for batch multiplies
+		std::vector<D3DMATERIAL9> _palette;
+		mutable std::vector<Scratch*> _scratch;    // free ones; a call takes one while it runs
+		mutable std::mutex            _scratchLock;
+		std::vector<D3DXVECTOR3> _localCenters;
+		std::vector<float>       _localRadii;
+		Bvh                      _tree;         // object i is item i
+		DWORD _triangles;
+	};
+}
+
+#endif // __drawListH__
@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frameClock.cpp
+//
+// Desc: High resolution clock, fixed timestep accumulator and frame limiter.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "frameClock.h"
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+double d3d::GetTime()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+		::QueryPerformanceFrequency(&frequency);
+	LARGE_INTEGER counter;
+	::QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+d3d::FixedTimestep::FixedTimestep(double step, int maxSteps)
+	: _step(step), _maxSteps(maxSteps), _accumulator(0.0)
+{
+}
+
+int d3d::FixedTimestep::Advance(double elapsed)
+{
+	if (elapsed > 0.0)
+		_accumulator += elapsed;
+
+	int steps = 0;
+	while (_accumulator >= _step && steps < _maxSteps)
+	{
+		_accumulator -= _step;
+		++steps;
+	}
+	if (_accumulator >= _step)
+		_accumulator = 0.0;
+	return steps;
+}
+
+d3d::FrameLimiter::FrameLimiter(double maxFps)
+	: _interval(0.0), _next(0.0)
+{
+	SetMaxFps(maxFps);
+}
+
+void d3d::FrameLimiter::SetMaxFps(double maxFps)
+{
+	_interval = maxFps > 0.0 ? 1.0 / maxFps : 0.0;
+	_next = 0.0;
+}
+
+void d3d::FrameLimiter::Wait()
+{
+	if (_interval <= 0.0)
+		return;
+
+	double now = GetTime();
+	if (_next == 0.0 || now > _next + _interval)
+	{
+		_next = now + _interval;
+		return;
+	}
+
+	// sleep to within a millisecond of the deadline, then yield the rest; a sleep can
+	// overshoot by the scheduler's granularity
+	double remaining = _next - now;
+	if (remaining > 0.002)
+		std::this_thread::sleep_for(std::chrono::duration<double>(remaining - 0.001));
+	while (GetTime() < _next)
+		std::this_thread::yield();
+
+	_next += _interval;
+}
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frameClock.h
+//
+// Desc: Frame timing.  GetTime is a high resolution clock in double seconds.
+//       FixedTimestep turns the variable frame time into whole simulation steps of a fixed
+//       length plus the fraction of a step the renderer should interpolate by, so the
+//       simulation produces the same results at any frame rate.  FrameLimiter caps the
+//       frame rate by sleeping instead of spinning.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __frameClockH__
+#define __frameClockH__
+
+namespace d3d
+{
+	// Seconds since an arbitrary point; QueryPerformanceCounter on Windows.
+	double GetTime();
+
+	class FixedTimestep
+	{
+	public:
+		// At most 'maxSteps' steps are taken per frame; time beyond that is dropped so a
+		// long stall does not make every following frame slower.
+		FixedTimestep(double step, int maxSteps);
+
+		// Adds a frame's real time and returns the number of steps to simulate now.
+		int Advance(double elapsed);
+
+		// Where the present lies between the previous and the latest step, in [0, 1).
+		float GetAlpha() const { return (float)(_accumulator / _step); }
+
+		double GetStep() const { return _step; }
+
+	private:
+		double _step;
+		int    _maxSteps;
+		double _accumulator;
+	};
+
+	class FrameLimiter
+	{
+	public:
+		FrameLimiter(double maxFps); // 0 = unlimited
+
+		void SetMaxFps(double maxFps);
+
+		// Call once per frame; returns when the next frame is due.  A limiter that fell
+		// behind starts over from now instead of rushing to catch up.
+		void Wait();
+
+	private:
+		double _interval;
+		double _next;
+	};
+}
+
+#endif // __frameClockH__
@@ -0,0 +1,157 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frustum.cpp
+//
+// Desc: View frustum extraction, cull volumes and culling.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "frustum.h"
+
+void d3d::ExtractFrustum(Frustum* frustum, const D3DXMATRIX* viewProj)
+{
+	const D3DXMATRIX& m = *viewProj;
+	D3DXPLANE* p = frustum->Planes;
+
+	// clip space: -w <= x <= w, -w <= y <= w, 0 <= z <= w
+	p[0] = D3DXPLANE(m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41);
+	p[1] = D3DXPLANE(m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41);
+	p[2] = D3DXPLANE(m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42);
+	p[3] = D3DXPLANE(m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42);
+	p[4] = D3DXPLANE(m._13, m._23, m._33, m._43);
+	p[5] = D3DXPLANE(m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43);
+
+	for (int i = 0; i < 6; ++i)
+		D3DXPlaneNormalize(&p[i], &p[i]);
+}
+
+bool d3d::IntersectFrustum(const Frustum& frustum, const D3DXVECTOR3* points, int count)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		int outside = 0;
+		while (outside < count && D3DXPlaneDotCoord(&frustum.Planes[i], &points[outside]) < 0.0f)
+			++outside;
+		if (outside == count)
+			return false;
+	}
+	return true;
+}
+
+void d3d::InitCullVolume(CullVolume* volume, const Frustum& frustum)
+{
+	volume->NumPlanes = 6;
+	for (int i = 0; i < 6; ++i)
+		volume->Planes[i] = frustum.Planes[i];
+}
+
+void d3d::AddCullPlane(CullVolume* volume, const D3DXPLANE& plane)
+{
+	if (volume->NumPlanes < MaxCullPlanes)
+		volume->Planes[volume->NumPlanes++] = plane;
+}
+
+void d3d::TransformCullVolume(CullVolume* volume, const D3DXMATRIX& m)
+{
+	// p * m lies on the positive side of a plane q when p does of q * transpose(m)
+	D3DXMATRIX t;
+	D3DXMatrixTranspose(&t, &m);
+	for (int i = 0; i < volume->NumPlanes; ++i)
+	{
+		D3DXPlaneTransform(&volume->Planes[i], &volume->Planes[i], &t);
+		D3DXPlaneNormalize(&volume->Planes[i], &volume->Planes[i]);
+	}
+}
+
+namespace
+{
+	// the point on all three planes
+	D3DXVECTOR3 IntersectPlanes(const D3DXPLANE& p0, const D3DXPLANE& p1, const D3DXPLANE& p2)
+	{
+		D3DXVECTOR3 n0(p0.a, p0.b, p0.c), n1(p1.a, p1.b, p1.c), n2(p2.a, p2.b, p2.c), c12, c20, c01;
+		D3DXVec3Cross(&c12, &n1, &n2);
+		D3DXVec3Cross(&c20, &n2, &n0);
+		D3DXVec3Cross(&c01, &n0, &n1);
+		float det = D3DXVec3Dot(&n0, &c12);
+		return (c12 * p0.d + c20 * p1.d + c01 * p2.d) * (-1.0f / det);
+	}
+}
+
+void d3d::ExtrudeCullVolume(CullVolume* volume, const Frustum& frustum, const D3DXVECTOR4& light)
+{
+	const D3DXPLANE* p = frustum.Planes;
+
+	// corner x + 2y + 4z lies on planes x (left, right), 2 + y (bottom, top) and 4 + z (near, far)
+	D3DXVECTOR3 corners[8], center(0.0f, 0.0f, 0.0f);
+	for (int i = 0; i < 8; ++i)
+	{
+		corners[i] = IntersectPlanes(p[i & 1], p[2 + ((i >> 1) & 1)], p[4 + ((i >> 2) & 1)]);
+		center += corners[i] * 0.125f;
+	}
+
+	// a caster's shadow moves away from the light, so the planes the light lies in front
+	// of still bound the casters; the others are open towards the light
+	D3DXVECTOR4 toLight = light.w == 0.0f ? D3DXVECTOR4(-light.x, -light.y, -light.z, 0.0f) : light;
+	bool keep[6];
+	volume->NumPlanes = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		keep[i] = p[i].a * toLight.x + p[i].b * toLight.y + p[i].c * toLight.z + p[i].d * toLight.w >= 0.0f;
+		if (keep[i])
+			AddCullPlane(volume, p[i]);
+	}
+
+	// the sides of the sweep run from the silhouette edges, between a kept and an open
+	// plane, towards the light.  Edge e lies on planes a and b; its ends are the corners
+	// where the third pair of planes crosses it.
+	static const int edges[12][2] = {
+		{ 0, 2 }, { 0, 3 }, { 1, 2 }, { 1, 3 },
+		{ 0, 4 }, { 0, 5 }, { 1, 4 }, { 1, 5 },
+		{ 2, 4 }, { 2, 5 }, { 3, 4 }, { 3, 5 } };
+	for (int e = 0; e < 12; ++e)
+	{
+		int a = edges[e][0], b = edges[e][1];
+		if (keep[a] == keep[b])
+			continue;
+
+		int corner = 0, along = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (a / 2 == k)
+				corner |= (a & 1) << k;
+			else if (b / 2 == k)
+				corner |= (b & 1) << k;
+			else
+				along = 1 << k;
+		}
+		const D3DXVECTOR3& v0 = corners[corner];
+		const D3DXVECTOR3& v1 = corners[corner | along];
+
+		D3DXVECTOR3 edge = v1 - v0, towards, normal;
+		if (toLight.w == 0.0f)
+			towards = D3DXVECTOR3(toLight.x, toLight.y, toLight.z);
+		else
+			towards = D3DXVECTOR3(toLight.x, toLight.y, toLight.z) - v0;
+		D3DXVec3Cross(&normal, &edge, &towards);
+		float length = D3DXVec3Length(&normal);
+		if (length <= 1e-6f * D3DXVec3Length(&edge) * D3DXVec3Length(&towards))
+			continue;   // the light looks along the edge; leaving the side out is conservative
+		normal *= 1.0f / length;
+
+		D3DXPLANE side;
+		D3DXPlaneFromPointNormal(&side, &v0, &normal);
+		if (D3DXPlaneDotCoord(&side, &center) < 0.0f)
+			side = -side;
+		AddCullPlane(volume, side);
+	}
+}
+
+bool d3d::IntersectSphere(const CullVolume& volume, const D3DXVECTOR3& center, float radius)
+{
+	for (int i = 0; i < volume.NumPlanes; ++i)
+	{
+		if (D3DXPlaneDotCoord(&volume.Planes[i], &center) < -radius)
+			return false;
+	}
+	return true;
+}
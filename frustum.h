@@ -0,0 +1,63 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: frustum.h
+//
+// Desc: View frustum planes extracted from a view * projection matrix, and conservative
+//       visibility tests against them.
+//
+//       A CullVolume is any convex set of planes objects are culled against: the view
+//       frustum, the frustum seen through a mirror, or the frustum swept towards a light
+//       (whatever casts a shadow into the view lies in it).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __frustumH__
+#define __frustumH__
+
+#include "d3dCompat.h"
+
+namespace d3d
+{
+	struct Frustum
+	{
+		// left, right, bottom, top, near, far; normals point into the frustum
+		D3DXPLANE Planes[6];
+	};
+
+	// Extracts the planes of the clip volume of 'viewProj' (row vectors, D3D depth 0..1).
+	void ExtractFrustum(Frustum* frustum, const D3DXMATRIX* viewProj);
+
+	// Returns false when every point lies behind one of the planes, i.e. the convex hull
+	// of the points is certainly outside.  Can return true for hulls that are not visible.
+	bool IntersectFrustum(const Frustum& frustum, const D3DXVECTOR3* points, int count);
+
+	// A frustum has 6 planes; the light swept one at most 12, the mirror one 11.
+	enum { MaxCullPlanes = 12 };
+
+	struct CullVolume
+	{
+		int       NumPlanes;
+		D3DXPLANE Planes[MaxCullPlanes];   // normalized, normals point into the volume
+	};
+
+	// The six planes of 'frustum'.
+	void InitCullVolume(CullVolume* volume, const Frustum& frustum);
+
+	// Adds 'plane' (normalized).  Planes beyond MaxCullPlanes are dropped, which only makes
+	// the volume larger.
+	void AddCullPlane(CullVolume* volume, const D3DXPLANE& plane);
+
+	// Turns 'volume' into the volume of the points p for which p * m lies in 'volume', e.g.
+	// the objects whose reflection under m is in view.
+	void TransformCullVolume(CullVolume* volume, const D3DXMATRIX& m);
+
+	// The points whose shadow can fall into 'frustum': the frustum swept away from 'light'
+	// towards the light source.  'light' follows D3DLIGHT9: w = 0 is a directional light
+	// travelling along xyz, w = 1 a point light at xyz.
+	void ExtrudeCullVolume(CullVolume* volume, const Frustum& frustum, const D3DXVECTOR4& light);
+
+	// Returns false when the sphere lies entirely behind one of the planes.
+	bool IntersectSphere(const CullVolume& volume, const D3DXVECTOR3& center, float radius);
+}
+
+#endif // __frustumH__
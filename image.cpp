@@ -0,0 +1,611 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: image.cpp
+//
+// Desc: BMP and baseline JPEG decoders.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "image.h"
+#include "dds.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	unsigned ReadU16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+	unsigned ReadU32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24); }
+	unsigned ReadBE16(const unsigned char* p) { return (p[0] << 8) | p[1]; }
+
+	inline DWORD Clamp255(float v)
+	{
+		return v <= 0.0f ? 0 : v >= 255.0f ? 255 : (DWORD)(v + 0.5f);
+	}
+
+	//
+	// JPEG
+	//
+
+	const int ZigZag[64] = {
+		 0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+		12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+		35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+		58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+	// Canonical Huffman table, decoded one bit at a time as in ITU T.81 F.2.2.3.
+	struct HuffmanTable
+	{
+		bool          defined;
+		int           minCode[17];
+		int           maxCode[17];     // -1 when there are no codes of that length
+		int           valPtr[17];
+		unsigned char values[256];
+	};
+
+	struct JpegComponent
+	{
+		int id;
+		int h, v;                      // sampling factors
+		int quant;
+		int dcTable, acTable;
+		int dcPred;
+		int blocksX, blocksY;          // blocks covering the component, padded to whole MCUs
+		std::vector<unsigned char> samples;   // blocksX * 8 wide
+	};
+
+	class JpegDecoder
+	{
+	public:
+		JpegDecoder(const unsigned char* data, size_t size)
+			: _p(data), _end(data + size), _bits(0), _count(0), _marker(false), _restartInterval(0),
+			  _width(0), _height(0), _maxH(1), _maxV(1), _frame(false)
+		{
+			memset(_quant, 0, sizeof(_quant));
+			memset(_dc, 0, sizeof(_dc));
+			memset(_ac, 0, sizeof(_ac));
+			for (int u = 0; u < 8; ++u)
+			{
+				for (int x = 0; x < 8; ++x)
+				{
+					float c = u == 0 ? sqrtf(0.5f) : 1.0f;
+					_idct[u][x] = 0.5f * c * cosf((2 * x + 1) * u * D3DX_PI / 16.0f);
+				}
+			}
+		}
+
+		bool Decode(d3d::Image* image)
+		{
+			if (_end - _p < 2 || _p[0] != 0xFF || _p[1] != 0xD8)
+				return false;
+			_p += 2;
+
+			for (;;)
+			{
+				// markers may be preceded by any number of 0xFF fill bytes
+				while (_p < _end && *_p != 0xFF)
+					++_p;
+				while (_p < _end && *_p == 0xFF)
+					++_p;
+				if (_p >= _end)
+					return false;
+				unsigned marker = *_p++;
+
+				if (marker == 0xD9)
+					break;
+				if (marker >= 0xD0 && marker <= 0xD7)
+					continue;   // a stray restart marker
+				if (_end - _p < 2)
+					return false;
+				size_t length = ReadBE16(_p);
+				if (length < 2 || length > (size_t)(_end - _p))
+					return false;
+				const unsigned char* segment = _p + 2;
+				size_t size = length - 2;
+				_p += length;
+
+				bool ok = true;
+				switch (marker)
+				{
+				case 0xC0: case 0xC1:
+					ok = ReadFrame(segment, size);
+					break;
+				case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+				case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+					return false;   // progressive, lossless, hierarchical or arithmetic
+				case 0xC4:
+					ok = ReadHuffmanTables(segment, size);
+					break;
+				case 0xDB:
+					ok = ReadQuantTables(segment, size);
+					break;
+				case 0xDD:
+					ok = size >= 2;
+					if (ok)
+						_restartInterval = ReadBE16(segment);
+					break;
+				case 0xDA:
+					ok = ReadScan(segment, size);
+					break;
+				default:
+					break;      // APPn, COM and friends
+				}
+				if (!ok)
+					return false;
+			}
+
+			if (!_frame)
+				return false;
+			Convert(image);
+			return true;
+		}
+
+	private:
+		bool ReadFrame(const unsigned char* s, size_t size)
+		{
+			if (_frame || size < 6 || s[0] != 8)
+				return false;
+			_height = (int)ReadBE16(s + 1);
+			_width = (int)ReadBE16(s + 3);
+			int count = s[5];
+			if (_width <= 0 || _height <= 0 || (count != 1 && count != 3) || size < 6 + 3 * (size_t)count)
+				return false;
+
+			_components.resize(count);
+			for (int i = 0; i < count; ++i)
+			{
+				JpegComponent& c = _components[i];
+				c.id = s[6 + i * 3];
+				c.h = s[7 + i * 3] >> 4;
+				c.v = s[7 + i * 3] & 15;
+				c.quant = s[8 + i * 3];
+				if (c.h < 1 || c.h > 2 || c.v < 1 || c.v > 2 || c.quant > 3)
+					return false;
+				_maxH = std::max(_maxH, c.h);
+				_maxV = std::max(_maxV, c.v);
+			}
+
+			int mcusX = (_width + 8 * _maxH - 1) / (8 * _maxH);
+			int mcusY = (_height + 8 * _maxV - 1) / (8 * _maxV);
+			for (int i = 0; i < count; ++i)
+			{
+				JpegComponent& c = _components[i];
+				c.blocksX = mcusX * c.h;
+				c.blocksY = mcusY * c.v;
+				c.samples.assign((size_t)c.blocksX * c.blocksY * 64, 0);
+			}
+			_frame = true;
+			return true;
+		}
+
+		bool ReadHuffmanTables(const unsigned char* s, size_t size)
+		{
+			while (size > 0)
+			{
+				if (size < 17)
+					return false;
+				int cls = s[0] >> 4, id = s[0] & 15;
+				if (cls > 1 || id > 3)
+					return false;
+				int total = 0;
+				for (int l = 1; l <= 16; ++l)
+					total += s[l];
+				if (total > 256 || size < 17 + (size_t)total)
+					return false;
+
+				HuffmanTable& t = cls == 0 ? _dc[id] : _ac[id];
+				int code = 0, k = 0;
+				for (int l = 1; l <= 16; ++l)
+				{
+					t.valPtr[l] = k;
+					t.minCode[l] = code;
+					code += s[l];
+					k += s[l];
+					t.maxCode[l] = s[l] ? code - 1 : -1;
+					code <<= 1;
+				}
+				memcpy(t.values, s + 17, total);
+				t.defined = true;
+
+				s += 17 + total;
+				size -= 17 + total;
+			}
+			return true;
+		}
+
+		bool ReadQuantTables(const unsigned char* s, size_t size)
+		{
+			while (size > 0)
+			{
+				int precision = s[0] >> 4, id = s[0] & 15;
+				size_t length = 1 + 64 * (precision ? 2 : 1);
+				if (id > 3 || precision > 1 || size < length)
+					return false;
+				for (int k = 0; k < 64; ++k)
+					_quant[id][k] = precision ? (int)ReadBE16(s + 1 + 2 * k) : s[1 + k];
+				s += length;
+				size -= length;
+			}
+			return true;
+		}
+
+		bool ReadScan(const unsigned char* s, size_t size)
+		{
+			if (!_frame || size < 1)
+				return false;
+			int count = s[0];
+			if (count < 1 || count > (int)_components.size() || size < 4 + 2 * (size_t)count)
+				return false;
+
+			JpegComponent* scan[3];
+			for (int i = 0; i < count; ++i)
+			{
+				JpegComponent* c = 0;
+				for (size_t j = 0; j < _components.size(); ++j)
+					if (_components[j].id == s[1 + i * 2])
+						c = &_components[j];
+				if (!c)
+					return false;
+				c->dcTable = s[2 + i * 2] >> 4;
+				c->acTable = s[2 + i * 2] & 15;
+				if (c->dcTable > 3 || c->acTable > 3 || !_dc[c->dcTable].defined || !_ac[c->acTable].defined)
+					return false;
+				c->dcPred = 0;
+				scan[i] = c;
+			}
+
+			_bits = 0;
+			_count = 0;
+			_marker = false;
+
+			// one component on its own is coded block by block over just its own area,
+			// several are interleaved a whole MCU at a time
+			int unitsX, unitsY;
+			if (count == 1)
+			{
+				const JpegComponent& c = *scan[0];
+				unitsX = ((_width * c.h + _maxH - 1) / _maxH + 7) / 8;
+				unitsY = ((_height * c.v + _maxV - 1) / _maxV + 7) / 8;
+			}
+			else
+			{
+				unitsX = (_width + 8 * _maxH - 1) / (8 * _maxH);
+				unitsY = (_height + 8 * _maxV - 1) / (8 * _maxV);
+			}
+
+			int units = unitsX * unitsY;
+			for (int unit = 0; unit < units; ++unit)
+			{
+				if (_restartInterval && unit > 0 && unit % _restartInterval == 0)
+					Restart(scan, count);
+
+				int ux = unit % unitsX, uy = unit / unitsX;
+				if (count == 1)
+				{
+					if (!DecodeBlock(*scan[0], ux, uy))
+						return false;
+					continue;
+				}
+				for (int i = 0; i < count; ++i)
+				{
+					JpegComponent& c = *scan[i];
+					for (int by = 0; by < c.v; ++by)
+						for (int bx = 0; bx < c.h; ++bx)
+							if (!DecodeBlock(c, ux * c.h + bx, uy * c.v + by))
+								return false;
+				}
+			}
+
+			// leave _p on the marker that ended the entropy coded data
+			return true;
+		}
+
+		void Restart(JpegComponent** scan, int count)
+		{
+			_bits = 0;
+			_count = 0;
+			_marker = false;
+			while (_p + 1 < _end && !(_p[0] == 0xFF && _p[1] >= 0xD0 && _p[1] <= 0xD7))
+				++_p;
+			if (_p + 1 < _end)
+				_p += 2;
+			for (int i = 0; i < count; ++i)
+				scan[i]->dcPred = 0;
+		}
+
+		// Past the end of the entropy coded data (a marker) the stream reads as zeros.
+		int GetBit()
+		{
+			if (_count == 0)
+			{
+				_bits = 0;
+				if (!_marker && _p < _end)
+				{
+					if (_p[0] != 0xFF)
+						_bits = *_p++;
+					else if (_p + 1 < _end && _p[1] == 0x00)
+					{
+						_bits = 0xFF;
+						_p += 2;
+					}
+					else
+						_marker = true;
+				}
+				_count = 8;
+			}
+			--_count;
+			return (_bits >> _count) & 1;
+		}
+
+		int GetBits(int n)
+		{
+			int v = 0;
+			while (n-- > 0)
+				v = (v << 1) | GetBit();
+			return v;
+		}
+
+		// Sign extends an n bit magnitude category value.
+		static int Extend(int v, int n)
+		{
+			return n > 0 && v < (1 << (n - 1)) ? v - (1 << n) + 1 : v;
+		}
+
+		int DecodeHuffman(const HuffmanTable& t)
+		{
+			int code = GetBit();
+			for (int l = 1; l <= 16; ++l)
+			{
+				if (t.maxCode[l] >= 0 && code <= t.maxCode[l])
+				{
+					int k = t.valPtr[l] + code - t.minCode[l];
+					return k < 256 ? t.values[k] : -1;
+				}
+				code = (code << 1) | GetBit();
+			}
+			return -1;
+		}
+
+		bool DecodeBlock(JpegComponent& c, int bx, int by)
+		{
+			const int* q = _quant[c.quant];
+			float coef[64];
+			memset(coef, 0, sizeof(coef));
+
+			int t = DecodeHuffman(_dc[c.dcTable]);
+			if (t < 0 || t > 11)
+				return false;
+			c.dcPred += Extend(GetBits(t), t);
+			coef[0] = (float)(c.dcPred * q[0]);
+
+			for (int k = 1; k < 64; )
+			{
+				int rs = DecodeHuffman(_ac[c.acTable]);
+				if (rs < 0)
+					return false;
+				int r = rs >> 4, s = rs & 15;
+				if (s == 0)
+				{
+					if (r != 15)
+						break;  // end of block
+					k += 16;
+					continue;
+				}
+				k += r;
+				if (k > 63)
+					return false;
+				coef[ZigZag[k]] = (float)(Extend(GetBits(s), s) * q[k]);
+				++k;
+			}
+
+			// separable inverse DCT: columns, then rows
+			float tmp[64];
+			for (int x = 0; x < 8; ++x)
+			{
+				for (int y = 0; y < 8; ++y)
+				{
+					float sum = 0.0f;
+					for (int v = 0; v < 8; ++v)
+						sum += _idct[v][y] * coef[v * 8 + x];
+					tmp[y * 8 + x] = sum;
+				}
+			}
+			unsigned char* out = &c.samples[((size_t)by * 8 * c.blocksX + bx) * 8];
+			size_t stride = (size_t)c.blocksX * 8;
+			for (int y = 0; y < 8; ++y)
+			{
+				for (int x = 0; x < 8; ++x)
+				{
+					float sum = 128.0f;
+					for (int u = 0; u < 8; ++u)
+						sum += _idct[u][x] * tmp[y * 8 + u];
+					out[y * stride + x] = (unsigned char)Clamp255(sum);
+				}
+			}
+			return true;
+		}
+
+		// Subsampled components are widened by repeating samples.
+		void Convert(d3d::Image* image)
+		{
+			image->Width = _width;
+			image->Height = _height;
+			image->Pixels.resize((size_t)_width * _height);
+
+			for (int y = 0; y < _height; ++y)
+			{
+				DWORD* out = &image->Pixels[(size_t)y * _width];
+				for (int x = 0; x < _width; ++x)
+				{
+					float s[3];
+					for (size_t i = 0; i < _components.size(); ++i)
+					{
+						const JpegComponent& c = _components[i];
+						int cx = x * c.h / _maxH, cy = y * c.v / _maxV;
+						s[i] = c.samples[(size_t)cy * c.blocksX * 8 + cx];
+					}
+					if (_components.size() == 1)
+					{
+						DWORD l = (DWORD)s[0];
+						out[x] = D3DCOLOR_XRGB(l, l, l);
+						continue;
+					}
+					float cb = s[1] - 128.0f, cr = s[2] - 128.0f;
+					out[x] = D3DCOLOR_XRGB(
+						Clamp255(s[0] + 1.402f * cr),
+						Clamp255(s[0] - 0.344136f * cb - 0.714136f * cr),
+						Clamp255(s[0] + 1.772f * cb));
+				}
+			}
+		}
+
+		const unsigned char* _p;
+		const unsigned char* _end;
+		unsigned _bits;
+		int      _count;
+		bool     _marker;
+
+		int          _quant[4][64];    // in zigzag order, as stored
+		HuffmanTable _dc[4];
+		HuffmanTable _ac[4];
+		int          _restartInterval;
+		float        _idct[8][8];      // [frequency][position]
+
+		int  _width, _height;
+		int  _maxH, _maxV;
+		bool _frame;
+		std::vector<JpegComponent> _components;
+	};
+}
+
+void d3d::HalveTexels(const DWORD* src, int width, int height, DWORD* dst)
+{
+	int w = std::max(1, width / 2);
+	int h = std::max(1, height / 2);
+	for (int y = 0; y < h; ++y)
+	{
+		for (int x = 0; x < w; ++x)
+		{
+			int sx0 = std::min(x * 2, width - 1), sx1 = std::min(x * 2 + 1, width - 1);
+			int sy0 = std::min(y * 2, height - 1), sy1 = std::min(y * 2 + 1, height - 1);
+			DWORD c[4] = {
+				src[sy0 * width + sx0], src[sy0 * width + sx1],
+				src[sy1 * width + sx0], src[sy1 * width + sx1] };
+			DWORD out = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				DWORD sum = 0;
+				for (int i = 0; i < 4; ++i)
+					sum += (c[i] >> shift) & 0xff;
+				out |= ((sum + 2) / 4) << shift;
+			}
+			dst[y * w + x] = out;
+		}
+	}
+}
+
+bool d3d::DecodeBMP(const unsigned char* p, size_t size, Image* image)
+{
+	if (size < 54 || p[0] != 'B' || p[1] != 'M')
+		return false;
+
+	unsigned dataOffset  = ReadU32(p + 10);
+	unsigned headerSize  = ReadU32(p + 14);
+	int      width       = (int)ReadU32(p + 18);
+	int      height      = (int)ReadU32(p + 22);
+	unsigned bitCount    = ReadU16(p + 28);
+	unsigned compression = ReadU32(p + 30);
+
+	bool bottomUp = height > 0;
+	if (height < 0)
+		height = -height;
+	if (width <= 0 || height <= 0 || (compression != 0 && compression != 3))
+		return false;
+	if (bitCount != 8 && bitCount != 24 && bitCount != 32)
+		return false;
+
+	size_t pitch = ((width * bitCount + 31) / 32) * 4;
+	if (dataOffset + pitch * height > size)
+		return false;
+	if (bitCount == 8 && 14 + (size_t)headerSize + 256 * 4 > size)
+		return false;
+
+	const unsigned char* palette = p + 14 + headerSize;
+
+	image->Width = width;
+	image->Height = height;
+	image->Pixels.resize((size_t)width * height);
+	for (int y = 0; y < height; ++y)
+	{
+		const unsigned char* row = p + dataOffset + pitch * (bottomUp ? height - 1 - y : y);
+		DWORD* out = &image->Pixels[(size_t)y * width];
+		for (int x = 0; x < width; ++x)
+		{
+			const unsigned char* s;
+			switch (bitCount)
+			{
+			case 8:
+				s = palette + row[x] * 4;
+				out[x] = D3DCOLOR_XRGB(s[2], s[1], s[0]);
+				break;
+			case 24:
+				s = row + x * 3;
+				out[x] = D3DCOLOR_XRGB(s[2], s[1], s[0]);
+				break;
+			default:
+				s = row + x * 4;
+				out[x] = D3DCOLOR_ARGB(s[3], s[2], s[1], s[0]);
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+bool d3d::DecodeJPEG(const unsigned char* data, size_t size, Image* image)
+{
+	JpegDecoder decoder(data, size);
+	return decoder.Decode(image);
+}
+
+bool d3d::DecodeImage(const unsigned char* data, size_t size, Image* image)
+{
+	if (size >= 2 && data[0] == 'B' && data[1] == 'M')
+		return DecodeBMP(data, size, image);
+	if (size >= 2 && data[0] == 0xFF && data[1] == 0xD8)
+		return DecodeJPEG(data, size, image);
+
+	DdsTexture dds;
+	if (!ParseDDS(data, size, &dds))
+		return false;
+	image->Width = (int)dds.Width;
+	image->Height = (int)dds.Height;
+	image->Pixels.resize((size_t)dds.Width * dds.Height);
+	DecodeLevel(dds.Format, dds.Data, dds.Width, dds.Height, &image->Pixels[0]);
+	return true;
+}
+
+bool d3d::ReadFileData(const char* fileName, std::vector<unsigned char>* data)
+{
+	FILE* f = fopen(fileName, "rb");
+	if (!f)
+		return false;
+	data->clear();
+	unsigned char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		data->insert(data->end(), buffer, buffer + n);
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+bool d3d::LoadImageFile(const char* fileName, Image* image)
+{
+	std::vector<unsigned char> data;
+	if (!ReadFileData(fileName, &data) || data.empty())
+		return false;
+	return DecodeImage(&data[0], data.size(), image);
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: image.h
+//
+// Desc: Portable image decoding for the textures the demo ships: uncompressed 8, 24 and
+//       32 bit BMPs and baseline (sequential, Huffman coded, 8 bit) JPEGs, greyscale or
+//       YCbCr with any sampling up to 2x2.  Progressive and arithmetic coded JPEGs are
+//       rejected.  DDS files (dds.h) decode to their top level.  Nothing here touches a
+//       device, so the asset loader's threads decode with it while the render thread keeps
+//       drawing.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __imageH__
+#define __imageH__
+
+#include "d3dCompat.h"
+#include <cstddef>
+#include <vector>
+
+namespace d3d
+{
+	// Width * Height A8R8G8B8 pixels, top row first.
+	struct Image
+	{
+		int                Width;
+		int                Height;
+		std::vector<DWORD> Pixels;
+	};
+
+	// Box filters 'width' x 'height' texels into the next mip level down,
+	// max(1, width / 2) x max(1, height / 2).
+	void HalveTexels(const DWORD* src, int width, int height, DWORD* dst);
+
+	bool DecodeBMP(const unsigned char* data, size_t size, Image* image);
+	bool DecodeJPEG(const unsigned char* data, size_t size, Image* image);
+
+	// Picks the decoder from the file signature; DDS files give their top level.
+	bool DecodeImage(const unsigned char* data, size_t size, Image* image);
+
+	bool ReadFileData(const char* fileName, std::vector<unsigned char>* data);
+
+	// ReadFileData followed by DecodeImage.
+	bool LoadImageFile(const char* fileName, Image* image);
+}
+
+#endif // __imageH__
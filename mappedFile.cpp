@@ -0,0 +1,70 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: mappedFile.cpp
+//
+// Desc: Read only file mapping.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool d3d::MappedFile::Open(const char* fileName)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = ::CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	HANDLE mapping = 0;
+	if (::GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		mapping = ::CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+	::CloseHandle(file);    // the mapping keeps the file open
+	if (!mapping)
+		return false;
+	void* view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	::CloseHandle(mapping); // and the view keeps the mapping
+	if (!view)
+		return false;
+	_data = (const unsigned char*)view;
+	_size = (size_t)size.QuadPart;
+#else
+	int fd = ::open(fileName, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* view = MAP_FAILED;
+	if (::fstat(fd, &st) == 0 && st.st_size > 0)
+		view = ::mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	_data = (const unsigned char*)view;
+	_size = (size_t)st.st_size;
+#endif
+	return true;
+}
+
+void d3d::MappedFile::Close()
+{
+	if (!_data)
+		return;
+#ifdef _WIN32
+	::UnmapViewOfFile(_data);
+#else
+	::munmap((void*)_data, _size);
+#endif
+	_data = 0;
+	_size = 0;
+}
@@ -0,0 +1,40 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: mappedFile.h
+//
+// Desc: A read only view of a whole file mapped into memory (MapViewOfFile on Windows,
+//       mmap elsewhere).  Pages are read from disk as they are first touched.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __mappedFileH__
+#define __mappedFileH__
+
+#include <cstddef>
+
+namespace d3d
+{
+	class MappedFile
+	{
+	public:
+		MappedFile() : _data(0), _size(0) {}
+		~MappedFile() { Close(); }
+
+		// Fails for missing or empty files.  Closes what was open before.
+		bool Open(const char* fileName);
+		void Close();
+
+		bool IsOpen() const { return _data != 0; }
+		const unsigned char* GetData() const { return _data; }
+		size_t GetSize() const { return _size; }
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+		const unsigned char* _data;
+		size_t               _size;
+	};
+}
+
+#endif // __mappedFileH__
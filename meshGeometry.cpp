@@ -0,0 +1,173 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: meshGeometry.cpp
+//
+// Desc: Procedural teapot and boxes.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "meshGeometry.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	struct Geometry
+	{
+		std::vector<d3d::MeshVertex>& vertices;
+		std::vector<WORD>&            indices;
+	};
+
+	void AddTriangle(Geometry& mesh, WORD a, WORD b, WORD c)
+	{
+		// Direct3D front faces are clockwise; orient every triangle so its
+		// geometric normal agrees with the averaged vertex normals.
+		const d3d::MeshVertex& va = mesh.vertices[a];
+		const d3d::MeshVertex& vb = mesh.vertices[b];
+		const d3d::MeshVertex& vc = mesh.vertices[c];
+		D3DXVECTOR3 e1(vb.x - va.x, vb.y - va.y, vb.z - va.z);
+		D3DXVECTOR3 e2(vc.x - va.x, vc.y - va.y, vc.z - va.z);
+		D3DXVECTOR3 n;
+		D3DXVec3Cross(&n, &e1, &e2);
+		float dot = n.x * (va.nx + vb.nx + vc.nx) + n.y * (va.ny + vb.ny + vc.ny) + n.z * (va.nz + vb.nz + vc.nz);
+
+		mesh.indices.push_back(a);
+		mesh.indices.push_back(dot >= 0.0f ? b : c);
+		mesh.indices.push_back(dot >= 0.0f ? c : b);
+	}
+
+	// Connects consecutive rings of 'ringSize' vertices starting at 'first'.
+	void StitchRings(Geometry& mesh, WORD first, int rings, int ringSize)
+	{
+		for (int i = 0; i + 1 < rings; ++i)
+		{
+			for (int j = 0; j < ringSize; ++j)
+			{
+				WORD a = (WORD)(first + i * ringSize + j);
+				WORD b = (WORD)(first + i * ringSize + (j + 1) % ringSize);
+				WORD c = (WORD)(first + (i + 1) * ringSize + j);
+				WORD d = (WORD)(first + (i + 1) * ringSize + (j + 1) % ringSize);
+				AddTriangle(mesh, a, b, c);
+				AddTriangle(mesh, b, d, c);
+			}
+		}
+	}
+
+	// Sweeps a circle of varying radius along a path in the xy plane.
+	void AddTube(Geometry& mesh, const float (*path)[3], int count, int sides)
+	{
+		WORD first = (WORD)mesh.vertices.size();
+		for (int i = 0; i < count; ++i)
+		{
+			int i0 = std::max(i - 1, 0), i1 = std::min(i + 1, count - 1);
+			float tx = path[i1][0] - path[i0][0];
+			float ty = path[i1][1] - path[i0][1];
+			float len = sqrtf(tx * tx + ty * ty);
+			tx /= len; ty /= len;
+
+			// frame: (-ty, tx, 0) in the xy plane and z
+			for (int j = 0; j < sides; ++j)
+			{
+				float a = 2.0f * D3DX_PI * j / sides;
+				float nx = -ty * cosf(a), ny = tx * cosf(a), nz = sinf(a);
+				d3d::MeshVertex v;
+				v.x = path[i][0] + nx * path[i][2];
+				v.y = path[i][1] + ny * path[i][2];
+				v.z = nz * path[i][2];
+				v.nx = nx; v.ny = ny; v.nz = nz;
+				mesh.vertices.push_back(v);
+			}
+		}
+		StitchRings(mesh, first, count, sides);
+	}
+}
+
+void d3d::BuildTeapot(std::vector<MeshVertex>* vertices, std::vector<WORD>* indices)
+{
+	Geometry mesh = { *vertices, *indices };
+
+	// (radius, height) profile from the bottom centre to the top of the knob
+	static const float profile[][2] = {
+		{ 0.00f, -0.75f }, { 0.60f, -0.75f }, { 0.95f, -0.72f }, { 1.18f, -0.58f },
+		{ 1.33f, -0.35f }, { 1.40f, -0.10f }, { 1.38f,  0.10f }, { 1.30f,  0.30f },
+		{ 1.15f,  0.45f }, { 1.00f,  0.52f }, { 0.90f,  0.55f }, { 0.70f,  0.60f },
+		{ 0.40f,  0.66f }, { 0.15f,  0.70f }, { 0.12f,  0.78f }, { 0.20f,  0.86f },
+		{ 0.10f,  0.92f }, { 0.00f,  0.93f } };
+	const int rings = sizeof(profile) / sizeof(profile[0]);
+	const int slices = 24;
+
+	WORD first = (WORD)mesh.vertices.size();
+	for (int i = 0; i < rings; ++i)
+	{
+		int i0 = std::max(i - 1, 0), i1 = std::min(i + 1, rings - 1);
+		float tr = profile[i1][0] - profile[i0][0];
+		float ty = profile[i1][1] - profile[i0][1];
+		float len = sqrtf(tr * tr + ty * ty);
+		float nr = ty / len, ny = -tr / len;
+
+		for (int j = 0; j < slices; ++j)
+		{
+			float a = 2.0f * D3DX_PI * j / slices;
+			d3d::MeshVertex v;
+			v.x = profile[i][0] * cosf(a);
+			v.y = profile[i][1];
+			v.z = profile[i][0] * sinf(a);
+			v.nx = nr * cosf(a);
+			v.ny = ny;
+			v.nz = nr * sinf(a);
+			mesh.vertices.push_back(v);
+		}
+	}
+	StitchRings(mesh, first, rings, slices);
+
+	// (x, y, radius)
+	static const float spout[][3] = {
+		{ 1.10f, -0.25f, 0.30f }, { 1.45f, -0.15f, 0.24f }, { 1.70f,  0.05f, 0.18f },
+		{ 1.85f,  0.30f, 0.14f }, { 1.95f,  0.50f, 0.12f }, { 2.10f,  0.58f, 0.13f } };
+	AddTube(mesh, spout, sizeof(spout) / sizeof(spout[0]), 12);
+
+	float handle[9][3];
+	for (int i = 0; i < 9; ++i)
+	{
+		float a = D3DX_PI * (-0.35f + 0.85f * i / 8.0f);
+		handle[i][0] = -1.30f - 0.45f * cosf(a);
+		handle[i][1] =  0.05f + 0.45f * sinf(a);
+		handle[i][2] =  0.09f;
+	}
+	AddTube(mesh, handle, 9, 10);
+}
+
+void d3d::BuildTeapotBox(std::vector<MeshVertex>* vertices, std::vector<WORD>* indices)
+{
+	BuildBox(D3DXVECTOR3(-1.84f, -0.75f, -1.40f), D3DXVECTOR3(2.23f, 0.93f, 1.40f), vertices, indices);
+}
+
+void d3d::BuildBox(const D3DXVECTOR3& min, const D3DXVECTOR3& max,
+	std::vector<MeshVertex>* vertices, std::vector<WORD>* indices)
+{
+	Geometry mesh = { *vertices, *indices };
+	const float* lo = (const float*)&min;
+	const float* hi = (const float*)&max;
+
+	// one face per axis and side: corners (u, v) in the two other axes
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (int side = 0; side < 2; ++side)
+		{
+			int u = (axis + 1) % 3, v = (axis + 2) % 3;
+			WORD first = (WORD)mesh.vertices.size();
+			for (int k = 0; k < 4; ++k)
+			{
+				float p[3], n[3] = { 0.0f, 0.0f, 0.0f };
+				p[axis] = side ? hi[axis] : lo[axis];
+				p[u] = (k & 1) ? hi[u] : lo[u];
+				p[v] = (k & 2) ? hi[v] : lo[v];
+				n[axis] = side ? 1.0f : -1.0f;
+				MeshVertex vertex = { p[0], p[1], p[2], n[0], n[1], n[2] };
+				mesh.vertices.push_back(vertex);
+			}
+			AddTriangle(mesh, first, (WORD)(first + 1), (WORD)(first + 2));
+			AddTriangle(mesh, (WORD)(first + 1), (WORD)(first + 3), (WORD)(first + 2));
+		}
+	}
+}
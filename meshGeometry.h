@@ -0,0 +1,34 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: meshGeometry.h
+//
+// Desc: Procedural mesh geometry in the MeshVertex layout.  The builders only fill
+//       vectors, so they run on any thread; RenderDevice::CreateMesh turns the result into
+//       a mesh.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __meshGeometryH__
+#define __meshGeometryH__
+
+#include "renderDevice.h"
+#include <vector>
+
+namespace d3d
+{
+	// Appends a triangle list: vertices, and three indices per triangle, clockwise
+	// from the front.
+	typedef void (*MeshBuilder)(std::vector<MeshVertex>* vertices, std::vector<WORD>* indices);
+
+	// A stand-in for D3DXCreateTeapot: a lathed body and lid, a spout and a handle, with
+	// roughly the same extents and orientation (spout towards +x).
+	void BuildTeapot(std::vector<MeshVertex>* vertices, std::vector<WORD>* indices);
+
+	// The box around BuildTeapot's geometry, 24 vertices with face normals.
+	void BuildTeapotBox(std::vector<MeshVertex>* vertices, std::vector<WORD>* indices);
+
+	void BuildBox(const D3DXVECTOR3& min, const D3DXVECTOR3& max,
+		std::vector<MeshVertex>* vertices, std::vector<WORD>* indices);
+}
+
+#endif // __meshGeometryH__
@@ -0,0 +1,623 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: meshLod.cpp
+//
+// Desc: Quadric error edge collapse and level of detail selection.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "meshLod.h"
+#include "staticMesh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <queue>
+
+namespace
+{
+	// Meshes are not simplified below this many triangles.
+	const UINT MinLodTriangles = 32;
+
+	// Collapses that turn a remaining triangle's normal further than this (cosine) are refused.
+	const float MaxNormalTurn = 0.2f;
+
+	// The squared distance to a set of weighted planes, a symmetric 4x4 matrix stored as its
+	// upper triangle row by row.
+	struct Quadric
+	{
+		double q[10];
+	};
+
+	void AddPlane(Quadric& quadric, const double (&p)[4], double weight)
+	{
+		int k = 0;
+		for (int i = 0; i < 4; ++i)
+			for (int j = i; j < 4; ++j)
+				quadric.q[k++] += p[i] * p[j] * weight;
+	}
+
+	double Evaluate(const Quadric& a, const Quadric& b, const D3DXVECTOR3& v)
+	{
+		double p[4] = { v.x, v.y, v.z, 1.0 };
+		double sum = 0.0;
+		int k = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = i; j < 4; ++j, ++k)
+				sum += (a.q[k] + b.q[k]) * p[i] * p[j] * (i == j ? 1.0 : 2.0);
+		}
+		return sum;
+	}
+
+	float LengthSq(const D3DXVECTOR3& v)
+	{
+		return D3DXVec3Dot(&v, &v);
+	}
+
+	// Squared distance from p to the triangle abc, by the region p projects into (Ericson,
+	// Real-Time Collision Detection, 5.1.5).
+	float DistanceSq(const D3DXVECTOR3& p, const D3DXVECTOR3& a, const D3DXVECTOR3& b, const D3DXVECTOR3& c)
+	{
+		D3DXVECTOR3 ab = b - a, ac = c - a, ap = p - a, bp = p - b, cp = p - c;
+		float d1 = D3DXVec3Dot(&ab, &ap), d2 = D3DXVec3Dot(&ac, &ap);
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			return LengthSq(ap);
+		float d3 = D3DXVec3Dot(&ab, &bp), d4 = D3DXVec3Dot(&ac, &bp);
+		if (d3 >= 0.0f && d4 <= d3)
+			return LengthSq(bp);
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			return LengthSq(ap - ab * (d1 / (d1 - d3)));
+		float d5 = D3DXVec3Dot(&ab, &cp), d6 = D3DXVec3Dot(&ac, &cp);
+		if (d6 >= 0.0f && d5 <= d6)
+			return LengthSq(cp);
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			return LengthSq(ap - ac * (d2 / (d2 - d6)));
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0.0f && d4 >= d3 && d5 >= d6)
+			return LengthSq(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		float denom = 1.0f / (va + vb + vc);
+		return LengthSq(ap - ab * (vb * denom) - ac * (vc * denom));
+	}
+
+	// A level's triangles bucketed into cubes about a triangle across, so a point's nearest
+	// triangle is found by searching the cubes around it in growing shells.
+	class TriangleGrid
+	{
+	public:
+		// 'positions' bounds every point that is queried.
+		TriangleGrid(const std::vector<D3DXVECTOR3>& positions, const WORD* indices, UINT numTriangles);
+
+		// Squared distance from 'p' to the nearest triangle, or to any triangle nearer
+		// than 'enough' once one is found.
+		float NearestSq(const D3DXVECTOR3& p, float enough);
+
+	private:
+		void GetCell(const D3DXVECTOR3& p, int* cell) const;
+
+		const std::vector<D3DXVECTOR3>& _positions;
+		const WORD*       _indices;
+		D3DXVECTOR3       _min;
+		float             _cellSize;
+		int               _size[3];
+		std::vector<UINT> _start;       // into _cells, one per cube and one past the end
+		std::vector<UINT> _cells;       // triangles overlapping each cube
+		std::vector<UINT> _seen;        // query that last measured each triangle
+		UINT              _query;
+	};
+
+	// Moving vertex From onto To, queued by the error it adds; stale once either vertex
+	// changed after it was queued.
+	struct Collapse
+	{
+		double Cost;
+		UINT   From, To;
+		UINT   FromVersion, ToVersion;
+
+		bool operator<(const Collapse& c) const { return Cost > c.Cost; }   // cheapest on top
+	};
+
+	class Simplifier
+	{
+	public:
+		Simplifier(const d3d::MeshVertex* vertices, UINT numVertices, const WORD* indices, UINT numTriangles);
+
+		UINT GetNumTriangles() const { return _live; }
+
+		// Collapses edges until at most 'target' triangles are left or none may go.
+		void Reduce(UINT target);
+
+		void Extract(d3d::LodGeometry* level) const;
+
+	private:
+		void Queue(UINT from, UINT to);
+		bool CanCollapse(UINT from, UINT to) const;
+		void CollapseEdge(UINT from, UINT to);
+		void GetNeighbours(UINT v, std::vector<UINT>* neighbours) const;
+
+		std::vector<d3d::MeshVertex>   _vertices;    // welded
+		std::vector<D3DXVECTOR3>       _positions;
+		std::vector<Quadric>           _quadrics;
+		std::vector<char>              _locked;      // on a seam or an open border
+		std::vector<char>              _removed;
+		std::vector<UINT>              _versions;
+		std::vector<UINT>              _triangles;   // three welded vertices each
+		std::vector<char>              _dead;
+		std::vector<std::vector<UINT> > _around;     // triangles of each vertex, dead ones included
+		std::priority_queue<Collapse>  _queue;
+		UINT                           _live;
+	};
+
+	struct VertexLess
+	{
+		const d3d::MeshVertex* v;
+		bool operator()(UINT a, UINT b) const { return memcmp(&v[a], &v[b], sizeof(d3d::MeshVertex)) < 0; }
+	};
+
+	struct PositionLess
+	{
+		const d3d::MeshVertex* v;
+		bool operator()(UINT a, UINT b) const { return memcmp(&v[a], &v[b], 3 * sizeof(float)) < 0; }
+	};
+}
+
+TriangleGrid::TriangleGrid(const std::vector<D3DXVECTOR3>& positions, const WORD* indices, UINT numTriangles)
+	: _positions(positions), _indices(indices), _seen(numTriangles, 0), _query(0)
+{
+	D3DXVECTOR3 max = _min = positions[0];
+	for (size_t i = 1; i < positions.size(); ++i)
+	{
+		D3DXVec3Minimize(&_min, &_min, &positions[i]);
+		D3DXVec3Maximize(&max, &max, &positions[i]);
+	}
+
+	// cubes as wide as an average triangle, but not many more of them than triangles
+	float average = 0.0f;
+	for (UINT t = 0; t < numTriangles; ++t)
+	{
+		const WORD* i = &indices[t * 3];
+		D3DXVECTOR3 lo = positions[i[0]], hi = lo;
+		for (int k = 1; k < 3; ++k)
+		{
+			D3DXVec3Minimize(&lo, &lo, &positions[i[k]]);
+			D3DXVec3Maximize(&hi, &hi, &positions[i[k]]);
+		}
+		average += std::max(hi.x - lo.x, std::max(hi.y - lo.y, hi.z - lo.z));
+	}
+	D3DXVECTOR3 extent = max - _min;
+	float largest = std::max(extent.x, std::max(extent.y, extent.z));
+	_cellSize = std::max(average / numTriangles, largest / 64.0f);
+	if (_cellSize <= 0.0f)
+		_cellSize = 1.0f;
+	for (;;)
+	{
+		for (int k = 0; k < 3; ++k)
+			_size[k] = (int)((&extent.x)[k] / _cellSize) + 1;
+		if ((UINT)(_size[0] * _size[1] * _size[2]) <= 4 * numTriangles + 64)
+			break;
+		_cellSize *= 1.25f;
+	}
+
+	// counted first, then filled in place
+	UINT numCells = (UINT)(_size[0] * _size[1] * _size[2]);
+	_start.assign(numCells + 1, 0);
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (UINT t = 0; t < numTriangles; ++t)
+		{
+			const WORD* i = &indices[t * 3];
+			int lo[3], hi[3], c[3];
+			GetCell(positions[i[0]], lo);
+			GetCell(positions[i[0]], hi);
+			for (int k = 1; k < 3; ++k)
+			{
+				GetCell(positions[i[k]], c);
+				for (int a = 0; a < 3; ++a)
+				{
+					lo[a] = std::min(lo[a], c[a]);
+					hi[a] = std::max(hi[a], c[a]);
+				}
+			}
+			for (int z = lo[2]; z <= hi[2]; ++z)
+				for (int y = lo[1]; y <= hi[1]; ++y)
+					for (int x = lo[0]; x <= hi[0]; ++x)
+					{
+						UINT cell = (UINT)((z * _size[1] + y) * _size[0] + x);
+						if (pass == 0)
+							++_start[cell + 1];
+						else
+							_cells[_start[cell]++] = t;
+					}
+		}
+		if (pass == 0)
+		{
+			for (UINT cell = 0; cell < numCells; ++cell)
+				_start[cell + 1] += _start[cell];
+			_cells.resize(_start[numCells]);
+		}
+	}
+	// filling moved every start onto the next cube's
+	for (UINT cell = numCells; cell > 0; --cell)
+		_start[cell] = _start[cell - 1];
+	_start[0] = 0;
+}
+
+void TriangleGrid::GetCell(const D3DXVECTOR3& p, int* cell) const
+{
+	for (int k = 0; k < 3; ++k)
+		cell[k] = std::min(std::max((int)(((&p.x)[k] - (&_min.x)[k]) / _cellSize), 0), _size[k] - 1);
+}
+
+float TriangleGrid::NearestSq(const D3DXVECTOR3& p, float enough)
+{
+	++_query;
+	int c[3];
+	GetCell(p, c);
+	int maxRing = std::max(_size[0], std::max(_size[1], _size[2]));
+	float nearest = FLT_MAX;
+	for (int ring = 0; ring < maxRing; ++ring)
+	{
+		int lo[3], hi[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			lo[k] = std::max(c[k] - ring, 0);
+			hi[k] = std::min(c[k] + ring, _size[k] - 1);
+		}
+		for (int z = lo[2]; z <= hi[2]; ++z)
+			for (int y = lo[1]; y <= hi[1]; ++y)
+				for (int x = lo[0]; x <= hi[0]; ++x)
+				{
+					// the shell only, the inside was searched before
+					if (abs(x - c[0]) != ring && abs(y - c[1]) != ring && abs(z - c[2]) != ring)
+						continue;
+					UINT cell = (UINT)((z * _size[1] + y) * _size[0] + x);
+					for (UINT i = _start[cell]; i < _start[cell + 1]; ++i)
+					{
+						UINT t = _cells[i];
+						if (_seen[t] == _query)
+							continue;
+						_seen[t] = _query;
+						const WORD* v = &_indices[t * 3];
+						nearest = std::min(nearest, DistanceSq(p, _positions[v[0]], _positions[v[1]], _positions[v[2]]));
+					}
+				}
+
+		// a triangle in no cube searched yet is at least 'ring' cubes away
+		float beyond = ring * _cellSize;
+		if (nearest <= enough || nearest <= beyond * beyond)
+			break;
+	}
+	return nearest;
+}
+
+Simplifier::Simplifier(const d3d::MeshVertex* vertices, UINT numVertices, const WORD* indices, UINT numTriangles)
+	: _live(0)
+{
+	// weld vertices that are byte for byte identical
+	std::vector<UINT> order(numVertices);
+	for (UINT i = 0; i < numVertices; ++i)
+		order[i] = i;
+	VertexLess vertexLess = { vertices };
+	std::sort(order.begin(), order.end(), vertexLess);
+	std::vector<UINT> weld(numVertices);
+	for (UINT i = 0; i < numVertices; ++i)
+	{
+		if (i == 0 || vertexLess(order[i - 1], order[i]))
+			_vertices.push_back(vertices[order[i]]);
+		weld[order[i]] = (UINT)_vertices.size() - 1;
+	}
+
+	UINT count = (UINT)_vertices.size();
+	_positions.resize(count);
+	for (UINT i = 0; i < count; ++i)
+		_positions[i] = D3DXVECTOR3(_vertices[i].x, _vertices[i].y, _vertices[i].z);
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	_quadrics.assign(count, zero);
+	_locked.assign(count, 0);
+	_removed.assign(count, 0);
+	_versions.assign(count, 0);
+	_around.resize(count);
+
+	// what is left sharing a position differs in its normal: a seam, where both sides must
+	// stay together
+	order.resize(count);
+	for (UINT i = 0; i < count; ++i)
+		order[i] = i;
+	PositionLess positionLess = { &_vertices[0] };
+	std::sort(order.begin(), order.end(), positionLess);
+	for (UINT i = 1; i < count; ++i)
+	{
+		if (!positionLess(order[i - 1], order[i]))
+			_locked[order[i - 1]] = _locked[order[i]] = 1;
+	}
+
+	for (UINT t = 0; t < numTriangles; ++t)
+	{
+		UINT v[3] = { weld[indices[t * 3]], weld[indices[t * 3 + 1]], weld[indices[t * 3 + 2]] };
+		if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0])
+			continue;
+		UINT index = (UINT)_triangles.size() / 3;
+		_triangles.insert(_triangles.end(), v, v + 3);
+		for (int k = 0; k < 3; ++k)
+			_around[v[k]].push_back(index);
+
+		// the triangle's plane, weighted by its area
+		D3DXVECTOR3 e1 = _positions[v[1]] - _positions[v[0]], e2 = _positions[v[2]] - _positions[v[0]], n;
+		D3DXVec3Cross(&n, &e1, &e2);
+		float length = D3DXVec3Length(&n);
+		if (length <= 0.0f)
+			continue;
+		n *= 1.0f / length;
+		double plane[4] = { n.x, n.y, n.z, -D3DXVec3Dot(&n, &_positions[v[0]]) };
+		for (int k = 0; k < 3; ++k)
+			AddPlane(_quadrics[v[k]], plane, 0.5 * length);
+	}
+	_live = (UINT)_triangles.size() / 3;
+	_dead.assign(_live, 0);
+
+	// an edge with one triangle is on an open border, which stays where it is
+	std::vector<std::pair<UINT, UINT> > edges;
+	for (UINT i = 0; i < _triangles.size(); ++i)
+	{
+		UINT a = _triangles[i], b = _triangles[i % 3 == 2 ? i - 2 : i + 1];
+		edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size(); )
+	{
+		size_t j = i;
+		while (j < edges.size() && edges[j] == edges[i])
+			++j;
+		if (j - i != 2)
+			_locked[edges[i].first] = _locked[edges[i].second] = 1;
+		i = j;
+	}
+
+	edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+	for (size_t i = 0; i < edges.size(); ++i)
+	{
+		Queue(edges[i].first, edges[i].second);
+		Queue(edges[i].second, edges[i].first);
+	}
+}
+
+void Simplifier::Queue(UINT from, UINT to)
+{
+	if (_locked[from])
+		return;
+	Collapse c;
+	c.Cost = Evaluate(_quadrics[from], _quadrics[to], _positions[to]);
+	c.From = from;
+	c.To = to;
+	c.FromVersion = _versions[from];
+	c.ToVersion = _versions[to];
+	_queue.push(c);
+}
+
+void Simplifier::GetNeighbours(UINT v, std::vector<UINT>* neighbours) const
+{
+	neighbours->clear();
+	const std::vector<UINT>& around = _around[v];
+	for (size_t i = 0; i < around.size(); ++i)
+	{
+		if (_dead[around[i]])
+			continue;
+		const UINT* t = &_triangles[around[i] * 3];
+		for (int k = 0; k < 3; ++k)
+			if (t[k] != v)
+				neighbours->push_back(t[k]);
+	}
+	std::sort(neighbours->begin(), neighbours->end());
+	neighbours->erase(std::unique(neighbours->begin(), neighbours->end()), neighbours->end());
+}
+
+bool Simplifier::CanCollapse(UINT from, UINT to) const
+{
+	// the triangles that stay must not fold over or become slivers
+	int shared = 0;
+	const std::vector<UINT>& around = _around[from];
+	for (size_t i = 0; i < around.size(); ++i)
+	{
+		if (_dead[around[i]])
+			continue;
+		const UINT* t = &_triangles[around[i] * 3];
+		if (t[0] == to || t[1] == to || t[2] == to)
+		{
+			++shared;
+			continue;
+		}
+		D3DXVECTOR3 p[3], q[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			p[k] = _positions[t[k]];
+			q[k] = t[k] == from ? _positions[to] : p[k];
+		}
+		D3DXVECTOR3 before, after, e1 = p[1] - p[0], e2 = p[2] - p[0], f1 = q[1] - q[0], f2 = q[2] - q[0];
+		D3DXVec3Cross(&before, &e1, &e2);
+		D3DXVec3Cross(&after, &f1, &f2);
+		float lengths = D3DXVec3Length(&before) * D3DXVec3Length(&after);
+		if (lengths <= 0.0f || D3DXVec3Dot(&before, &after) < MaxNormalTurn * lengths)
+			return false;
+	}
+	if (shared == 0)
+		return false;
+
+	// the vertices next to both must be the far corners of the triangles the edge takes
+	// away, or the surface pinches
+	std::vector<UINT> a, b, common;
+	GetNeighbours(from, &a);
+	GetNeighbours(to, &b);
+	std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(common));
+	return (int)common.size() == shared;
+}
+
+void Simplifier::CollapseEdge(UINT from, UINT to)
+{
+	std::vector<UINT>& around = _around[from];
+	for (size_t i = 0; i < around.size(); ++i)
+	{
+		UINT index = around[i];
+		if (_dead[index])
+			continue;
+		UINT* t = &_triangles[index * 3];
+		if (t[0] == to || t[1] == to || t[2] == to)
+		{
+			_dead[index] = 1;
+			--_live;
+			continue;
+		}
+		for (int k = 0; k < 3; ++k)
+			if (t[k] == from)
+				t[k] = to;
+		_around[to].push_back(index);
+	}
+	around.clear();
+	_removed[from] = 1;
+	++_versions[from];
+	++_versions[to];
+	for (int k = 0; k < 10; ++k)
+		_quadrics[to].q[k] += _quadrics[from].q[k];
+
+	std::vector<UINT>& kept = _around[to];
+	size_t n = 0;
+	for (size_t i = 0; i < kept.size(); ++i)
+		if (!_dead[kept[i]])
+			kept[n++] = kept[i];
+	kept.resize(n);
+
+	// collapses next to 'to' cost something else now
+	std::vector<UINT> neighbours;
+	GetNeighbours(to, &neighbours);
+	for (size_t i = 0; i < neighbours.size(); ++i)
+	{
+		Queue(to, neighbours[i]);
+		Queue(neighbours[i], to);
+	}
+}
+
+void Simplifier::Reduce(UINT target)
+{
+	while (_live > target && !_queue.empty())
+	{
+		Collapse c = _queue.top();
+		_queue.pop();
+		if (_removed[c.From] || _removed[c.To] ||
+			c.FromVersion != _versions[c.From] || c.ToVersion != _versions[c.To])
+			continue;
+		if (CanCollapse(c.From, c.To))
+			CollapseEdge(c.From, c.To);
+	}
+}
+
+void Simplifier::Extract(d3d::LodGeometry* level) const
+{
+	std::vector<WORD> indices;
+	for (size_t t = 0; t < _dead.size(); ++t)
+	{
+		if (!_dead[t])
+			for (int k = 0; k < 3; ++k)
+				indices.push_back((WORD)_triangles[t * 3 + k]);
+	}
+	UINT numTriangles = (UINT)indices.size() / 3;
+	d3d::OptimizeVertexCache(&indices[0], numTriangles, (UINT)_vertices.size());
+
+	// vertices in the order the triangles first use them
+	std::vector<int> remap(_vertices.size(), -1);
+	level->Vertices.clear();
+	level->Indices.clear();
+	for (size_t i = 0; i < indices.size(); ++i)
+	{
+		if (remap[indices[i]] < 0)
+		{
+			remap[indices[i]] = (int)level->Vertices.size();
+			level->Vertices.push_back(_vertices[indices[i]]);
+		}
+		level->Indices.push_back((WORD)remap[indices[i]]);
+	}
+
+	// how far the full mesh's vertices, the collapsed ones too, are from this surface
+	TriangleGrid grid(_positions, &indices[0], numTriangles);
+	float error = 0.0f;
+	for (size_t v = 0; v < _positions.size(); ++v)
+		error = std::max(error, grid.NearestSq(_positions[v], error));
+	level->Error = sqrtf(error);
+}
+
+void d3d::BuildLodChain(const MeshVertex* vertices, UINT numVertices, const WORD* indices, UINT numTriangles,
+	std::vector<LodGeometry>* levels)
+{
+	Simplifier simplifier(vertices, numVertices, indices, numTriangles);
+	UINT previous = simplifier.GetNumTriangles();
+	for (int level = 1; level < MaxLodLevels; ++level)
+	{
+		UINT target = previous / 2;
+		if (target < MinLodTriangles)
+			break;
+		simplifier.Reduce(target);
+
+		// a level that saves less than a quarter is not worth a switch
+		UINT count = simplifier.GetNumTriangles();
+		if (count > previous - previous / 4)
+			break;
+		levels->push_back(LodGeometry());
+		simplifier.Extract(&levels->back());
+		previous = count;
+	}
+}
+
+void d3d::ReleaseMeshLod(MeshLod* lod)
+{
+	for (int i = 1; i < lod->NumLevels; ++i)
+		lod->Levels[i]->Release();
+	lod->NumLevels = std::min(lod->NumLevels, 1);
+}
+
+d3d::LodView d3d::InitLodView(const D3DXVECTOR3& eye, const D3DXMATRIX& proj, UINT viewportHeight,
+	float pixels, float bias, LodHistory* history)
+{
+	// _22 takes y onto -1..1, half the viewport; a perspective projection (w = z) also
+	// divides by the distance
+	LodView view;
+	view.Eye = eye;
+	view.PixelScale = fabsf(proj._22) * viewportHeight * 0.5f;
+	view.Parallel = proj._34 == 0.0f;
+	view.Tolerance = pixels * powf(2.0f, bias);
+	view.History = history;
+	return view;
+}
+
+int d3d::SelectLod(const MeshLod& lod, const LodView& view, const D3DXVECTOR3& center, float radius, float scale,
+	int previous)
+{
+	// pixels a unit of mesh space covers at the point of the sphere nearest the eye
+	float pixels = view.PixelScale * scale;
+	if (!view.Parallel)
+	{
+		D3DXVECTOR3 d = center - view.Eye;
+		float distance = D3DXVec3Length(&d) - radius;
+		if (distance <= 0.0f)
+			return 0;
+		pixels /= distance;
+	}
+
+	if (previous == NoLod)
+	{
+		int level = 0;
+		while (level + 1 < lod.NumLevels && lod.Errors[level + 1] * pixels <= view.Tolerance)
+			++level;
+		return level;
+	}
+
+	// finer only past the tolerance plus the margin, coarser only below it less the margin
+	int level = std::min(previous, lod.NumLevels - 1);
+	while (level > 0 && lod.Errors[level] * pixels > view.Tolerance * (1.0f + LodHysteresis))
+		--level;
+	while (level + 1 < lod.NumLevels && lod.Errors[level + 1] * pixels <= view.Tolerance * (1.0f - LodHysteresis))
+		++level;
+	return level;
+}
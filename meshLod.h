@@ -0,0 +1,92 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: meshLod.h
+//
+// Desc: Levels of detail made by simplifying a mesh when it is loaded.  Each level
+//       collapses edges of the one before it, cheapest first by Garland and Heckbert's
+//       quadric error metric, until it has about half the triangles.  A collapse moves one
+//       vertex onto a neighbour, so every level keeps a subset of the full mesh's vertices
+//       with their normals; seams and open borders are never moved.  Each level records how
+//       far the full mesh's vertices lie from its surface.
+//
+//       A pass picks the coarsest level whose error covers at most a few pixels from where
+//       it is drawn (SelectLod), so switching level changes the picture by less than that
+//       and does not pop.  A pass bias lets shadows and reflections accept larger errors.
+//       A view that remembers the levels it picked (LodHistory) keeps a level until its
+//       error leaves the tolerance by a margin, so a copy hovering at the threshold does
+//       not switch back and forth every frame.
+//
+//       BuildLodChain only fills vectors and may run on any thread; AssetLoader runs it on
+//       its workers and creates the levels' meshes a few at a time.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __meshLodH__
+#define __meshLodH__
+
+#include "renderDevice.h"
+#include <vector>
+
+namespace d3d
+{
+	enum { MaxLodLevels = 5 };
+
+	// One simplified level: a triangle list as BuildTeapot makes them, and the largest
+	// distance from a vertex of the full mesh to this level's surface, in mesh space.
+	struct LodGeometry
+	{
+		std::vector<MeshVertex> Vertices;
+		std::vector<WORD>       Indices;
+		float                   Error;
+	};
+
+	// Appends up to MaxLodLevels - 1 levels, coarsest last, each with about half the
+	// triangles of the one before.  Stops early once a mesh gets too small to simplify
+	// further.
+	void BuildLodChain(const MeshVertex* vertices, UINT numVertices, const WORD* indices, UINT numTriangles,
+		std::vector<LodGeometry>* levels);
+
+	// A mesh and its simplified levels.  Level 0 is the full mesh, with no error.
+	struct MeshLod
+	{
+		int   NumLevels;
+		Mesh* Levels[MaxLodLevels];
+		UINT  PrimCounts[MaxLodLevels];
+		float Errors[MaxLodLevels];
+	};
+
+	// Releases the simplified levels; level 0 belongs to whoever created it.
+	void ReleaseMeshLod(MeshLod* lod);
+
+	// The level a view last picked for each of the copies it draws, NoLod before the first.
+	// It carries over from frame to frame, so a view keeps one of its own and only one
+	// thread at a time may choose levels with it.
+	typedef std::vector<unsigned char> LodHistory;
+	const unsigned char NoLod = 0xff;
+
+	// How a pass chooses levels: from where it looks, how many pixels a unit covers, and
+	// how many pixels a level's error may cover.
+	struct LodView
+	{
+		D3DXVECTOR3 Eye;
+		float       PixelScale;   // pixels a unit covers at distance 1, or anywhere when Parallel
+		bool        Parallel;     // orthographic projection
+		float       Tolerance;
+		LodHistory* History;      // or 0 to choose every time afresh
+	};
+
+	// 'proj' maps onto a viewport 'viewportHeight' pixels high.  The tolerance is 'pixels'
+	// doubled for every step of 'bias'.
+	LodView InitLodView(const D3DXVECTOR3& eye, const D3DXMATRIX& proj, UINT viewportHeight,
+		float pixels, float bias, LodHistory* history = 0);
+
+	// The coarsest level of 'lod' within the view's tolerance for a copy bounded by the
+	// sphere ('center', 'radius') and scaled by 'scale' from mesh space.  Given the level
+	// 'previous' picked last time (NoLod for none) it stays there unless a coarser level
+	// fits the tolerance less LodHysteresis or its own error exceeds the tolerance plus it.
+	const float LodHysteresis = 0.15f;
+	int SelectLod(const MeshLod& lod, const LodView& view, const D3DXVECTOR3& center, float radius, float scale,
+		int previous = NoLod);
+}
+
+#endif // __meshLodH__
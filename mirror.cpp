@@ -0,0 +1,268 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: mirror.cpp
+//
+// Desc: Planar mirror setup and culling.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "mirror.h"
+#include "simdMath.h"
+#include <algorithm>
+#include <cmath>
+
+d3d::Mirror d3d::InitMirror(const D3DXVECTOR3 corners[4])
+{
+	Mirror m;
+	for (int i = 0; i < 4; ++i)
+		m.Corners[i] = corners[i];
+
+	// clockwise winding in a left handed system: the cross product points at the viewer
+	D3DXVECTOR3 e1 = corners[1] - corners[0];
+	D3DXVECTOR3 e2 = corners[2] - corners[0];
+	D3DXVECTOR3 n;
+	D3DXVec3Cross(&n, &e1, &e2);
+	D3DXVec3Normalize(&n, &n);
+	D3DXPlaneFromPointNormal(&m.Plane, &corners[0], &n);
+	MatrixReflect(&m.Reflect, m.Plane);
+
+	m.StencilRef = 0;
+	return m;
+}
+
+d3d::MirrorView d3d::InitMirrorView(const Mirror& mirror, int index)
+{
+	MirrorView v;
+	v.Index = index;
+	v.Level = 1;
+	v.StencilRef = mirror.StencilRef;
+	v.Reflect = mirror.Reflect;
+	v.Plane = mirror.Plane;
+	return v;
+}
+
+d3d::MirrorBudget d3d::InitMirrorBudget(int maxDepth, DWORD maxTriangles, float maxMilliseconds)
+{
+	MirrorBudget b;
+	b.MaxDepth = maxDepth < 1 ? 1 : maxDepth;
+	b.MaxTriangles = maxTriangles;
+	b.MaxMilliseconds = maxMilliseconds;
+	return b;
+}
+
+int d3d::CullMirrors(Mirror* mirrors, int count, const D3DXVECTOR3& eye, const Frustum& frustum,
+	int maxDepth, int* visible)
+{
+	if (maxDepth < 1)
+		maxDepth = 1;
+	const int maxVisible = MaxVisibleMirrors / maxDepth;
+
+	int numVisible = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		Mirror& m = mirrors[i];
+		m.StencilRef = 0;
+
+		if (numVisible == maxVisible)
+			continue;
+		if (D3DXPlaneDotCoord(&m.Plane, &eye) <= 0.0f)
+			continue;
+		if (!IntersectFrustum(frustum, m.Corners, 4))
+			continue;
+
+		m.StencilRef = 1 + numVisible * maxDepth;
+		visible[numVisible++] = i;
+	}
+	return numVisible;
+}
+
+bool d3d::CullMirror(const Mirror& mirror, int index, const MirrorView& parent,
+	const D3DXVECTOR3& eye, const Frustum& frustum, MirrorView* view)
+{
+	// where the eye sees the mirror: reflected by everything the parent is seen through
+	D3DXVECTOR3 corners[4];
+	TransformCoordArray(corners, sizeof(D3DXVECTOR3), mirror.Corners, sizeof(D3DXVECTOR3), &parent.Reflect, 4);
+
+	D3DXVECTOR3 normal(mirror.Plane.a, mirror.Plane.b, mirror.Plane.c);
+	D3DXVec3TransformNormal(&normal, &normal, &parent.Reflect);
+	D3DXPLANE plane;
+	D3DXPlaneFromPointNormal(&plane, &corners[0], &normal);
+
+	if (D3DXPlaneDotCoord(&plane, &eye) <= 0.0f)
+		return false;
+
+	// only what lies behind the parent mirror shows up in it
+	int behind = 0;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (D3DXPlaneDotCoord(&parent.Plane, &corners[i]) < 0.0f)
+			++behind;
+	}
+	if (behind == 0 || !IntersectFrustum(frustum, corners, 4))
+		return false;
+
+	view->Index = index;
+	view->Level = parent.Level + 1;
+	view->StencilRef = parent.StencilRef + 1;
+	MatrixMultiply(&view->Reflect, &mirror.Reflect, &parent.Reflect);
+	view->Plane = plane;
+	return true;
+}
+
+namespace
+{
+	struct ClipVertex
+	{
+		float x, y, z, w;
+	};
+
+	// distance of a clip space vertex to one of the planes 0 <= z, -w <= x, y <= w
+	float ClipDistance(const ClipVertex& v, int plane)
+	{
+		switch (plane)
+		{
+		case 0:  return v.z;
+		case 1:  return v.w + v.x;
+		case 2:  return v.w - v.x;
+		case 3:  return v.w + v.y;
+		default: return v.w - v.y;
+		}
+	}
+}
+
+float d3d::GetMirrorScreenArea(const Mirror& mirror, const D3DXMATRIX& viewProj, int width, int height)
+{
+	// a quad clipped by 5 planes has at most 9 corners
+	ClipVertex polygon[2][12];
+	int count = 4;
+	for (int i = 0; i < 4; ++i)
+	{
+		const D3DXVECTOR3& p = mirror.Corners[i];
+		const D3DXMATRIX& m = viewProj;
+		ClipVertex& v = polygon[0][i];
+		v.x = p.x * m._11 + p.y * m._21 + p.z * m._31 + m._41;
+		v.y = p.x * m._12 + p.y * m._22 + p.z * m._32 + m._42;
+		v.z = p.x * m._13 + p.y * m._23 + p.z * m._33 + m._43;
+		v.w = p.x * m._14 + p.y * m._24 + p.z * m._34 + m._44;
+	}
+
+	int in = 0;
+	for (int plane = 0; plane < 5 && count > 0; ++plane)
+	{
+		const ClipVertex* src = polygon[in];
+		ClipVertex* dst = polygon[1 - in];
+		int n = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const ClipVertex& a = src[i];
+			const ClipVertex& b = src[(i + 1) % count];
+			float da = ClipDistance(a, plane), db = ClipDistance(b, plane);
+			if (da >= 0.0f)
+				dst[n++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				float t = da / (da - db);
+				ClipVertex& v = dst[n++];
+				v.x = a.x + (b.x - a.x) * t;
+				v.y = a.y + (b.y - a.y) * t;
+				v.z = a.z + (b.z - a.z) * t;
+				v.w = a.w + (b.w - a.w) * t;
+			}
+		}
+		count = n;
+		in = 1 - in;
+	}
+	if (count < 3)
+		return 0.0f;
+
+	// shoelace formula in pixels
+	const ClipVertex* v = polygon[in];
+	float area = 0.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		const ClipVertex& a = v[i];
+		const ClipVertex& b = v[(i + 1) % count];
+		float ax = a.x / a.w, ay = a.y / a.w;
+		float bx = b.x / b.w, by = b.y / b.w;
+		area += ax * by - bx * ay;
+	}
+	return fabsf(area) * 0.5f * (width * 0.5f) * (height * 0.5f);
+}
+
+void d3d::MatrixObliqueProjection(D3DXMATRIX* out, const D3DXMATRIX& view, const D3DXMATRIX& proj,
+	const D3DXPLANE& clipPlane)
+{
+	// the plane in view space: for row vectors v = p * V it is inverse(V) * plane
+	D3DXMATRIX invView;
+	D3DXMatrixInverse(&invView, 0, &view);
+	const D3DXPLANE& w = clipPlane;
+	float c[4];
+	for (int i = 0; i < 4; ++i)
+		c[i] = invView.m[i][0] * w.a + invView.m[i][1] * w.b + invView.m[i][2] * w.c + invView.m[i][3] * w.d;
+
+	// the corner of the view volume opposite the plane, (sgn x, sgn y, 1, 1) in clip space
+	float q[4];
+	q[0] = (c[0] > 0.0f ? 1.0f : c[0] < 0.0f ? -1.0f : 0.0f) / proj._11;
+	q[1] = (c[1] > 0.0f ? 1.0f : c[1] < 0.0f ? -1.0f : 0.0f) / proj._22;
+	q[2] = 1.0f;
+	q[3] = (1.0f - proj._33) / proj._43;
+
+	// the third column becomes the scaled plane; the far plane w - z = 0 still passes through q
+	float qw = q[0] * proj._14 + q[1] * proj._24 + q[2] * proj._34 + q[3] * proj._44;
+	float qc = q[0] * c[0] + q[1] * c[1] + q[2] * c[2] + q[3] * c[3];
+	float scale = qc != 0.0f ? qw / qc : 0.0f;
+
+	*out = proj;
+	if (scale == 0.0f)
+		return;
+	out->_13 = c[0] * scale;
+	out->_23 = c[1] * scale;
+	out->_33 = c[2] * scale;
+	out->_43 = c[3] * scale;
+}
+
+void d3d::GetMirrorCamera(const Mirror& mirror, const D3DXVECTOR3& eye, float farPlane,
+	D3DXMATRIX* view, D3DXMATRIX* proj)
+{
+	// x along the top edge, y up the left edge, z into the mirror
+	const D3DXVECTOR3* c = mirror.Corners;
+	D3DXVECTOR3 x = c[2] - c[1], y = c[1] - c[0];
+	D3DXVECTOR3 z(-mirror.Plane.a, -mirror.Plane.b, -mirror.Plane.c);
+	D3DXVec3Normalize(&x, &x);
+	D3DXVec3Normalize(&y, &y);
+
+	*view = D3DXMATRIX(
+		x.x, y.x, z.x, 0.0f,
+		x.y, y.y, z.y, 0.0f,
+		x.z, y.z, z.z, 0.0f,
+		-D3DXVec3Dot(&x, &eye), -D3DXVec3Dot(&y, &eye), -D3DXVec3Dot(&z, &eye), 1.0f);
+
+	// the quad's edges in view space, at the distance of the mirror plane
+	D3DXVECTOR3 topLeft = c[1] - eye, bottomRight = c[3] - eye;
+	float zn = std::max(D3DXVec3Dot(&z, &topLeft), 0.001f);
+	float zf = std::max(farPlane, zn * 2.0f);
+	D3DXMatrixPerspectiveOffCenterLH(proj,
+		D3DXVec3Dot(&x, &topLeft), D3DXVec3Dot(&x, &bottomRight),
+		D3DXVec3Dot(&y, &bottomRight), D3DXVec3Dot(&y, &topLeft), zn, zf);
+}
+
+void d3d::GetMirrorCullVolume(const Mirror& mirror, const D3DXVECTOR3& eye, const Frustum& frustum,
+	CullVolume* volume)
+{
+	InitCullVolume(volume, frustum);
+	TransformCullVolume(volume, mirror.Reflect);
+	AddCullPlane(volume, mirror.Plane);
+
+	// the quad is its own reflection; orient the sides by a point on the ray through its middle
+	D3DXVECTOR3 apex, center = (mirror.Corners[0] + mirror.Corners[2]) * 0.5f;
+	TransformCoordArray(&apex, sizeof(D3DXVECTOR3), &eye, sizeof(D3DXVECTOR3), &mirror.Reflect, 1);
+	D3DXVECTOR3 inside = center * 2.0f - apex;
+	for (int i = 0; i < 4; ++i)
+	{
+		D3DXPLANE side;
+		D3DXPlaneFromPoints(&side, &apex, &mirror.Corners[i], &mirror.Corners[(i + 1) & 3]);
+		if (D3DXPlaneDotCoord(&side, &inside) < 0.0f)
+			side = -side;
+		AddCullPlane(volume, side);
+	}
+}
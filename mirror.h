@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: mirror.h
+//
+// Desc: Planar mirrors.  Each mirror is a quad with its plane and reflection matrix;
+//       CullMirrors() picks the ones worth reflecting this frame and hands each of them
+//       its own value of the 8 bit stencil buffer.
+//
+//       Mirrors seen inside other mirrors are MirrorViews: the mirror together with the
+//       chain of reflections it is seen through.  A view at level L inside a mirror with
+//       stencil ref r owns the stencil value r + L - 1, so every directly visible mirror
+//       reserves MaxDepth consecutive values.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __mirrorH__
+#define __mirrorH__
+
+#include "frustum.h"
+
+namespace d3d
+{
+	// Stencil refs 1..255; 0 is left for pixels that are not covered by a mirror.
+	enum { MaxVisibleMirrors = 255 };
+
+	struct Mirror
+	{
+		D3DXVECTOR3 Corners[4];   // clockwise as seen from the reflecting side
+		D3DXPLANE   Plane;        // normal points out of the reflecting side
+		D3DXMATRIX  Reflect;      // reflection about Plane
+		DWORD       StencilRef;   // set by CullMirrors, 0 while culled
+	};
+
+	struct MirrorView
+	{
+		int        Index;         // into the mirror list
+		int        Level;         // 1 for mirrors seen directly
+		DWORD      StencilRef;    // stencil value of the pixels showing this view
+		D3DXMATRIX Reflect;       // world -> reflected world of what is seen in it
+		D3DXPLANE  Plane;         // the mirror plane where the eye sees it
+	};
+
+	// Limits on nested reflections.  Directly visible mirrors are always reflected once;
+	// reflections of mirrors inside mirrors stop at whichever limit is reached first.
+	struct MirrorBudget
+	{
+		int   MaxDepth;           // reflection levels, 1 = mirrors never show other mirrors
+		DWORD MaxTriangles;       // triangles per frame spent on nested levels
+		float MaxMilliseconds;    // time per frame spent on nested levels
+	};
+
+	Mirror       InitMirror(const D3DXVECTOR3 corners[4]);
+	MirrorView   InitMirrorView(const Mirror& mirror, int index);
+	MirrorBudget InitMirrorBudget(int maxDepth, DWORD maxTriangles, float maxMilliseconds);
+
+	// Rejects the mirrors that face away from 'eye' or lie outside 'frustum' and gives the
+	// rest stencil refs 'maxDepth' apart.  Writes the indices of the visible mirrors to
+	// 'visible' (room for MaxVisibleMirrors entries) and returns how many there are; at
+	// most MaxVisibleMirrors / maxDepth.
+	int CullMirrors(Mirror* mirrors, int count, const D3DXVECTOR3& eye, const Frustum& frustum,
+		int maxDepth, int* visible);
+
+	// Tests whether 'mirror' can be seen inside 'parent': it has to face the eye after
+	// the parent's reflection, lie behind the parent's plane and touch the frustum.
+	// Fills 'view' (one level deeper, next stencil value) when it can.
+	bool CullMirror(const Mirror& mirror, int index, const MirrorView& parent,
+		const D3DXVECTOR3& eye, const Frustum& frustum, MirrorView* view);
+
+	// Pixels the mirror quad covers on a width x height viewport under 'viewProj', clipped
+	// to the near plane and the screen.  Nothing in front of it is taken into account.
+	float GetMirrorScreenArea(const Mirror& mirror, const D3DXMATRIX& viewProj, int width, int height);
+
+	// Moves the near plane of 'proj' onto the world space 'clipPlane' (Lengyel's oblique
+	// frustum), so everything on its negative side is clipped and the far plane tilts as
+	// little as it has to.  The eye must lie on the negative side.  Depth is no longer
+	// linear in view z, so only draws with the same projection may test against it.
+	void MatrixObliqueProjection(D3DXMATRIX* out, const D3DXMATRIX& view, const D3DXMATRIX& proj,
+		const D3DXPLANE& clipPlane);
+
+	// The camera for rendering what 'eye' sees in 'mirror' into a texture: it looks straight
+	// into the mirror and its off-center window is the quad itself, with the near plane on
+	// the mirror plane.  Drawn with this camera, the reflected scene lands on the texture
+	// where the quad's uvs (0, 1) (0, 0) (1, 0) (1, 1) at corners 0..3 sample it, whatever
+	// the angle the mirror is seen at.  The eye must lie on the reflecting side.
+	void GetMirrorCamera(const Mirror& mirror, const D3DXVECTOR3& eye, float farPlane,
+		D3DXMATRIX* view, D3DXMATRIX* proj);
+
+	// The objects 'eye' can see in 'mirror': those in front of it whose reflection lies in
+	// 'frustum' and is seen through the quad, i.e. inside the pyramid from the reflected eye
+	// through the corners.  The volume is in world space, before the reflection.
+	void GetMirrorCullVolume(const Mirror& mirror, const D3DXVECTOR3& eye, const Frustum& frustum,
+		CullVolume* volume);
+}
+
+#endif // __mirrorH__
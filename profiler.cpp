@@ -0,0 +1,434 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: profiler.cpp
+//
+// Desc: Per thread scope rings, per second summary and Chrome trace export.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "profiler.h"
+
+#if D3D_PROFILE
+
+#include "frameClock.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+thread_local DWORD d3d::ProfileCounts[d3d::PROFILE_COUNTER_COUNT];
+
+const char* d3d::GetProfileCounterName(ProfileCounter counter)
+{
+	static const char* names[PROFILE_COUNTER_COUNT] = {
+		"draws", "primitives", "states", "clears", "textures" };
+	return (unsigned)counter < PROFILE_COUNTER_COUNT ? names[counter] : "?";
+}
+
+namespace
+{
+	const DWORD RingSize = 1 << 15;   // about 30 s of a dozen scopes at 60 fps
+	const int   MaxDepth = 32;
+
+	struct OpenScope
+	{
+		const char*      name;
+		d3d::ProfileTick start;
+		DWORD            counts[d3d::PROFILE_COUNTER_COUNT];
+		int              total;     // its entry in Totals, or -1
+		DWORD            summary;   // Summaries when it opened
+	};
+
+	// totals of one scope since the last summary
+	struct ScopeTotal
+	{
+		const char*      name;
+		int              parent;    // entry in Totals, or -1
+		int              depth;
+		d3d::ProfileTick ticks;
+		DWORD            calls;
+		double           counts[d3d::PROFILE_COUNTER_COUNT];
+	};
+
+	// a scope name and parent a thread already found in Totals, matched by address
+	struct CachedTotal
+	{
+		const char* name;
+		int         parent;
+		int         total;
+	};
+
+	// what one thread has open and has recorded
+	struct ThreadProfile
+	{
+		ThreadProfile() : Ring(RingSize), Written(0), Depth(0), Id(0), CacheSummary(0) {}
+
+		std::vector<d3d::ProfileEvent> Ring;    // allocated whole, then wraps
+		unsigned long long Written;             // events ever recorded; the ring holds the last RingSize
+		OpenScope          Open[MaxDepth];
+		int                Depth;
+		int                Id;                  // trace thread id
+		std::vector<CachedTotal> Cache;         // entries of the summary CacheSummary
+		DWORD              CacheSummary;
+	};
+
+	// hands its thread's profile back when the thread exits
+	struct ThreadOwner
+	{
+		ThreadOwner() : profile(0) {}
+		~ThreadOwner();
+
+		ThreadProfile* profile;
+	};
+
+	void DefaultOutput(const char* text)
+	{
+#ifdef _WIN32
+		::OutputDebugStringA(text);
+#else
+		fputs(text, stdout);
+		fflush(stdout);
+#endif
+	}
+
+	// Lock guards the profiles list, the totals and the summary state.  A thread's ring and
+	// open scopes are its own; a profile whose thread exited waits in Retired for the next
+	// new thread, so its events stay for the trace and the profiles are only as many as
+	// the threads that ever ran at once
+	std::mutex                                  Lock;
+	std::vector<std::unique_ptr<ThreadProfile> > Threads;
+	std::vector<ThreadProfile*>                 Retired;
+	thread_local ThreadOwner                    Current;
+	std::atomic<ThreadProfile*>                 RenderThread(0);
+	std::atomic<DWORD>                          Frame(0);
+
+	// the innermost scope the render thread has open, as Summaries << 32 | its entry + 1,
+	// for the outermost scopes of the other threads to go under
+	std::atomic<unsigned long long>             RenderOpen(0);
+
+	// rdtsc ticks are converted with the rate measured against GetTime since the first scope
+	bool             Started = false;
+	d3d::ProfileTick StartTick = 0;
+	double           StartTime = 0.0;
+
+	std::vector<ScopeTotal> Totals;
+	std::atomic<DWORD> Summaries(0);
+	DWORD  SummaryFrames = 0;
+	double SummaryStart = 0.0;
+	void (*Output)(const char* text) = DefaultOutput;
+
+	ThreadOwner::~ThreadOwner()
+	{
+		if (!profile)
+			return;
+		std::lock_guard<std::mutex> lock(Lock);
+		profile->Depth = 0;
+		if (RenderThread == profile)
+		{
+			RenderThread = 0;
+			RenderOpen = 0;
+		}
+		Retired.push_back(profile);
+	}
+
+	unsigned long long PackOpen(DWORD summary, int total)
+	{
+		return (unsigned long long)summary << 32 | (DWORD)(total + 1);
+	}
+
+	// the calling thread's profile; the first thread to profile is taken for the render
+	// thread until one ends a frame
+	ThreadProfile& GetThreadProfile()
+	{
+		if (!Current.profile)
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			ThreadProfile* profile;
+			if (!Retired.empty())
+			{
+				profile = Retired.back();
+				Retired.pop_back();
+			}
+			else
+			{
+				profile = new ThreadProfile;
+				profile->Id = (int)Threads.size() + 1;
+				Threads.push_back(std::unique_ptr<ThreadProfile>(profile));
+			}
+			Current.profile = profile;
+			if (!RenderThread)
+				RenderThread = profile;
+			if (!Started)
+			{
+				Started = true;
+				StartTick = d3d::GetProfileTick();
+				StartTime = d3d::GetTime();
+				SummaryStart = StartTime;
+			}
+		}
+		return *Current.profile;
+	}
+
+	double TicksPerSecond()
+	{
+#if D3D_PROFILE_RDTSC
+		double seconds = d3d::GetTime() - StartTime;
+		if (!Started || seconds < 0.001)
+			return 1.0e9;
+		return (double)(d3d::GetProfileTick() - StartTick) / seconds;
+#else
+		return 1.0e9;
+#endif
+	}
+
+	// under Lock
+	int FindTotal(const char* name, int parent)
+	{
+		for (size_t i = 0; i < Totals.size(); ++i)
+			if (Totals[i].parent == parent && strcmp(Totals[i].name, name) == 0)
+				return (int)i;
+
+		ScopeTotal t;
+		memset(&t, 0, sizeof(t));
+		t.name = name;
+		t.parent = parent;
+		t.depth = parent < 0 ? 0 : Totals[parent].depth + 1;
+		Totals.push_back(t);
+		return (int)Totals.size() - 1;
+	}
+
+	// FindTotal through the thread's cache, which only locks the first time a name and
+	// parent come up in a summary; -1 once that summary is over
+	int LookupTotal(ThreadProfile& thread, const char* name, int parent, DWORD summary)
+	{
+		if (thread.CacheSummary != summary)
+		{
+			thread.Cache.clear();
+			thread.CacheSummary = summary;
+		}
+		for (size_t i = 0; i < thread.Cache.size(); ++i)
+		{
+			const CachedTotal& c = thread.Cache[i];
+			if (c.name == name && c.parent == parent)
+				return c.total;
+		}
+
+		CachedTotal c = { name, parent, -1 };
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			if (Summaries != summary)
+				return -1;
+			c.total = FindTotal(name, parent);
+		}
+		thread.Cache.push_back(c);
+		return c.total;
+	}
+
+	// children follow their parent in the order they first opened
+	void WriteTotals(std::string& text, int parent, double msPerTick, double frames)
+	{
+		char line[256];
+		for (size_t i = 0; i < Totals.size(); ++i)
+		{
+			const ScopeTotal& t = Totals[i];
+			if (t.parent != parent)
+				continue;
+			int indent = 2 + 2 * t.depth;
+			int n = sprintf(line, "%*s%-*s %8.3f ms", indent, "", 24 - indent, t.name, t.ticks * msPerTick / frames);
+			for (int c = 0; c < d3d::PROFILE_COUNTER_COUNT; ++c)
+			{
+				n += sprintf(line + n, "  %s %.0f", d3d::GetProfileCounterName((d3d::ProfileCounter)c),
+					t.counts[c] / frames);
+			}
+			sprintf(line + n, "\n");
+			text += line;
+			WriteTotals(text, (int)i, msPerTick, frames);
+		}
+	}
+
+	std::string FormatSummary(double seconds)
+	{
+		char line[256];
+		sprintf(line, "profile: %u frames in %.2f s, %.2f ms/frame\n",
+			(unsigned)SummaryFrames, seconds, seconds * 1000.0 / SummaryFrames);
+		std::string text = line;
+		WriteTotals(text, -1, 1000.0 / TicksPerSecond(), (double)SummaryFrames);
+		return text;
+	}
+}
+
+void d3d::ProfileBegin(const char* name)
+{
+	ThreadProfile& thread = GetThreadProfile();
+	if (thread.Depth >= MaxDepth)
+	{
+		++thread.Depth;
+		return;
+	}
+
+	// a thread's outermost scopes go under what the render thread has open
+	DWORD summary = Summaries;
+	bool render = &thread == RenderThread;
+	int parent = -1;
+	if (thread.Depth > 0)
+	{
+		const OpenScope& outer = thread.Open[thread.Depth - 1];
+		parent = outer.summary == summary ? outer.total : -1;
+	}
+	else if (!render)
+	{
+		unsigned long long open = RenderOpen;
+		parent = (DWORD)(open >> 32) == summary ? (int)(DWORD)open - 1 : -1;
+	}
+
+	OpenScope& s = thread.Open[thread.Depth++];
+	s.name = name;
+	s.total = LookupTotal(thread, name, parent, summary);
+	s.summary = summary;
+	if (render)
+		RenderOpen = PackOpen(summary, s.total);
+	memcpy(s.counts, ProfileCounts, sizeof(s.counts));
+	s.start = GetProfileTick();
+}
+
+void d3d::ProfileEnd()
+{
+	ProfileTick end = GetProfileTick();
+	ThreadProfile& thread = GetThreadProfile();
+	if (thread.Depth == 0)
+		return;
+	if (--thread.Depth >= MaxDepth)
+		return;
+
+	const OpenScope& s = thread.Open[thread.Depth];
+	ProfileEvent& e = thread.Ring[(DWORD)(thread.Written++ % RingSize)];
+	e.Name = s.name;
+	e.Start = s.start;
+	e.End = end;
+	e.Frame = Frame;
+	e.Depth = thread.Depth;
+	for (int c = 0; c < PROFILE_COUNTER_COUNT; ++c)
+		e.Counts[c] = ProfileCounts[c] - s.counts[c];
+
+	if (&thread == RenderThread)
+	{
+		const OpenScope* outer = thread.Depth > 0 ? &thread.Open[thread.Depth - 1] : 0;
+		RenderOpen = outer ? PackOpen(outer->summary, outer->total) : 0;
+	}
+
+	// a summary written while the scope was open dropped its entry
+	if (s.total < 0)
+		return;
+	std::lock_guard<std::mutex> lock(Lock);
+	if (s.summary == Summaries)
+	{
+		ScopeTotal& total = Totals[s.total];
+		total.ticks += e.End - e.Start;
+		++total.calls;
+		for (int c = 0; c < PROFILE_COUNTER_COUNT; ++c)
+			total.counts[c] += e.Counts[c];
+	}
+}
+
+void d3d::ProfileEndFrame()
+{
+	ThreadProfile& thread = GetThreadProfile();
+	std::string text;
+	void (*output)(const char* text) = 0;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		if (RenderThread != &thread)
+		{
+			RenderThread = &thread;
+			RenderOpen = 0;
+		}
+		++Frame;
+		++SummaryFrames;
+
+		double now = GetTime();
+		if (now - SummaryStart < 1.0)
+			return;
+		text = FormatSummary(now - SummaryStart);
+		Totals.clear();
+		++Summaries;
+		RenderOpen = 0;
+		SummaryFrames = 0;
+		SummaryStart = now;
+		output = Output;
+	}
+	output(text.c_str());
+}
+
+void d3d::SetProfileOutput(void (*output)(const char* text))
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	Output = output ? output : DefaultOutput;
+}
+
+bool d3d::WriteProfileTrace(const char* fileName)
+{
+	std::lock_guard<std::mutex> lock(Lock);
+	FILE* file = fopen(fileName, "w");
+	if (!file)
+		return false;
+
+	ProfileTick origin = 0;
+	bool first = true;
+	for (size_t t = 0; t < Threads.size(); ++t)
+	{
+		const ThreadProfile& thread = *Threads[t];
+		unsigned long long begin = thread.Written > RingSize ? thread.Written - RingSize : 0;
+		for (unsigned long long i = begin; i < thread.Written; ++i)
+		{
+			const ProfileEvent& e = thread.Ring[(DWORD)(i % RingSize)];
+			if (first || e.Start < origin)
+				origin = e.Start;
+			first = false;
+		}
+	}
+	double usPerTick = 1.0e6 / TicksPerSecond();
+
+	// complete events for the scopes on one track per thread, counter tracks from the render
+	// thread's outermost scopes
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool comma = false;
+	for (size_t t = 0; t < Threads.size(); ++t)
+	{
+		const ThreadProfile& thread = *Threads[t];
+		unsigned long long begin = thread.Written > RingSize ? thread.Written - RingSize : 0;
+		for (unsigned long long i = begin; i < thread.Written; ++i)
+		{
+			const ProfileEvent& e = thread.Ring[(DWORD)(i % RingSize)];
+			double ts = (e.Start - origin) * usPerTick;
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u",
+				comma ? ",\n" : "", e.Name, thread.Id, ts, (e.End - e.Start) * usPerTick, (unsigned)e.Frame);
+			for (int c = 0; c < PROFILE_COUNTER_COUNT; ++c)
+				fprintf(file, ",\"%s\":%u", GetProfileCounterName((ProfileCounter)c), (unsigned)e.Counts[c]);
+			fprintf(file, "}}");
+			comma = true;
+
+			if (e.Depth == 0 && &thread == RenderThread)
+			{
+				fprintf(file, ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{",
+					thread.Id, ts);
+				for (int c = 0; c < PROFILE_COUNTER_COUNT; ++c)
+					fprintf(file, "%s\"%s\":%u", c ? "," : "", GetProfileCounterName((ProfileCounter)c), (unsigned)e.Counts[c]);
+				fprintf(file, "}}");
+			}
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
+
+#endif // D3D_PROFILE
@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: profiler.h
+//
+// Desc: Frame profiler.  Named scopes record their start and end in CPU ticks (rdtsc where
+//       the compiler has it, steady_clock elsewhere) into a ring buffer, together with how
+//       much the draw, primitive, state change, Clear and texture bind counters grew while
+//       they were open.  The ring can be written out as a Chrome trace (chrome://tracing,
+//       Perfetto), and once a second a summary of the average time and counters per frame
+//       of every scope is printed.
+//
+//       Any thread may open scopes.  Each has its own stack, ring and counters, so a scope
+//       only counts what its own thread did; the trace shows every thread on its own track.
+//       A thread that exits leaves its profile, events and track to the next thread that
+//       starts.  A scope only takes the profiler's lock to add to the summary, and to look
+//       its name up the first time it opens in a summary.
+//       Scopes are told apart by name, not by the address of the string.  The render thread
+//       is the one that ends frames; in the summary a scope another thread opens outside
+//       any other sits under the scope the render thread has open at the time (the one
+//       waiting for a ParallelFor, say), and its time is added up over the threads, so
+//       such children can add up to more than their parent.
+//
+//       Use the D3D_PROFILE_* macros.  Building with D3D_PROFILE defined to 0 turns them
+//       into nothing and compiles the profiler out.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __profilerH__
+#define __profilerH__
+
+#ifndef D3D_PROFILE
+#define D3D_PROFILE 1
+#endif
+
+#if D3D_PROFILE
+
+#include "d3dCompat.h"
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define D3D_PROFILE_RDTSC 1
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <x86intrin.h>
+#define D3D_PROFILE_RDTSC 1
+#else
+#include <chrono>
+#define D3D_PROFILE_RDTSC 0
+#endif
+
+namespace d3d
+{
+	enum ProfileCounter
+	{
+		PROFILE_DRAWS,          // draw calls submitted to the device
+		PROFILE_PRIMITIVES,
+		PROFILE_STATE_CHANGES,  // state calls the state cache let through
+		PROFILE_CLEARS,
+		PROFILE_TEXTURE_BINDS,
+		PROFILE_COUNTER_COUNT
+	};
+
+	const char* GetProfileCounterName(ProfileCounter counter);
+
+	// Running totals of the calling thread; scopes store the difference between their end
+	// and start.
+	extern thread_local DWORD ProfileCounts[PROFILE_COUNTER_COUNT];
+
+	typedef unsigned long long ProfileTick;
+
+	inline ProfileTick GetProfileTick()
+	{
+#if D3D_PROFILE_RDTSC
+		return (ProfileTick)__rdtsc();
+#else
+		return (ProfileTick)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	inline void ProfileCount(ProfileCounter counter, DWORD amount)
+	{
+		ProfileCounts[counter] += amount;
+	}
+
+	struct ProfileEvent
+	{
+		const char* Name;       // a string that outlives the profiler
+		ProfileTick Start;
+		ProfileTick End;
+		DWORD       Frame;
+		int         Depth;      // 0 for scopes opened outside any other on the same thread
+		DWORD       Counts[PROFILE_COUNTER_COUNT];
+	};
+
+	// 'name' must outlive the profiler.  Scopes close in the reverse order they opened.
+	void ProfileBegin(const char* name);
+	void ProfileEnd();
+
+	// Ends a frame.  Once a second the per frame averages since the last summary are
+	// handed to the summary output.
+	void ProfileEndFrame();
+
+	// Where summaries go; by default OutputDebugString on Windows and stdout elsewhere.
+	void SetProfileOutput(void (*output)(const char* text));
+
+	// Writes the events still in the rings as a Chrome trace, between frames while no
+	// other thread has a scope open.  Returns false when the file cannot be written.
+	bool WriteProfileTrace(const char* fileName);
+
+	class ProfileScope
+	{
+	public:
+		explicit ProfileScope(const char* name) { ProfileBegin(name); }
+		~ProfileScope() { ProfileEnd(); }
+
+	private:
+		ProfileScope(const ProfileScope&);
+		ProfileScope& operator=(const ProfileScope&);
+	};
+}
+
+#define D3D_PROFILE_JOIN2(a, b) a##b
+#define D3D_PROFILE_JOIN(a, b) D3D_PROFILE_JOIN2(a, b)
+
+#define D3D_PROFILE_SCOPE(name)         d3d::ProfileScope D3D_PROFILE_JOIN(profileScope, __LINE__)(name)
+#define D3D_PROFILE_COUNT(counter, n)   d3d::ProfileCount(d3d::counter, (DWORD)(n))
+#define D3D_PROFILE_END_FRAME()         d3d::ProfileEndFrame()
+#define D3D_PROFILE_WRITE_TRACE(file)   d3d::WriteProfileTrace(file)
+
+#else
+
+#define D3D_PROFILE_SCOPE(name)         ((void)0)
+#define D3D_PROFILE_COUNT(counter, n)   ((void)0)
+#define D3D_PROFILE_END_FRAME()         ((void)0)
+#define D3D_PROFILE_WRITE_TRACE(file)   false
+
+#endif // D3D_PROFILE
+
+#endif // __profilerH__
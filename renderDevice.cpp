@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: renderDevice.cpp
+//
+// Desc: Backend independent helpers for the RenderDevice interface.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "renderDevice.h"
+
+const D3DRENDERSTATETYPE d3d::PassRenderStates[d3d::PASS_STATE_COUNT] = {
+	D3DRS_STENCILENABLE,
+	D3DRS_STENCILFUNC,
+	D3DRS_STENCILREF,
+	D3DRS_STENCILMASK,
+	D3DRS_STENCILWRITEMASK,
+	D3DRS_STENCILFAIL,
+	D3DRS_STENCILZFAIL,
+	D3DRS_STENCILPASS,
+	D3DRS_ZENABLE,
+	D3DRS_ZWRITEENABLE,
+	D3DRS_ZFUNC,
+	D3DRS_ALPHABLENDENABLE,
+	D3DRS_SRCBLEND,
+	D3DRS_DESTBLEND,
+	D3DRS_CULLMODE
+};
+
+void d3d::PassDesc::GetRenderStates(DWORD values[PASS_STATE_COUNT]) const
+{
+	values[0]  = StencilEnable;
+	values[1]  = StencilFunc;
+	values[2]  = StencilRef;
+	values[3]  = StencilMask;
+	values[4]  = StencilWriteMask;
+	values[5]  = StencilFail;
+	values[6]  = StencilZFail;
+	values[7]  = StencilPass;
+	values[8]  = ZEnable;
+	values[9]  = ZWriteEnable;
+	values[10] = ZFunc;
+	values[11] = AlphaBlendEnable;
+	values[12] = SrcBlend;
+	values[13] = DestBlend;
+	values[14] = CullMode;
+}
+
+d3d::PassDesc d3d::InitPassDesc()
+{
+	PassDesc desc;
+	desc.StencilEnable    = false;
+	desc.StencilFunc      = D3DCMP_ALWAYS;
+	desc.StencilRef       = 0;
+	desc.StencilMask      = 0xffffffff;
+	desc.StencilWriteMask = 0xffffffff;
+	desc.StencilFail      = D3DSTENCILOP_KEEP;
+	desc.StencilZFail     = D3DSTENCILOP_KEEP;
+	desc.StencilPass      = D3DSTENCILOP_KEEP;
+	desc.ZEnable          = true;
+	desc.ZWriteEnable     = true;
+	desc.ZFunc            = D3DCMP_LESSEQUAL;
+	desc.AlphaBlendEnable = false;
+	desc.SrcBlend         = D3DBLEND_ONE;
+	desc.DestBlend        = D3DBLEND_ZERO;
+	desc.CullMode         = D3DCULL_CCW;
+	return desc;
+}
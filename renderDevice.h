@@ -0,0 +1,218 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: renderDevice.h
+//
+// Desc: The device interface the demo renders through.  It mirrors the part of
+//       IDirect3DDevice9 used by RenderScene/RenderMirro/RenderShadow, so the same scene code
+//       runs either on a real Direct3D 9 device (d3d9Device.cpp) or on the headless CPU
+//       rasterizer (softDevice.h/.cpp).
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __renderDeviceH__
+#define __renderDeviceH__
+
+#include "d3dCompat.h"
+
+namespace d3d
+{
+	//
+	// Resources.  Each one is created by a RenderDevice and destroyed with Release().
+	//
+
+	class Texture
+	{
+	public:
+		// A8R8G8B8 textures with a full mip chain only (CreateTexture): copies 'rows' rows of
+		// texels, tightly packed, into level 0 starting at row 'first'.
+		virtual bool WriteRows(UINT first, UINT rows, const DWORD* texels) = 0;
+		// Rebuilds the levels below level 0 from it.
+		virtual void GenerateMips() = 0;
+		// Copies a whole level in the texture's format, tightly packed; for DXT1/DXT5 that
+		// is the rows of 4x4 blocks (GetLevelPitch in dds.h).
+		virtual bool WriteLevel(UINT level, const void* data) = 0;
+		virtual void Release() = 0;
+	protected:
+		virtual ~Texture() {}
+	};
+
+	class VertexBuffer
+	{
+	public:
+		virtual bool Lock(UINT offset, UINT size, void** data, DWORD flags) = 0;
+		virtual void Unlock() = 0;
+		virtual void Release() = 0;
+	protected:
+		virtual ~VertexBuffer() {}
+	};
+
+	// 16 bit indices.
+	class IndexBuffer
+	{
+	public:
+		virtual bool Lock(UINT offset, UINT size, void** data, DWORD flags) = 0;
+		virtual void Unlock() = 0;
+		virtual void Release() = 0;
+	protected:
+		virtual ~IndexBuffer() {}
+	};
+
+	// Vertex layout of the meshes CreateMesh makes: D3DFVF_XYZ | D3DFVF_NORMAL.
+	struct MeshVertex
+	{
+		float x, y, z;
+		float nx, ny, nz;
+	};
+
+	class Mesh
+	{
+	public:
+		virtual void  DrawSubset(DWORD attribId) = 0;
+		virtual DWORD GetNumFaces() const = 0;
+		virtual DWORD GetNumVertices() const = 0;
+		// Copies GetNumVertices() positions and 3 * GetNumFaces() triangle indices.
+		virtual bool  GetGeometry(D3DXVECTOR3* positions, DWORD* indices) const = 0;
+		virtual void  Release() = 0;
+	protected:
+		virtual ~Mesh() {}
+	};
+
+	// One copy of a mesh in an instanced draw: its world matrix and an index into the
+	// material palette passed with the draw.
+	struct MeshInstance
+	{
+		D3DXMATRIX World;
+		DWORD      Material;
+	};
+
+	//
+	// Pass descriptors.  A PassDesc is the fixed recipe of depth, stencil, blend and cull
+	// states one pass needs; the device compiles it into a StateBlock once (in Setup) and
+	// ApplyStateBlock switches to it with a single call.
+	//
+
+	enum
+	{
+		PASS_STATE_COUNT = 15
+	};
+
+	struct PassDesc
+	{
+		bool  StencilEnable;
+		DWORD StencilFunc;
+		DWORD StencilRef;
+		DWORD StencilMask;
+		DWORD StencilWriteMask;
+		DWORD StencilFail;
+		DWORD StencilZFail;
+		DWORD StencilPass;
+		bool  ZEnable;
+		bool  ZWriteEnable;
+		DWORD ZFunc;
+		bool  AlphaBlendEnable;
+		DWORD SrcBlend;
+		DWORD DestBlend;
+		DWORD CullMode;
+
+		// Flattens the descriptor into PASS_STATE_COUNT render state values, in the
+		// order of PassRenderStates.
+		void GetRenderStates(DWORD values[PASS_STATE_COUNT]) const;
+	};
+
+	// The render states covered by a PassDesc.
+	extern const D3DRENDERSTATETYPE PassRenderStates[PASS_STATE_COUNT];
+
+	// Direct3D's default states: no stencil, z test and write, no blending, CCW culling.
+	PassDesc InitPassDesc();
+
+	class StateBlock
+	{
+	public:
+		virtual const PassDesc& GetDesc() const = 0;
+		virtual void Release() = 0;
+	protected:
+		virtual ~StateBlock() {}
+	};
+
+	//
+	// Device
+	//
+
+	class RenderDevice
+	{
+	public:
+		// resources
+		virtual bool CreateVertexBuffer(UINT length, DWORD fvf, VertexBuffer** vb) = 0;
+		virtual bool CreateIndexBuffer(UINT length, IndexBuffer** ib) = 0;
+		// A8R8G8B8 with a full mip chain; level 0 is undefined until written.
+		virtual bool CreateTexture(UINT width, UINT height, Texture** tex) = 0;
+		// D3DFMT_A8R8G8B8, X8R8G8B8, DXT1 or DXT5 with 'levels' levels, each undefined until
+		// written.
+		virtual bool CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels,
+			Texture** tex) = 0;
+		// One subset (0) holding every triangle.
+		virtual bool CreateMesh(const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+			UINT numTriangles, Mesh** mesh) = 0;
+		// A8R8G8B8, one level, with a D24S8 depth/stencil buffer of its own.  Undefined
+		// until drawn into.
+		virtual bool CreateRenderTarget(UINT width, UINT height, Texture** tex) = 0;
+
+		// fixed function state
+		virtual void SetRenderState(D3DRENDERSTATETYPE state, DWORD value) = 0;
+		virtual void SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value) = 0;
+		virtual void SetTexture(DWORD stage, Texture* tex) = 0;
+		virtual void SetMaterial(const D3DMATERIAL9* mtrl) = 0;
+		virtual void SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix) = 0;
+		virtual void SetLight(DWORD index, const D3DLIGHT9* light) = 0;
+		virtual void LightEnable(DWORD index, bool enable) = 0;
+		virtual void SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride) = 0;
+		virtual void SetFVF(DWORD fvf) = 0;
+		virtual void SetIndices(IndexBuffer* ib) = 0;
+
+		// World space plane (a, b, c, d): while bit 'index' of D3DRS_CLIPPLANEENABLE is set
+		// only what lies where ax + by + cz + d >= 0 is drawn.  The software device has
+		// plane 0 only.
+		virtual void SetClipPlane(DWORD index, const float* plane) = 0;
+
+		// pass state blocks
+		virtual bool CreateStateBlock(const PassDesc& desc, StateBlock** block) = 0;
+		virtual void ApplyStateBlock(StateBlock* block) = 0;
+
+		// frame
+		// Draws and Clears go to 'target', made by CreateRenderTarget, and its depth/stencil
+		// buffer; 0 selects the back buffer again.  The target must not be bound as a texture
+		// while it is drawn into.
+		virtual void SetRenderTarget(Texture* target) = 0;
+		virtual void Clear(DWORD count, const D3DRECT* rects, DWORD flags,
+			D3DCOLOR color, float z, DWORD stencil) = 0;
+		virtual void BeginScene() = 0;
+		virtual void EndScene() = 0;
+		virtual void Present() = 0;
+		virtual void DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount) = 0;
+		virtual void DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+			UINT numVertices, UINT startIndex, UINT primCount) = 0;
+
+		// Draws subset 0 of 'mesh' once per instance, transformed by its World and lit with
+		// palette[Material] instead of the current world transform and material.  Every
+		// other state (texture, lights, passes) applies as for DrawSubset.  Instances whose
+		// Material is not below 'paletteSize' may be skipped.  Afterwards the
+		// world transform, material, stream source, FVF and indices are undefined.
+		virtual void DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+			const D3DMATERIAL9* palette, UINT paletteSize) = 0;
+
+		// mesh->DrawSubset(attribId), routed through the device so that a CommandBuffer can
+		// record it.
+		virtual void DrawSubset(Mesh* mesh, DWORD attribId) { mesh->DrawSubset(attribId); }
+
+		virtual void Release() = 0;
+	protected:
+		virtual ~RenderDevice() {}
+	};
+
+#ifdef _WIN32
+	// Wraps an already created IDirect3DDevice9.  The wrapper takes its own reference.
+	RenderDevice* CreateD3D9Device(IDirect3DDevice9* device);
+#endif
+}
+
+#endif // __renderDeviceH__
@@ -0,0 +1,649 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: sceneFile.cpp
+//
+// Desc: Binary scene files: checking, and compiling them from text.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "sceneFile.h"
+#include "image.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+	const DWORD SceneMagic = 'S' | ('C' << 8) | ('N' << 16) | ('1' << 24);
+
+	// bytes per element of every chunk, in SceneChunk order
+	const size_t ChunkStrides[d3d::SCENE_CHUNK_COUNT] = {
+		sizeof(char),
+		sizeof(d3d::SceneMaterial),
+		sizeof(d3d::SceneVertex),
+		sizeof(WORD),
+		sizeof(d3d::MeshRange),
+		sizeof(d3d::MeshVertex),
+		sizeof(WORD),
+		sizeof(d3d::SceneMesh),
+		sizeof(d3d::SceneMirror),
+		sizeof(d3d::SceneReceiver),
+		sizeof(d3d::SceneLight),
+		sizeof(d3d::SceneInstance),
+		sizeof(d3d::SceneCamera),
+	};
+
+	bool IndicesBelow(const WORD* indices, UINT count, UINT limit)
+	{
+		for (UINT i = 0; i < count; ++i)
+			if (indices[i] >= limit)
+				return false;
+		return true;
+	}
+
+	//
+	// Text scenes
+	//
+
+	struct Builtin
+	{
+		const char*      Name;
+		d3d::MeshBuilder Build;
+	};
+
+	const Builtin Builtins[] = {
+		{ "teapot",     d3d::BuildTeapot },
+		{ "teapot-box", d3d::BuildTeapotBox },
+	};
+
+	class SceneCompiler
+	{
+	public:
+		SceneCompiler() : _room(d3d::SceneVertexFVF, sizeof(d3d::SceneVertex)), _sourceHash(0), _line(0)
+		{
+			d3d::SceneCamera& c = _camera;
+			c.Target = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+			c.Height = 3.0f;
+			c.Distance = 20.0f;
+			c.Angle = 1.5f * D3DX_PI;
+			c.FieldOfView = 0.25f * D3DX_PI;
+			c.NearPlane = 1.0f;
+			c.FarPlane = 1000.0f;
+		}
+
+		bool Compile(const char* text, size_t size, std::vector<unsigned char>* file, std::string* error);
+
+	private:
+		bool Command(const std::string& command);
+		bool Material();
+		bool Quad();
+		bool Triangle();
+		bool Mirror();
+		bool Receiver();
+		bool Light();
+		bool Mesh();
+		bool Instance();
+		bool Camera();
+		bool Write(std::vector<unsigned char>* file);
+
+		bool Fail(const std::string& message);
+		bool Word(std::string* word, const char* what);
+		bool Number(float* f);
+		bool Numbers(float* f, int count);
+		bool Name(const std::vector<std::string>& names, const char* what, DWORD* index);
+
+		std::istringstream             _tokens;   // the rest of the current line
+		std::vector<std::string>       _materialNames;
+		std::vector<std::string>       _meshNames;
+		std::string                    _strings;
+		std::vector<d3d::SceneMaterial> _materials;
+		d3d::StaticMeshBuilder         _room;
+		std::vector<d3d::MeshVertex>   _meshVertices;
+		std::vector<WORD>              _meshIndices;
+		std::vector<d3d::SceneMesh>    _meshes;
+		std::vector<d3d::SceneMirror>  _mirrors;
+		std::vector<d3d::SceneReceiver> _receivers;
+		std::vector<d3d::SceneLight>   _lights;
+		std::vector<d3d::SceneInstance> _instances;
+		d3d::SceneCamera               _camera;
+		DWORD                          _sourceHash;
+		int                            _line;
+		std::string                    _error;
+	};
+
+	bool SceneCompiler::Compile(const char* text, size_t size, std::vector<unsigned char>* file, std::string* error)
+	{
+		_sourceHash = d3d::HashSceneSource(text, size);
+		std::istringstream lines(std::string(text, size));
+		std::string line;
+		bool ok = true;
+		while (ok && std::getline(lines, line))
+		{
+			++_line;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+
+			_tokens.clear();
+			_tokens.str(line);
+			std::string command, extra;
+			if (!(_tokens >> command))
+				continue;
+			ok = Command(command);
+			if (ok && _tokens >> extra)
+				ok = Fail("unexpected '" + extra + "'");
+		}
+
+		_line = 0;
+		if (ok && _materials.empty())
+			ok = Fail("no materials");
+		if (ok)
+			ok = Write(file);
+		if (!ok)
+			*error = _error;
+		return ok;
+	}
+
+	bool SceneCompiler::Command(const std::string& command)
+	{
+		if (command == "material") return Material();
+		if (command == "quad")     return Quad();
+		if (command == "triangle") return Triangle();
+		if (command == "mirror")   return Mirror();
+		if (command == "receiver") return Receiver();
+		if (command == "light")    return Light();
+		if (command == "mesh")     return Mesh();
+		if (command == "instance") return Instance();
+		if (command == "camera")   return Camera();
+		return Fail("unknown command '" + command + "'");
+	}
+
+	// material <name> [color r g b] [diffuse|ambient|specular|emissive r g b] [alpha a]
+	//          [power p] [texture <file>] [placeholder r g b]
+	bool SceneCompiler::Material()
+	{
+		std::string name;
+		if (!Word(&name, "material name"))
+			return false;
+		for (size_t i = 0; i < _materialNames.size(); ++i)
+			if (_materialNames[i] == name)
+				return Fail("material '" + name + "' defined twice");
+
+		// defaults to d3d::WHITE_MTRL
+		d3d::SceneMaterial m;
+		D3DXCOLOR white(1.0f, 1.0f, 1.0f, 1.0f), black(0.0f, 0.0f, 0.0f, 1.0f);
+		m.Material.Diffuse = m.Material.Ambient = m.Material.Specular = white;
+		m.Material.Emissive = black;
+		m.Material.Power = 8.0f;
+		m.Texture = d3d::NoSceneTexture;
+		m.Placeholder = D3DCOLOR_XRGB(255, 255, 255);
+
+		std::string key;
+		while (_tokens >> key)
+		{
+			float c[3];
+			if (key == "texture")
+			{
+				std::string file;
+				if (!Word(&file, "texture file"))
+					return false;
+				m.Texture = (DWORD)_strings.size();
+				_strings.append(file.c_str(), file.size() + 1);
+			}
+			else if (key == "power")
+			{
+				if (!Number(&m.Material.Power))
+					return false;
+			}
+			else if (key == "alpha")
+			{
+				if (!Number(&m.Material.Diffuse.a))
+					return false;
+			}
+			else if (key == "color" || key == "diffuse" || key == "ambient" || key == "specular" ||
+				key == "emissive" || key == "placeholder")
+			{
+				if (!Numbers(c, 3))
+					return false;
+				D3DXCOLOR color(c[0], c[1], c[2], 1.0f);
+				if (key == "color")
+					m.Material.Diffuse = m.Material.Ambient = m.Material.Specular = color;
+				else if (key == "diffuse")
+					m.Material.Diffuse = color;
+				else if (key == "ambient")
+					m.Material.Ambient = color;
+				else if (key == "specular")
+					m.Material.Specular = color;
+				else if (key == "emissive")
+					m.Material.Emissive = color;
+				else
+					m.Placeholder = D3DCOLOR_XRGB((int)c[0], (int)c[1], (int)c[2]);
+			}
+			else
+				return Fail("unknown material property '" + key + "'");
+		}
+
+		_materialNames.push_back(name);
+		_materials.push_back(m);
+		return true;
+	}
+
+	// quad <material> and four corners, clockwise from the front; u runs from the first
+	// corner to the last, v from the second to the first
+	bool SceneCompiler::Quad()
+	{
+		DWORD material;
+		D3DXVECTOR3 c[4];
+		if (!Name(_materialNames, "material", &material) || !Numbers((float*)c, 12))
+			return false;
+
+		D3DXPLANE plane;
+		D3DXPlaneFromPoints(&plane, &c[0], &c[1], &c[2]);
+		const float uv[4][2] = { { 0.0f, 1.0f }, { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f } };
+		const int corners[6] = { 0, 1, 2, 0, 2, 3 };
+		d3d::SceneVertex v[6];
+		for (int i = 0; i < 6; ++i)
+		{
+			const D3DXVECTOR3& p = c[corners[i]];
+			d3d::SceneVertex vertex = { p.x, p.y, p.z, plane.a, plane.b, plane.c,
+				uv[corners[i]][0], uv[corners[i]][1] };
+			v[i] = vertex;
+		}
+		_room.AddTriangles(v, 2, material);
+		return true;
+	}
+
+	// triangle <material> and three vertices: x y z nx ny nz u v
+	bool SceneCompiler::Triangle()
+	{
+		DWORD material;
+		d3d::SceneVertex v[3];
+		if (!Name(_materialNames, "material", &material) || !Numbers((float*)v, 24))
+			return false;
+		_room.AddTriangles(v, 1, material);
+		return true;
+	}
+
+	// mirror <material> and four corners, clockwise as seen from the reflecting side,
+	//        [scale s] [every n]; both only matter when reflections are rendered to textures
+	bool SceneCompiler::Mirror()
+	{
+		d3d::SceneMirror m;
+		if (!Name(_materialNames, "material", &m.Material) || !Numbers((float*)m.Corners, 12))
+			return false;
+		m.TextureScale = 1.0f;
+		m.UpdateInterval = 1;
+
+		std::string key;
+		while (_tokens >> key)
+		{
+			float f;
+			if (key == "scale")
+			{
+				if (!Number(&m.TextureScale))
+					return false;
+				if (m.TextureScale <= 0.0f || m.TextureScale > 1.0f)
+					return Fail("mirror texture scale must be in (0, 1]");
+			}
+			else if (key == "every")
+			{
+				if (!Number(&f))
+					return false;
+				if (f < 1.0f)
+					return Fail("mirror update interval must be at least 1");
+				m.UpdateInterval = (DWORD)f;
+			}
+			else
+				return Fail("unknown mirror property '" + key + "'");
+		}
+		_mirrors.push_back(m);
+		return true;
+	}
+
+	// receiver <material> a b c d
+	bool SceneCompiler::Receiver()
+	{
+		d3d::SceneReceiver r;
+		if (!Name(_materialNames, "material", &r.Material) || !Numbers((float*)&r.Plane, 4))
+			return false;
+		_receivers.push_back(r);
+		return true;
+	}
+
+	// light dx dy dz r g b
+	bool SceneCompiler::Light()
+	{
+		float f[6];
+		if (!Numbers(f, 6))
+			return false;
+		d3d::SceneLight l;
+		l.Direction = D3DXVECTOR3(f[0], f[1], f[2]);
+		l.Color = D3DXCOLOR(f[3], f[4], f[5], 1.0f);
+		_lights.push_back(l);
+		return true;
+	}
+
+	// mesh <name> <builtin>
+	bool SceneCompiler::Mesh()
+	{
+		std::string name, builtin;
+		if (!Word(&name, "mesh name") || !Word(&builtin, "mesh geometry"))
+			return false;
+
+		const Builtin* b = 0;
+		for (size_t i = 0; i < sizeof(Builtins) / sizeof(Builtins[0]); ++i)
+			if (builtin == Builtins[i].Name)
+				b = &Builtins[i];
+		if (!b)
+			return Fail("unknown mesh geometry '" + builtin + "'");
+
+		std::vector<d3d::MeshVertex> vertices;
+		std::vector<WORD> indices;
+		b->Build(&vertices, &indices);
+		if (indices.empty() || vertices.size() > 0x10000)
+			return Fail("mesh '" + name + "' has no triangles or too many vertices");
+
+		d3d::SceneMesh m;
+		m.FirstVertex = (UINT)_meshVertices.size();
+		m.NumVertices = (UINT)vertices.size();
+		m.FirstIndex = (UINT)_meshIndices.size();
+		m.NumTriangles = (UINT)indices.size() / 3;
+		D3DXComputeBoundingSphere((const D3DXVECTOR3*)&vertices[0], m.NumVertices, sizeof(d3d::MeshVertex),
+			&m.Center, &m.Radius);
+		_meshVertices.insert(_meshVertices.end(), vertices.begin(), vertices.end());
+		_meshIndices.insert(_meshIndices.end(), indices.begin(), indices.end());
+		_meshNames.push_back(name);
+		_meshes.push_back(m);
+		return true;
+	}
+
+	// instance <mesh> <material> x y z
+	bool SceneCompiler::Instance()
+	{
+		d3d::SceneInstance inst;
+		if (!Name(_meshNames, "mesh", &inst.Mesh) || !Name(_materialNames, "material", &inst.Material) ||
+			!Numbers((float*)&inst.Position, 3))
+			return false;
+		_instances.push_back(inst);
+		return true;
+	}
+
+	// camera [target x y z] [height h] [distance d] [angle degrees] [fov degrees] [near n] [far f]
+	bool SceneCompiler::Camera()
+	{
+		std::string key;
+		while (_tokens >> key)
+		{
+			bool ok;
+			if (key == "target")
+				ok = Numbers((float*)&_camera.Target, 3);
+			else if (key == "height")
+				ok = Number(&_camera.Height);
+			else if (key == "distance")
+				ok = Number(&_camera.Distance);
+			else if (key == "angle")
+			{
+				ok = Number(&_camera.Angle);
+				_camera.Angle *= D3DX_PI / 180.0f;
+			}
+			else if (key == "fov")
+			{
+				ok = Number(&_camera.FieldOfView);
+				_camera.FieldOfView *= D3DX_PI / 180.0f;
+			}
+			else if (key == "near")
+				ok = Number(&_camera.NearPlane);
+			else if (key == "far")
+				ok = Number(&_camera.FarPlane);
+			else
+				return Fail("unknown camera property '" + key + "'");
+			if (!ok)
+				return false;
+		}
+		return true;
+	}
+
+	void AppendChunk(std::vector<unsigned char>* file, d3d::SceneHeader* header, d3d::SceneChunk chunk,
+		const void* data, size_t count)
+	{
+		file->resize((file->size() + 3) & ~(size_t)3);
+		header->Offsets[chunk] = (DWORD)file->size();
+		header->Counts[chunk] = (DWORD)count;
+		const unsigned char* bytes = (const unsigned char*)data;
+		if (count > 0)
+			file->insert(file->end(), bytes, bytes + count * ChunkStrides[chunk]);
+	}
+
+	bool SceneCompiler::Write(std::vector<unsigned char>* file)
+	{
+		std::vector<unsigned char> vertices;
+		std::vector<WORD> indices;
+		std::vector<d3d::MeshRange> ranges;
+		d3d::StaticMeshStats stats;
+		if (!_room.Weld(&vertices, &indices, &ranges, &stats))
+			return Fail("no static geometry");
+
+		d3d::SceneHeader header;
+		memset(&header, 0, sizeof(header));
+		header.Magic = SceneMagic;
+		header.Version = d3d::SceneVersion;
+		header.SourceHash = _sourceHash;
+
+		file->assign(sizeof(header), 0);
+		AppendChunk(file, &header, d3d::SCENE_STRINGS, _strings.data(), _strings.size());
+		AppendChunk(file, &header, d3d::SCENE_MATERIALS, _materials.data(), _materials.size());
+		AppendChunk(file, &header, d3d::SCENE_STATIC_VERTICES, vertices.data(), vertices.size() / sizeof(d3d::SceneVertex));
+		AppendChunk(file, &header, d3d::SCENE_STATIC_INDICES, indices.data(), indices.size());
+		AppendChunk(file, &header, d3d::SCENE_STATIC_RANGES, ranges.data(), ranges.size());
+		AppendChunk(file, &header, d3d::SCENE_MESH_VERTICES, _meshVertices.data(), _meshVertices.size());
+		AppendChunk(file, &header, d3d::SCENE_MESH_INDICES, _meshIndices.data(), _meshIndices.size());
+		AppendChunk(file, &header, d3d::SCENE_MESHES, _meshes.data(), _meshes.size());
+		AppendChunk(file, &header, d3d::SCENE_MIRRORS, _mirrors.data(), _mirrors.size());
+		AppendChunk(file, &header, d3d::SCENE_RECEIVERS, _receivers.data(), _receivers.size());
+		AppendChunk(file, &header, d3d::SCENE_LIGHTS, _lights.data(), _lights.size());
+		AppendChunk(file, &header, d3d::SCENE_INSTANCES, _instances.data(), _instances.size());
+		AppendChunk(file, &header, d3d::SCENE_CAMERA, &_camera, 1);
+
+		header.Size = (DWORD)file->size();
+		memcpy(&(*file)[0], &header, sizeof(header));
+		return true;
+	}
+
+	bool SceneCompiler::Fail(const std::string& message)
+	{
+		std::ostringstream s;
+		if (_line > 0)
+			s << "line " << _line << ": ";
+		s << message;
+		_error = s.str();
+		return false;
+	}
+
+	bool SceneCompiler::Word(std::string* word, const char* what)
+	{
+		return (_tokens >> *word) ? true : Fail(std::string("missing ") + what);
+	}
+
+	bool SceneCompiler::Number(float* f)
+	{
+		std::string word;
+		if (!(_tokens >> word))
+			return Fail("missing number");
+		char* end = 0;
+		*f = (float)strtod(word.c_str(), &end);
+		return *end == '\0' ? true : Fail("'" + word + "' is not a number");
+	}
+
+	bool SceneCompiler::Numbers(float* f, int count)
+	{
+		for (int i = 0; i < count; ++i)
+			if (!Number(&f[i]))
+				return false;
+		return true;
+	}
+
+	bool SceneCompiler::Name(const std::vector<std::string>& names, const char* what, DWORD* index)
+	{
+		std::string name;
+		if (!Word(&name, what))
+			return false;
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			if (names[i] == name)
+			{
+				*index = (DWORD)i;
+				return true;
+			}
+		}
+		return Fail(std::string("unknown ") + what + " '" + name + "'");
+	}
+}
+
+bool d3d::ParseScene(const unsigned char* data, size_t size, Scene* scene)
+{
+	if (size < sizeof(SceneHeader))
+		return false;
+	const SceneHeader* header = (const SceneHeader*)data;
+	if (header->Magic != SceneMagic || header->Version != SceneVersion || header->Size != size)
+		return false;
+
+	const void* chunks[SCENE_CHUNK_COUNT];
+	for (int i = 0; i < SCENE_CHUNK_COUNT; ++i)
+	{
+		unsigned long long offset = header->Offsets[i], count = header->Counts[i];
+		if (offset < sizeof(SceneHeader) || offset % 4 != 0 || offset + count * ChunkStrides[i] > size)
+			return false;
+		chunks[i] = data + offset;
+		scene->Counts[i] = (UINT)count;
+	}
+	scene->SourceHash = header->SourceHash;
+
+	scene->Strings = (const char*)chunks[SCENE_STRINGS];
+	scene->Materials = (const SceneMaterial*)chunks[SCENE_MATERIALS];
+	scene->StaticVertices = (const SceneVertex*)chunks[SCENE_STATIC_VERTICES];
+	scene->StaticIndices = (const WORD*)chunks[SCENE_STATIC_INDICES];
+	scene->StaticRanges = (const MeshRange*)chunks[SCENE_STATIC_RANGES];
+	scene->MeshVertices = (const MeshVertex*)chunks[SCENE_MESH_VERTICES];
+	scene->MeshIndices = (const WORD*)chunks[SCENE_MESH_INDICES];
+	scene->Meshes = (const SceneMesh*)chunks[SCENE_MESHES];
+	scene->Mirrors = (const SceneMirror*)chunks[SCENE_MIRRORS];
+	scene->Receivers = (const SceneReceiver*)chunks[SCENE_RECEIVERS];
+	scene->Lights = (const SceneLight*)chunks[SCENE_LIGHTS];
+	scene->Instances = (const SceneInstance*)chunks[SCENE_INSTANCES];
+	scene->Camera = (const SceneCamera*)chunks[SCENE_CAMERA];
+
+	// everything one chunk says about another must hold, so the loader can trust it
+	const UINT* counts = scene->Counts;
+	UINT numMaterials = counts[SCENE_MATERIALS];
+	if (counts[SCENE_CAMERA] != 1 ||
+		(counts[SCENE_STRINGS] > 0 && scene->Strings[counts[SCENE_STRINGS] - 1] != '\0'))
+		return false;
+	for (UINT i = 0; i < numMaterials; ++i)
+	{
+		DWORD texture = scene->Materials[i].Texture;
+		if (texture != NoSceneTexture && texture >= counts[SCENE_STRINGS])
+			return false;
+	}
+	for (UINT i = 0; i < counts[SCENE_STATIC_RANGES]; ++i)
+	{
+		const MeshRange& r = scene->StaticRanges[i];
+		if (r.Material >= numMaterials || r.BaseVertex < 0 || r.NumVertices > 0x10000 ||
+			(unsigned long long)r.BaseVertex + r.NumVertices > counts[SCENE_STATIC_VERTICES] ||
+			r.StartIndex + 3ull * r.PrimCount > counts[SCENE_STATIC_INDICES] ||
+			!IndicesBelow(scene->StaticIndices + r.StartIndex, r.PrimCount * 3, r.NumVertices))
+			return false;
+	}
+	for (UINT i = 0; i < counts[SCENE_MESHES]; ++i)
+	{
+		const SceneMesh& m = scene->Meshes[i];
+		if (m.NumVertices == 0 || m.NumVertices > 0x10000 || m.NumTriangles == 0 ||
+			(unsigned long long)m.FirstVertex + m.NumVertices > counts[SCENE_MESH_VERTICES] ||
+			m.FirstIndex + 3ull * m.NumTriangles > counts[SCENE_MESH_INDICES] ||
+			!IndicesBelow(scene->MeshIndices + m.FirstIndex, m.NumTriangles * 3, m.NumVertices))
+			return false;
+	}
+	for (UINT i = 0; i < counts[SCENE_MIRRORS]; ++i)
+		if (scene->Mirrors[i].Material >= numMaterials || scene->Mirrors[i].UpdateInterval == 0 ||
+			!(scene->Mirrors[i].TextureScale > 0.0f && scene->Mirrors[i].TextureScale <= 1.0f))
+			return false;
+	for (UINT i = 0; i < counts[SCENE_RECEIVERS]; ++i)
+		if (scene->Receivers[i].Material >= numMaterials)
+			return false;
+	for (UINT i = 0; i < counts[SCENE_INSTANCES]; ++i)
+		if (scene->Instances[i].Mesh >= counts[SCENE_MESHES] || scene->Instances[i].Material >= numMaterials)
+			return false;
+	return true;
+}
+
+const char* d3d::GetSceneTexture(const Scene& scene, UINT material)
+{
+	DWORD texture = scene.Materials[material].Texture;
+	return texture == NoSceneTexture ? 0 : scene.Strings + texture;
+}
+
+DWORD d3d::HashSceneSource(const char* text, size_t size)
+{
+	DWORD hash = 2166136261u;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+	return hash;
+}
+
+bool d3d::CompileScene(const char* text, size_t size, std::vector<unsigned char>* file, std::string* error)
+{
+	SceneCompiler compiler;
+	return compiler.Compile(text, size, file, error);
+}
+
+bool d3d::ConvertScene(const char* sourceFile, const char* sceneFile, std::string* error)
+{
+	std::vector<unsigned char> text, scene;
+	if (!ReadFileData(sourceFile, &text))
+	{
+		*error = std::string("cannot read ") + sourceFile;
+		return false;
+	}
+	if (!CompileScene(text.empty() ? "" : (const char*)&text[0], text.size(), &scene, error))
+	{
+		*error = std::string(sourceFile) + ": " + *error;
+		return false;
+	}
+
+	// written under a name of its own and renamed, so a reader never maps half a file
+	std::string temp = std::string(sceneFile) + ".tmp";
+	FILE* f = fopen(temp.c_str(), "wb");
+	bool ok = f && fwrite(&scene[0], 1, scene.size(), f) == scene.size();
+	ok = f && fclose(f) == 0 && ok;
+	remove(sceneFile);   // rename does not replace files on Windows
+	if (!ok || rename(temp.c_str(), sceneFile) != 0)
+	{
+		remove(temp.c_str());
+		*error = std::string("cannot write ") + sceneFile;
+		return false;
+	}
+	return true;
+}
+
+bool d3d::LoadScene(const char* sceneFile, const char* sourceFile, MappedFile* file, Scene* scene,
+	std::string* error)
+{
+	if (file->Open(sceneFile) && ParseScene(file->GetData(), file->GetSize(), scene))
+	{
+		// a scene shipped without its source is used as it is
+		std::vector<unsigned char> text;
+		if (!ReadFileData(sourceFile, &text) ||
+			HashSceneSource(text.empty() ? "" : (const char*)&text[0], text.size()) == scene->SourceHash)
+			return true;
+	}
+	file->Close();
+
+	if (!ConvertScene(sourceFile, sceneFile, error))
+		return false;
+	if (file->Open(sceneFile) && ParseScene(file->GetData(), file->GetSize(), scene))
+		return true;
+	file->Close();
+	*error = std::string("cannot load ") + sceneFile;
+	return false;
+}
@@ -0,0 +1,171 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: sceneFile.h
+//
+// Desc: Binary scene files.  A header with a version and a table of chunks, each an array
+//       of one of the plain structs below, 4 byte aligned and little endian.  ParseScene()
+//       only checks the file and points into it, so a mapped scene costs what paging it in
+//       costs, and its vertices and indices are copied straight into the device's buffers.
+//
+//       The files are compiled from a text description (see room.scn) by
+//       d3dSceneConvert, or by LoadScene() when the binary is missing, of another version or
+//       compiled from other text than the source holds now.
+//       The static geometry is welded and cache ordered and the procedural meshes are
+//       built at that point, not at load.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __sceneFileH__
+#define __sceneFileH__
+
+#include "mappedFile.h"
+#include "meshGeometry.h"
+#include "staticMesh.h"
+#include <string>
+#include <vector>
+
+namespace d3d
+{
+	// Files of any other version are rejected and compiled again.
+	enum { SceneVersion = 3 };
+
+	// Static geometry: one vertex buffer, one index buffer, a range per material.
+	struct SceneVertex
+	{
+		float x, y, z;
+		float nx, ny, nz;
+		float u, v;
+	};
+	const DWORD SceneVertexFVF = D3DFVF_XYZ | D3DFVF_NORMAL | D3DFVF_TEX1;
+
+	const DWORD NoSceneTexture = 0xffffffff;
+
+	struct SceneMaterial
+	{
+		D3DMATERIAL9 Material;
+		DWORD        Texture;       // offset of its file name in the strings, or NoSceneTexture
+		D3DCOLOR     Placeholder;   // shown until the texture is loaded
+	};
+
+	// A mesh for instances, in the meshes' own vertex and index arrays.
+	struct SceneMesh
+	{
+		UINT        FirstVertex;
+		UINT        NumVertices;
+		UINT        FirstIndex;
+		UINT        NumTriangles;
+		D3DXVECTOR3 Center;         // bounding sphere
+		float       Radius;
+	};
+
+	struct SceneMirror
+	{
+		D3DXVECTOR3 Corners[4];     // clockwise as seen from the reflecting side
+		DWORD       Material;
+		float       TextureScale;   // reflection texture size over the back buffer size
+		DWORD       UpdateInterval; // frames between reflection texture updates, at least 1
+	};
+
+	// A plane of the static geometry that planar shadows fall on.
+	struct SceneReceiver
+	{
+		D3DXPLANE Plane;            // normal points to the side that can be lit
+		DWORD     Material;         // whose range is drawn to mark the plane
+	};
+
+	struct SceneLight
+	{
+		D3DXVECTOR3 Direction;      // directional lights only
+		D3DXCOLOR   Color;
+	};
+
+	struct SceneInstance
+	{
+		DWORD       Mesh;
+		DWORD       Material;
+		D3DXVECTOR3 Position;
+	};
+
+	// The camera circles 'Target' at 'Height' above the floor.
+	struct SceneCamera
+	{
+		D3DXVECTOR3 Target;
+		float       Height;
+		float       Distance;
+		float       Angle;          // radians around the y axis
+		float       FieldOfView;    // vertical, radians
+		float       NearPlane;
+		float       FarPlane;
+	};
+
+	enum SceneChunk
+	{
+		SCENE_STRINGS,              // char
+		SCENE_MATERIALS,            // SceneMaterial
+		SCENE_STATIC_VERTICES,      // SceneVertex
+		SCENE_STATIC_INDICES,       // WORD
+		SCENE_STATIC_RANGES,        // MeshRange, Material indexes the materials
+		SCENE_MESH_VERTICES,        // MeshVertex
+		SCENE_MESH_INDICES,         // WORD
+		SCENE_MESHES,               // SceneMesh
+		SCENE_MIRRORS,              // SceneMirror
+		SCENE_RECEIVERS,            // SceneReceiver
+		SCENE_LIGHTS,               // SceneLight
+		SCENE_INSTANCES,            // SceneInstance
+		SCENE_CAMERA,               // one SceneCamera
+		SCENE_CHUNK_COUNT
+	};
+
+	struct SceneHeader
+	{
+		DWORD Magic;                // "SCN1"
+		DWORD Version;
+		DWORD Size;                 // of the whole file
+		DWORD SourceHash;           // HashSceneSource() of the text it was compiled from
+		DWORD Offsets[SCENE_CHUNK_COUNT];
+		DWORD Counts[SCENE_CHUNK_COUNT];
+	};
+
+	// A parsed scene: pointers into the file's data and element counts.
+	struct Scene
+	{
+		const char*          Strings;
+		const SceneMaterial* Materials;
+		const SceneVertex*   StaticVertices;
+		const WORD*          StaticIndices;
+		const MeshRange*     StaticRanges;
+		const MeshVertex*    MeshVertices;
+		const WORD*          MeshIndices;
+		const SceneMesh*     Meshes;
+		const SceneMirror*   Mirrors;
+		const SceneReceiver* Receivers;
+		const SceneLight*    Lights;
+		const SceneInstance* Instances;
+		const SceneCamera*   Camera;
+		UINT                 Counts[SCENE_CHUNK_COUNT];
+		DWORD                SourceHash;
+	};
+
+	// Checks the header, the chunk bounds and every index between chunks.
+	bool ParseScene(const unsigned char* data, size_t size, Scene* scene);
+
+	// Texture file name of 'material', or 0 when it has none.
+	const char* GetSceneTexture(const Scene& scene, UINT material);
+
+	// 32 bit FNV-1a of a text scene, stored in the files compiled from it.
+	DWORD HashSceneSource(const char* text, size_t size);
+
+	// Compiles a text scene.  On failure 'error' says where and why.
+	bool CompileScene(const char* text, size_t size, std::vector<unsigned char>* file, std::string* error);
+
+	// Compiles 'sourceFile' into 'sceneFile'.
+	bool ConvertScene(const char* sourceFile, const char* sceneFile, std::string* error);
+
+	// Maps 'sceneFile' into 'file', compiling 'sourceFile' first when the scene file is
+	// missing, of another version or out of date with the source.  Without a source the
+	// scene file is used as it is.
+	bool LoadScene(const char* sceneFile, const char* sourceFile, MappedFile* file, Scene* scene,
+		std::string* error);
+}
+
+#endif // __sceneFileH__
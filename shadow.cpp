@@ -0,0 +1,177 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shadow.cpp
+//
+// Desc: Planar shadow matrices with change tracking.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "shadow.h"
+#include "simdMath.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+d3d::ShadowReceiver d3d::InitShadowReceiver(const D3DXPLANE& plane, const StaticMesh* geometry, int range)
+{
+	ShadowReceiver r;
+	D3DXPlaneNormalize(&r.Plane, &plane);
+	r.Geometry = geometry;
+	r.Range = range;
+	return r;
+}
+
+void d3d::GetReceiverTextureCamera(const ShadowReceiver& receiver, const void* points, UINT count, UINT stride,
+	D3DXMATRIX* view, D3DXMATRIX* proj)
+{
+	// z into the plane, y along the world's up (or +z for a floor) as far as the plane allows
+	const D3DXPLANE& plane = receiver.Plane;
+	D3DXVECTOR3 z(-plane.a, -plane.b, -plane.c);
+	D3DXVECTOR3 up = fabsf(plane.b) > 0.9f ? D3DXVECTOR3(0.0f, 0.0f, 1.0f) : D3DXVECTOR3(0.0f, 1.0f, 0.0f);
+	D3DXVECTOR3 x, y = up - z * D3DXVec3Dot(&z, &up);
+	D3DXVec3Normalize(&y, &y);
+	D3DXVec3Cross(&x, &y, &z);
+
+	// the plane sits at view z = 1, whatever is flattened onto it lies well inside 0..2
+	*view = D3DXMATRIX(
+		x.x, y.x, z.x, 0.0f,
+		x.y, y.y, z.y, 0.0f,
+		x.z, y.z, z.z, 0.0f,
+		0.0f, 0.0f, 1.0f - plane.d, 1.0f);
+
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for (UINT i = 0; i < count; ++i)
+	{
+		const D3DXVECTOR3& p = *(const D3DXVECTOR3*)((const char*)points + i * stride);
+		float px = D3DXVec3Dot(&x, &p), py = D3DXVec3Dot(&y, &p);
+		minX = std::min(minX, px);
+		maxX = std::max(maxX, px);
+		minY = std::min(minY, py);
+		maxY = std::max(maxY, py);
+	}
+	if (count == 0 || maxX <= minX || maxY <= minY)
+	{
+		minX = minY = -1.0f;
+		maxX = maxY = 1.0f;
+	}
+	D3DXMatrixOrthoOffCenterLH(proj, minX, maxX, minY, maxY, 0.0f, 2.0f);
+}
+
+d3d::PlanarShadows::PlanarShadows() : _changes(0)
+{
+}
+
+int d3d::PlanarShadows::AddLight(const D3DXVECTOR4& light)
+{
+	Light l = { light, 1 };
+	_lights.push_back(l);
+	++_changes;
+	Resize();
+	return (int)_lights.size() - 1;
+}
+
+int d3d::PlanarShadows::AddReceiver(const ShadowReceiver& receiver)
+{
+	Receiver r = { receiver, 1, 0 };
+	_receivers.push_back(r);
+	Resize();
+	return (int)_receivers.size() - 1;
+}
+
+int d3d::PlanarShadows::AddCaster(Mesh* mesh, const D3DXMATRIX& world)
+{
+	Caster c = { mesh, world, 1 };
+	_casters.push_back(c);
+	++_changes;
+	Resize();
+	return (int)_casters.size() - 1;
+}
+
+void d3d::PlanarShadows::Resize()
+{
+	// the layout changes with every Add, so everything is recomputed on next use
+	Entry empty;
+	empty.lightVersion = empty.receiverVersion = empty.casterVersion = 0;
+	empty.casts = false;
+	_entries.assign(_lights.size() * _receivers.size() * _casters.size(), empty);
+}
+
+void d3d::PlanarShadows::SetLight(int light, const D3DXVECTOR4& value)
+{
+	Light& l = _lights[light];
+	if (memcmp(&l.light, &value, sizeof(value)) != 0)
+	{
+		l.light = value;
+		++l.version;
+		++_changes;
+	}
+}
+
+void d3d::PlanarShadows::SetReceiverPlane(int receiver, const D3DXPLANE& plane)
+{
+	Receiver& r = _receivers[receiver];
+	D3DXPLANE p;
+	D3DXPlaneNormalize(&p, &plane);
+	if (r.receiver.Plane != p)
+	{
+		r.receiver.Plane = p;
+		++r.version;
+	}
+}
+
+void d3d::PlanarShadows::SetCasterWorld(int caster, const D3DXMATRIX& world)
+{
+	Caster& c = _casters[caster];
+	if (memcmp(&c.world, &world, sizeof(world)) != 0)
+	{
+		c.world = world;
+		++c.version;
+		++_changes;
+	}
+}
+
+DWORD d3d::PlanarShadows::GetMatrixUpdates() const
+{
+	DWORD updates = 0;
+	for (size_t r = 0; r < _receivers.size(); ++r)
+		updates += _receivers[r].updates;
+	return updates;
+}
+
+const D3DXMATRIX* d3d::PlanarShadows::GetMatrix(int light, int receiver, int caster)
+{
+	const Light& l = _lights[light];
+	Receiver& r = _receivers[receiver];
+	const Caster& c = _casters[caster];
+	Entry& e = _entries[(light * _receivers.size() + receiver) * _casters.size() + caster];
+
+	if (e.lightVersion != l.version || e.receiverVersion != r.version || e.casterVersion != c.version)
+	{
+		const D3DXPLANE& plane = r.receiver.Plane;
+		D3DXVECTOR3 origin(c.world._41, c.world._42, c.world._43);
+		D3DXVECTOR3 lightPos(l.light.x, l.light.y, l.light.z);
+
+		// the light has to reach the front of the receiver, and the caster has to be there too
+		bool lit = l.light.w == 0.0f ? D3DXPlaneDotNormal(&plane, &lightPos) < 0.0f
+		                             : D3DXPlaneDotCoord(&plane, &lightPos) > 0.0f;
+		e.casts = lit && D3DXPlaneDotCoord(&plane, &origin) > 0.0f;
+
+		if (e.casts)
+		{
+			// D3DXMatrixShadow wants the direction towards a directional light
+			D3DXVECTOR4 toLight = l.light.w == 0.0f ? D3DXVECTOR4(-l.light.x, -l.light.y, -l.light.z, 0.0f)
+			                                        : l.light;
+			D3DXMATRIX S;
+			MatrixShadow(&S, toLight, plane);
+			MatrixMultiply(&e.matrix, &c.world, &S);
+			++r.updates;
+		}
+
+		e.lightVersion = l.version;
+		e.receiverVersion = r.version;
+		e.casterVersion = c.version;
+	}
+
+	return e.casts ? &e.matrix : 0;
+}
@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shadow.h
+//
+// Desc: Planar projected shadows for several lights, receiver planes and casters.  The
+//       caster world * D3DXMatrixShadow(light, receiver) matrices are kept between frames
+//       and only recomputed after the light, the receiver or the caster changed.
+//
+//       The matrices of different receivers are kept apart, so GetMatrix may be called for
+//       different receivers from different threads at once.
+//
+//       A receiver's shadows can also be rendered once into a texture laid over its plane
+//       (GetReceiverTextureCamera) and kept until GetVersion says a light or caster moved.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __shadowH__
+#define __shadowH__
+
+#include "staticMesh.h"
+#include <vector>
+
+namespace d3d
+{
+	// A flat surface shadows are projected onto, and the triangles that cover it.
+	struct ShadowReceiver
+	{
+		D3DXPLANE         Plane;        // normal points to the side that can be lit
+		const StaticMesh* Geometry;
+		int               Range;
+	};
+
+	ShadowReceiver InitShadowReceiver(const D3DXPLANE& plane, const StaticMesh* geometry, int range);
+
+	// An orthographic camera looking onto the lit side of 'receiver', its window the
+	// smallest rectangle in the plane around the 'count' points (the receiver's vertices,
+	// 'stride' bytes apart), for rendering the shadows that fall on it into a texture.  A
+	// point whose p * view * proj is (x, y) lands on that texture at (0.5 + 0.5x, 0.5 - 0.5y).
+	void GetReceiverTextureCamera(const ShadowReceiver& receiver, const void* points, UINT count, UINT stride,
+		D3DXMATRIX* view, D3DXMATRIX* proj);
+
+	class PlanarShadows
+	{
+	public:
+		PlanarShadows();
+
+		// Lights follow D3DLIGHT9: w = 0 is a directional light travelling along xyz,
+		// w = 1 a point light at xyz.
+		int AddLight(const D3DXVECTOR4& light);
+		int AddReceiver(const ShadowReceiver& receiver);
+		int AddCaster(Mesh* mesh, const D3DXMATRIX& world);
+
+		// Setting an unchanged value keeps the cached matrices.
+		void SetLight(int light, const D3DXVECTOR4& value);
+		void SetReceiverPlane(int receiver, const D3DXPLANE& plane);
+		void SetCasterWorld(int caster, const D3DXMATRIX& world);
+		// The matrices do not depend on the mesh and stay cached.
+		void SetCasterMesh(int caster, Mesh* mesh) { _casters[caster].mesh = mesh; }
+
+		int GetNumLights() const    { return (int)_lights.size(); }
+		int GetNumReceivers() const { return (int)_receivers.size(); }
+		int GetNumCasters() const   { return (int)_casters.size(); }
+
+		const D3DXVECTOR4&    GetLight(int light) const       { return _lights[light].light; }
+		const ShadowReceiver& GetReceiver(int receiver) const { return _receivers[receiver].receiver; }
+		Mesh*                 GetCaster(int caster) const     { return _casters[caster].mesh; }
+
+		// The caster's world matrix flattened onto the receiver, or 0 when this light
+		// cannot throw a shadow of it there (receiver facing away, caster behind it).
+		const D3DXMATRIX* GetMatrix(int light, int receiver, int caster);
+
+		// Number of shadow matrices computed so far.
+		DWORD GetMatrixUpdates() const;
+
+		// Changes whenever a light, a caster or the receiver changed, i.e. whenever the
+		// shadows on the receiver may have.
+		DWORD GetVersion(int receiver) const { return _changes + _receivers[receiver].version; }
+
+	private:
+		struct Light    { D3DXVECTOR4 light; DWORD version; };
+		struct Receiver { ShadowReceiver receiver; DWORD version; DWORD updates; };
+		struct Caster   { Mesh* mesh; D3DXMATRIX world; DWORD version; };
+
+		struct Entry
+		{
+			DWORD      lightVersion, receiverVersion, casterVersion;   // 0 = never computed
+			bool       casts;
+			D3DXMATRIX matrix;
+		};
+
+		void Resize();
+
+		std::vector<Light>    _lights;
+		std::vector<Receiver> _receivers;
+		std::vector<Caster>   _casters;
+		std::vector<Entry>    _entries;    // [light][receiver][caster]
+		DWORD                 _changes;    // lights and casters added or changed
+	};
+}
+
+#endif // __shadowH__
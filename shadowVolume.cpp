@@ -0,0 +1,279 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shadowVolume.cpp
+//
+// Desc: Edge adjacency, SSE face classification and silhouette extrusion.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "shadowVolume.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define SHADOW_VOLUME_SSE
+#endif
+
+namespace
+{
+	struct PositionLess
+	{
+		bool operator()(const D3DXVECTOR3& a, const D3DXVECTOR3& b) const
+		{
+			if (a.x != b.x) return a.x < b.x;
+			if (a.y != b.y) return a.y < b.y;
+			return a.z < b.z;
+		}
+	};
+
+	typedef std::pair<DWORD, DWORD> EdgeKey;
+
+	inline EdgeKey MakeEdgeKey(DWORD a, DWORD b)
+	{
+		return a < b ? EdgeKey(a, b) : EdgeKey(b, a);
+	}
+}
+
+bool d3d::CreateShadowVolume(RenderDevice* device, Mesh* mesh, ShadowVolume** volume)
+{
+	*volume = 0;
+
+	std::vector<D3DXVECTOR3> positions(mesh->GetNumVertices());
+	std::vector<DWORD> indices(mesh->GetNumFaces() * 3);
+	if (positions.empty() || indices.empty() || !mesh->GetGeometry(&positions[0], &indices[0]))
+		return false;
+
+	ShadowVolume* v = new ShadowVolume();
+
+	// weld vertices that share a position: seams and poles split them for normals and
+	// texture coordinates, but the silhouette must see one surface
+	std::map<D3DXVECTOR3, DWORD, PositionLess> welded;
+	std::vector<DWORD> remap(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		std::map<D3DXVECTOR3, DWORD, PositionLess>::iterator it = welded.find(positions[i]);
+		if (it == welded.end())
+		{
+			it = welded.insert(std::make_pair(positions[i], (DWORD)v->_positions.size())).first;
+			v->_positions.push_back(positions[i]);
+		}
+		remap[i] = it->second;
+	}
+
+	// faces that collapsed to a line or a point cast nothing
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		DWORD a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+		if (a == b || b == c || c == a)
+			continue;
+		v->_faces.push_back(a);
+		v->_faces.push_back(b);
+		v->_faces.push_back(c);
+	}
+
+	// face planes, four faces per group of 16 floats: a0..a3 b0..b3 c0..c3 d0..d3
+	int numFaces = (int)v->_faces.size() / 3;
+	int padded = (numFaces + 3) & ~3;
+	v->_planes.assign(padded * 4, 0.0f);
+	v->_lit.assign(padded, 0);
+	for (int f = 0; f < numFaces; ++f)
+	{
+		const D3DXVECTOR3& p0 = v->_positions[v->_faces[f * 3 + 0]];
+		const D3DXVECTOR3& p1 = v->_positions[v->_faces[f * 3 + 1]];
+		const D3DXVECTOR3& p2 = v->_positions[v->_faces[f * 3 + 2]];
+		D3DXPLANE plane;
+		D3DXPlaneFromPoints(&plane, &p0, &p1, &p2);
+
+		float* group = &v->_planes[(f & ~3) * 4];
+		group[0 + (f & 3)] = plane.a;
+		group[4 + (f & 3)] = plane.b;
+		group[8 + (f & 3)] = plane.c;
+		group[12 + (f & 3)] = plane.d;
+	}
+
+	// edge adjacency; an edge shared by more than two faces is split into extra edges
+	std::map<EdgeKey, int> open;
+	for (int f = 0; f < numFaces; ++f)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			DWORD a = v->_faces[f * 3 + k], b = v->_faces[f * 3 + (k + 1) % 3];
+			std::map<EdgeKey, int>::iterator it = open.find(MakeEdgeKey(a, b));
+			if (it != open.end() && v->_edges[it->second].V[0] == b)
+			{
+				v->_edges[it->second].Face[1] = f;
+				open.erase(it);
+				continue;
+			}
+
+			VolumeEdge e = { { a, b }, { f, -1 } };
+			if (it == open.end())
+				open.insert(std::make_pair(MakeEdgeKey(a, b), (int)v->_edges.size()));
+			v->_edges.push_back(e);
+		}
+	}
+
+	// worst case: every face dark (two caps) and every edge on the silhouette (two sides)
+	v->_capacity = (UINT)(numFaces * 2 + v->_edges.size() * 2) * 3;
+	if (!device->CreateVertexBuffer(v->_capacity * sizeof(D3DXVECTOR3), D3DFVF_XYZ, &v->_vb))
+	{
+		v->Release();
+		return false;
+	}
+
+	*volume = v;
+	return true;
+}
+
+d3d::ShadowVolume::ShadowVolume()
+	: _vb(0), _capacity(0), _triangles(0), _light(0.0f, 0.0f, 0.0f, 0.0f), _extrude(0.0f), _built(false),
+	  _uploaded(false)
+{
+}
+
+d3d::ShadowVolume::~ShadowVolume()
+{
+	if (_vb)
+		_vb->Release();
+}
+
+void d3d::ShadowVolume::Release()
+{
+	delete this;
+}
+
+void d3d::ShadowVolume::ClassifyFaces(const D3DXVECTOR4& toLight)
+{
+	// a face is lit when the light is in front of its plane: dot(plane, toLight) > 0
+	size_t count = _lit.size();
+	const float* p = _planes.empty() ? 0 : &_planes[0];
+
+#ifdef SHADOW_VOLUME_SSE
+	__m128 lx = _mm_set1_ps(toLight.x);
+	__m128 ly = _mm_set1_ps(toLight.y);
+	__m128 lz = _mm_set1_ps(toLight.z);
+	__m128 lw = _mm_set1_ps(toLight.w);
+	__m128 zero = _mm_setzero_ps();
+	for (size_t i = 0; i < count; i += 4, p += 16)
+	{
+		__m128 s = _mm_mul_ps(_mm_loadu_ps(p), lx);
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(p + 4), ly));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(p + 8), lz));
+		s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(p + 12), lw));
+		int mask = _mm_movemask_ps(_mm_cmpgt_ps(s, zero));
+		_lit[i + 0] = (unsigned char)(mask & 1);
+		_lit[i + 1] = (unsigned char)((mask >> 1) & 1);
+		_lit[i + 2] = (unsigned char)((mask >> 2) & 1);
+		_lit[i + 3] = (unsigned char)((mask >> 3) & 1);
+	}
+#else
+	for (size_t i = 0; i < count; i += 4, p += 16)
+	{
+		for (int k = 0; k < 4; ++k)
+		{
+			float s = p[k] * toLight.x + p[4 + k] * toLight.y + p[8 + k] * toLight.z + p[12 + k] * toLight.w;
+			_lit[i + k] = s > 0.0f;
+		}
+	}
+#endif
+}
+
+D3DXVECTOR3 d3d::ShadowVolume::Extrude(const D3DXVECTOR3& p) const
+{
+	D3DXVECTOR3 dir(_light.x, _light.y, _light.z);
+	if (_light.w != 0.0f)
+		dir = p - dir;
+	D3DXVec3Normalize(&dir, &dir);
+	return p + dir * _extrude;
+}
+
+bool d3d::ShadowVolume::Build(const D3DXVECTOR4& objectLight, float extrude)
+{
+	if (_built && _extrude == extrude &&
+		_light.x == objectLight.x && _light.y == objectLight.y &&
+		_light.z == objectLight.z && _light.w == objectLight.w)
+		return false;
+
+	_light = objectLight;
+	_extrude = extrude;
+	_built = true;
+
+	D3DXVECTOR4 toLight = objectLight.w == 0.0f ?
+		D3DXVECTOR4(-objectLight.x, -objectLight.y, -objectLight.z, 0.0f) : objectLight;
+	ClassifyFaces(toLight);
+
+	_vertices.resize(_capacity);
+	D3DXVECTOR3* out = _vertices.empty() ? 0 : &_vertices[0];
+	D3DXVECTOR3* start = out;
+
+	// caps from the faces turned away from the light: the near cap in place with its
+	// winding flipped, the far cap extruded, so both face out of the volume
+	int numFaces = (int)_faces.size() / 3;
+	for (int f = 0; f < numFaces; ++f)
+	{
+		if (_lit[f])
+			continue;
+		const D3DXVECTOR3& a = _positions[_faces[f * 3 + 0]];
+		const D3DXVECTOR3& b = _positions[_faces[f * 3 + 1]];
+		const D3DXVECTOR3& c = _positions[_faces[f * 3 + 2]];
+		*out++ = a; *out++ = c; *out++ = b;
+		*out++ = Extrude(a); *out++ = Extrude(b); *out++ = Extrude(c);
+	}
+
+	// sides along the silhouette, wound like the dark face; open edges count as lit
+	for (size_t i = 0; i < _edges.size(); ++i)
+	{
+		const VolumeEdge& e = _edges[i];
+		bool lit0 = _lit[e.Face[0]] != 0;
+		bool lit1 = e.Face[1] < 0 || _lit[e.Face[1]] != 0;
+		if (lit0 == lit1)
+			continue;
+
+		const D3DXVECTOR3& v0 = _positions[e.V[lit0 ? 1 : 0]];
+		const D3DXVECTOR3& v1 = _positions[e.V[lit0 ? 0 : 1]];
+		D3DXVECTOR3 x0 = Extrude(v0), x1 = Extrude(v1);
+		*out++ = v0; *out++ = v1; *out++ = x1;
+		*out++ = v0; *out++ = x1; *out++ = x0;
+	}
+
+	_triangles = (DWORD)(out - start) / 3;
+	_uploaded = false;
+	return true;
+}
+
+void d3d::ShadowVolume::Upload()
+{
+	if (_uploaded)
+		return;
+	_uploaded = true;
+
+	D3DXVECTOR3* out = 0;
+	if (_triangles == 0)
+		return;
+	if (!_vb->Lock(0, 0, (void**)&out, 0))
+	{
+		_triangles = 0;
+		return;
+	}
+	memcpy(out, &_vertices[0], _triangles * 3 * sizeof(D3DXVECTOR3));
+	_vb->Unlock();
+}
+
+bool d3d::ShadowVolume::Update(const D3DXVECTOR4& objectLight, float extrude)
+{
+	if (!Build(objectLight, extrude))
+		return false;
+	Upload();
+	return true;
+}
+
+void d3d::ShadowVolume::Draw(RenderDevice* device)
+{
+	if (_triangles == 0)
+		return;
+	device->SetStreamSource(0, _vb, 0, sizeof(D3DXVECTOR3));
+	device->SetFVF(D3DFVF_XYZ);
+	device->DrawPrimitive(D3DPT_TRIANGLELIST, 0, _triangles);
+}
@@ -0,0 +1,84 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shadowVolume.h
+//
+// Desc: Stencil shadow volumes for closed or open triangle meshes.  The mesh is welded and
+//       its edge adjacency built once when the volume is created; after that each light
+//       change classifies the faces (four at a time with SSE), walks the edge list for the
+//       silhouette and extrudes it, with both caps, for z-fail (Carmack's reverse) stencil
+//       counting.  The volume is rebuilt only when the light moves relative to the mesh.
+//
+//       Build() only touches the volume's own memory and may run on any thread; Upload()
+//       copies the result into the vertex buffer and belongs on the render thread.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __shadowVolumeH__
+#define __shadowVolumeH__
+
+#include "renderDevice.h"
+#include <vector>
+
+namespace d3d
+{
+	// An edge of the welded mesh.  V is ordered as in Face[0]; Face[1] is -1 on an open edge.
+	struct VolumeEdge
+	{
+		DWORD V[2];
+		int   Face[2];
+	};
+
+	class ShadowVolume
+	{
+	public:
+		// 'objectLight' is in the mesh's object space and follows D3DLIGHT9: w = 0 is a
+		// directional light travelling along xyz, w = 1 a point light at xyz.  The silhouette
+		// is pushed 'extrude' units away from the light; keep the far cap inside the far plane.
+		// Returns false when nothing changed since the last call.
+		bool Build(const D3DXVECTOR4& objectLight, float extrude);
+
+		// Writes what Build made into the vertex buffer, if it has not been written yet.
+		void Upload();
+
+		// Build followed by Upload.
+		bool Update(const D3DXVECTOR4& objectLight, float extrude);
+
+		// Draws the volume with the current world transform, which should be the mesh's.
+		void Draw(RenderDevice* device);
+
+		DWORD GetTriangleCount() const { return _triangles; }
+		DWORD GetNumEdges() const      { return (DWORD)_edges.size(); }
+
+		void Release();
+
+	private:
+		friend bool CreateShadowVolume(RenderDevice* device, Mesh* mesh, ShadowVolume** volume);
+
+		ShadowVolume();
+		~ShadowVolume();
+
+		void ClassifyFaces(const D3DXVECTOR4& toLight);
+		D3DXVECTOR3 Extrude(const D3DXVECTOR3& p) const;
+
+		std::vector<D3DXVECTOR3>   _positions;    // welded
+		std::vector<DWORD>         _faces;        // three welded indices per face
+		std::vector<float>         _planes;       // a, b, c, d of four faces at a time
+		std::vector<VolumeEdge>    _edges;
+		std::vector<unsigned char> _lit;          // per face, padded to a multiple of four
+		std::vector<D3DXVECTOR3>   _vertices;     // built, waiting for Upload
+
+		VertexBuffer* _vb;
+		UINT          _capacity;                  // in vertices
+		DWORD         _triangles;
+
+		D3DXVECTOR4   _light;
+		float         _extrude;
+		bool          _built;
+		bool          _uploaded;
+	};
+
+	// Welds 'mesh' and builds the edge adjacency.  Fails if the mesh cannot be read back.
+	bool CreateShadowVolume(RenderDevice* device, Mesh* mesh, ShadowVolume** volume);
+}
+
+#endif // __shadowVolumeH__
@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simdMath.cpp
+//
+// Desc: SSE and scalar matrix routines.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simdMath.h"
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define SIMD_MATH_SSE
+#endif
+
+namespace
+{
+#ifdef SIMD_MATH_SSE
+	// One row of a * b, given the rows of b.
+	inline __m128 MultiplyRow(const float* a, __m128 b0, __m128 b1, __m128 b2, __m128 b3)
+	{
+		__m128 r = _mm_mul_ps(_mm_set1_ps(a[0]), b0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[2]), b2));
+		return _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(a[3]), b3));
+	}
+
+	inline void Multiply(float* out, const float* a, __m128 b0, __m128 b1, __m128 b2, __m128 b3)
+	{
+		// every row of 'a' is read before its output row is written, so out == a works
+		__m128 r0 = MultiplyRow(a + 0, b0, b1, b2, b3);
+		__m128 r1 = MultiplyRow(a + 4, b0, b1, b2, b3);
+		__m128 r2 = MultiplyRow(a + 8, b0, b1, b2, b3);
+		__m128 r3 = MultiplyRow(a + 12, b0, b1, b2, b3);
+		_mm_storeu_ps(out + 0, r0);
+		_mm_storeu_ps(out + 4, r1);
+		_mm_storeu_ps(out + 8, r2);
+		_mm_storeu_ps(out + 12, r3);
+	}
+#else
+	inline void Multiply(float* out, const float* a, const float* b)
+	{
+		float r[16];
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				r[i * 4 + j] =
+					a[i * 4 + 0] * b[0 + j] +
+					a[i * 4 + 1] * b[4 + j] +
+					a[i * 4 + 2] * b[8 + j] +
+					a[i * 4 + 3] * b[12 + j];
+			}
+		}
+		for (int i = 0; i < 16; ++i)
+			out[i] = r[i];
+	}
+#endif
+
+	inline const float* Floats(const D3DXMATRIX* m) { return &m->_11; }
+	inline float*       Floats(D3DXMATRIX* m)       { return &m->_11; }
+
+	inline D3DXVECTOR3 Cross(const D3DXVECTOR3& a, const D3DXVECTOR3& b)
+	{
+		return D3DXVECTOR3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+	}
+
+	inline float Dot(const D3DXVECTOR3& a, const D3DXVECTOR3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	inline D3DXVECTOR3 Normalize(const D3DXVECTOR3& v)
+	{
+		float len = sqrtf(Dot(v, v));
+		float inv = len > 0.0f ? 1.0f / len : 0.0f;
+		return D3DXVECTOR3(v.x * inv, v.y * inv, v.z * inv);
+	}
+
+	inline D3DXPLANE NormalizePlane(const D3DXPLANE& p)
+	{
+		float len = sqrtf(p.a * p.a + p.b * p.b + p.c * p.c);
+		float inv = len > 0.0f ? 1.0f / len : 0.0f;
+		return D3DXPLANE(p.a * inv, p.b * inv, p.c * inv, p.d * inv);
+	}
+
+	inline void Set(D3DXMATRIX* out,
+		float m11, float m12, float m13, float m14,
+		float m21, float m22, float m23, float m24,
+		float m31, float m32, float m33, float m34,
+		float m41, float m42, float m43, float m44)
+	{
+		out->_11 = m11; out->_12 = m12; out->_13 = m13; out->_14 = m14;
+		out->_21 = m21; out->_22 = m22; out->_23 = m23; out->_24 = m24;
+		out->_31 = m31; out->_32 = m32; out->_33 = m33; out->_34 = m34;
+		out->_41 = m41; out->_42 = m42; out->_43 = m43; out->_44 = m44;
+	}
+}
+
+void d3d::MatrixMultiply(D3DXMATRIX* out, const D3DXMATRIX* a, const D3DXMATRIX* b)
+{
+#ifdef SIMD_MATH_SSE
+	const float* pb = Floats(b);
+	Multiply(Floats(out), Floats(a),
+		_mm_loadu_ps(pb), _mm_loadu_ps(pb + 4), _mm_loadu_ps(pb + 8), _mm_loadu_ps(pb + 12));
+#else
+	Multiply(Floats(out), Floats(a), Floats(b));
+#endif
+}
+
+void d3d::MatrixMultiplyArray(D3DXMATRIX* out, const D3DXMATRIX* in, const D3DXMATRIX* m, UINT count)
+{
+#ifdef SIMD_MATH_SSE
+	// the right hand side stays in registers for the whole batch
+	const float* pm = Floats(m);
+	__m128 m0 = _mm_loadu_ps(pm), m1 = _mm_loadu_ps(pm + 4);
+	__m128 m2 = _mm_loadu_ps(pm + 8), m3 = _mm_loadu_ps(pm + 12);
+	for (UINT i = 0; i < count; ++i)
+		Multiply(Floats(out + i), Floats(in + i), m0, m1, m2, m3);
+#else
+	D3DXMATRIX r = *m;
+	for (UINT i = 0; i < count; ++i)
+		Multiply(Floats(out + i), Floats(in + i), Floats(&r));
+#endif
+}
+
+void d3d::MatrixPremultiplyArray(D3DXMATRIX* out, const D3DXMATRIX* m, const D3DXMATRIX* in, UINT count)
+{
+	D3DXMATRIX left = *m;   // 'out' may overlap 'm'
+	for (UINT i = 0; i < count; ++i)
+		MatrixMultiply(out + i, &left, in + i);
+}
+
+void d3d::TransformCoordArray(D3DXVECTOR3* out, UINT outStride, const D3DXVECTOR3* in, UINT inStride,
+	const D3DXMATRIX* m, UINT count)
+{
+	const unsigned char* src = (const unsigned char*)in;
+	unsigned char* dst = (unsigned char*)out;
+
+#ifdef SIMD_MATH_SSE
+	const float* pm = Floats(m);
+	__m128 m0 = _mm_loadu_ps(pm), m1 = _mm_loadu_ps(pm + 4);
+	__m128 m2 = _mm_loadu_ps(pm + 8), m3 = _mm_loadu_ps(pm + 12);
+	for (UINT i = 0; i < count; ++i, src += inStride, dst += outStride)
+	{
+		const float* p = (const float*)src;
+		__m128 r = _mm_mul_ps(_mm_set1_ps(p[0]), m0);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p[1]), m1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(p[2]), m2));
+		r = _mm_add_ps(r, m3);
+
+		float v[4];
+		_mm_storeu_ps(v, r);
+		float inv = v[3] != 0.0f ? 1.0f / v[3] : 0.0f;
+		float* q = (float*)dst;
+		q[0] = v[0] * inv;
+		q[1] = v[1] * inv;
+		q[2] = v[2] * inv;
+	}
+#else
+	for (UINT i = 0; i < count; ++i, src += inStride, dst += outStride)
+	{
+		const float* p = (const float*)src;
+		float v[4];
+		for (int j = 0; j < 4; ++j)
+			v[j] = p[0] * m->m[0][j] + p[1] * m->m[1][j] + p[2] * m->m[2][j] + m->m[3][j];
+		float inv = v[3] != 0.0f ? 1.0f / v[3] : 0.0f;
+		float* q = (float*)dst;
+		q[0] = v[0] * inv;
+		q[1] = v[1] * inv;
+		q[2] = v[2] * inv;
+	}
+#endif
+}
+
+void d3d::MatrixTranslation(D3DXMATRIX* out, float x, float y, float z)
+{
+	Set(out,
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f,
+		x,    y,    z,    1.0f);
+}
+
+void d3d::MatrixLookAtLH(D3DXMATRIX* out, const D3DXVECTOR3& eye, const D3DXVECTOR3& at, const D3DXVECTOR3& up)
+{
+	D3DXVECTOR3 zaxis = Normalize(at - eye);
+	D3DXVECTOR3 xaxis = Normalize(Cross(up, zaxis));
+	D3DXVECTOR3 yaxis = Cross(zaxis, xaxis);
+
+	Set(out,
+		xaxis.x, yaxis.x, zaxis.x, 0.0f,
+		xaxis.y, yaxis.y, zaxis.y, 0.0f,
+		xaxis.z, yaxis.z, zaxis.z, 0.0f,
+		-Dot(xaxis, eye), -Dot(yaxis, eye), -Dot(zaxis, eye), 1.0f);
+}
+
+void d3d::MatrixPerspectiveFovLH(D3DXMATRIX* out, float fovy, float aspect, float zn, float zf)
+{
+	float yScale = 1.0f / tanf(fovy * 0.5f);
+	float xScale = yScale / aspect;
+
+	Set(out,
+		xScale, 0.0f,   0.0f,                 0.0f,
+		0.0f,   yScale, 0.0f,                 0.0f,
+		0.0f,   0.0f,   zf / (zf - zn),       1.0f,
+		0.0f,   0.0f,   -zn * zf / (zf - zn), 0.0f);
+}
+
+void d3d::MatrixReflect(D3DXMATRIX* out, const D3DXPLANE& plane)
+{
+	D3DXPLANE p = NormalizePlane(plane);
+
+	Set(out,
+		-2.0f * p.a * p.a + 1.0f, -2.0f * p.b * p.a,        -2.0f * p.c * p.a,        0.0f,
+		-2.0f * p.a * p.b,        -2.0f * p.b * p.b + 1.0f, -2.0f * p.c * p.b,        0.0f,
+		-2.0f * p.a * p.c,        -2.0f * p.b * p.c,        -2.0f * p.c * p.c + 1.0f, 0.0f,
+		-2.0f * p.a * p.d,        -2.0f * p.b * p.d,        -2.0f * p.c * p.d,        1.0f);
+}
+
+void d3d::MatrixShadow(D3DXMATRIX* out, const D3DXVECTOR4& l, const D3DXPLANE& plane)
+{
+	D3DXPLANE p = NormalizePlane(plane);
+	float d = p.a * l.x + p.b * l.y + p.c * l.z + p.d * l.w;
+
+	Set(out,
+		-p.a * l.x + d, -p.a * l.y,     -p.a * l.z,     -p.a * l.w,
+		-p.b * l.x,     -p.b * l.y + d, -p.b * l.z,     -p.b * l.w,
+		-p.c * l.x,     -p.c * l.y,     -p.c * l.z + d, -p.c * l.w,
+		-p.d * l.x,     -p.d * l.y,     -p.d * l.z,     -p.d * l.w + d);
+}
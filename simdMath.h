@@ -0,0 +1,44 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simdMath.h
+//
+// Desc: Matrix and vector routines for the per-frame paths, with SSE where the target has
+//       it and plain C++ elsewhere.  They work on the D3DX types but do not call D3DX, so
+//       the Windows and the software builds run the same code.  Sums are evaluated in the
+//       same order as D3DXMatrixMultiply, so results match D3DX to the last bit or two.
+//
+//       Matrices are row-major with row vectors (v' = v * M), as in Direct3D.  Nothing
+//       needs to be 16 byte aligned.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simdMathH__
+#define __simdMathH__
+
+#include "renderDevice.h"
+
+namespace d3d
+{
+	// out = a * b.  'out' may be 'a' or 'b'.
+	void MatrixMultiply(D3DXMATRIX* out, const D3DXMATRIX* a, const D3DXMATRIX* b);
+
+	// out[i] = in[i] * m for 'count' matrices, e.g. every world matrix of a scene times
+	// one reflection.  'out' may be 'in'.
+	void MatrixMultiplyArray(D3DXMATRIX* out, const D3DXMATRIX* in, const D3DXMATRIX* m, UINT count);
+
+	// out[i] = m * in[i], e.g. one parent transform applied to many children.
+	void MatrixPremultiplyArray(D3DXMATRIX* out, const D3DXMATRIX* m, const D3DXMATRIX* in, UINT count);
+
+	// Points (w = 1) through 'm' with the divide by w; strides are in bytes so positions
+	// can be read from and written to vertex buffers directly.
+	void TransformCoordArray(D3DXVECTOR3* out, UINT outStride, const D3DXVECTOR3* in, UINT inStride,
+		const D3DXMATRIX* m, UINT count);
+
+	void MatrixTranslation(D3DXMATRIX* out, float x, float y, float z);
+	void MatrixLookAtLH(D3DXMATRIX* out, const D3DXVECTOR3& eye, const D3DXVECTOR3& at, const D3DXVECTOR3& up);
+	void MatrixPerspectiveFovLH(D3DXMATRIX* out, float fovy, float aspect, float zn, float zf);
+	void MatrixReflect(D3DXMATRIX* out, const D3DXPLANE& plane);
+	void MatrixShadow(D3DXMATRIX* out, const D3DXVECTOR4& light, const D3DXPLANE& plane);
+}
+
+#endif // __simdMathH__
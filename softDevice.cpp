@@ -0,0 +1,1311 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softDevice.cpp
+//
+// Desc: Headless tile based CPU rasterizer implementing RenderDevice.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "softDevice.h"
+#include "dds.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	//
+	// Resources
+	//
+
+	struct MipLevel
+	{
+		int    width, height;
+		size_t offset;
+	};
+
+	class SoftTexture : public d3d::Texture
+	{
+	public:
+		SoftTexture(int width, int height, int numLevels = 1, D3DFORMAT format = D3DFMT_A8R8G8B8)
+			: format(format)
+		{
+			size_t size = 0;
+			for (int i = 0; i < numLevels; ++i)
+			{
+				MipLevel level = { width, height, size };
+				levels.push_back(level);
+				size += (size_t)width * height;
+				width = std::max(1, width / 2);
+				height = std::max(1, height / 2);
+			}
+			texels.resize(size);
+		}
+
+		bool WriteRows(UINT first, UINT rows, const DWORD* data)
+		{
+			const MipLevel& top = levels[0];
+			if (first + rows > (UINT)top.height)
+				return false;
+			memcpy(&texels[(size_t)first * top.width], data, (size_t)rows * top.width * sizeof(DWORD));
+			return true;
+		}
+		void GenerateMips() { BuildMips(); }
+
+		// Compressed levels are expanded; the rasterizer samples A8R8G8B8 only.
+		bool WriteLevel(UINT level, const void* data)
+		{
+			if (level >= levels.size())
+				return false;
+			const MipLevel& l = levels[level];
+			d3d::DecodeLevel(format, (const unsigned char*)data, l.width, l.height, &texels[l.offset]);
+			return true;
+		}
+		void Release() { delete this; }
+
+		// Builds the box filtered mip chain below level 0.
+		void BuildMips()
+		{
+			int w = levels[0].width;
+			int h = levels[0].height;
+			levels.resize(1);
+			texels.resize((size_t)w * h);
+			while (w > 1 || h > 1)
+			{
+				const MipLevel src = levels.back();
+				MipLevel dst;
+				dst.width  = std::max(1, w / 2);
+				dst.height = std::max(1, h / 2);
+				dst.offset = texels.size();
+				texels.resize(texels.size() + dst.width * dst.height);
+				d3d::HalveTexels(&texels[src.offset], src.width, src.height, &texels[dst.offset]);
+
+				levels.push_back(dst);
+				w = dst.width;
+				h = dst.height;
+			}
+		}
+
+		D3DFORMAT             format; // what WriteLevel gets
+		std::vector<MipLevel> levels;
+		std::vector<DWORD>    texels; // A8R8G8B8, all levels back to back
+		std::vector<DWORD>    depth;  // depth << 8 | stencil; render targets only
+	};
+
+	class SoftVertexBuffer : public d3d::VertexBuffer
+	{
+	public:
+		SoftVertexBuffer(UINT length, DWORD fvf) : data(length), fvf(fvf) {}
+
+		// size 0 locks the rest of the buffer, as in D3D9; the flags only matter to a GPU
+		bool Lock(UINT offset, UINT size, void** ptr, DWORD)
+		{
+			if (offset >= data.size() || size > data.size() - offset)
+				return false;
+			*ptr = &data[offset];
+			return true;
+		}
+		void Unlock() {}
+		void Release() { delete this; }
+
+		std::vector<unsigned char> data;
+		DWORD fvf;
+	};
+
+	class SoftIndexBuffer : public d3d::IndexBuffer
+	{
+	public:
+		SoftIndexBuffer(UINT length) : data(length / sizeof(WORD)) {}
+
+		bool Lock(UINT offset, UINT size, void** ptr, DWORD)
+		{
+			UINT length = (UINT)(data.size() * sizeof(WORD));
+			if (offset >= length || size > length - offset)
+				return false;
+			*ptr = (unsigned char*)&data[0] + offset;
+			return true;
+		}
+		void Unlock() {}
+		void Release() { delete this; }
+
+		std::vector<WORD> data;
+	};
+
+	class SoftStateBlock : public d3d::StateBlock
+	{
+	public:
+		SoftStateBlock(const d3d::PassDesc& desc) : desc(desc) { desc.GetRenderStates(values); }
+
+		const d3d::PassDesc& GetDesc() const { return desc; }
+		void Release() { delete this; }
+
+		d3d::PassDesc desc;
+		DWORD         values[d3d::PASS_STATE_COUNT];
+	};
+
+	class SoftMesh : public d3d::Mesh
+	{
+	public:
+		SoftMesh(d3d::SoftwareDevice* device) : device(device) {}
+
+		void DrawSubset(DWORD attribId)
+		{
+			if (attribId == 0 && !indices.empty())
+			{
+				device->DrawIndexedTriangles(&vertices[0], sizeof(d3d::MeshVertex),
+					D3DFVF_XYZ | D3DFVF_NORMAL, (UINT)vertices.size(),
+					&indices[0], (UINT)indices.size() / 3);
+			}
+		}
+		DWORD GetNumFaces() const { return (DWORD)indices.size() / 3; }
+		DWORD GetNumVertices() const { return (DWORD)vertices.size(); }
+		bool  GetGeometry(D3DXVECTOR3* positions, DWORD* out) const
+		{
+			for (size_t i = 0; i < vertices.size(); ++i)
+				positions[i] = D3DXVECTOR3(vertices[i].x, vertices[i].y, vertices[i].z);
+			for (size_t i = 0; i < indices.size(); ++i)
+				out[i] = indices[i];
+			return true;
+		}
+		void  Release() { delete this; }
+
+		d3d::SoftwareDevice*         device;
+		std::vector<d3d::MeshVertex> vertices;
+		std::vector<WORD>            indices;
+	};
+
+	//
+	// Pixel pipeline helpers
+	//
+
+	inline bool Compare(DWORD func, unsigned a, unsigned b)
+	{
+		switch (func)
+		{
+		case D3DCMP_NEVER:        return false;
+		case D3DCMP_LESS:         return a <  b;
+		case D3DCMP_EQUAL:        return a == b;
+		case D3DCMP_LESSEQUAL:    return a <= b;
+		case D3DCMP_GREATER:      return a >  b;
+		case D3DCMP_NOTEQUAL:     return a != b;
+		case D3DCMP_GREATEREQUAL: return a >= b;
+		default:                  return true;
+		}
+	}
+
+	inline unsigned StencilOp(DWORD op, unsigned s, unsigned ref)
+	{
+		switch (op)
+		{
+		case D3DSTENCILOP_ZERO:    return 0;
+		case D3DSTENCILOP_REPLACE: return ref & 0xff;
+		case D3DSTENCILOP_INCRSAT: return s < 0xff ? s + 1 : 0xff;
+		case D3DSTENCILOP_DECRSAT: return s > 0 ? s - 1 : 0;
+		case D3DSTENCILOP_INVERT:  return ~s & 0xff;
+		case D3DSTENCILOP_INCR:    return (s + 1) & 0xff;
+		case D3DSTENCILOP_DECR:    return (s - 1) & 0xff;
+		default:                   return s;
+		}
+	}
+
+	inline void BlendFactor(DWORD blend, const float* src, const float* dst, float* f)
+	{
+		switch (blend)
+		{
+		case D3DBLEND_ZERO:         f[0] = f[1] = f[2] = f[3] = 0.0f; break;
+		case D3DBLEND_SRCCOLOR:     f[0] = src[0]; f[1] = src[1]; f[2] = src[2]; f[3] = src[3]; break;
+		case D3DBLEND_INVSRCCOLOR:  f[0] = 1 - src[0]; f[1] = 1 - src[1]; f[2] = 1 - src[2]; f[3] = 1 - src[3]; break;
+		case D3DBLEND_SRCALPHA:     f[0] = f[1] = f[2] = f[3] = src[3]; break;
+		case D3DBLEND_INVSRCALPHA:  f[0] = f[1] = f[2] = f[3] = 1 - src[3]; break;
+		case D3DBLEND_DESTALPHA:    f[0] = f[1] = f[2] = f[3] = dst[3]; break;
+		case D3DBLEND_INVDESTALPHA: f[0] = f[1] = f[2] = f[3] = 1 - dst[3]; break;
+		case D3DBLEND_DESTCOLOR:    f[0] = dst[0]; f[1] = dst[1]; f[2] = dst[2]; f[3] = dst[3]; break;
+		case D3DBLEND_INVDESTCOLOR: f[0] = 1 - dst[0]; f[1] = 1 - dst[1]; f[2] = 1 - dst[2]; f[3] = 1 - dst[3]; break;
+		default:                    f[0] = f[1] = f[2] = f[3] = 1.0f; break;
+		}
+	}
+
+	inline float Saturate(float f)
+	{
+		return f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+	}
+
+	// 24 bit depth.  1.0f * 16777215.0f + 0.5f rounds up to 2^24 in float, so clamp.
+	inline DWORD ToDepth24(float z)
+	{
+		DWORD depth = (DWORD)(Saturate(z) * 16777215.0f + 0.5f);
+		return depth > 0xffffff ? 0xffffff : depth;
+	}
+
+	inline void Unpack(DWORD c, float* out)
+	{
+		const float k = 1.0f / 255.0f;
+		out[0] = ((c >> 16) & 0xff) * k;
+		out[1] = ((c >> 8) & 0xff) * k;
+		out[2] = (c & 0xff) * k;
+		out[3] = (c >> 24) * k;
+	}
+
+	inline DWORD Pack(const float* c)
+	{
+		return D3DCOLOR_ARGB(
+			(int)(Saturate(c[3]) * 255.0f + 0.5f),
+			(int)(Saturate(c[0]) * 255.0f + 0.5f),
+			(int)(Saturate(c[1]) * 255.0f + 0.5f),
+			(int)(Saturate(c[2]) * 255.0f + 0.5f));
+	}
+
+	// log2 accurate to a few percent, good enough for picking mip levels
+	inline float FastLog2(float x)
+	{
+		union { float f; unsigned i; } u;
+		u.f = x;
+		float e = (float)((int)((u.i >> 23) & 0xff) - 128);
+		u.i = (u.i & 0x007fffff) | 0x3f800000;
+		return e + (-0.34484843f * u.f + 2.02466578f) * u.f - 0.67487759f + 1.0f;
+	}
+
+	void SampleBilinear(const SoftTexture* tex, int level, float u, float v, bool linear, float* out)
+	{
+		const MipLevel& l = tex->levels[level];
+		const DWORD* texels = &tex->texels[l.offset];
+
+		if (!linear)
+		{
+			int x = (int)floorf(u * l.width) % l.width;
+			int y = (int)floorf(v * l.height) % l.height;
+			if (x < 0) x += l.width;
+			if (y < 0) y += l.height;
+			Unpack(texels[y * l.width + x], out);
+			return;
+		}
+
+		float fx = u * l.width - 0.5f;
+		float fy = v * l.height - 0.5f;
+		float x0f = floorf(fx), y0f = floorf(fy);
+		float ax = fx - x0f, ay = fy - y0f;
+		int x0 = (int)x0f % l.width, y0 = (int)y0f % l.height;
+		if (x0 < 0) x0 += l.width;
+		if (y0 < 0) y0 += l.height;
+		int x1 = x0 + 1 == l.width ? 0 : x0 + 1;
+		int y1 = y0 + 1 == l.height ? 0 : y0 + 1;
+
+		float c00[4], c10[4], c01[4], c11[4];
+		Unpack(texels[y0 * l.width + x0], c00);
+		Unpack(texels[y0 * l.width + x1], c10);
+		Unpack(texels[y1 * l.width + x0], c01);
+		Unpack(texels[y1 * l.width + x1], c11);
+		for (int i = 0; i < 4; ++i)
+		{
+			float top = c00[i] + (c10[i] - c00[i]) * ax;
+			float bottom = c01[i] + (c11[i] - c01[i]) * ax;
+			out[i] = top + (bottom - top) * ay;
+		}
+	}
+
+	void Sample(const SoftTexture* tex, const d3d::SoftwareDevice::RasterState& st,
+		float u, float v, float lod, float* out)
+	{
+		int maxLevel = (int)tex->levels.size() - 1;
+		if (lod <= 0.0f || st.mipFilter == D3DTEXF_NONE || maxLevel == 0)
+		{
+			bool linear = (lod <= 0.0f ? st.magFilter : st.minFilter) == D3DTEXF_LINEAR;
+			SampleBilinear(tex, 0, u, v, linear, out);
+			return;
+		}
+
+		bool linear = st.minFilter == D3DTEXF_LINEAR;
+		if (lod >= (float)maxLevel)
+		{
+			SampleBilinear(tex, maxLevel, u, v, linear, out);
+			return;
+		}
+
+		if (st.mipFilter != D3DTEXF_LINEAR)
+		{
+			SampleBilinear(tex, (int)(lod + 0.5f), u, v, linear, out);
+			return;
+		}
+
+		int level = (int)lod;
+		float t = lod - level;
+		float a[4], b[4];
+		SampleBilinear(tex, level, u, v, linear, a);
+		SampleBilinear(tex, level + 1, u, v, linear, b);
+		for (int i = 0; i < 4; ++i)
+			out[i] = a[i] + (b[i] - a[i]) * t;
+	}
+
+	inline int FloorDiv16(int v)
+	{
+		return v >= 0 ? v >> 4 : -((-v + 15) >> 4);
+	}
+
+	D3DMATRIX IdentityMatrix()
+	{
+		D3DMATRIX m;
+		memset(&m, 0, sizeof(m));
+		m._11 = m._22 = m._33 = m._44 = 1.0f;
+		return m;
+	}
+
+	const float GuardBand = 4.0f;
+	const int   NumClipPlanes = 6;
+	const float ClipPlanes[NumClipPlanes][4] = {
+		{ 0.0f,  0.0f,  1.0f, 0.0f },      // near:  z >= 0
+		{ 0.0f,  0.0f, -1.0f, 1.0f },      // far:   z <= w
+		{ 1.0f,  0.0f,  0.0f, GuardBand }, // guard band keeps the fixed point maths in range
+		{-1.0f,  0.0f,  0.0f, GuardBand },
+		{ 0.0f,  1.0f,  0.0f, GuardBand },
+		{ 0.0f, -1.0f,  0.0f, GuardBand } };
+
+	inline float PlaneDistance(const float* p, const d3d::SoftwareDevice::ClipVertex& v)
+	{
+		return p[0] * v.x + p[1] * v.y + p[2] * v.z + p[3] * v.w;
+	}
+
+	// plane NumClipPlanes is the user clip plane
+	inline float ClipDistance(int plane, const d3d::SoftwareDevice::ClipVertex& v)
+	{
+		return plane < NumClipPlanes ? PlaneDistance(ClipPlanes[plane], v) : v.clip;
+	}
+
+	d3d::SoftwareDevice::ClipVertex Lerp(const d3d::SoftwareDevice::ClipVertex& a,
+		const d3d::SoftwareDevice::ClipVertex& b, float t)
+	{
+		d3d::SoftwareDevice::ClipVertex r;
+		r.x = a.x + (b.x - a.x) * t;
+		r.y = a.y + (b.y - a.y) * t;
+		r.z = a.z + (b.z - a.z) * t;
+		r.w = a.w + (b.w - a.w) * t;
+		r.clip = a.clip + (b.clip - a.clip) * t;
+		for (int i = 0; i < 9; ++i)
+			r.attr[i] = a.attr[i] + (b.attr[i] - a.attr[i]) * t;
+		return r;
+	}
+}
+
+//
+// SoftwareDevice
+//
+
+d3d::SoftwareDevice::SoftwareDevice(int width, int height, int threads)
+	: _width(width), _height(height),
+	_tilesX((width + TileSize - 1) / TileSize), _tilesY((height + TileSize - 1) / TileSize),
+	_backWidth(width), _backHeight(height),
+	_color(width * height, 0), _depth(width * height, 0xffffff00),
+	_colorTarget(&_color[0]), _depthTarget(&_depth[0]),
+	_pool(threads),
+	_texture(0), _stream(0), _streamOffset(0), _streamStride(0), _fvf(0), _indices(0), _stateDirty(true),
+	_userClip(false), _bins(_tilesX * _tilesY)
+{
+	memset(_clipPlane, 0, sizeof(_clipPlane));
+	memset(_renderStates, 0, sizeof(_renderStates));
+	_renderStates[D3DRS_ZENABLE]          = D3DZB_TRUE;
+	_renderStates[D3DRS_ZWRITEENABLE]     = true;
+	_renderStates[D3DRS_ZFUNC]            = D3DCMP_LESSEQUAL;
+	_renderStates[D3DRS_SRCBLEND]         = D3DBLEND_ONE;
+	_renderStates[D3DRS_DESTBLEND]        = D3DBLEND_ZERO;
+	_renderStates[D3DRS_CULLMODE]         = D3DCULL_CCW;
+	_renderStates[D3DRS_STENCILFAIL]      = D3DSTENCILOP_KEEP;
+	_renderStates[D3DRS_STENCILZFAIL]     = D3DSTENCILOP_KEEP;
+	_renderStates[D3DRS_STENCILPASS]      = D3DSTENCILOP_KEEP;
+	_renderStates[D3DRS_STENCILFUNC]      = D3DCMP_ALWAYS;
+	_renderStates[D3DRS_STENCILMASK]      = 0xffffffff;
+	_renderStates[D3DRS_STENCILWRITEMASK] = 0xffffffff;
+	_renderStates[D3DRS_LIGHTING]         = true;
+	_renderStates[D3DRS_LOCALVIEWER]      = true;
+	_renderStates[D3DRS_COLORWRITEENABLE] = 0xf;
+
+	memset(_samplerStates, 0, sizeof(_samplerStates));
+	_samplerStates[D3DSAMP_MINFILTER] = D3DTEXF_POINT;
+	_samplerStates[D3DSAMP_MAGFILTER] = D3DTEXF_POINT;
+	_samplerStates[D3DSAMP_MIPFILTER] = D3DTEXF_NONE;
+
+	memset(&_material, 0, sizeof(_material));
+	memset(_lights, 0, sizeof(_lights));
+	memset(_lightEnabled, 0, sizeof(_lightEnabled));
+	_world = _view = _proj = IdentityMatrix();
+}
+
+d3d::SoftwareDevice::~SoftwareDevice()
+{
+}
+
+void d3d::SoftwareDevice::Release()
+{
+	delete this;
+}
+
+bool d3d::SoftwareDevice::CreateVertexBuffer(UINT length, DWORD fvf, VertexBuffer** vb)
+{
+	*vb = new SoftVertexBuffer(length, fvf);
+	return true;
+}
+
+bool d3d::SoftwareDevice::CreateIndexBuffer(UINT length, IndexBuffer** ib)
+{
+	*ib = new SoftIndexBuffer(length);
+	return true;
+}
+
+bool d3d::SoftwareDevice::CreateTexture(UINT width, UINT height, Texture** tex)
+{
+	if (width == 0 || height == 0)
+	{
+		*tex = 0;
+		return false;
+	}
+	*tex = new SoftTexture((int)width, (int)height);
+	return true;
+}
+
+bool d3d::SoftwareDevice::CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels,
+	Texture** tex)
+{
+	bool known = format == D3DFMT_A8R8G8B8 || format == D3DFMT_X8R8G8B8 ||
+		format == D3DFMT_DXT1 || format == D3DFMT_DXT5;
+	if (!known || width == 0 || height == 0 || levels == 0)
+	{
+		*tex = 0;
+		return false;
+	}
+	*tex = new SoftTexture((int)width, (int)height, (int)levels, format);
+	return true;
+}
+
+bool d3d::SoftwareDevice::CreateRenderTarget(UINT width, UINT height, Texture** tex)
+{
+	if (width == 0 || height == 0)
+	{
+		*tex = 0;
+		return false;
+	}
+	SoftTexture* target = new SoftTexture((int)width, (int)height);
+	target->depth.assign(target->texels.size(), 0xffffff00);
+	*tex = target;
+	return true;
+}
+
+bool d3d::SoftwareDevice::CreateMesh(const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+	UINT numTriangles, Mesh** mesh)
+{
+	SoftMesh* m = new SoftMesh(this);
+	m->vertices.assign(vertices, vertices + numVertices);
+	m->indices.assign(indices, indices + numTriangles * 3);
+	*mesh = m;
+	return true;
+}
+
+void d3d::SoftwareDevice::SetRenderState(D3DRENDERSTATETYPE state, DWORD value)
+{
+	if ((unsigned)state < 256 && _renderStates[state] != value)
+	{
+		_renderStates[state] = value;
+		_stateDirty = true;
+	}
+}
+
+void d3d::SoftwareDevice::SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value)
+{
+	if (sampler == 0 && (unsigned)type < 16 && _samplerStates[type] != value)
+	{
+		_samplerStates[type] = value;
+		_stateDirty = true;
+	}
+}
+
+void d3d::SoftwareDevice::SetTexture(DWORD stage, Texture* tex)
+{
+	if (stage == 0 && _texture != tex)
+	{
+		_texture = tex;
+		_stateDirty = true;
+	}
+}
+
+void d3d::SoftwareDevice::SetMaterial(const D3DMATERIAL9* mtrl)
+{
+	_material = *mtrl;
+}
+
+void d3d::SoftwareDevice::SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix)
+{
+	switch (state)
+	{
+	case D3DTS_WORLD:      _world = *matrix; break;
+	case D3DTS_VIEW:       _view = *matrix; break;
+	case D3DTS_PROJECTION: _proj = *matrix; break;
+	default: break;
+	}
+}
+
+void d3d::SoftwareDevice::SetLight(DWORD index, const D3DLIGHT9* light)
+{
+	if (index < MaxLights)
+		_lights[index] = *light;
+}
+
+void d3d::SoftwareDevice::LightEnable(DWORD index, bool enable)
+{
+	if (index < MaxLights)
+		_lightEnabled[index] = enable;
+}
+
+void d3d::SoftwareDevice::SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride)
+{
+	if (stream == 0)
+	{
+		_stream = vb;
+		_streamOffset = offset;
+		_streamStride = stride;
+	}
+}
+
+void d3d::SoftwareDevice::SetIndices(IndexBuffer* ib)
+{
+	_indices = ib;
+}
+
+void d3d::SoftwareDevice::SetClipPlane(DWORD index, const float* plane)
+{
+	if (index == 0)
+		memcpy(_clipPlane, plane, sizeof(_clipPlane));
+}
+
+void d3d::SoftwareDevice::SetFVF(DWORD fvf)
+{
+	_fvf = fvf;
+}
+
+bool d3d::SoftwareDevice::CreateStateBlock(const PassDesc& desc, StateBlock** block)
+{
+	*block = new SoftStateBlock(desc);
+	return true;
+}
+
+void d3d::SoftwareDevice::ApplyStateBlock(StateBlock* block)
+{
+	const SoftStateBlock* sb = (const SoftStateBlock*)block;
+	for (int i = 0; i < PASS_STATE_COUNT; ++i)
+		SetRenderState(PassRenderStates[i], sb->values[i]);
+}
+
+void d3d::SoftwareDevice::Clear(DWORD count, const D3DRECT* rects, DWORD flags,
+	D3DCOLOR color, float z, DWORD stencil)
+{
+	D3DRECT full = { 0, 0, _width, _height };
+	if (count == 0 || rects == 0)
+	{
+		count = 1;
+		rects = &full;
+	}
+
+	for (DWORD i = 0; i < count; ++i)
+	{
+		ClearCmd cmd;
+		cmd.flags   = flags;
+		cmd.x1      = std::max(0, (int)rects[i].x1);
+		cmd.y1      = std::max(0, (int)rects[i].y1);
+		cmd.x2      = std::min(_width, (int)rects[i].x2);
+		cmd.y2      = std::min(_height, (int)rects[i].y2);
+		cmd.color   = color;
+		cmd.depth   = ToDepth24(z) << 8;
+		cmd.stencil = stencil & 0xff;
+		if (cmd.x1 >= cmd.x2 || cmd.y1 >= cmd.y2)
+			continue;
+
+		unsigned entry = 0x80000000u | (unsigned)_clears.size();
+		_clears.push_back(cmd);
+		for (int ty = cmd.y1 / TileSize; ty <= (cmd.y2 - 1) / TileSize; ++ty)
+			for (int tx = cmd.x1 / TileSize; tx <= (cmd.x2 - 1) / TileSize; ++tx)
+				_bins[ty * _tilesX + tx].push_back(entry);
+	}
+}
+
+// The binned work belongs to the old target, so it is rasterized before switching.
+void d3d::SoftwareDevice::SetRenderTarget(Texture* target)
+{
+	SoftTexture* tex = (SoftTexture*)target;
+	DWORD* color = tex ? &tex->texels[0] : &_color[0];
+	if (color == _colorTarget)
+		return;
+
+	Flush();
+	_colorTarget = color;
+	_depthTarget = tex ? &tex->depth[0] : &_depth[0];
+	_width  = tex ? tex->levels[0].width : _backWidth;
+	_height = tex ? tex->levels[0].height : _backHeight;
+	_tilesX = (_width + TileSize - 1) / TileSize;
+	_tilesY = (_height + TileSize - 1) / TileSize;
+	// never shrunk: switching back to the back buffer would allocate every bin again, and
+	// Flush leaves the ones a small target does not use empty
+	if (_bins.size() < (size_t)(_tilesX * _tilesY))
+		_bins.resize(_tilesX * _tilesY);
+}
+
+void d3d::SoftwareDevice::BeginScene()
+{
+}
+
+void d3d::SoftwareDevice::EndScene()
+{
+	Flush();
+}
+
+void d3d::SoftwareDevice::Present()
+{
+	// Clears issued outside BeginScene/EndScene still have to land.
+	Flush();
+}
+
+void d3d::SoftwareDevice::DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount)
+{
+	if (type != D3DPT_TRIANGLELIST || !_stream || _streamStride == 0)
+		return;
+
+	SoftVertexBuffer* vb = (SoftVertexBuffer*)_stream;
+	size_t first = _streamOffset + (size_t)startVertex * _streamStride;
+	size_t bytes = (size_t)primCount * 3 * _streamStride;
+	if (first + bytes > vb->data.size())
+		return;
+
+	ProcessTriangles(&vb->data[first], _streamStride, _fvf, 0, primCount * 3, 0, primCount);
+}
+
+void d3d::SoftwareDevice::DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+	UINT numVertices, UINT startIndex, UINT primCount)
+{
+	if (type != D3DPT_TRIANGLELIST || !_stream || _streamStride == 0 || !_indices)
+		return;
+
+	// only [minIndex, minIndex + numVertices) relative to baseVertex is transformed
+	SoftVertexBuffer* vb = (SoftVertexBuffer*)_stream;
+	SoftIndexBuffer* ib = (SoftIndexBuffer*)_indices;
+	size_t base = _streamOffset + (size_t)(baseVertex + (INT)minIndex) * _streamStride;
+	if (baseVertex + (INT)minIndex < 0 || base + (size_t)numVertices * _streamStride > vb->data.size())
+		return;
+	if ((size_t)startIndex + primCount * 3 > ib->data.size())
+		return;
+
+	ProcessTriangles(&vb->data[base], _streamStride, _fvf, minIndex, numVertices,
+		&ib->data[startIndex], primCount);
+}
+
+void d3d::SoftwareDevice::DrawIndexedTriangles(const void* vertices, UINT stride, DWORD fvf,
+	UINT numVertices, const WORD* indices, UINT numTriangles)
+{
+	ProcessTriangles(vertices, stride, fvf, 0, numVertices, indices, numTriangles);
+}
+
+void d3d::SoftwareDevice::DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+	const D3DMATERIAL9* palette, UINT paletteSize)
+{
+	// meshes of this device are SoftMeshes
+	const SoftMesh* m = (const SoftMesh*)mesh;
+	if (m->indices.empty())
+		return;
+
+	TransformSetup setup;
+	BeginTransform(&setup);
+
+	UINT numVertices = (UINT)m->vertices.size();
+	UINT numTriangles = (UINT)m->indices.size() / 3;
+	for (UINT i = 0; i < count; ++i)
+	{
+		if (instances[i].Material >= paletteSize)
+			continue;
+		TransformVertices(setup, instances[i].World, palette[instances[i].Material],
+			(const unsigned char*)&m->vertices[0], sizeof(d3d::MeshVertex), D3DFVF_XYZ | D3DFVF_NORMAL, numVertices);
+		BinTriangles(0, numVertices, &m->indices[0], numTriangles);
+	}
+}
+
+void d3d::SoftwareDevice::ProcessTriangles(const void* vertices, UINT stride, DWORD fvf,
+	UINT firstVertex, UINT numVertices, const WORD* indices, UINT numTriangles)
+{
+	TransformSetup setup;
+	BeginTransform(&setup);
+	TransformVertices(setup, _world, _material, (const unsigned char*)vertices, stride, fvf, numVertices);
+	BinTriangles(firstVertex, numVertices, indices, numTriangles);
+}
+
+void d3d::SoftwareDevice::BinTriangles(UINT firstVertex, UINT numVertices, const WORD* indices, UINT numTriangles)
+{
+	// indices count from 'firstVertex'; anything outside the transformed range is dropped
+	const ClipVertex* v = &_clipVerts[0];
+	for (UINT i = 0; i < numTriangles; ++i)
+	{
+		if (indices)
+		{
+			UINT a = indices[i * 3] - firstVertex;
+			UINT b = indices[i * 3 + 1] - firstVertex;
+			UINT c = indices[i * 3 + 2] - firstVertex;
+			if (a < numVertices && b < numVertices && c < numVertices)
+				ClipAndBin(v[a], v[b], v[c]);
+		}
+		else
+		{
+			ClipAndBin(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+		}
+	}
+}
+
+void d3d::SoftwareDevice::BeginTransform(TransformSetup* setup) const
+{
+	setup->view = D3DXMATRIX(_view);
+	setup->proj = D3DXMATRIX(_proj);
+
+	D3DXMATRIX invView;
+	D3DXMatrixInverse(&invView, 0, &setup->view);
+	setup->eye = D3DXVECTOR3(invView._41, invView._42, invView._43);
+
+	setup->lighting = _renderStates[D3DRS_LIGHTING] != 0;
+	setup->specular = _renderStates[D3DRS_SPECULARENABLE] != 0;
+	setup->globalAmbient = D3DXCOLOR(_renderStates[D3DRS_AMBIENT]);
+
+	// gather the active lights once per draw
+	setup->numActive = 0;
+	for (int i = 0; i < MaxLights; ++i)
+		if (_lightEnabled[i])
+			setup->active[setup->numActive++] = i;
+}
+
+void d3d::SoftwareDevice::TransformVertices(const TransformSetup& setup, const D3DMATRIX& worldMatrix,
+	const D3DMATERIAL9& m, const unsigned char* src, UINT stride, DWORD fvf, UINT count)
+{
+	if (_clipVerts.size() < count)
+		_clipVerts.resize(count);
+
+	// vertex layout
+	UINT offset = (fvf & D3DFVF_XYZ) ? 12 : 0;
+	int normalOffset = -1, diffuseOffset = -1, texOffset = -1;
+	if (fvf & D3DFVF_NORMAL)  { normalOffset = offset; offset += 12; }
+	if (fvf & D3DFVF_DIFFUSE) { diffuseOffset = offset; offset += 4; }
+	if (fvf & D3DFVF_TEX1)    { texOffset = offset; offset += 8; }
+
+	D3DXMATRIX world(worldMatrix);
+	D3DXMATRIX wvp = world * setup.view * setup.proj;
+	const D3DXVECTOR3& eye = setup.eye;
+
+	bool lighting = setup.lighting && normalOffset >= 0;
+	bool specular = setup.specular;
+	const D3DXCOLOR& globalAmbient = setup.globalAmbient;
+	const int* active = setup.active;
+	int numActive = setup.numActive;
+
+	// the user clip plane in object space, so each vertex needs a single dot product
+	float clip[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	_userClip = (_renderStates[D3DRS_CLIPPLANEENABLE] & D3DCLIPPLANE0) != 0;
+	if (_userClip)
+	{
+		for (int k = 0; k < 4; ++k)
+			clip[k] = world.m[k][0] * _clipPlane[0] + world.m[k][1] * _clipPlane[1] +
+				world.m[k][2] * _clipPlane[2] + world.m[k][3] * _clipPlane[3];
+	}
+
+	for (UINT i = 0; i < count; ++i)
+	{
+		const unsigned char* s = src + i * stride;
+		const float* p = (const float*)s;
+		ClipVertex& out = _clipVerts[i];
+
+		out.x = p[0] * wvp._11 + p[1] * wvp._21 + p[2] * wvp._31 + wvp._41;
+		out.y = p[0] * wvp._12 + p[1] * wvp._22 + p[2] * wvp._32 + wvp._42;
+		out.z = p[0] * wvp._13 + p[1] * wvp._23 + p[2] * wvp._33 + wvp._43;
+		out.w = p[0] * wvp._14 + p[1] * wvp._24 + p[2] * wvp._34 + wvp._44;
+		out.clip = p[0] * clip[0] + p[1] * clip[1] + p[2] * clip[2] + clip[3];
+
+		float* a = out.attr;
+		if (lighting)
+		{
+			const float* n = (const float*)(s + normalOffset);
+			D3DXVECTOR3 pos(
+				p[0] * world._11 + p[1] * world._21 + p[2] * world._31 + world._41,
+				p[0] * world._12 + p[1] * world._22 + p[2] * world._32 + world._42,
+				p[0] * world._13 + p[1] * world._23 + p[2] * world._33 + world._43);
+			D3DXVECTOR3 normal(
+				n[0] * world._11 + n[1] * world._21 + n[2] * world._31,
+				n[0] * world._12 + n[1] * world._22 + n[2] * world._32,
+				n[0] * world._13 + n[1] * world._23 + n[2] * world._33);
+			D3DXVec3Normalize(&normal, &normal);
+
+			float amb[3] = { globalAmbient.r, globalAmbient.g, globalAmbient.b };
+			float dif[3] = { 0.0f, 0.0f, 0.0f };
+			float spe[3] = { 0.0f, 0.0f, 0.0f };
+			for (int l = 0; l < numActive; ++l)
+			{
+				const D3DLIGHT9& light = _lights[active[l]];
+				D3DXVECTOR3 toLight;
+				float atten = 1.0f;
+				if (light.Type == D3DLIGHT_DIRECTIONAL)
+				{
+					toLight = D3DXVECTOR3(-light.Direction.x, -light.Direction.y, -light.Direction.z);
+				}
+				else
+				{
+					toLight = D3DXVECTOR3(light.Position.x, light.Position.y, light.Position.z) - pos;
+					float d = D3DXVec3Length(&toLight);
+					if (light.Range > 0.0f && d > light.Range)
+						continue;
+					float k = light.Attenuation0 + light.Attenuation1 * d + light.Attenuation2 * d * d;
+					atten = k > 0.0f ? 1.0f / k : 1.0f;
+				}
+				D3DXVec3Normalize(&toLight, &toLight);
+
+				amb[0] += light.Ambient.r * atten;
+				amb[1] += light.Ambient.g * atten;
+				amb[2] += light.Ambient.b * atten;
+
+				float ndotl = D3DXVec3Dot(&normal, &toLight);
+				if (ndotl <= 0.0f)
+					continue;
+				dif[0] += light.Diffuse.r * ndotl * atten;
+				dif[1] += light.Diffuse.g * ndotl * atten;
+				dif[2] += light.Diffuse.b * ndotl * atten;
+
+				if (specular && m.Power > 0.0f)
+				{
+					D3DXVECTOR3 toEye = eye - pos;
+					D3DXVec3Normalize(&toEye, &toEye);
+					D3DXVECTOR3 h = toEye + toLight;
+					D3DXVec3Normalize(&h, &h);
+					float ndoth = D3DXVec3Dot(&normal, &h);
+					if (ndoth > 0.0f)
+					{
+						float sp = powf(ndoth, m.Power) * atten;
+						spe[0] += light.Specular.r * sp;
+						spe[1] += light.Specular.g * sp;
+						spe[2] += light.Specular.b * sp;
+					}
+				}
+			}
+
+			a[0] = Saturate(m.Emissive.r + m.Ambient.r * amb[0] + m.Diffuse.r * dif[0]);
+			a[1] = Saturate(m.Emissive.g + m.Ambient.g * amb[1] + m.Diffuse.g * dif[1]);
+			a[2] = Saturate(m.Emissive.b + m.Ambient.b * amb[2] + m.Diffuse.b * dif[2]);
+			a[3] = Saturate(m.Diffuse.a);
+			a[4] = Saturate(m.Specular.r * spe[0]);
+			a[5] = Saturate(m.Specular.g * spe[1]);
+			a[6] = Saturate(m.Specular.b * spe[2]);
+		}
+		else
+		{
+			if (diffuseOffset >= 0)
+				Unpack(*(const DWORD*)(s + diffuseOffset), a);
+			else
+				a[0] = a[1] = a[2] = a[3] = 1.0f;
+			a[4] = a[5] = a[6] = 0.0f;
+		}
+
+		if (texOffset >= 0)
+		{
+			const float* t = (const float*)(s + texOffset);
+			a[7] = t[0];
+			a[8] = t[1];
+		}
+		else
+		{
+			a[7] = a[8] = 0.0f;
+		}
+	}
+}
+
+void d3d::SoftwareDevice::ClipAndBin(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c)
+{
+	// the frustum planes, then the user clip plane when one is enabled
+	int numPlanes = NumClipPlanes + (_userClip ? 1 : 0);
+	unsigned outA = 0, outB = 0, outC = 0;
+	for (int i = 0; i < numPlanes; ++i)
+	{
+		if (ClipDistance(i, a) < 0.0f) outA |= 1 << i;
+		if (ClipDistance(i, b) < 0.0f) outB |= 1 << i;
+		if (ClipDistance(i, c) < 0.0f) outC |= 1 << i;
+	}
+
+	if (outA & outB & outC)
+		return;
+	if ((outA | outB | outC) == 0)
+	{
+		BinTriangle(a, b, c);
+		return;
+	}
+
+	// Sutherland-Hodgman against the planes the triangle straddles
+	ClipVertex bufferA[3 + NumClipPlanes + 1], bufferB[3 + NumClipPlanes + 1];
+	ClipVertex* in = bufferA;
+	ClipVertex* out = bufferB;
+	int count = 3;
+	in[0] = a; in[1] = b; in[2] = c;
+
+	unsigned straddle = outA | outB | outC;
+	for (int i = 0; i < numPlanes && count >= 3; ++i)
+	{
+		if (!(straddle & (1 << i)))
+			continue;
+
+		int n = 0;
+		for (int j = 0; j < count; ++j)
+		{
+			const ClipVertex& p0 = in[j];
+			const ClipVertex& p1 = in[(j + 1) % count];
+			float d0 = ClipDistance(i, p0);
+			float d1 = ClipDistance(i, p1);
+			if (d0 >= 0.0f)
+				out[n++] = p0;
+			if ((d0 >= 0.0f) != (d1 >= 0.0f))
+				out[n++] = Lerp(p0, p1, d0 / (d0 - d1));
+		}
+		std::swap(in, out);
+		count = n;
+	}
+
+	for (int i = 1; i + 1 < count; ++i)
+		BinTriangle(in[0], in[i], in[i + 1]);
+}
+
+void d3d::SoftwareDevice::BinTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c)
+{
+	const ClipVertex* v[3] = { &a, &b, &c };
+	RasterTri t;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		float invW = 1.0f / v[i]->w;
+		float sx = (v[i]->x * invW * 0.5f + 0.5f) * _width;
+		float sy = (0.5f - v[i]->y * invW * 0.5f) * _height;
+		t.x[i] = (int)floorf(sx * 16.0f + 0.5f);
+		t.y[i] = (int)floorf(sy * 16.0f + 0.5f);
+		t.z[i] = v[i]->z * invW;
+		t.invW[i] = invW;
+		for (int k = 0; k < 9; ++k)
+			t.attr[i][k] = v[i]->attr[k] * invW;
+	}
+
+	long long area =
+		(long long)(t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) -
+		(long long)(t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+	if (area == 0)
+		return;
+
+	// positive area is clockwise on screen
+	DWORD cull = _renderStates[D3DRS_CULLMODE];
+	if ((cull == D3DCULL_CCW && area < 0) || (cull == D3DCULL_CW && area > 0))
+		return;
+
+	if (area < 0)
+	{
+		std::swap(t.x[1], t.x[2]);
+		std::swap(t.y[1], t.y[2]);
+		std::swap(t.z[1], t.z[2]);
+		std::swap(t.invW[1], t.invW[2]);
+		for (int k = 0; k < 9; ++k)
+			std::swap(t.attr[1][k], t.attr[2][k]);
+		area = -area;
+	}
+	t.area = area;
+
+	// pixels whose centres can be covered
+	int minX = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+	int maxX = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+	int minY = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+	int maxY = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+	t.minX = std::max(0, FloorDiv16(minX - 8 + 15));
+	t.minY = std::max(0, FloorDiv16(minY - 8 + 15));
+	t.maxX = std::min(_width - 1, FloorDiv16(maxX - 8));
+	t.maxY = std::min(_height - 1, FloorDiv16(maxY - 8));
+	if (t.minX > t.maxX || t.minY > t.maxY)
+		return;
+
+	t.state = CurrentState();
+
+	unsigned index = (unsigned)_tris.size();
+	_tris.push_back(t);
+	for (int ty = t.minY / TileSize; ty <= t.maxY / TileSize; ++ty)
+		for (int tx = t.minX / TileSize; tx <= t.maxX / TileSize; ++tx)
+			_bins[ty * _tilesX + tx].push_back(index);
+}
+
+int d3d::SoftwareDevice::CurrentState()
+{
+	if (_stateDirty || _states.empty())
+	{
+		const DWORD* rs = _renderStates;
+		RasterState s;
+		s.zEnable          = rs[D3DRS_ZENABLE];
+		s.zWriteEnable     = rs[D3DRS_ZWRITEENABLE];
+		s.zFunc            = rs[D3DRS_ZFUNC];
+		s.stencilEnable    = rs[D3DRS_STENCILENABLE];
+		s.stencilFunc      = rs[D3DRS_STENCILFUNC];
+		s.stencilRef       = rs[D3DRS_STENCILREF];
+		s.stencilMask      = rs[D3DRS_STENCILMASK];
+		s.stencilWriteMask = rs[D3DRS_STENCILWRITEMASK];
+		s.stencilFail      = rs[D3DRS_STENCILFAIL];
+		s.stencilZFail     = rs[D3DRS_STENCILZFAIL];
+		s.stencilPass      = rs[D3DRS_STENCILPASS];
+		s.alphaBlendEnable = rs[D3DRS_ALPHABLENDENABLE];
+		s.srcBlend         = rs[D3DRS_SRCBLEND];
+		s.destBlend        = rs[D3DRS_DESTBLEND];
+		s.colorWriteEnable = rs[D3DRS_COLORWRITEENABLE];
+		s.specularEnable   = rs[D3DRS_SPECULARENABLE];
+		s.minFilter        = _samplerStates[D3DSAMP_MINFILTER];
+		s.magFilter        = _samplerStates[D3DSAMP_MAGFILTER];
+		s.mipFilter        = _samplerStates[D3DSAMP_MIPFILTER];
+		s.texture          = _texture;
+		_states.push_back(s);
+		_stateDirty = false;
+	}
+	return (int)_states.size() - 1;
+}
+
+void d3d::SoftwareDevice::Flush()
+{
+	if (_tris.empty() && _clears.empty())
+		return;
+
+	_pool.ParallelFor(_tilesX * _tilesY, &SoftwareDevice::RasterizeTileTask, this);
+
+	_tris.clear();
+	_states.clear();
+	_clears.clear();
+	for (size_t i = 0; i < _bins.size(); ++i)
+		_bins[i].clear();
+	_stateDirty = true;
+}
+
+void d3d::SoftwareDevice::RasterizeTileTask(void* context, int tile)
+{
+	((SoftwareDevice*)context)->RasterizeTile(tile);
+}
+
+void d3d::SoftwareDevice::RasterizeTile(int tile)
+{
+	const std::vector<unsigned>& bin = _bins[tile];
+	if (bin.empty())
+		return;
+
+	const int tileX0 = (tile % _tilesX) * TileSize;
+	const int tileY0 = (tile / _tilesX) * TileSize;
+	const int tileX1 = std::min(tileX0 + TileSize, _width) - 1;
+	const int tileY1 = std::min(tileY0 + TileSize, _height) - 1;
+
+	for (size_t e = 0; e < bin.size(); ++e)
+	{
+		unsigned entry = bin[e];
+
+		if (entry & 0x80000000u)
+		{
+			const ClearCmd& c = _clears[entry & 0x7fffffffu];
+			int x0 = std::max(c.x1, tileX0), x1 = std::min(c.x2 - 1, tileX1);
+			int y0 = std::max(c.y1, tileY0), y1 = std::min(c.y2 - 1, tileY1);
+
+			DWORD dsMask = 0, dsValue = 0;
+			if (c.flags & D3DCLEAR_ZBUFFER) { dsMask |= 0xffffff00; dsValue |= c.depth; }
+			if (c.flags & D3DCLEAR_STENCIL) { dsMask |= 0x000000ff; dsValue |= c.stencil; }
+
+			for (int y = y0; y <= y1; ++y)
+			{
+				DWORD* color = _colorTarget + y * _width;
+				DWORD* depth = _depthTarget + y * _width;
+				for (int x = x0; x <= x1; ++x)
+				{
+					if (c.flags & D3DCLEAR_TARGET)
+						color[x] = c.color;
+					if (dsMask)
+						depth[x] = (depth[x] & ~dsMask) | dsValue;
+				}
+			}
+			continue;
+		}
+
+		const RasterTri& t = _tris[entry];
+		const RasterState& st = _states[t.state];
+		const SoftTexture* tex = (const SoftTexture*)st.texture;
+
+		int x0 = std::max(t.minX, tileX0), x1 = std::min(t.maxX, tileX1);
+		int y0 = std::max(t.minY, tileY0), y1 = std::min(t.maxY, tileY1);
+		if (x0 > x1 || y0 > y1)
+			continue;
+
+		// edge k is opposite vertex k
+		long long row[3], stepX[3], stepY[3];
+		const int px = x0 * 16 + 8, py = y0 * 16 + 8;
+		for (int k = 0; k < 3; ++k)
+		{
+			int a = (k + 1) % 3, b = (k + 2) % 3;
+			long long dx = t.x[b] - t.x[a];
+			long long dy = t.y[b] - t.y[a];
+			bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+			stepX[k] = -dy * 16;
+			stepY[k] = dx * 16;
+			row[k] = dx * (py - t.y[a]) - dy * (px - t.x[a]) + (topLeft ? 0 : -1);
+		}
+
+		const float invArea = 1.0f / (float)t.area;
+
+		// attribute gradients for the mip level selection
+		float dl1dx = (float)stepX[1] * invArea, dl1dy = (float)stepY[1] * invArea;
+		float dl2dx = (float)stepX[2] * invArea, dl2dy = (float)stepY[2] * invArea;
+		float qx = dl1dx * (t.invW[1] - t.invW[0]) + dl2dx * (t.invW[2] - t.invW[0]);
+		float qy = dl1dy * (t.invW[1] - t.invW[0]) + dl2dy * (t.invW[2] - t.invW[0]);
+		float ux = dl1dx * (t.attr[1][7] - t.attr[0][7]) + dl2dx * (t.attr[2][7] - t.attr[0][7]);
+		float uy = dl1dy * (t.attr[1][7] - t.attr[0][7]) + dl2dy * (t.attr[2][7] - t.attr[0][7]);
+		float vx = dl1dx * (t.attr[1][8] - t.attr[0][8]) + dl2dx * (t.attr[2][8] - t.attr[0][8]);
+		float vy = dl1dy * (t.attr[1][8] - t.attr[0][8]) + dl2dy * (t.attr[2][8] - t.attr[0][8]);
+		float texW = tex ? (float)tex->levels[0].width : 0.0f;
+		float texH = tex ? (float)tex->levels[0].height : 0.0f;
+
+		const unsigned stencilRef = st.stencilRef & 0xff;
+		const unsigned stencilMask = st.stencilMask & 0xff;
+		const unsigned stencilWriteMask = st.stencilWriteMask & 0xff;
+		const unsigned stencilRefMasked = stencilRef & stencilMask;
+
+		DWORD colorMask = 0;
+		if (st.colorWriteEnable & D3DCOLORWRITEENABLE_RED)   colorMask |= 0x00ff0000;
+		if (st.colorWriteEnable & D3DCOLORWRITEENABLE_GREEN) colorMask |= 0x0000ff00;
+		if (st.colorWriteEnable & D3DCOLORWRITEENABLE_BLUE)  colorMask |= 0x000000ff;
+		if (st.colorWriteEnable & D3DCOLORWRITEENABLE_ALPHA) colorMask |= 0xff000000;
+
+		for (int y = y0; y <= y1; ++y)
+		{
+			long long w0 = row[0], w1 = row[1], w2 = row[2];
+			DWORD* colorRow = _colorTarget + y * _width;
+			DWORD* depthRow = _depthTarget + y * _width;
+
+			for (int x = x0; x <= x1; ++x, w0 += stepX[0], w1 += stepX[1], w2 += stepX[2])
+			{
+				if ((w0 | w1 | w2) < 0)
+					continue;
+
+				float l1 = (float)w1 * invArea;
+				float l2 = (float)w2 * invArea;
+				float z = t.z[0] + l1 * (t.z[1] - t.z[0]) + l2 * (t.z[2] - t.z[0]);
+
+				DWORD ds = depthRow[x];
+				unsigned stencil = ds & 0xff;
+				unsigned newStencil = stencil;
+				bool pass = true;
+
+				if (st.stencilEnable && !Compare(st.stencilFunc, stencilRefMasked, stencil & stencilMask))
+				{
+					newStencil = StencilOp(st.stencilFail, stencil, stencilRef);
+					pass = false;
+				}
+
+				DWORD depth = ToDepth24(z);
+				if (pass && st.zEnable && !Compare(st.zFunc, depth, ds >> 8))
+				{
+					if (st.stencilEnable)
+						newStencil = StencilOp(st.stencilZFail, stencil, stencilRef);
+					pass = false;
+				}
+
+				if (pass && st.stencilEnable)
+					newStencil = StencilOp(st.stencilPass, stencil, stencilRef);
+
+				DWORD newDs = ds;
+				if (newStencil != stencil)
+					newDs = (newDs & ~stencilWriteMask) | (newStencil & stencilWriteMask);
+				if (pass && st.zEnable && st.zWriteEnable)
+					newDs = (depth << 8) | (newDs & 0xff);
+				depthRow[x] = newDs;
+
+				if (!pass || colorMask == 0)
+					continue;
+
+				// shade
+				float q = t.invW[0] + l1 * (t.invW[1] - t.invW[0]) + l2 * (t.invW[2] - t.invW[0]);
+				float invQ = 1.0f / q;
+				float src[4];
+				for (int k = 0; k < 4; ++k)
+					src[k] = (t.attr[0][k] + l1 * (t.attr[1][k] - t.attr[0][k]) + l2 * (t.attr[2][k] - t.attr[0][k])) * invQ;
+
+				if (tex)
+				{
+					float uq = t.attr[0][7] + l1 * (t.attr[1][7] - t.attr[0][7]) + l2 * (t.attr[2][7] - t.attr[0][7]);
+					float vq = t.attr[0][8] + l1 * (t.attr[1][8] - t.attr[0][8]) + l2 * (t.attr[2][8] - t.attr[0][8]);
+					float u = uq * invQ, v = vq * invQ;
+
+					float dudx = (ux - u * qx) * invQ * texW, dvdx = (vx - v * qx) * invQ * texH;
+					float dudy = (uy - u * qy) * invQ * texW, dvdy = (vy - v * qy) * invQ * texH;
+					float rho2 = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+					float lod = rho2 > 0.0f ? 0.5f * FastLog2(rho2) : 0.0f;
+
+					float texel[4];
+					Sample(tex, st, u, v, lod, texel);
+					src[0] *= texel[0];
+					src[1] *= texel[1];
+					src[2] *= texel[2];
+					src[3] = texel[3];
+				}
+
+				if (st.specularEnable)
+				{
+					for (int k = 4; k < 7; ++k)
+						src[k - 4] += (t.attr[0][k] + l1 * (t.attr[1][k] - t.attr[0][k]) + l2 * (t.attr[2][k] - t.attr[0][k])) * invQ;
+				}
+
+				DWORD out;
+				if (st.alphaBlendEnable)
+				{
+					float dst[4], fs[4], fd[4], res[4];
+					Unpack(colorRow[x], dst);
+					src[0] = Saturate(src[0]); src[1] = Saturate(src[1]);
+					src[2] = Saturate(src[2]); src[3] = Saturate(src[3]);
+					BlendFactor(st.srcBlend, src, dst, fs);
+					BlendFactor(st.destBlend, src, dst, fd);
+					for (int k = 0; k < 4; ++k)
+						res[k] = src[k] * fs[k] + dst[k] * fd[k];
+					out = Pack(res);
+				}
+				else
+				{
+					out = Pack(src);
+				}
+
+				colorRow[x] = (colorRow[x] & ~colorMask) | (out & colorMask);
+			}
+
+			row[0] += stepY[0];
+			row[1] += stepY[1];
+			row[2] += stepY[2];
+		}
+	}
+}
+
+bool d3d::SoftwareDevice::SaveBackBuffer(const char* bmpFile) const
+{
+	FILE* f = fopen(bmpFile, "wb");
+	if (!f)
+		return false;
+
+	int pitch = (_backWidth * 3 + 3) & ~3;
+	unsigned dataSize = pitch * _backHeight;
+	unsigned char header[54];
+	memset(header, 0, sizeof(header));
+	header[0] = 'B'; header[1] = 'M';
+	unsigned fields[] = { 54 + dataSize, 0, 54, 40, (unsigned)_backWidth, (unsigned)_backHeight };
+	for (int i = 0; i < 6; ++i)
+		for (int b = 0; b < 4; ++b)
+			header[2 + i * 4 + b] = (unsigned char)(fields[i] >> (b * 8));
+	header[26] = 1;   // planes
+	header[28] = 24;  // bits per pixel
+	fwrite(header, 1, sizeof(header), f);
+
+	std::vector<unsigned char> row(pitch, 0);
+	for (int y = _backHeight - 1; y >= 0; --y)
+	{
+		const DWORD* src = &_color[y * _backWidth];
+		for (int x = 0; x < _backWidth; ++x)
+		{
+			row[x * 3 + 0] = (unsigned char)(src[x]);
+			row[x * 3 + 1] = (unsigned char)(src[x] >> 8);
+			row[x * 3 + 2] = (unsigned char)(src[x] >> 16);
+		}
+		fwrite(&row[0], 1, pitch, f);
+	}
+	fclose(f);
+	return true;
+}
@@ -0,0 +1,182 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: softDevice.h
+//
+// Desc: Headless RenderDevice.  Draw calls are transformed, lit and clipped on the calling
+//       thread and binned into 64x64 screen tiles; EndScene() rasterizes the tiles in
+//       parallel into an in-memory A8R8G8B8 back buffer and D24S8 depth/stencil buffer, or
+//       into a render target texture and its own depth/stencil buffer.
+//       Implements the fixed function subset the demo uses: Gouraud lighting with one
+//       modulated texture stage, z test/write, the full stencil test, blending and culling.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __softDeviceH__
+#define __softDeviceH__
+
+#include "renderDevice.h"
+#include "taskPool.h"
+#include <vector>
+
+namespace d3d
+{
+	class SoftwareDevice : public RenderDevice
+	{
+	public:
+		SoftwareDevice(int width, int height, int threads);
+
+		// RenderDevice
+		bool CreateVertexBuffer(UINT length, DWORD fvf, VertexBuffer** vb);
+		bool CreateIndexBuffer(UINT length, IndexBuffer** ib);
+		bool CreateTexture(UINT width, UINT height, Texture** tex);
+		bool CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels, Texture** tex);
+		bool CreateMesh(const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+			UINT numTriangles, Mesh** mesh);
+		bool CreateRenderTarget(UINT width, UINT height, Texture** tex);
+
+		void SetRenderState(D3DRENDERSTATETYPE state, DWORD value);
+		void SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value);
+		void SetTexture(DWORD stage, Texture* tex);
+		void SetMaterial(const D3DMATERIAL9* mtrl);
+		void SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix);
+		void SetLight(DWORD index, const D3DLIGHT9* light);
+		void LightEnable(DWORD index, bool enable);
+		void SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride);
+		void SetFVF(DWORD fvf);
+		void SetIndices(IndexBuffer* ib);
+		void SetClipPlane(DWORD index, const float* plane);
+
+		bool CreateStateBlock(const PassDesc& desc, StateBlock** block);
+		void ApplyStateBlock(StateBlock* block);
+
+		void SetRenderTarget(Texture* target);
+		void Clear(DWORD count, const D3DRECT* rects, DWORD flags, D3DCOLOR color, float z, DWORD stencil);
+		void BeginScene();
+		void EndScene();
+		void Present();
+		void DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount);
+		void DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+			UINT numVertices, UINT startIndex, UINT primCount);
+		void DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+			const D3DMATERIAL9* palette, UINT paletteSize);
+
+		void Release();
+
+		// Draws an indexed triangle list; used by the software meshes.
+		void DrawIndexedTriangles(const void* vertices, UINT stride, DWORD fvf, UINT numVertices,
+			const WORD* indices, UINT numTriangles);
+
+		// Surfaces.  Valid after EndScene().
+		int          GetWidth() const  { return _backWidth; }
+		int          GetHeight() const { return _backHeight; }
+		const DWORD* GetBackBuffer() const   { return &_color[0]; }   // A8R8G8B8
+		const DWORD* GetDepthStencil() const { return &_depth[0]; }   // depth << 8 | stencil
+		bool         SaveBackBuffer(const char* bmpFile) const;
+
+		enum { TileSize = 64, MaxLights = 8 };
+
+		struct ClipVertex
+		{
+			float x, y, z, w;       // clip space
+			float attr[9];          // diffuse rgba, specular rgb, u, v
+			float clip;             // distance to the user clip plane
+		};
+
+		// What stays the same for every draw until the view, the lights or the render
+		// states change; an instanced draw computes it once for all of its copies.
+		struct TransformSetup
+		{
+			D3DXMATRIX  view, proj;
+			D3DXVECTOR3 eye;
+			int         active[MaxLights];
+			int         numActive;
+			bool        lighting, specular;
+			D3DXCOLOR   globalAmbient;
+		};
+
+		struct RasterState
+		{
+			DWORD zEnable, zWriteEnable, zFunc;
+			DWORD stencilEnable, stencilFunc, stencilRef, stencilMask, stencilWriteMask;
+			DWORD stencilFail, stencilZFail, stencilPass;
+			DWORD alphaBlendEnable, srcBlend, destBlend;
+			DWORD colorWriteEnable;
+			DWORD specularEnable;
+			DWORD minFilter, magFilter, mipFilter;
+			const void* texture;
+		};
+
+		struct RasterTri
+		{
+			int   x[3], y[3];       // 28.4 fixed point, clockwise
+			float z[3], invW[3];
+			float attr[3][9];       // perspective divided attributes
+			long long area;         // twice the area in 1/256 pixel units
+			int   minX, minY, maxX, maxY;
+			int   state;
+		};
+
+		struct ClearCmd
+		{
+			DWORD flags;
+			int   x1, y1, x2, y2;
+			DWORD color;
+			DWORD depth;
+			DWORD stencil;
+		};
+
+	private:
+		~SoftwareDevice();
+
+		void ProcessTriangles(const void* vertices, UINT stride, DWORD fvf,
+			UINT firstVertex, UINT numVertices, const WORD* indices, UINT numTriangles);
+		void BeginTransform(TransformSetup* setup) const;
+		void TransformVertices(const TransformSetup& setup, const D3DMATRIX& world, const D3DMATERIAL9& m,
+			const unsigned char* src, UINT stride, DWORD fvf, UINT count);
+		void BinTriangles(UINT firstVertex, UINT numVertices, const WORD* indices, UINT numTriangles);
+		void ClipAndBin(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c);
+		void BinTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c);
+		int  CurrentState();
+		void Flush();
+		void RasterizeTile(int tile);
+
+		static void RasterizeTileTask(void* context, int tile);
+
+		// the current render target
+		int _width, _height;
+		int _tilesX, _tilesY;
+
+		int _backWidth, _backHeight;
+		std::vector<DWORD> _color;
+		std::vector<DWORD> _depth;
+		DWORD* _colorTarget;    // _color or a render target's texels
+		DWORD* _depthTarget;
+
+		TaskPool _pool;
+
+		// fixed function state
+		DWORD        _renderStates[256];
+		DWORD        _samplerStates[16];
+		const void*  _texture;
+		D3DMATERIAL9 _material;
+		D3DMATRIX    _world, _view, _proj;
+		D3DLIGHT9    _lights[MaxLights];
+		bool         _lightEnabled[MaxLights];
+		VertexBuffer* _stream;
+		UINT         _streamOffset, _streamStride;
+		DWORD        _fvf;
+		IndexBuffer* _indices;
+		bool         _stateDirty;
+		float        _clipPlane[4];     // world space; only plane 0 is supported
+		bool         _userClip;         // the last transformed vertices carry a clip distance
+
+		// per frame
+		std::vector<ClipVertex>            _clipVerts;
+		std::vector<RasterState>           _states;
+		std::vector<RasterTri>             _tris;
+		std::vector<ClearCmd>              _clears;
+		std::vector< std::vector<unsigned> > _bins;
+	};
+}
+
+#endif // __softDeviceH__
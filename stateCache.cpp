@@ -0,0 +1,426 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: stateCache.cpp
+//
+// Desc: Redundant state filter in front of a RenderDevice.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "stateCache.h"
+#include <cstring>
+
+DWORD d3d::StateCacheStats::TotalForwarded() const
+{
+	DWORD total = 0;
+	for (int i = 0; i < STATE_CATEGORY_COUNT; ++i)
+		total += forwarded[i];
+	return total;
+}
+
+DWORD d3d::StateCacheStats::TotalDropped() const
+{
+	DWORD total = 0;
+	for (int i = 0; i < STATE_CATEGORY_COUNT; ++i)
+		total += dropped[i];
+	return total;
+}
+
+const char* d3d::GetStateCategoryName(StateCategory category)
+{
+	static const char* names[STATE_CATEGORY_COUNT] = {
+		"RenderState", "SamplerState", "Texture", "Material",
+		"Transform", "Light", "StreamSource", "FVF", "Indices", "ClipPlane", "StateBlock" };
+	return (unsigned)category < STATE_CATEGORY_COUNT ? names[category] : "?";
+}
+
+d3d::StateCache::StateCache(RenderDevice* device)
+	: _device(device)
+{
+	Invalidate();
+	memset(&_frame, 0, sizeof(_frame));
+	memset(&_lastFrame, 0, sizeof(_lastFrame));
+}
+
+d3d::StateCache::~StateCache()
+{
+	if (_device)
+	{
+		_device->Release();
+		_device = 0;
+	}
+}
+
+void d3d::StateCache::Release()
+{
+	delete this;
+}
+
+void d3d::StateCache::Invalidate()
+{
+	memset(_renderStateValid, 0, sizeof(_renderStateValid));
+	memset(_samplerStateValid, 0, sizeof(_samplerStateValid));
+	memset(_textureValid, 0, sizeof(_textureValid));
+	memset(_lightValid, 0, sizeof(_lightValid));
+	memset(_lightEnabledValid, 0, sizeof(_lightEnabledValid));
+	memset(_clipPlaneValid, 0, sizeof(_clipPlaneValid));
+	_materialValid = false;
+	_worldValid = _viewValid = _projValid = false;
+	_streamValid = false;
+	_fvfValid = false;
+	_indicesValid = false;
+}
+
+void d3d::StateCache::InvalidateStream()
+{
+	_streamValid = false;
+	_fvfValid = false;
+	_indicesValid = false;
+}
+
+namespace
+{
+	class CachedMesh : public d3d::Mesh
+	{
+	public:
+		CachedMesh(d3d::Mesh* inner, d3d::StateCache* cache) : inner(inner), cache(cache) {}
+		~CachedMesh() { inner->Release(); }
+
+		void  DrawSubset(DWORD attribId)
+		{
+			D3D_PROFILE_COUNT(PROFILE_DRAWS, 1);
+			D3D_PROFILE_COUNT(PROFILE_PRIMITIVES, inner->GetNumFaces());
+			inner->DrawSubset(attribId);
+			cache->InvalidateStream();
+		}
+		DWORD GetNumFaces() const { return inner->GetNumFaces(); }
+		DWORD GetNumVertices() const { return inner->GetNumVertices(); }
+		bool  GetGeometry(D3DXVECTOR3* positions, DWORD* indices) const { return inner->GetGeometry(positions, indices); }
+		void  Release() { delete this; }
+
+		d3d::Mesh*       inner;
+		d3d::StateCache* cache;
+	};
+}
+
+bool d3d::StateCache::CreateVertexBuffer(UINT length, DWORD fvf, VertexBuffer** vb)
+{
+	return _device->CreateVertexBuffer(length, fvf, vb);
+}
+
+bool d3d::StateCache::CreateIndexBuffer(UINT length, IndexBuffer** ib)
+{
+	return _device->CreateIndexBuffer(length, ib);
+}
+
+bool d3d::StateCache::CreateTexture(UINT width, UINT height, Texture** tex)
+{
+	return _device->CreateTexture(width, height, tex);
+}
+
+bool d3d::StateCache::CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels, Texture** tex)
+{
+	return _device->CreateTextureLevels(format, width, height, levels, tex);
+}
+
+bool d3d::StateCache::CreateMesh(const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+	UINT numTriangles, Mesh** mesh)
+{
+	Mesh* inner = 0;
+	if (!_device->CreateMesh(vertices, numVertices, indices, numTriangles, &inner))
+	{
+		*mesh = 0;
+		return false;
+	}
+	*mesh = new CachedMesh(inner, this);
+	return true;
+}
+
+bool d3d::StateCache::CreateRenderTarget(UINT width, UINT height, Texture** tex)
+{
+	return _device->CreateRenderTarget(width, height, tex);
+}
+
+void d3d::StateCache::SetRenderState(D3DRENDERSTATETYPE state, DWORD value)
+{
+	if ((unsigned)state >= MaxRenderStates)
+	{
+		_device->SetRenderState(state, value);
+		return;
+	}
+
+	if (Changed(STATE_RENDERSTATE, !_renderStateValid[state] || _renderStates[state] != value))
+	{
+		_renderStates[state] = value;
+		_renderStateValid[state] = true;
+		_device->SetRenderState(state, value);
+	}
+}
+
+void d3d::StateCache::SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value)
+{
+	if (sampler >= MaxSamplers || (unsigned)type >= MaxSamplerStates)
+	{
+		_device->SetSamplerState(sampler, type, value);
+		return;
+	}
+
+	if (Changed(STATE_SAMPLERSTATE, !_samplerStateValid[sampler][type] || _samplerStates[sampler][type] != value))
+	{
+		_samplerStates[sampler][type] = value;
+		_samplerStateValid[sampler][type] = true;
+		_device->SetSamplerState(sampler, type, value);
+	}
+}
+
+void d3d::StateCache::SetTexture(DWORD stage, Texture* tex)
+{
+	if (stage >= MaxStages)
+	{
+		_device->SetTexture(stage, tex);
+		return;
+	}
+
+	if (Changed(STATE_TEXTURE, !_textureValid[stage] || _textures[stage] != tex))
+	{
+		_textures[stage] = tex;
+		_textureValid[stage] = true;
+		D3D_PROFILE_COUNT(PROFILE_TEXTURE_BINDS, 1);
+		_device->SetTexture(stage, tex);
+	}
+}
+
+void d3d::StateCache::SetMaterial(const D3DMATERIAL9* mtrl)
+{
+	if (Changed(STATE_MATERIAL, !_materialValid || memcmp(&_material, mtrl, sizeof(D3DMATERIAL9)) != 0))
+	{
+		_material = *mtrl;
+		_materialValid = true;
+		_device->SetMaterial(mtrl);
+	}
+}
+
+void d3d::StateCache::SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix)
+{
+	D3DMATRIX* cached = 0;
+	bool* valid = 0;
+	switch (state)
+	{
+	case D3DTS_WORLD:      cached = &_world; valid = &_worldValid; break;
+	case D3DTS_VIEW:       cached = &_view;  valid = &_viewValid;  break;
+	case D3DTS_PROJECTION: cached = &_proj;  valid = &_projValid;  break;
+	default:
+		_device->SetTransform(state, matrix);
+		return;
+	}
+
+	if (Changed(STATE_TRANSFORM, !*valid || memcmp(cached, matrix, sizeof(D3DMATRIX)) != 0))
+	{
+		*cached = *matrix;
+		*valid = true;
+		_device->SetTransform(state, matrix);
+	}
+}
+
+void d3d::StateCache::SetLight(DWORD index, const D3DLIGHT9* light)
+{
+	if (index >= MaxLights)
+	{
+		_device->SetLight(index, light);
+		return;
+	}
+
+	if (Changed(STATE_LIGHT, !_lightValid[index] || memcmp(&_lights[index], light, sizeof(D3DLIGHT9)) != 0))
+	{
+		_lights[index] = *light;
+		_lightValid[index] = true;
+		_device->SetLight(index, light);
+	}
+}
+
+void d3d::StateCache::LightEnable(DWORD index, bool enable)
+{
+	if (index >= MaxLights)
+	{
+		_device->LightEnable(index, enable);
+		return;
+	}
+
+	if (Changed(STATE_LIGHT, !_lightEnabledValid[index] || _lightEnabled[index] != enable))
+	{
+		_lightEnabled[index] = enable;
+		_lightEnabledValid[index] = true;
+		_device->LightEnable(index, enable);
+	}
+}
+
+void d3d::StateCache::SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride)
+{
+	if (stream != 0)
+	{
+		_device->SetStreamSource(stream, vb, offset, stride);
+		return;
+	}
+
+	if (Changed(STATE_STREAM, !_streamValid || _stream != vb || _streamOffset != offset || _streamStride != stride))
+	{
+		_stream = vb;
+		_streamOffset = offset;
+		_streamStride = stride;
+		_streamValid = true;
+		_device->SetStreamSource(stream, vb, offset, stride);
+	}
+}
+
+void d3d::StateCache::SetFVF(DWORD fvf)
+{
+	if (Changed(STATE_FVF, !_fvfValid || _fvf != fvf))
+	{
+		_fvf = fvf;
+		_fvfValid = true;
+		_device->SetFVF(fvf);
+	}
+}
+
+void d3d::StateCache::SetIndices(IndexBuffer* ib)
+{
+	if (Changed(STATE_INDICES, !_indicesValid || _indices != ib))
+	{
+		_indices = ib;
+		_indicesValid = true;
+		_device->SetIndices(ib);
+	}
+}
+
+void d3d::StateCache::SetClipPlane(DWORD index, const float* plane)
+{
+	if (index >= MaxClipPlanes)
+	{
+		_device->SetClipPlane(index, plane);
+		return;
+	}
+
+	if (Changed(STATE_CLIPPLANE, !_clipPlaneValid[index] || memcmp(_clipPlanes[index], plane, sizeof(_clipPlanes[index])) != 0))
+	{
+		memcpy(_clipPlanes[index], plane, sizeof(_clipPlanes[index]));
+		_clipPlaneValid[index] = true;
+		_device->SetClipPlane(index, plane);
+	}
+}
+
+namespace
+{
+	class CachedStateBlock : public d3d::StateBlock
+	{
+	public:
+		CachedStateBlock(d3d::StateBlock* inner) : inner(inner) { inner->GetDesc().GetRenderStates(values); }
+		~CachedStateBlock() { inner->Release(); }
+
+		const d3d::PassDesc& GetDesc() const { return inner->GetDesc(); }
+		void Release() { delete this; }
+
+		d3d::StateBlock* inner;
+		DWORD            values[d3d::PASS_STATE_COUNT];
+	};
+}
+
+bool d3d::StateCache::CreateStateBlock(const PassDesc& desc, StateBlock** block)
+{
+	StateBlock* inner = 0;
+	if (!_device->CreateStateBlock(desc, &inner))
+	{
+		*block = 0;
+		return false;
+	}
+	*block = new CachedStateBlock(inner);
+	return true;
+}
+
+void d3d::StateCache::ApplyStateBlock(StateBlock* block)
+{
+	const CachedStateBlock* cached = (const CachedStateBlock*)block;
+
+	int changes = 0;
+	for (int i = 0; i < PASS_STATE_COUNT; ++i)
+	{
+		D3DRENDERSTATETYPE state = PassRenderStates[i];
+		if (!_renderStateValid[state] || _renderStates[state] != cached->values[i])
+			++changes;
+	}
+
+	if (!Changed(STATE_STATEBLOCK, changes > 0))
+		return;
+
+	if (changes * 2 > PASS_STATE_COUNT)
+	{
+		_device->ApplyStateBlock(cached->inner);
+		for (int i = 0; i < PASS_STATE_COUNT; ++i)
+		{
+			D3DRENDERSTATETYPE state = PassRenderStates[i];
+			_renderStates[state] = cached->values[i];
+			_renderStateValid[state] = true;
+		}
+	}
+	else
+	{
+		for (int i = 0; i < PASS_STATE_COUNT; ++i)
+			SetRenderState(PassRenderStates[i], cached->values[i]);
+	}
+}
+
+// Not cached: targets change a few times a frame at most, and every state stays valid.
+void d3d::StateCache::SetRenderTarget(Texture* target)
+{
+	_device->SetRenderTarget(target);
+}
+
+void d3d::StateCache::Clear(DWORD count, const D3DRECT* rects, DWORD flags, D3DCOLOR color, float z, DWORD stencil)
+{
+	D3D_PROFILE_COUNT(PROFILE_CLEARS, 1);
+	_device->Clear(count, rects, flags, color, z, stencil);
+}
+
+void d3d::StateCache::BeginScene()
+{
+	_device->BeginScene();
+}
+
+void d3d::StateCache::EndScene()
+{
+	_device->EndScene();
+}
+
+void d3d::StateCache::Present()
+{
+	_device->Present();
+
+	_lastFrame = _frame;
+	memset(&_frame, 0, sizeof(_frame));
+}
+
+void d3d::StateCache::DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount)
+{
+	D3D_PROFILE_COUNT(PROFILE_DRAWS, 1);
+	D3D_PROFILE_COUNT(PROFILE_PRIMITIVES, primCount);
+	_device->DrawPrimitive(type, startVertex, primCount);
+}
+
+void d3d::StateCache::DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+	UINT numVertices, UINT startIndex, UINT primCount)
+{
+	D3D_PROFILE_COUNT(PROFILE_DRAWS, 1);
+	D3D_PROFILE_COUNT(PROFILE_PRIMITIVES, primCount);
+	_device->DrawIndexedPrimitive(type, baseVertex, minIndex, numVertices, startIndex, primCount);
+}
+
+void d3d::StateCache::DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+	const D3DMATERIAL9* palette, UINT paletteSize)
+{
+	D3D_PROFILE_COUNT(PROFILE_DRAWS, 1);
+	D3D_PROFILE_COUNT(PROFILE_PRIMITIVES, mesh->GetNumFaces() * count);
+
+	// meshes handed out by the cache wrap the device's own
+	_device->DrawInstances(((CachedMesh*)mesh)->inner, instances, count, palette, paletteSize);
+	_worldValid = false;
+	_materialValid = false;
+	InvalidateStream();
+}
@@ -0,0 +1,168 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: stateCache.h
+//
+// Desc: A RenderDevice that sits in front of another one and remembers the last value of
+//       every render state, sampler state, texture, material, transform, light, stream,
+//       FVF and index buffer it forwarded.  Calls that would not change anything are dropped.  Forwarded and
+//       dropped calls are counted per frame (a frame ends at Present).  Draws, Clears and forwarded
+//       state calls also feed the profiler's counters.
+//
+//       Applying a pass state block only emits the render states that differ from the
+//       cached ones; when most of the block differs the device's own state block is
+//       applied instead, since one Apply is cheaper than many SetRenderState calls.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __stateCacheH__
+#define __stateCacheH__
+
+#include "renderDevice.h"
+#include "profiler.h"
+
+namespace d3d
+{
+	enum StateCategory
+	{
+		STATE_RENDERSTATE,
+		STATE_SAMPLERSTATE,
+		STATE_TEXTURE,
+		STATE_MATERIAL,
+		STATE_TRANSFORM,
+		STATE_LIGHT,
+		STATE_STREAM,
+		STATE_FVF,
+		STATE_INDICES,
+		STATE_CLIPPLANE,
+		STATE_STATEBLOCK,
+		STATE_CATEGORY_COUNT
+	};
+
+	struct StateCacheStats
+	{
+		DWORD forwarded[STATE_CATEGORY_COUNT];
+		DWORD dropped[STATE_CATEGORY_COUNT];
+
+		DWORD TotalForwarded() const;
+		DWORD TotalDropped() const;
+	};
+
+	const char* GetStateCategoryName(StateCategory category);
+
+	class StateCache : public RenderDevice
+	{
+	public:
+		// Takes ownership of 'device'; Release() releases it too.
+		StateCache(RenderDevice* device);
+
+		// Forgets every cached value, e.g. after something changed the device behind our back.
+		void Invalidate();
+
+		// Forgets the stream source, FVF and indices only.  Meshes created through the cache call it
+		// after drawing, since ID3DXMesh::DrawSubset binds its own buffers.
+		void InvalidateStream();
+
+		// Counters of the last completed frame and of the frame in progress.
+		const StateCacheStats& GetFrameStats() const   { return _lastFrame; }
+		const StateCacheStats& GetCurrentStats() const { return _frame; }
+
+		RenderDevice* GetDevice() const { return _device; }
+
+		// RenderDevice
+		bool CreateVertexBuffer(UINT length, DWORD fvf, VertexBuffer** vb);
+		bool CreateIndexBuffer(UINT length, IndexBuffer** ib);
+		bool CreateTexture(UINT width, UINT height, Texture** tex);
+		bool CreateTextureLevels(D3DFORMAT format, UINT width, UINT height, UINT levels, Texture** tex);
+		bool CreateMesh(const MeshVertex* vertices, UINT numVertices, const WORD* indices,
+			UINT numTriangles, Mesh** mesh);
+		bool CreateRenderTarget(UINT width, UINT height, Texture** tex);
+
+		void SetRenderState(D3DRENDERSTATETYPE state, DWORD value);
+		void SetSamplerState(DWORD sampler, D3DSAMPLERSTATETYPE type, DWORD value);
+		void SetTexture(DWORD stage, Texture* tex);
+		void SetMaterial(const D3DMATERIAL9* mtrl);
+		void SetTransform(D3DTRANSFORMSTATETYPE state, const D3DMATRIX* matrix);
+		void SetLight(DWORD index, const D3DLIGHT9* light);
+		void LightEnable(DWORD index, bool enable);
+		void SetStreamSource(UINT stream, VertexBuffer* vb, UINT offset, UINT stride);
+		void SetFVF(DWORD fvf);
+		void SetIndices(IndexBuffer* ib);
+		void SetClipPlane(DWORD index, const float* plane);
+
+		bool CreateStateBlock(const PassDesc& desc, StateBlock** block);
+		void ApplyStateBlock(StateBlock* block);
+
+		void SetRenderTarget(Texture* target);
+		void Clear(DWORD count, const D3DRECT* rects, DWORD flags, D3DCOLOR color, float z, DWORD stencil);
+		void BeginScene();
+		void EndScene();
+		void Present();
+		void DrawPrimitive(D3DPRIMITIVETYPE type, UINT startVertex, UINT primCount);
+		void DrawIndexedPrimitive(D3DPRIMITIVETYPE type, INT baseVertex, UINT minIndex,
+			UINT numVertices, UINT startIndex, UINT primCount);
+		void DrawInstances(Mesh* mesh, const MeshInstance* instances, UINT count,
+			const D3DMATERIAL9* palette, UINT paletteSize);
+
+		void Release();
+
+		enum
+		{
+			MaxRenderStates  = 256,
+			MaxSamplers      = 16,
+			MaxSamplerStates = 16,
+			MaxStages        = 8,
+			MaxLights        = 8,
+			MaxClipPlanes    = 6
+		};
+
+	private:
+		~StateCache();
+
+		bool Changed(StateCategory category, bool changed)
+		{
+			if (changed)
+			{
+				++_frame.forwarded[category];
+				D3D_PROFILE_COUNT(PROFILE_STATE_CHANGES, 1);
+			}
+			else
+				++_frame.dropped[category];
+			return changed;
+		}
+
+		RenderDevice* _device;
+
+		DWORD   _renderStates[MaxRenderStates];
+		bool    _renderStateValid[MaxRenderStates];
+		DWORD   _samplerStates[MaxSamplers][MaxSamplerStates];
+		bool    _samplerStateValid[MaxSamplers][MaxSamplerStates];
+		Texture* _textures[MaxStages];
+		bool    _textureValid[MaxStages];
+
+		D3DMATERIAL9 _material;
+		bool         _materialValid;
+		D3DMATRIX    _world, _view, _proj;
+		bool         _worldValid, _viewValid, _projValid;
+
+		D3DLIGHT9 _lights[MaxLights];
+		bool      _lightValid[MaxLights];
+		bool      _lightEnabled[MaxLights];
+		bool      _lightEnabledValid[MaxLights];
+
+		VertexBuffer* _stream;
+		UINT          _streamOffset, _streamStride;
+		bool          _streamValid;
+		DWORD         _fvf;
+		bool          _fvfValid;
+		IndexBuffer*  _indices;
+		bool          _indicesValid;
+
+		float _clipPlanes[MaxClipPlanes][4];
+		bool  _clipPlaneValid[MaxClipPlanes];
+
+		StateCacheStats _frame;
+		StateCacheStats _lastFrame;
+	};
+}
+
+#endif // __stateCacheH__
@@ -0,0 +1,422 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: staticMesh.cpp
+//
+// Desc: Welded, cache ordered static geometry.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "staticMesh.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+int d3d::StaticMesh::FindRange(DWORD material, int start) const
+{
+	for (size_t i = std::max(start, 0); i < _ranges.size(); ++i)
+		if (_ranges[i].Material == material)
+			return (int)i;
+	return -1;
+}
+
+void d3d::StaticMesh::DrawRange(RenderDevice* device, int range) const
+{
+	const MeshRange& r = _ranges[range];
+	device->SetStreamSource(0, _vb, 0, _stride);
+	device->SetIndices(_ib);
+	device->SetFVF(_fvf);
+	device->DrawIndexedPrimitive(D3DPT_TRIANGLELIST, r.BaseVertex, 0, r.NumVertices, r.StartIndex, r.PrimCount);
+}
+
+void d3d::StaticMesh::Release()
+{
+	delete this;
+}
+
+d3d::StaticMesh::~StaticMesh()
+{
+	if (_vb)
+		_vb->Release();
+	if (_ib)
+		_ib->Release();
+}
+
+d3d::StaticMeshBuilder::StaticMeshBuilder(DWORD fvf, UINT stride)
+	: _fvf(fvf), _stride(stride)
+{
+}
+
+void d3d::StaticMeshBuilder::AddTriangles(const void* vertices, UINT numTriangles, DWORD material)
+{
+	Source s;
+	s.material = material;
+	s.first = (UINT)(_vertices.size() / _stride);
+	s.count = numTriangles * 3;
+	_sources.push_back(s);
+
+	const unsigned char* bytes = (const unsigned char*)vertices;
+	_vertices.insert(_vertices.end(), bytes, bytes + (size_t)s.count * _stride);
+}
+
+namespace
+{
+	struct VertexLess
+	{
+		const unsigned char* vertices;
+		UINT stride;
+
+		bool operator()(UINT a, UINT b) const
+		{
+			int c = memcmp(vertices + (size_t)a * stride, vertices + (size_t)b * stride, stride);
+			return c != 0 ? c < 0 : a < b;
+		}
+	};
+}
+
+bool d3d::StaticMeshBuilder::Build(RenderDevice* device, StaticMesh** mesh) const
+{
+	*mesh = 0;
+	std::vector<unsigned char> vertices;
+	std::vector<WORD> indices;
+	std::vector<MeshRange> ranges;
+	StaticMeshStats stats;
+	if (!Weld(&vertices, &indices, &ranges, &stats) ||
+		!CreateStaticMesh(device, _fvf, _stride, &vertices[0], (UINT)(vertices.size() / _stride),
+			&indices[0], (UINT)indices.size(), &ranges[0], (UINT)ranges.size(), mesh))
+		return false;
+	(*mesh)->_stats = stats;
+	return true;
+}
+
+bool d3d::StaticMeshBuilder::Weld(std::vector<unsigned char>* vertices, std::vector<WORD>* indices,
+	std::vector<MeshRange>* ranges, StaticMeshStats* stats) const
+{
+	// sources of one material end up next to each other
+	std::map<DWORD, std::vector<UINT> > materials;
+	for (size_t i = 0; i < _sources.size(); ++i)
+		materials[_sources[i].material].push_back((UINT)i);
+
+	std::vector<unsigned char>& outVertices = *vertices;
+	std::vector<WORD>& outIndices = *indices;
+	outVertices.clear();
+	outIndices.clear();
+	ranges->clear();
+	float missesBefore = 0.0f, missesAfter = 0.0f;
+
+	for (std::map<DWORD, std::vector<UINT> >::const_iterator m = materials.begin(); m != materials.end(); ++m)
+	{
+		std::vector<UINT> input;
+		for (size_t i = 0; i < m->second.size(); ++i)
+		{
+			const Source& s = _sources[m->second[i]];
+			for (UINT v = 0; v < s.count; ++v)
+				input.push_back(s.first + v);
+		}
+
+		// weld: equal bytes sort next to each other
+		VertexLess less = { &_vertices[0], _stride };
+		std::vector<UINT> order(input);
+		std::sort(order.begin(), order.end(), less);
+
+		std::map<UINT, UINT> welded;
+		std::vector<UINT> unique;
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			if (i == 0 || memcmp(&_vertices[(size_t)order[i] * _stride],
+				&_vertices[(size_t)unique.back() * _stride], _stride) != 0)
+				unique.push_back(order[i]);
+			welded[order[i]] = (UINT)unique.size() - 1;
+		}
+
+		// welding can collapse a triangle to a line
+		std::vector<UINT> triangles;
+		for (size_t i = 0; i + 2 < input.size(); i += 3)
+		{
+			UINT a = welded[input[i]], b = welded[input[i + 1]], c = welded[input[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			triangles.push_back(a);
+			triangles.push_back(b);
+			triangles.push_back(c);
+		}
+
+		// 16 bit indices reach 65536 vertices; a material with more is split into several
+		// ranges, each taking triangles in input order until the next one would not fit
+		std::vector<int> local(unique.size(), -1);
+		size_t first = 0;
+		while (first < triangles.size())
+		{
+			std::vector<UINT> used;   // welded vertices of this range
+			std::vector<WORD> rangeIndices;
+			size_t end = first;
+			for (; end < triangles.size(); end += 3)
+			{
+				UINT added = 0;
+				for (int k = 0; k < 3; ++k)
+					if (local[triangles[end + k]] < 0)
+						++added;
+				if (used.size() + added > 0x10000)
+					break;
+				for (int k = 0; k < 3; ++k)
+				{
+					UINT v = triangles[end + k];
+					if (local[v] < 0)
+					{
+						local[v] = (int)used.size();
+						used.push_back(v);
+					}
+					rangeIndices.push_back((WORD)local[v]);
+				}
+			}
+			for (size_t i = 0; i < used.size(); ++i)
+				local[used[i]] = -1;
+			first = end;
+
+			UINT numTriangles = (UINT)rangeIndices.size() / 3;
+			UINT numVertices = (UINT)used.size();
+			missesBefore += ComputeAcmr(&rangeIndices[0], numTriangles, numVertices, 16) * numTriangles;
+			OptimizeVertexCache(&rangeIndices[0], numTriangles, numVertices);
+			missesAfter += ComputeAcmr(&rangeIndices[0], numTriangles, numVertices, 16) * numTriangles;
+
+			// vertices in the order the triangles first use them
+			std::vector<int> remap(numVertices, -1);
+			UINT emitted = 0;
+			MeshRange r;
+			r.Material = m->first;
+			r.BaseVertex = (INT)(outVertices.size() / _stride);
+			r.StartIndex = (UINT)outIndices.size();
+			r.PrimCount = numTriangles;
+			for (size_t i = 0; i < rangeIndices.size(); ++i)
+			{
+				if (remap[rangeIndices[i]] < 0)
+				{
+					const unsigned char* v = &_vertices[(size_t)unique[used[rangeIndices[i]]] * _stride];
+					outVertices.insert(outVertices.end(), v, v + _stride);
+					remap[rangeIndices[i]] = (int)emitted++;
+				}
+				outIndices.push_back((WORD)remap[rangeIndices[i]]);
+			}
+			r.NumVertices = emitted;
+
+			D3DXComputeBoundingSphere((const D3DXVECTOR3*)&outVertices[(size_t)r.BaseVertex * _stride],
+				r.NumVertices, _stride, &r.Center, &r.Radius);
+			ranges->push_back(r);
+		}
+	}
+
+	if (outIndices.empty())
+		return false;
+
+	stats->InputVertices = (UINT)(_vertices.size() / _stride);
+	stats->Vertices = (UINT)(outVertices.size() / _stride);
+	stats->Triangles = (UINT)(outIndices.size() / 3);
+	stats->AcmrBefore = missesBefore / stats->Triangles;
+	stats->AcmrAfter = missesAfter / stats->Triangles;
+	return true;
+}
+
+bool d3d::CreateStaticMesh(RenderDevice* device, DWORD fvf, UINT stride, const void* vertices, UINT numVertices,
+	const WORD* indices, UINT numIndices, const MeshRange* ranges, UINT numRanges, StaticMesh** mesh)
+{
+	*mesh = 0;
+	if (numVertices == 0 || numIndices == 0)
+		return false;
+
+	StaticMesh* result = new StaticMesh;
+	result->_stride = stride;
+	result->_fvf = fvf;
+	result->_ranges.assign(ranges, ranges + numRanges);
+
+	void* data = 0;
+	UINT vertexBytes = numVertices * stride;
+	if (!device->CreateVertexBuffer(vertexBytes, fvf, &result->_vb) ||
+		!result->_vb->Lock(0, 0, &data, 0))
+	{
+		result->Release();
+		return false;
+	}
+	memcpy(data, vertices, vertexBytes);
+	result->_vb->Unlock();
+
+	UINT indexBytes = numIndices * sizeof(WORD);
+	if (!device->CreateIndexBuffer(indexBytes, &result->_ib) ||
+		!result->_ib->Lock(0, 0, &data, 0))
+	{
+		result->Release();
+		return false;
+	}
+	memcpy(data, indices, indexBytes);
+	result->_ib->Unlock();
+
+	StaticMeshStats& stats = result->_stats;
+	stats.InputVertices = stats.Vertices = numVertices;
+	stats.Triangles = numIndices / 3;
+	stats.AcmrBefore = stats.AcmrAfter = 0.0f;
+
+	*mesh = result;
+	return true;
+}
+
+//
+// Vertex cache ordering
+//
+
+namespace
+{
+	const int CacheSize = 32;   // simulated LRU cache; larger than any real one is harmless
+
+	float VertexScore(int cachePosition, UINT remaining)
+	{
+		if (remaining == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			// the last triangle's vertices are used again soon anyway; do not favour them
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = powf(1.0f - (cachePosition - 3) * (1.0f / (CacheSize - 3)), 1.5f);
+		}
+
+		// vertices with few triangles left are finished off first
+		return score + 2.0f / sqrtf((float)remaining);
+	}
+}
+
+void d3d::OptimizeVertexCache(WORD* indices, UINT numTriangles, UINT numVertices)
+{
+	UINT numIndices = numTriangles * 3;
+
+	// triangles of each vertex; the live ones stay in front of each list
+	std::vector<UINT> offsets(numVertices + 1, 0);
+	for (UINT i = 0; i < numIndices; ++i)
+		++offsets[indices[i] + 1];
+	for (UINT v = 0; v < numVertices; ++v)
+		offsets[v + 1] += offsets[v];
+
+	std::vector<UINT> adjacency(numIndices);
+	std::vector<UINT> remaining(numVertices, 0);
+	for (UINT i = 0; i < numIndices; ++i)
+	{
+		WORD v = indices[i];
+		adjacency[offsets[v] + remaining[v]++] = i / 3;
+	}
+
+	std::vector<int>   cachePosition(numVertices, -1);
+	std::vector<float> vertexScore(numVertices);
+	for (UINT v = 0; v < numVertices; ++v)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(numTriangles);
+	std::vector<bool>  emitted(numTriangles, false);
+	int best = -1;
+	float bestScore = -1.0f;
+	for (UINT t = 0; t < numTriangles; ++t)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] +
+			vertexScore[indices[t * 3 + 2]];
+		if (triangleScore[t] > bestScore)
+		{
+			bestScore = triangleScore[t];
+			best = (int)t;
+		}
+	}
+
+	std::vector<WORD> output;
+	output.reserve(numIndices);
+	WORD cache[CacheSize + 3];
+	int cacheCount = 0;
+	UINT cursor = 0;
+
+	while (output.size() < numIndices)
+	{
+		// nothing in the cache has triangles left: take the next one in input order
+		if (best < 0)
+		{
+			while (emitted[cursor])
+				++cursor;
+			best = (int)cursor;
+		}
+
+		const WORD* tri = &indices[best * 3];
+		emitted[best] = true;
+		for (int k = 0; k < 3; ++k)
+		{
+			WORD v = tri[k];
+			output.push_back(v);
+
+			UINT* list = &adjacency[offsets[v]];
+			for (UINT j = 0; j < remaining[v]; ++j)
+			{
+				if (list[j] == (UINT)best)
+				{
+					std::swap(list[j], list[remaining[v] - 1]);
+					--remaining[v];
+					break;
+				}
+			}
+		}
+
+		// the triangle's vertices move to the front of the cache
+		WORD next[CacheSize + 3];
+		int nextCount = 0;
+		for (int k = 0; k < 3; ++k)
+			next[nextCount++] = tri[k];
+		for (int i = 0; i < cacheCount; ++i)
+			if (cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+				next[nextCount++] = cache[i];
+
+		// rescore what is (or just fell out of) the cache and its triangles
+		for (int i = 0; i < nextCount; ++i)
+		{
+			WORD v = next[i];
+			cachePosition[v] = i < CacheSize ? i : -1;
+			float score = VertexScore(cachePosition[v], remaining[v]);
+			float delta = score - vertexScore[v];
+			vertexScore[v] = score;
+			for (UINT j = 0; j < remaining[v]; ++j)
+				triangleScore[adjacency[offsets[v] + j]] += delta;
+		}
+
+		cacheCount = std::min(nextCount, (int)CacheSize);
+		memcpy(cache, next, cacheCount * sizeof(WORD));
+
+		best = -1;
+		bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			WORD v = cache[i];
+			for (UINT j = 0; j < remaining[v]; ++j)
+			{
+				UINT t = adjacency[offsets[v] + j];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = (int)t;
+				}
+			}
+		}
+	}
+
+	memcpy(indices, &output[0], numIndices * sizeof(WORD));
+}
+
+float d3d::ComputeAcmr(const WORD* indices, UINT numTriangles, UINT numVertices, UINT cacheSize)
+{
+	if (numTriangles == 0)
+		return 0.0f;
+
+	// a vertex is cached while fewer than cacheSize misses happened since it was loaded
+	std::vector<UINT> loadedAt(numVertices, 0);
+	UINT misses = 0;
+	for (UINT i = 0; i < numTriangles * 3; ++i)
+	{
+		WORD v = indices[i];
+		if (loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize)
+			loadedAt[v] = ++misses;
+	}
+	return (float)misses / numTriangles;
+}
@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: staticMesh.h
+//
+// Desc: Indexed geometry that never changes after load.  The builder takes plain triangle
+//       lists tagged with a material, welds vertices that are byte for byte identical,
+//       orders every material's triangles for the post-transform vertex cache (Forsyth's
+//       linear-speed algorithm) and stores all of it in one vertex buffer and one 16 bit
+//       index buffer.  Everything added with the same material becomes one range, drawn
+//       with a single DrawIndexedPrimitive; a material that welds to more than 65536
+//       vertices becomes several ranges in a row, each with its own BaseVertex, so the
+//       indices stay 16 bit.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __staticMeshH__
+#define __staticMeshH__
+
+#include "renderDevice.h"
+#include <vector>
+
+namespace d3d
+{
+	class StaticMesh;
+
+	// Plain data, so a range can be written to a file as it is.
+	struct MeshRange
+	{
+		DWORD       Material;
+		INT         BaseVertex;   // indices of the range count from here
+		UINT        NumVertices;
+		UINT        StartIndex;
+		UINT        PrimCount;
+
+		D3DXVECTOR3 Center;       // bounding sphere in mesh space
+		float       Radius;
+	};
+
+	// Average cache miss ratio (vertices transformed per triangle) on a 16 entry FIFO.
+	struct StaticMeshStats
+	{
+		UINT  InputVertices;
+		UINT  Vertices;
+		UINT  Triangles;
+		float AcmrBefore;
+		float AcmrAfter;
+	};
+
+	class StaticMesh
+	{
+	public:
+		int  GetNumRanges() const                  { return (int)_ranges.size(); }
+		const MeshRange& GetRange(int range) const { return _ranges[range]; }
+		// The first range of 'material' from 'start' on, or -1.
+		int  FindRange(DWORD material, int start = 0) const;
+
+		VertexBuffer* GetVertexBuffer() const { return _vb; }
+		IndexBuffer*  GetIndexBuffer() const  { return _ib; }
+		UINT  GetStride() const { return _stride; }
+		DWORD GetFVF() const    { return _fvf; }
+		const StaticMeshStats& GetStats() const { return _stats; }
+
+		// Binds the buffers and draws one range with the current transform and material.
+		void DrawRange(RenderDevice* device, int range) const;
+
+		void Release();
+
+	private:
+		friend bool CreateStaticMesh(RenderDevice* device, DWORD fvf, UINT stride, const void* vertices,
+			UINT numVertices, const WORD* indices, UINT numIndices, const MeshRange* ranges, UINT numRanges,
+			StaticMesh** mesh);
+		friend class StaticMeshBuilder;
+
+		StaticMesh() : _vb(0), _ib(0), _stride(0), _fvf(0) {}
+		~StaticMesh();
+
+		VertexBuffer*          _vb;
+		IndexBuffer*           _ib;
+		UINT                   _stride;
+		DWORD                  _fvf;
+		std::vector<MeshRange> _ranges;
+		StaticMeshStats        _stats;
+	};
+
+	class StaticMeshBuilder
+	{
+	public:
+		StaticMeshBuilder(DWORD fvf, UINT stride);
+
+		// A triangle list of 'numTriangles' * 3 vertices laid out as the builder's FVF.
+		void AddTriangles(const void* vertices, UINT numTriangles, DWORD material);
+
+		// Fails when nothing was added or the buffers cannot be created.  Ranges are
+		// ordered by material.
+		bool Build(RenderDevice* device, StaticMesh** mesh) const;
+
+		// What Build() puts in the buffers, for tools that store it and create the mesh
+		// later with CreateStaticMesh().
+		bool Weld(std::vector<unsigned char>* vertices, std::vector<WORD>* indices,
+			std::vector<MeshRange>* ranges, StaticMeshStats* stats) const;
+
+	private:
+		struct Source
+		{
+			DWORD material;
+			UINT  first;      // first vertex in _vertices
+			UINT  count;
+		};
+
+		DWORD _fvf;
+		UINT  _stride;
+		std::vector<unsigned char> _vertices;
+		std::vector<Source>        _sources;
+	};
+
+	// A mesh from geometry a StaticMeshBuilder welded earlier, copied straight into the
+	// buffers.  Its stats have no ACMR figures.
+	bool CreateStaticMesh(RenderDevice* device, DWORD fvf, UINT stride, const void* vertices, UINT numVertices,
+		const WORD* indices, UINT numIndices, const MeshRange* ranges, UINT numRanges, StaticMesh** mesh);
+
+	// Reorders 'numTriangles' triangles of 'indices' in place for a vertex cache.
+	void OptimizeVertexCache(WORD* indices, UINT numTriangles, UINT numVertices);
+
+	// Vertices transformed per triangle on a FIFO cache of 'cacheSize' entries.
+	float ComputeAcmr(const WORD* indices, UINT numTriangles, UINT numVertices, UINT cacheSize);
+}
+
+#endif // __staticMeshH__
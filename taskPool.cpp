@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: taskPool.cpp
+//
+// Desc: A small fixed-size worker pool.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "taskPool.h"
+
+d3d::TaskPool::TaskPool(int threads)
+	: _generation(0), _busy(0), _quit(false), _func(0), _context(0), _count(0), _next(0)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	for (int i = 1; i < threads; ++i)
+		_workers.push_back(std::thread(&TaskPool::WorkerMain, this));
+}
+
+d3d::TaskPool::~TaskPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+	for (size_t i = 0; i < _workers.size(); ++i)
+		_workers[i].join();
+}
+
+void d3d::TaskPool::ParallelFor(int count, TaskFunc func, void* context)
+{
+	if (count <= 0)
+		return;
+
+	// not worth waking anybody up
+	if (_workers.empty() || count == 1)
+	{
+		for (int i = 0; i < count; ++i)
+			func(context, i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_func = func;
+		_context = context;
+		_count = count;
+		_next.store(0);
+		_busy = (int)_workers.size();
+		++_generation;
+	}
+	_wake.notify_all();
+
+	RunTasks();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _busy == 0; });
+}
+
+void d3d::TaskPool::RunTasks()
+{
+	for (;;)
+	{
+		int index = _next.fetch_add(1);
+		if (index >= _count)
+			break;
+		_func(_context, index);
+	}
+}
+
+void d3d::TaskPool::WorkerMain()
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_wake.wait(lock, [&] { return _quit || _generation != seen; });
+			if (_quit)
+				return;
+			seen = _generation;
+		}
+
+		RunTasks();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_busy == 0)
+			_done.notify_one();
+	}
+}
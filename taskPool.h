@@ -0,0 +1,62 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: taskPool.h
+//
+// Desc: A small fixed-size worker pool.  ParallelFor splits an index range across the
+//       workers and the calling thread and returns once every index has been processed.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __taskPoolH__
+#define __taskPoolH__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace d3d
+{
+	class TaskPool
+	{
+	public:
+		typedef void (*TaskFunc)(void* context, int index);
+
+		TaskPool(int threads); // total threads including the caller, 0 = hardware threads
+		~TaskPool();
+
+		int GetThreadCount() const { return (int)_workers.size() + 1; }
+
+		void ParallelFor(int count, TaskFunc func, void* context);
+
+		template<class F> void ParallelFor(int count, F& func)
+		{
+			ParallelFor(count, &Invoke<F>, &func);
+		}
+
+	private:
+		template<class F> static void Invoke(void* context, int index)
+		{
+			(*(F*)context)(index);
+		}
+
+		void WorkerMain();
+		void RunTasks();
+
+		std::vector<std::thread> _workers;
+		std::mutex               _mutex;
+		std::condition_variable  _wake;
+		std::condition_variable  _done;
+		unsigned                 _generation;
+		int                      _busy;
+		bool                     _quit;
+
+		TaskFunc         _func;
+		void*            _context;
+		int              _count;
+		std::atomic<int> _next;
+	};
+}
+
+#endif // __taskPoolH__
@@ -0,0 +1,137 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: transformCache.cpp
+//
+// Desc: Lazily rebuilt world, reflection and view matrices.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "transformCache.h"
+#include "simdMath.h"
+
+d3d::TransformCache::TransformCache()
+	: _eye(0.0f, 0.0f, 0.0f), _target(0.0f, 0.0f, 0.0f), _up(0.0f, 0.0f, 0.0f),
+	  _cameraVersion(0), _viewVersion(0), _updates(0)
+{
+}
+
+int d3d::TransformCache::AddObject(const D3DXVECTOR3& position)
+{
+	Object o;
+	o.position = position;
+	o.version = 1;
+	o.worldVersion = 0;
+	_objects.push_back(o);
+	Resize();
+	return (int)_objects.size() - 1;
+}
+
+int d3d::TransformCache::AddMirror(const D3DXPLANE& plane)
+{
+	Mirror m;
+	m.plane = plane;
+	m.version = 1;
+	m.reflectVersion = 0;
+	_mirrors.push_back(m);
+	Resize();
+	return (int)_mirrors.size() - 1;
+}
+
+void d3d::TransformCache::Resize()
+{
+	Reflected empty;
+	empty.objectVersion = empty.mirrorVersion = 0;
+	_reflected.assign(_objects.size() * _mirrors.size(), empty);
+}
+
+bool d3d::TransformCache::SetPosition(int object, const D3DXVECTOR3& position)
+{
+	Object& o = _objects[object];
+	if (o.position == position)
+		return false;
+	o.position = position;
+	++o.version;
+	return true;
+}
+
+bool d3d::TransformCache::SetPlane(int mirror, const D3DXPLANE& plane)
+{
+	Mirror& m = _mirrors[mirror];
+	if (m.plane == plane)
+		return false;
+	m.plane = plane;
+	++m.version;
+	return true;
+}
+
+bool d3d::TransformCache::SetCamera(const D3DXVECTOR3& eye, const D3DXVECTOR3& target, const D3DXVECTOR3& up)
+{
+	if (_cameraVersion != 0 && _eye == eye && _target == target && _up == up)
+		return false;
+	_eye = eye;
+	_target = target;
+	_up = up;
+	++_cameraVersion;
+	return true;
+}
+
+const D3DXMATRIX& d3d::TransformCache::GetWorld(int object)
+{
+	Object& o = _objects[object];
+	if (o.worldVersion != o.version)
+	{
+		MatrixTranslation(&o.world, o.position.x, o.position.y, o.position.z);
+		o.worldVersion = o.version;
+		++_updates;
+	}
+	return o.world;
+}
+
+const D3DXMATRIX& d3d::TransformCache::GetReflect(int mirror)
+{
+	Mirror& m = _mirrors[mirror];
+	if (m.reflectVersion != m.version)
+	{
+		MatrixReflect(&m.reflect, m.plane);
+		m.reflectVersion = m.version;
+		++_updates;
+	}
+	return m.reflect;
+}
+
+const D3DXMATRIX& d3d::TransformCache::GetReflectedWorld(int object, int mirror)
+{
+	Reflected& r = _reflected[object * _mirrors.size() + mirror];
+	if (r.objectVersion != _objects[object].version || r.mirrorVersion != _mirrors[mirror].version)
+	{
+		MatrixMultiply(&r.world, &GetWorld(object), &GetReflect(mirror));
+		r.objectVersion = _objects[object].version;
+		r.mirrorVersion = _mirrors[mirror].version;
+		++_updates;
+	}
+	return r.world;
+}
+
+const D3DXMATRIX& d3d::TransformCache::GetView()
+{
+	if (_viewVersion != _cameraVersion)
+	{
+		MatrixLookAtLH(&_view, _eye, _target, _up);
+		_viewVersion = _cameraVersion;
+		++_updates;
+	}
+	return _view;
+}
+
+void d3d::TransformCache::Update()
+{
+	for (size_t o = 0; o < _objects.size(); ++o)
+	{
+		GetWorld((int)o);
+		for (size_t m = 0; m < _mirrors.size(); ++m)
+			GetReflectedWorld((int)o, (int)m);
+	}
+	for (size_t m = 0; m < _mirrors.size(); ++m)
+		GetReflect((int)m);
+	GetView();
+}
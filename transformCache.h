@@ -0,0 +1,88 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: transformCache.h
+//
+// Desc: Matrices derived from a few scene inputs: object positions, mirror planes and the
+//       camera.  Every input carries a version that only changes when Set* stores a new
+//       value; a derived matrix remembers the versions it was built from and is rebuilt
+//       on the next Get* after one of them changed.
+//
+//       Update() rebuilds every stale matrix at once; until the next Set*, Get* then only
+//       reads and may be called from several threads.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __transformCacheH__
+#define __transformCacheH__
+
+#include "renderDevice.h"
+#include <vector>
+
+namespace d3d
+{
+	class TransformCache
+	{
+	public:
+		TransformCache();
+
+		int AddObject(const D3DXVECTOR3& position);
+		int AddMirror(const D3DXPLANE& plane);
+
+		// Return true when the value changed, i.e. the dependent matrices went stale.
+		bool SetPosition(int object, const D3DXVECTOR3& position);
+		bool SetPlane(int mirror, const D3DXPLANE& plane);
+		bool SetCamera(const D3DXVECTOR3& eye, const D3DXVECTOR3& target, const D3DXVECTOR3& up);
+
+		const D3DXMATRIX& GetWorld(int object);                        // T
+		const D3DXMATRIX& GetReflect(int mirror);                      // R
+		const D3DXMATRIX& GetReflectedWorld(int object, int mirror);   // T * R
+		const D3DXMATRIX& GetView();
+
+		// Brings every world, reflection, reflected world and view matrix up to date.
+		void Update();
+
+		int GetNumObjects() const { return (int)_objects.size(); }
+		int GetNumMirrors() const { return (int)_mirrors.size(); }
+
+		// Number of matrices rebuilt so far.
+		DWORD GetUpdates() const { return _updates; }
+
+	private:
+		struct Object
+		{
+			D3DXVECTOR3 position;
+			DWORD       version;
+			D3DXMATRIX  world;
+			DWORD       worldVersion;      // 'version' the world matrix was built from
+		};
+
+		struct Mirror
+		{
+			D3DXPLANE  plane;
+			DWORD      version;
+			D3DXMATRIX reflect;
+			DWORD      reflectVersion;
+		};
+
+		struct Reflected
+		{
+			DWORD      objectVersion, mirrorVersion;   // 0 = never built
+			D3DXMATRIX world;
+		};
+
+		void Resize();
+
+		std::vector<Object>    _objects;
+		std::vector<Mirror>    _mirrors;
+		std::vector<Reflected> _reflected;  // [object][mirror]
+
+		D3DXVECTOR3 _eye, _target, _up;
+		DWORD       _cameraVersion;
+		D3DXMATRIX  _view;
+		DWORD       _viewVersion;
+
+		DWORD       _updates;
+	};
+}
+
+#endif // __transformCacheH__